@@ -0,0 +1,351 @@
+/**
+ * consumer_bench.c
+ *
+ * Replays the NVML call sequences of the container-stack consumers of libnvidia-ml.so.1 against
+ * a build of the shim and measures what one invocation costs, spawn and dlopen included:
+ *
+ *   cli-info     nvidia-container-cli info: driver/CUDA versions, then every device's minor,
+ *                PCI info, UUID, name, brand, compute capability and MIG mode
+ *   prestart     nvidia-container-runtime-hook prestart (nvidia-container-cli configure): the
+ *                same enumeration, then each requested device (NVIDIA_VISIBLE_DEVICES=all)
+ *                resolved again by UUID
+ *   sandboxutils libnvidia-sandboxutils init: double nvmlInit, PCI info v3, UUID-V lookups and
+ *                MIG capability per device
+ *   cdi-generate nvidia-ctk cdi generate (go-nvml): per device minor, UUID, PCI info, MIG mode,
+ *                max MIG device count, architecture and compute capability
+ *   scrape       one exporter scrape of a long-running process: name, UUID, temperature, power,
+ *                utilization, memory, fan, clocks and P-state of every device
+ *
+ * Each sample spawns this program again (posix_spawn, as a container runtime execs its hook)
+ * with FAKE_NVML_GPU_COUNT set. The child dlopen()s the library, resolves each symbol on first
+ * use as the consumers do, runs the sequence and reports its phase timings through a pipe. For
+ * `scrape` the child initializes once and reports the mean of several scrapes, since exporters
+ * pay spawn and dlopen only at startup.
+ *
+ * Usage:
+ *   consumer_bench [-n SAMPLES] [-g GPU_COUNTS] [-s SCENARIO] LIBRARY
+ *     GPU_COUNTS  comma-separated list (default 4,64,512,4096)
+ *     SCENARIO    one of the names above (default: all)
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_nvml.h"
+
+// Prototypes only: the symbols are looked up with dlsym, these just give SYM() its types.
+#define NVML_IMPL(name, ...) nvmlReturn_t name NVML_PARAMS(__VA_ARGS__);
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+
+extern char **environ;
+
+#define SCRAPE_REPEAT 20
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// --- Child Side: Call Sequences ---
+static void *g_lib;
+
+static void *resolve(const char *name) {
+    void *fn = dlsym(g_lib, name);
+    if (fn == NULL) {
+        fprintf(stderr, "consumer_bench: missing symbol %s\n", name);
+        _exit(1);
+    }
+    return fn;
+}
+
+// Resolve on first use and cache, like go-nvml's lazy symbol table.
+#define SYM(name)                                                  \
+    ({                                                             \
+        static __typeof__(&name) fn_;                              \
+        if (fn_ == NULL) fn_ = (__typeof__(&name))resolve(#name);  \
+        fn_;                                                       \
+    })
+
+// Calls whose failure means the sequence is broken; optional queries ignore their result.
+#define MUST(call)                                                               \
+    do {                                                                         \
+        if ((call) != NVML_SUCCESS) {                                            \
+            fprintf(stderr, "consumer_bench: %s failed\n", #call);              \
+            _exit(1);                                                            \
+        }                                                                        \
+    } while (0)
+
+static void seq_versions(void) {
+    char driver[NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE];
+    int cuda;
+    MUST(SYM(nvmlSystemGetDriverVersion)(driver, sizeof(driver)));
+    MUST(SYM(nvmlSystemGetCudaDriverVersion)(&cuda));
+}
+
+static void seq_cli_device(unsigned int i, nvmlDevice_t *out) {
+    nvmlDevice_t dev;
+    unsigned int minor, mig_current, mig_pending;
+    nvmlPciInfo_t pci;
+    char uuid[NVML_DEVICE_UUID_BUFFER_SIZE], name[NVML_DEVICE_NAME_BUFFER_SIZE];
+    nvmlBrandType_t brand;
+    int major, minor_cc;
+    MUST(SYM(nvmlDeviceGetHandleByIndex_v2)(i, &dev));
+    MUST(SYM(nvmlDeviceGetMinorNumber)(dev, &minor));
+    MUST(SYM(nvmlDeviceGetPciInfo_v3)(dev, &pci));
+    MUST(SYM(nvmlDeviceGetUUID)(dev, uuid, sizeof(uuid)));
+    MUST(SYM(nvmlDeviceGetName)(dev, name, sizeof(name)));
+    MUST(SYM(nvmlDeviceGetBrand)(dev, &brand));
+    MUST(SYM(nvmlDeviceGetCudaComputeCapability)(dev, &major, &minor_cc));
+    SYM(nvmlDeviceGetMigMode)(dev, &mig_current, &mig_pending);
+    if (out != NULL) *out = dev;
+}
+
+static void seq_cli_info(void) {
+    unsigned int count;
+    MUST(SYM(nvmlInit_v2)());
+    seq_versions();
+    MUST(SYM(nvmlDeviceGetCount_v2)(&count));
+    for (unsigned int i = 0; i < count; ++i) seq_cli_device(i, NULL);
+    MUST(SYM(nvmlShutdown)());
+}
+
+static void seq_prestart(void) {
+    unsigned int count;
+    char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+    MUST(SYM(nvmlInit_v2)());
+    seq_versions();
+    MUST(SYM(nvmlDeviceGetCount_v2)(&count));
+    for (unsigned int i = 0; i < count; ++i) {
+        nvmlDevice_t dev, again;
+        seq_cli_device(i, &dev);
+        MUST(SYM(nvmlDeviceGetUUID)(dev, uuid, sizeof(uuid)));
+        MUST(SYM(nvmlDeviceGetHandleByUUID)(uuid, &again));
+    }
+    MUST(SYM(nvmlShutdown)());
+}
+
+static void seq_sandboxutils(void) {
+    unsigned int count;
+    char driver[NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE];
+    MUST(SYM(nvmlInit_v2)());
+    MUST(SYM(nvmlInit_v2)());
+    MUST(SYM(nvmlSystemGetDriverVersion)(driver, sizeof(driver)));
+    MUST(SYM(nvmlDeviceGetCount_v2)(&count));
+    for (unsigned int i = 0; i < count; ++i) {
+        nvmlDevice_t dev, again;
+        nvmlPciInfo_t pci;
+        nvmlUUID_t uuid = {.version = 1, .type = NVML_UUID_TYPE_ASCII};
+        unsigned int minor, mig_capable, mig_gpu;
+        MUST(SYM(nvmlDeviceGetHandleByIndex_v2)(i, &dev));
+        MUST(SYM(nvmlDeviceGetPciInfo_v3)(dev, &pci));
+        MUST(SYM(nvmlDeviceGetUUID)(dev, uuid.value.str, sizeof(uuid.value.str)));
+        MUST(SYM(nvmlDeviceGetHandleByUUIDV)(&uuid, &again));
+        MUST(SYM(nvmlDeviceGetMinorNumber)(dev, &minor));
+        SYM(nvmlDeviceGetMigCapability)(dev, &mig_capable, &mig_gpu);
+    }
+    // One shutdown per init, as NVML's reference-counted init expects.
+    MUST(SYM(nvmlShutdown)());
+    MUST(SYM(nvmlShutdown)());
+}
+
+static void seq_cdi_generate(void) {
+    unsigned int count;
+    char driver[NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE];
+    MUST(SYM(nvmlInit_v2)());
+    MUST(SYM(nvmlSystemGetDriverVersion)(driver, sizeof(driver)));
+    MUST(SYM(nvmlDeviceGetCount_v2)(&count));
+    for (unsigned int i = 0; i < count; ++i) {
+        nvmlDevice_t dev;
+        unsigned int minor, mig_current, mig_pending, mig_max;
+        char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+        nvmlPciInfo_t pci;
+        nvmlDeviceArchitecture_t arch;
+        int major, minor_cc;
+        MUST(SYM(nvmlDeviceGetHandleByIndex_v2)(i, &dev));
+        MUST(SYM(nvmlDeviceGetMinorNumber)(dev, &minor));
+        MUST(SYM(nvmlDeviceGetUUID)(dev, uuid, sizeof(uuid)));
+        MUST(SYM(nvmlDeviceGetPciInfo_v3)(dev, &pci));
+        SYM(nvmlDeviceGetMigMode)(dev, &mig_current, &mig_pending);
+        SYM(nvmlDeviceGetMaxMigDeviceCount)(dev, &mig_max);
+        SYM(nvmlDeviceGetArchitecture)(dev, &arch);
+        SYM(nvmlDeviceGetCudaComputeCapability)(dev, &major, &minor_cc);
+    }
+    MUST(SYM(nvmlShutdown)());
+}
+
+static void seq_scrape(void) {
+    unsigned int count;
+    MUST(SYM(nvmlDeviceGetCount_v2)(&count));
+    for (unsigned int i = 0; i < count; ++i) {
+        nvmlDevice_t dev;
+        char name[NVML_DEVICE_NAME_BUFFER_SIZE], uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+        unsigned int value;
+        nvmlUtilization_t util;
+        nvmlMemory_t memory;
+        MUST(SYM(nvmlDeviceGetHandleByIndex_v2)(i, &dev));
+        MUST(SYM(nvmlDeviceGetName)(dev, name, sizeof(name)));
+        MUST(SYM(nvmlDeviceGetUUID)(dev, uuid, sizeof(uuid)));
+        SYM(nvmlDeviceGetTemperature)(dev, 0, &value);
+        SYM(nvmlDeviceGetPowerUsage)(dev, &value);
+        SYM(nvmlDeviceGetUtilizationRates)(dev, &util);
+        SYM(nvmlDeviceGetMemoryInfo)(dev, &memory);
+        SYM(nvmlDeviceGetFanSpeed)(dev, &value);
+        SYM(nvmlDeviceGetClockInfo)(dev, 0, &value);
+        SYM(nvmlDeviceGetClockInfo)(dev, 2, &value);
+        SYM(nvmlDeviceGetPerformanceState)(dev, &value);
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} scenario_t;
+
+static const scenario_t g_scenarios[] = {
+    {"cli-info", seq_cli_info},
+    {"prestart", seq_prestart},
+    {"sandboxutils", seq_sandboxutils},
+    {"cdi-generate", seq_cdi_generate},
+    {"scrape", seq_scrape},
+};
+#define SCENARIO_COUNT (sizeof(g_scenarios) / sizeof(g_scenarios[0]))
+
+// Child entry: "--child SCENARIO LIBRARY"; writes {dlopen_ns, calls_ns} to stdout.
+static int child_main(const char *scenario, const char *library) {
+    const scenario_t *sc = NULL;
+    for (size_t i = 0; i < SCENARIO_COUNT; ++i) {
+        if (strcmp(g_scenarios[i].name, scenario) == 0) sc = &g_scenarios[i];
+    }
+    if (sc == NULL) return 2;
+    unsigned long long t[2], start = now_ns();
+    g_lib = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    if (g_lib == NULL) {
+        fprintf(stderr, "consumer_bench: %s\n", dlerror());
+        return 1;
+    }
+    t[0] = now_ns() - start;
+    if (sc->run == seq_scrape) {
+        MUST(SYM(nvmlInit_v2)());
+        seq_scrape(); // warm-up: first-use symbol resolution is startup cost, not scrape cost
+        start = now_ns();
+        for (int i = 0; i < SCRAPE_REPEAT; ++i) seq_scrape();
+        t[1] = (now_ns() - start) / SCRAPE_REPEAT;
+    } else {
+        start = now_ns();
+        sc->run();
+        t[1] = now_ns() - start;
+    }
+    return write(STDOUT_FILENO, t, sizeof(t)) == sizeof(t) ? 0 : 1;
+}
+
+// --- Parent Side ---
+static int cmp_ull(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+// One sample: spawn the child and time it until it has exited.
+static int run_sample(const char *self, const char *scenario, const char *library, unsigned int gpus,
+                      unsigned long long out[3]) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+    char count[16];
+    snprintf(count, sizeof(count), "%u", gpus);
+    setenv("FAKE_NVML_GPU_COUNT", count, 1);
+    char *argv[] = {(char *)self, "--child", (char *)scenario, (char *)library, NULL};
+
+    pid_t pid;
+    unsigned long long start = now_ns();
+    int rc = posix_spawn(&pid, self, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (rc != 0) {
+        close(fds[0]);
+        return -1;
+    }
+    unsigned long long t[2];
+    ssize_t n = read(fds[0], t, sizeof(t));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    out[0] = now_ns() - start;
+    if (n != sizeof(t) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    out[1] = t[0];
+    out[2] = t[1];
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "--child") == 0) return child_main(argv[2], argv[3]);
+
+    int samples = 50;
+    const char *counts = "4,64,512,4096";
+    const char *only = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:g:s:")) != -1) {
+        switch (opt) {
+        case 'n': samples = atoi(optarg); break;
+        case 'g': counts = optarg; break;
+        case 's': only = optarg; break;
+        default: samples = 0; break;
+        }
+    }
+    if (optind + 1 != argc || samples <= 0) {
+        fprintf(stderr, "usage: %s [-n SAMPLES] [-g GPU_COUNTS] [-s SCENARIO] LIBRARY\n", argv[0]);
+        return 2;
+    }
+    const char *library = argv[optind];
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len <= 0) return 1;
+    self[len] = '\0';
+
+    unsigned long long *total = calloc((size_t)samples, sizeof(*total));
+    unsigned long long *calls = calloc((size_t)samples, sizeof(*calls));
+    printf("%-13s %6s %8s %10s %10s %10s %10s %12s\n", "scenario", "gpus", "samples", "p50_us", "p99_us",
+           "dlopen_us", "calls_us", "calls_us/gpu");
+    for (size_t s = 0; s < SCENARIO_COUNT; ++s) {
+        const char *scenario = g_scenarios[s].name;
+        if (only != NULL && strcmp(only, scenario) != 0) continue;
+        char *list = strdup(counts), *save = NULL;
+        for (char *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+            unsigned int gpus = (unsigned int)strtoul(tok, NULL, 10);
+            unsigned long long dlopen_sum = 0;
+            for (int i = 0; i < samples; ++i) {
+                unsigned long long t[3];
+                if (run_sample(self, scenario, library, gpus, t) != 0) {
+                    fprintf(stderr, "consumer_bench: %s at %u GPUs failed\n", scenario, gpus);
+                    return 1;
+                }
+                total[i] = t[0];
+                dlopen_sum += t[1];
+                calls[i] = t[2];
+            }
+            qsort(total, (size_t)samples, sizeof(*total), cmp_ull);
+            qsort(calls, (size_t)samples, sizeof(*calls), cmp_ull);
+            double calls_p50 = calls[samples / 2] / 1e3;
+            printf("%-13s %6u %8d %10.1f %10.1f %10.1f %10.1f %12.3f\n", scenario, gpus, samples,
+                   total[samples / 2] / 1e3, total[(samples * 99) / 100] / 1e3,
+                   dlopen_sum / 1e3 / samples, calls_p50, gpus ? calls_p50 / gpus : 0.0);
+        }
+        free(list);
+    }
+    free(total);
+    free(calls);
+    return 0;
+}
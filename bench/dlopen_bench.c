@@ -0,0 +1,131 @@
+/**
+ * dlopen_bench.c
+ *
+ * Measures what a container start pays for loading the NVML library: dlopen() of a fresh copy
+ * of the library plus the first nvmlInit_v2 / nvmlDeviceGetCount_v2 / nvmlShutdown sequence,
+ * the way nvidia-container-cli and libnvidia-sandboxutils use it. Every sample runs in a newly
+ * forked child so nothing is already mapped or resolved; the page cache is warm after the first
+ * sample, as it is on a host that starts containers continuously.
+ *
+ * Usage:
+ *   dlopen_bench [-n SAMPLES] LIBRARY...
+ *
+ * Prints min / median / p90 / mean per library, in microseconds, plus the exported symbol and
+ * dynamic relocation counts that drive the load cost.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef int (*nvml_void_fn)(void);
+typedef int (*nvml_count_fn)(unsigned int *);
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Child side: load, resolve and call, then report the elapsed time through the pipe.
+static void run_sample(const char *path, int fd) {
+    double start = now_us();
+    void *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        fprintf(stderr, "dlopen_bench: %s\n", dlerror());
+        _exit(1);
+    }
+    nvml_void_fn init = (nvml_void_fn)dlsym(lib, "nvmlInit_v2");
+    nvml_count_fn count = (nvml_count_fn)dlsym(lib, "nvmlDeviceGetCount_v2");
+    nvml_void_fn shutdown = (nvml_void_fn)dlsym(lib, "nvmlShutdown");
+    unsigned int n = 0;
+    if (init == NULL || count == NULL || shutdown == NULL || init() != 0 || count(&n) != 0 || shutdown() != 0) {
+        fprintf(stderr, "dlopen_bench: %s: NVML call sequence failed\n", path);
+        _exit(1);
+    }
+    double elapsed = now_us() - start;
+    _exit(write(fd, &elapsed, sizeof(elapsed)) == sizeof(elapsed) ? 0 : 1);
+}
+
+// Exported (defined global/weak dynamic) symbols and dynamic relocations, read from the file.
+static void count_dynamic(const char *path, long *exports, long *relocs) {
+    *exports = *relocs = -1;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) return;
+    const unsigned char *img = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (img == MAP_FAILED) return;
+    const ElfW(Ehdr) *eh = (const ElfW(Ehdr) *)img;
+    const ElfW(Shdr) *sh = (const ElfW(Shdr) *)(img + eh->e_shoff);
+    *exports = *relocs = 0;
+    for (int i = 0; i < eh->e_shnum; ++i) {
+        if (sh[i].sh_type == SHT_RELA || sh[i].sh_type == SHT_REL) {
+            *relocs += (long)(sh[i].sh_size / sh[i].sh_entsize);
+        } else if (sh[i].sh_type == SHT_DYNSYM) {
+            const ElfW(Sym) *sym = (const ElfW(Sym) *)(img + sh[i].sh_offset);
+            for (size_t k = 0; k < sh[i].sh_size / sizeof(*sym); ++k) {
+                int bind = ELF64_ST_BIND(sym[k].st_info);
+                if (sym[k].st_shndx != SHN_UNDEF && (bind == STB_GLOBAL || bind == STB_WEAK)) (*exports)++;
+            }
+        }
+    }
+    munmap((void *)img, (size_t)st.st_size);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    int samples = 200;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') samples = atoi(optarg);
+    }
+    if (optind >= argc || samples <= 0) {
+        fprintf(stderr, "usage: %s [-n SAMPLES] LIBRARY...\n", argv[0]);
+        return 2;
+    }
+
+    double *t = calloc((size_t)samples, sizeof(double));
+    printf("%-40s %8s %9s %9s %9s %9s %8s %7s\n",
+           "library", "samples", "min_us", "p50_us", "p90_us", "mean_us", "exports", "relocs");
+    for (int l = optind; l < argc; ++l) {
+        const char *path = argv[l];
+        double sum = 0;
+        for (int i = 0; i < samples; ++i) {
+            int fds[2];
+            if (pipe(fds) != 0) return 1;
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                run_sample(path, fds[1]);
+            }
+            close(fds[1]);
+            int status = 0;
+            if (read(fds[0], &t[i], sizeof(t[i])) != sizeof(t[i])) t[i] = -1;
+            close(fds[0]);
+            waitpid(pid, &status, 0);
+            if (t[i] < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+            sum += t[i];
+        }
+        qsort(t, (size_t)samples, sizeof(double), cmp_double);
+        long exports, relocs;
+        count_dynamic(path, &exports, &relocs);
+        printf("%-40s %8d %9.1f %9.1f %9.1f %9.1f %8ld %7ld\n", path, samples, t[0],
+               t[samples / 2], t[samples * 9 / 10], sum / samples, exports, relocs);
+    }
+    free(t);
+    return 0;
+}
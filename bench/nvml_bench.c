@@ -0,0 +1,413 @@
+/**
+ * nvml_bench.c
+ *
+ * Per-symbol microbenchmark of the NVML shim's hot paths. Every function in
+ * fake_nvml_functions.def (plus nvmlErrorString) is called in a tight loop against the default
+ * fake world of a statically linked libfake_nvml.a, first on one thread and then on 2, 4, ... up
+ * to N threads at once. Results are written as JSON:
+ *
+ *   ns_per_call       single-thread latency
+ *   calls_per_sec     aggregate throughput at each thread count
+ *   efficiency        throughput(T) / (T * throughput(1)); 1.0 is perfect scaling
+ *   allocs_per_call   malloc/calloc/realloc calls made by the shim per NVML call (counted with
+ *                     -Wl,--wrap, so only allocations made by the shim itself are seen)
+ *
+ * Usage:
+ *   nvml_bench [-t MAX_THREADS] [-d MS_PER_RUN] [-n REPEAT] [-f SUBSTRING] [-o OUT.json]
+ *              [-c BASELINE.json] [-r THRESHOLD_PERCENT]
+ *
+ * Every measurement is repeated REPEAT times (default 5), in separate passes over all symbols,
+ * and the fastest run is reported.
+ * With -c, single-thread latencies are compared with the baseline file; symbols slower by more
+ * than THRESHOLD_PERCENT (default 50) and by at least 5 ns are listed, and the exit status is 1.
+ * Run with FAKE_NVML_LOG, FAKE_NVML_REDUNDANT and FAKE_NVML_STATS unset: each one adds work to
+ * every call by design.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_nvml.h"
+
+#define NVML_IMPL(name, ...) nvmlReturn_t name NVML_PARAMS(__VA_ARGS__);
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+const char *nvmlErrorString(nvmlReturn_t result);
+
+// --- Allocation Counting ---
+// Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc: every allocation made by code in
+// the link (the shim included) passes through here.
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+static __thread unsigned long long t_allocs;
+
+void *__wrap_malloc(size_t size) {
+    t_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    t_allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    t_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+// --- Call Thunks ---
+// Each thunk calls one NVML function with arguments chosen by type: the first fake GPU for a
+// device handle, a shared scratch buffer for any pointer, a generous length for unsigned int.
+// Functions whose generic arguments would only exercise an error path get a hand-written thunk.
+static nvmlDevice_t g_device;
+static char g_scratch[64 << 10] __attribute__((aligned(64)));
+static char g_uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+static char g_bus_id[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
+static nvmlUUID_t g_uuid_v;
+static nvmlEventSet_t g_event_set;
+
+#define BENCH_ARG(T)                              \
+    ((T)_Generic((T)0,                            \
+        nvmlDevice_t: g_device,                   \
+        unsigned int: 64u,                        \
+        int: 0,                                   \
+        unsigned long: 0ul,                       \
+        unsigned long long: 0ull,                 \
+        default: (uintptr_t)g_scratch))
+
+#define BENCH_ARGS(...) NVML_CAT(BENCH_ARGS_, NVML_NARG(__VA_ARGS__))(__VA_ARGS__)
+#define BENCH_ARGS_0() ()
+#define BENCH_ARGS_1(T0) (BENCH_ARG(T0))
+#define BENCH_ARGS_2(T0, T1) (BENCH_ARG(T0), BENCH_ARG(T1))
+#define BENCH_ARGS_3(T0, T1, T2) (BENCH_ARG(T0), BENCH_ARG(T1), BENCH_ARG(T2))
+#define BENCH_ARGS_4(T0, T1, T2, T3) (BENCH_ARG(T0), BENCH_ARG(T1), BENCH_ARG(T2), BENCH_ARG(T3))
+#define BENCH_ARGS_5(T0, T1, T2, T3, T4) \
+    (BENCH_ARG(T0), BENCH_ARG(T1), BENCH_ARG(T2), BENCH_ARG(T3), BENCH_ARG(T4))
+#define BENCH_ARGS_6(T0, T1, T2, T3, T4, T5) \
+    (BENCH_ARG(T0), BENCH_ARG(T1), BENCH_ARG(T2), BENCH_ARG(T3), BENCH_ARG(T4), BENCH_ARG(T5))
+#define BENCH_ARGS_7(T0, T1, T2, T3, T4, T5, T6) \
+    (BENCH_ARG(T0), BENCH_ARG(T1), BENCH_ARG(T2), BENCH_ARG(T3), BENCH_ARG(T4), BENCH_ARG(T5), BENCH_ARG(T6))
+#define BENCH_ARGS_8(T0, T1, T2, T3, T4, T5, T6, T7)                                                 \
+    (BENCH_ARG(T0), BENCH_ARG(T1), BENCH_ARG(T2), BENCH_ARG(T3), BENCH_ARG(T4), BENCH_ARG(T5), \
+     BENCH_ARG(T6), BENCH_ARG(T7))
+
+#define NVML_IMPL(name, ...) \
+    static nvmlReturn_t bench_generic_##name(void) { return name BENCH_ARGS(__VA_ARGS__); }
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+
+static nvmlReturn_t bench_init_shutdown(void) {
+    nvmlReturn_t ret = nvmlInit_v2();
+    return ret != NVML_SUCCESS ? ret : nvmlShutdown();
+}
+
+static nvmlReturn_t bench_handle_by_index(void) {
+    nvmlDevice_t device;
+    return nvmlDeviceGetHandleByIndex_v2(0, &device);
+}
+
+static nvmlReturn_t bench_handle_by_uuid(void) {
+    nvmlDevice_t device;
+    return nvmlDeviceGetHandleByUUID(g_uuid, &device);
+}
+
+static nvmlReturn_t bench_handle_by_uuidv(void) {
+    nvmlDevice_t device;
+    return nvmlDeviceGetHandleByUUIDV(&g_uuid_v, &device);
+}
+
+static nvmlReturn_t bench_handle_by_bus_id(void) {
+    nvmlDevice_t device;
+    return nvmlDeviceGetHandleByPciBusId_v2(g_bus_id, &device);
+}
+
+static nvmlReturn_t bench_event_set_create_free(void) {
+    nvmlEventSet_t set;
+    nvmlReturn_t ret = nvmlEventSetCreate(&set);
+    return ret != NVML_SUCCESS ? ret : nvmlEventSetFree(set);
+}
+
+static nvmlReturn_t bench_register_events(void) {
+    return nvmlDeviceRegisterEvents(g_device, nvmlEventTypeXidCriticalError, g_event_set);
+}
+
+// A zero timeout measures the cost of finding no pending event.
+static nvmlReturn_t bench_event_set_wait(void) {
+    nvmlEventData_t data;
+    return nvmlEventSetWait_v2(g_event_set, &data, 0);
+}
+
+static nvmlReturn_t bench_temperature(void) {
+    unsigned int temp;
+    return nvmlDeviceGetTemperature(g_device, NVML_TEMPERATURE_GPU, &temp);
+}
+
+static nvmlReturn_t bench_error_string(void) {
+    return nvmlErrorString(NVML_ERROR_NOT_SUPPORTED) != NULL ? NVML_SUCCESS : NVML_ERROR_UNKNOWN;
+}
+
+typedef struct {
+    const char *name;
+    nvmlReturn_t (*call)(void);
+} benchCase_t;
+
+// Hand-written thunks take precedence over the generic one of the same name; unversioned aliases
+// share the code of their versioned target. nvmlInit_v2 and nvmlShutdown are measured as a pair:
+// either alone would change the state the other calls run in. The same holds for
+// nvmlEventSetCreate and nvmlEventSetFree.
+static const benchCase_t g_special_cases[] = {
+    {"nvmlInit_v2", bench_init_shutdown},
+    {"nvmlInit", NULL},
+    {"nvmlInitWithFlags", NULL},
+    {"nvmlShutdown", NULL},
+    {"nvmlDeviceGetHandleByIndex_v2", bench_handle_by_index},
+    {"nvmlDeviceGetHandleByIndex", bench_handle_by_index},
+    {"nvmlDeviceGetHandleByUUID", bench_handle_by_uuid},
+    {"nvmlDeviceGetHandleByUUIDV", bench_handle_by_uuidv},
+    {"nvmlDeviceGetHandleByPciBusId_v2", bench_handle_by_bus_id},
+    {"nvmlDeviceGetHandleByPciBusId", bench_handle_by_bus_id},
+    {"nvmlDeviceGetTemperature", bench_temperature},
+    {"nvmlEventSetCreate", bench_event_set_create_free},
+    {"nvmlEventSetFree", NULL},
+    {"nvmlDeviceRegisterEvents", bench_register_events},
+    {"nvmlEventSetWait_v2", bench_event_set_wait},
+    {"nvmlEventSetWait", bench_event_set_wait},
+    {"nvmlErrorString", bench_error_string},
+};
+
+static const benchCase_t g_generic_cases[] = {
+#define NVML_IMPL(name, ...) {#name, bench_generic_##name},
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+    {"nvmlErrorString", bench_error_string},
+};
+
+#define BENCH_CASE_COUNT (sizeof(g_generic_cases) / sizeof(g_generic_cases[0]))
+
+// The thunk to run for a symbol, or NULL if the symbol is not measured on its own.
+static nvmlReturn_t (*bench_thunk(const benchCase_t *c))(void) {
+    for (size_t i = 0; i < sizeof(g_special_cases) / sizeof(g_special_cases[0]); ++i) {
+        if (strcmp(g_special_cases[i].name, c->name) == 0) return g_special_cases[i].call;
+    }
+    return c->call;
+}
+
+// --- Measurement ---
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+typedef struct {
+    nvmlReturn_t (*call)(void);
+    unsigned long long iterations;
+    pthread_barrier_t *start;
+    unsigned long long elapsed_ns;
+    unsigned long long allocs;
+} benchWorker_t;
+
+static void *bench_worker(void *arg) {
+    benchWorker_t *w = arg;
+    pthread_barrier_wait(w->start);
+    unsigned long long allocs = t_allocs;
+    unsigned long long start = now_ns();
+    for (unsigned long long i = 0; i < w->iterations; ++i) w->call();
+    w->elapsed_ns = now_ns() - start;
+    w->allocs = t_allocs - allocs;
+    return NULL;
+}
+
+// Run `iterations` calls on each of `threads` threads; returns the wall time of the slowest one.
+static unsigned long long bench_run(nvmlReturn_t (*call)(void), unsigned int threads,
+                                    unsigned long long iterations, unsigned long long *allocs) {
+    pthread_t tids[threads];
+    benchWorker_t workers[threads];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, threads);
+    for (unsigned int t = 0; t < threads; ++t) {
+        workers[t] = (benchWorker_t){.call = call, .iterations = iterations, .start = &start};
+        pthread_create(&tids[t], NULL, bench_worker, &workers[t]);
+    }
+    unsigned long long slowest = 0;
+    *allocs = 0;
+    for (unsigned int t = 0; t < threads; ++t) {
+        pthread_join(tids[t], NULL);
+        if (workers[t].elapsed_ns > slowest) slowest = workers[t].elapsed_ns;
+        *allocs += workers[t].allocs;
+    }
+    pthread_barrier_destroy(&start);
+    return slowest ? slowest : 1;
+}
+
+#define BENCH_MAX_LEVELS 32
+
+typedef struct {
+    const char *name;
+    nvmlReturn_t (*call)(void);
+    unsigned long long iterations;           // per thread, per run
+    unsigned long long ns[BENCH_MAX_LEVELS]; // fastest run at each thread count
+    unsigned long long allocs[BENCH_MAX_LEVELS];
+} benchResult_t;
+
+// --- Baseline Comparison ---
+// Reads the "symbol" / "ns_per_call" pairs of a file written by this tool. The format is ours,
+// so a scan for the two keys is enough; no general JSON parser is needed.
+static double baseline_lookup(const char *text, const char *symbol) {
+    char key[160];
+    snprintf(key, sizeof(key), "\"symbol\": \"%s\"", symbol);
+    const char *at = strstr(text, key);
+    if (at == NULL) return -1;
+    at = strstr(at, "\"ns_per_call\": ");
+    return at != NULL ? strtod(at + strlen("\"ns_per_call\": "), NULL) : -1;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    char *text = malloc((size_t)size + 1);
+    if (text != NULL) text[fread(text, 1, (size_t)size, f)] = '\0';
+    fclose(f);
+    return text;
+}
+
+int main(int argc, char **argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int max_threads = cpus > 0 ? (unsigned int)cpus : 1;
+    unsigned long long run_ms = 5;
+    unsigned int repeat = 5;
+    const char *filter = NULL, *out_path = NULL, *baseline_path = NULL;
+    double threshold = 50;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:d:n:f:o:c:r:")) != -1) {
+        switch (opt) {
+        case 't': max_threads = (unsigned int)atoi(optarg); break;
+        case 'd': run_ms = strtoull(optarg, NULL, 10); break;
+        case 'n': repeat = (unsigned int)atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 'c': baseline_path = optarg; break;
+        case 'r': threshold = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t MAX_THREADS] [-d MS_PER_RUN] [-n REPEAT] [-f SUBSTRING] [-o OUT.json] "
+                            "[-c BASELINE.json] [-r THRESHOLD_PERCENT]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (max_threads == 0 || run_ms == 0 || repeat == 0) return 2;
+    if (getenv("FAKE_NVML_LOG") || getenv("FAKE_NVML_REDUNDANT") || getenv("FAKE_NVML_STATS")) {
+        fprintf(stderr, "nvml_bench: warning: FAKE_NVML_LOG/REDUNDANT/STATS set, results include their cost\n");
+    }
+    char *baseline = NULL;
+    if (baseline_path != NULL && (baseline = read_file(baseline_path)) == NULL) {
+        fprintf(stderr, "nvml_bench: cannot read baseline %s\n", baseline_path);
+        return 2;
+    }
+    FILE *out = out_path != NULL ? fopen(out_path, "w") : stdout;
+    if (out == NULL) {
+        perror(out_path);
+        return 2;
+    }
+
+    if (nvmlInit_v2() != NVML_SUCCESS || nvmlDeviceGetHandleByIndex_v2(0, &g_device) != NVML_SUCCESS ||
+        nvmlDeviceGetUUID(g_device, g_uuid, sizeof(g_uuid)) != NVML_SUCCESS) {
+        fprintf(stderr, "nvml_bench: fake NVML failed to initialize\n");
+        return 1;
+    }
+    nvmlPciInfo_t pci;
+    nvmlDeviceGetPciInfo_v3(g_device, &pci);
+    snprintf(g_bus_id, sizeof(g_bus_id), "%s", pci.busId);
+    g_uuid_v.version = 1;
+    g_uuid_v.type = NVML_UUID_TYPE_ASCII;
+    snprintf(g_uuid_v.value.str, sizeof(g_uuid_v.value.str), "%.40s", g_uuid);
+    if (nvmlEventSetCreate(&g_event_set) != NVML_SUCCESS) {
+        fprintf(stderr, "nvml_bench: cannot create an event set\n");
+        return 1;
+    }
+
+    unsigned int levels[BENCH_MAX_LEVELS], level_count = 0;
+    for (unsigned int t = 1; t < max_threads && level_count < BENCH_MAX_LEVELS - 1; t *= 2) levels[level_count++] = t;
+    levels[level_count++] = max_threads;
+
+    // Select and calibrate: one single-thread run of each symbol should last about run_ms.
+    static benchResult_t results[BENCH_CASE_COUNT];
+    size_t result_count = 0;
+    for (size_t i = 0; i < BENCH_CASE_COUNT; ++i) {
+        const benchCase_t *c = &g_generic_cases[i];
+        nvmlReturn_t (*call)(void) = bench_thunk(c);
+        if (call == NULL || (filter != NULL && strstr(c->name, filter) == NULL)) continue;
+        unsigned long long allocs, probe = 1000;
+        unsigned long long iterations = probe * run_ms * 1000000ULL / bench_run(call, 1, probe, &allocs);
+        benchResult_t *res = &results[result_count++];
+        *res = (benchResult_t){.name = c->name, .call = call, .iterations = iterations < 1000 ? 1000 : iterations};
+        for (unsigned int l = 0; l < level_count; ++l) res->ns[l] = ~0ULL;
+    }
+
+    // Every configuration is measured `repeat` times and the fastest run is kept. The repeats are
+    // whole passes over the symbol list, so a slow phase of a shared machine lands on different
+    // symbols in each pass instead of inflating every run of a few of them.
+    for (unsigned int r = 0; r < repeat; ++r) {
+        for (size_t i = 0; i < result_count; ++i) {
+            benchResult_t *res = &results[i];
+            for (unsigned int l = 0; l < level_count; ++l) {
+                unsigned long long allocs;
+                unsigned long long ns = bench_run(res->call, levels[l], res->iterations, &allocs);
+                if (ns < res->ns[l]) {
+                    res->ns[l] = ns;
+                    res->allocs[l] = allocs;
+                }
+            }
+        }
+    }
+
+    fprintf(out, "{\n  \"max_threads\": %u,\n  \"run_ms\": %llu,\n  \"repeat\": %u,\n  \"results\": [",
+            max_threads, run_ms, repeat);
+    int regressions = 0;
+    for (size_t i = 0; i < result_count; ++i) {
+        const benchResult_t *res = &results[i];
+        double ns_per_call = (double)res->ns[0] / (double)res->iterations;
+        double single_cps = 1e9 / ns_per_call;
+        fprintf(out, "%s\n    {\"symbol\": \"%s\", \"ns_per_call\": %.2f, \"allocs_per_call\": %.4f, \"scaling\": [",
+                i ? "," : "", res->name, ns_per_call, (double)res->allocs[0] / (double)res->iterations);
+        for (unsigned int l = 0; l < level_count; ++l) {
+            double cps = (double)res->iterations * levels[l] * 1e9 / (double)res->ns[l];
+            fprintf(out, "%s{\"threads\": %u, \"calls_per_sec\": %.0f, \"efficiency\": %.3f}",
+                    l ? ", " : "", levels[l], cps, cps / (levels[l] * single_cps));
+        }
+        fprintf(out, "]}");
+
+        double base = baseline != NULL ? baseline_lookup(baseline, res->name) : -1;
+        if (base > 0 && ns_per_call > base * (1 + threshold / 100) && ns_per_call - base >= 5) {
+            fprintf(stderr, "nvml_bench: REGRESSION %s: %.2f ns/call vs baseline %.2f (+%.0f%%)\n",
+                    res->name, ns_per_call, base, (ns_per_call / base - 1) * 100);
+            regressions++;
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+    nvmlEventSetFree(g_event_set);
+    nvmlShutdown();
+    free(baseline);
+
+    if (baseline_path != NULL) {
+        fprintf(stderr, "nvml_bench: %d symbol(s) regressed by more than %.0f%% against %s\n",
+                regressions, threshold, baseline_path);
+    }
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,404 @@
+/**
+ * scaling_bench.c
+ *
+ * Multi-process scaling harness for the shim: P processes x T threads hammer one workload for a
+ * fixed time, the way a host running hundreds of monitoring agents does. Workloads:
+ *
+ *   churn      nvmlInit_v2, nvmlDeviceGetCount_v2, nvmlShutdown on every thread (init refcount)
+ *   enum       round-robin over the devices: handle by index, UUID, handle by UUID, PCI info,
+ *              handle by PCI bus ID
+ *   telemetry  round-robin over the devices: temperature, power, utilization, memory, clock
+ *
+ * Each process is forked from the harness before the library is loaded, dlopen()s it itself and
+ * starts its threads; all processes are released at once and run for the same wall-clock time.
+ * One operation is one pass of the workload's call sequence. Reported per configuration:
+ * aggregate operations per second, p50 / p99 / p99.9 operation latency (log-linear histogram,
+ * within 7%), operations that returned anything but NVML_SUCCESS or NVML_ERROR_NOT_SUPPORTED,
+ * mean RSS per process and its growth from before dlopen, and -- with -S, which runs the shim
+ * with FAKE_NVML_STATS=1 on a private segment -- the resident size of the shared segment.
+ *
+ * Usage:
+ *   scaling_bench [-p PROCS] [-t THREADS] [-g GPU_COUNTS] [-d MS] [-w WORKLOAD] [-S] LIBRARY
+ *     PROCS       comma-separated process counts (default 1,4,16,64)
+ *     GPU_COUNTS  comma-separated list (default 4,64,512,4096)
+ *     WORKLOAD    one of the names above (default: all)
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_nvml.h"
+
+// Prototypes only: the symbols are looked up with dlsym, these just give the table its types.
+#define NVML_IMPL(name, ...) nvmlReturn_t name NVML_PARAMS(__VA_ARGS__);
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+
+// Log-linear latency histogram: values below 16 ns get their own bucket, above that each power
+// of two is split into 16 buckets.
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS 1024
+
+static inline unsigned int hist_bucket(unsigned long long ns) {
+    if (ns < (1ULL << HIST_SUB_BITS)) return (unsigned int)ns;
+    unsigned int exp = 63 - (unsigned int)__builtin_clzll(ns);
+    unsigned int sub = (unsigned int)(ns >> (exp - HIST_SUB_BITS)) & ((1U << HIST_SUB_BITS) - 1);
+    return ((exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+static unsigned long long hist_value(unsigned int bucket) {
+    if (bucket < (1U << HIST_SUB_BITS)) return bucket;
+    unsigned int exp = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    unsigned long long sub = bucket & ((1U << HIST_SUB_BITS) - 1);
+    return ((1ULL << HIST_SUB_BITS) + sub) << (exp - HIST_SUB_BITS);
+}
+
+// Per-process result, written by the child into a shared anonymous mapping.
+typedef struct {
+    int done;
+    unsigned long long ops;
+    unsigned long long errors;
+    unsigned long long begin_ns, end_ns; // first thread start, last thread end (CLOCK_MONOTONIC)
+    long rss_kib;
+    long rss_base_kib; // before dlopen
+    unsigned long long hist[HIST_BUCKETS];
+} procResult_t;
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static long rss_kib(void) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) return -1;
+    char line[256];
+    long kib = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmRSS: %ld kB", &kib) == 1) break;
+    }
+    fclose(f);
+    return kib;
+}
+
+// --- Child Side: Workloads ---
+static struct {
+#define NVML_FN(name) __typeof__(&name) name
+    NVML_FN(nvmlInit_v2);
+    NVML_FN(nvmlShutdown);
+    NVML_FN(nvmlDeviceGetCount_v2);
+    NVML_FN(nvmlDeviceGetHandleByIndex_v2);
+    NVML_FN(nvmlDeviceGetUUID);
+    NVML_FN(nvmlDeviceGetHandleByUUID);
+    NVML_FN(nvmlDeviceGetPciInfo_v3);
+    NVML_FN(nvmlDeviceGetHandleByPciBusId_v2);
+    NVML_FN(nvmlDeviceGetTemperature);
+    NVML_FN(nvmlDeviceGetPowerUsage);
+    NVML_FN(nvmlDeviceGetUtilizationRates);
+    NVML_FN(nvmlDeviceGetMemoryInfo);
+    NVML_FN(nvmlDeviceGetClockInfo);
+#undef NVML_FN
+} g_nvml;
+
+static unsigned int g_gpu_count;
+
+#define OK(call) ((call) == NVML_SUCCESS)
+// Telemetry getters the shim does not model report NOT_SUPPORTED, which is not a failure.
+#define SUPPORTED(call) ({ nvmlReturn_t r_ = (call); r_ == NVML_SUCCESS || r_ == NVML_ERROR_NOT_SUPPORTED; })
+
+static int op_churn(unsigned int *cursor) {
+    (void)cursor;
+    unsigned int count;
+    int ok = OK(g_nvml.nvmlInit_v2());
+    ok &= OK(g_nvml.nvmlDeviceGetCount_v2(&count));
+    ok &= OK(g_nvml.nvmlShutdown());
+    return ok;
+}
+
+static int op_enum(unsigned int *cursor) {
+    unsigned int i = (*cursor)++ % g_gpu_count;
+    nvmlDevice_t dev, by_uuid, by_bus;
+    char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+    nvmlPciInfo_t pci;
+    int ok = OK(g_nvml.nvmlDeviceGetHandleByIndex_v2(i, &dev));
+    ok = ok && OK(g_nvml.nvmlDeviceGetUUID(dev, uuid, sizeof(uuid)));
+    ok = ok && OK(g_nvml.nvmlDeviceGetHandleByUUID(uuid, &by_uuid));
+    ok = ok && OK(g_nvml.nvmlDeviceGetPciInfo_v3(dev, &pci));
+    ok = ok && OK(g_nvml.nvmlDeviceGetHandleByPciBusId_v2(pci.busId, &by_bus));
+    return ok && by_uuid == dev && by_bus == dev;
+}
+
+static int op_telemetry(unsigned int *cursor) {
+    unsigned int i = (*cursor)++ % g_gpu_count;
+    nvmlDevice_t dev;
+    unsigned int value;
+    nvmlUtilization_t util;
+    nvmlMemory_t memory;
+    if (!OK(g_nvml.nvmlDeviceGetHandleByIndex_v2(i, &dev))) return 0;
+    int ok = SUPPORTED(g_nvml.nvmlDeviceGetTemperature(dev, 0, &value));
+    ok &= SUPPORTED(g_nvml.nvmlDeviceGetPowerUsage(dev, &value));
+    ok &= SUPPORTED(g_nvml.nvmlDeviceGetUtilizationRates(dev, &util));
+    ok &= SUPPORTED(g_nvml.nvmlDeviceGetMemoryInfo(dev, &memory));
+    ok &= SUPPORTED(g_nvml.nvmlDeviceGetClockInfo(dev, 0, &value));
+    return ok;
+}
+
+typedef struct {
+    const char *name;
+    int (*op)(unsigned int *cursor);
+} workload_t;
+
+static const workload_t g_workloads[] = {
+    {"churn", op_churn},
+    {"enum", op_enum},
+    {"telemetry", op_telemetry},
+};
+#define WORKLOAD_COUNT (sizeof(g_workloads) / sizeof(g_workloads[0]))
+
+typedef struct {
+    pthread_t tid;
+    const workload_t *workload;
+    unsigned long long duration_ns;
+    unsigned int cursor;
+    pthread_barrier_t *start;
+    unsigned long long ops, errors, begin_ns, end_ns;
+    unsigned long long hist[HIST_BUCKETS];
+} worker_t;
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    pthread_barrier_wait(w->start);
+    unsigned long long begin = now_ns(), t = begin, end = begin + w->duration_ns;
+    while (t < end) {
+        int ok = w->workload->op(&w->cursor);
+        unsigned long long after = now_ns();
+        w->hist[hist_bucket(after - t)]++;
+        w->ops++;
+        w->errors += !ok;
+        t = after;
+    }
+    w->begin_ns = begin;
+    w->end_ns = t;
+    return NULL;
+}
+
+// Load the library, start the threads, then block until the parent releases every process at
+// once by closing the write end of `go_fd`.
+static int child_main(const char *library, const workload_t *workload, unsigned int threads,
+                      unsigned long long duration_ns, int ready_fd, int go_fd, procResult_t *out) {
+    out->rss_base_kib = rss_kib();
+    void *lib = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        fprintf(stderr, "scaling_bench: %s\n", dlerror());
+        return 1;
+    }
+#define LOAD(name)                                                              \
+    if ((g_nvml.name = (__typeof__(g_nvml.name))dlsym(lib, #name)) == NULL) {   \
+        fprintf(stderr, "scaling_bench: missing symbol %s\n", #name);           \
+        return 1;                                                               \
+    }
+    LOAD(nvmlInit_v2) LOAD(nvmlShutdown) LOAD(nvmlDeviceGetCount_v2) LOAD(nvmlDeviceGetHandleByIndex_v2)
+    LOAD(nvmlDeviceGetUUID) LOAD(nvmlDeviceGetHandleByUUID) LOAD(nvmlDeviceGetPciInfo_v3)
+    LOAD(nvmlDeviceGetHandleByPciBusId_v2) LOAD(nvmlDeviceGetTemperature) LOAD(nvmlDeviceGetPowerUsage)
+    LOAD(nvmlDeviceGetUtilizationRates) LOAD(nvmlDeviceGetMemoryInfo) LOAD(nvmlDeviceGetClockInfo)
+#undef LOAD
+    // Enumeration and telemetry run inside one long-lived init, as agents do; churn threads
+    // bring the reference count up and down on their own.
+    if (workload->op != op_churn) {
+        if (!OK(g_nvml.nvmlInit_v2()) || !OK(g_nvml.nvmlDeviceGetCount_v2(&g_gpu_count)) || g_gpu_count == 0) {
+            fprintf(stderr, "scaling_bench: nvmlInit_v2 / nvmlDeviceGetCount_v2 failed\n");
+            return 1;
+        }
+    }
+
+    worker_t *workers = calloc(threads, sizeof(*workers));
+    pthread_barrier_t start;
+    if (workers == NULL) return 1;
+    pthread_barrier_init(&start, NULL, threads + 1);
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers[i].workload = workload;
+        workers[i].duration_ns = duration_ns;
+        workers[i].cursor = (unsigned int)getpid() * 7919U + i * 104729U;
+        workers[i].start = &start;
+        if (pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]) != 0) return 1;
+    }
+    char byte = 0;
+    if (write(ready_fd, &byte, 1) != 1) return 1;
+    while (read(go_fd, &byte, 1) > 0) {
+    }
+    pthread_barrier_wait(&start);
+
+    for (unsigned int i = 0; i < threads; ++i) {
+        pthread_join(workers[i].tid, NULL);
+        out->ops += workers[i].ops;
+        out->errors += workers[i].errors;
+        if (i == 0 || workers[i].begin_ns < out->begin_ns) out->begin_ns = workers[i].begin_ns;
+        if (workers[i].end_ns > out->end_ns) out->end_ns = workers[i].end_ns;
+        for (unsigned int b = 0; b < HIST_BUCKETS; ++b) out->hist[b] += workers[i].hist[b];
+    }
+    out->rss_kib = rss_kib();
+    out->done = 1;
+    free(workers);
+    return 0;
+}
+
+// --- Parent Side ---
+static unsigned long long hist_percentile(const unsigned long long *hist, unsigned long long total, double q) {
+    unsigned long long rank = (unsigned long long)(q * (double)total), seen = 0;
+    for (unsigned int b = 0; b < HIST_BUCKETS; ++b) {
+        seen += hist[b];
+        if (seen > rank) return hist_value(b);
+    }
+    return 0;
+}
+
+// One configuration: fork the processes, release them together and collect their results.
+static int run_config(const char *library, const workload_t *workload, unsigned int procs,
+                      unsigned int threads, unsigned long long duration_ns, procResult_t *results) {
+    memset(results, 0, procs * sizeof(*results));
+    int ready[2], go[2];
+    if (pipe(ready) != 0 || pipe(go) != 0) return -1;
+    pid_t *pids = calloc(procs, sizeof(*pids));
+    unsigned int started = 0;
+    for (; started < procs; ++started) {
+        pid_t pid = fork();
+        if (pid < 0) break;
+        if (pid == 0) {
+            close(ready[0]);
+            close(go[1]);
+            _exit(child_main(library, workload, threads, duration_ns, ready[1], go[0], &results[started]));
+        }
+        pids[started] = pid;
+    }
+    close(ready[1]);
+    close(go[0]);
+    // Wait until every process has loaded the library and parked its threads.
+    char byte;
+    unsigned int parked = 0;
+    while (parked < started && read(ready[0], &byte, 1) == 1) parked++;
+    close(go[1]);
+    close(ready[0]);
+
+    int failed = started < procs || parked < started;
+    for (unsigned int i = 0; i < started; ++i) {
+        int status;
+        waitpid(pids[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !results[i].done) failed = 1;
+    }
+    free(pids);
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    const char *proc_counts = "1,4,16,64";
+    const char *gpu_counts = "4,64,512,4096";
+    const char *only = NULL;
+    unsigned int threads = 4;
+    unsigned long long duration_ms = 500;
+    int stats = 0, usage = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:g:d:w:S")) != -1) {
+        switch (opt) {
+        case 'p': proc_counts = optarg; break;
+        case 't': threads = (unsigned int)atoi(optarg); break;
+        case 'g': gpu_counts = optarg; break;
+        case 'd': duration_ms = strtoull(optarg, NULL, 10); break;
+        case 'w': only = optarg; break;
+        case 'S': stats = 1; break;
+        default: usage = 1; break;
+        }
+    }
+    if (usage || optind + 1 != argc || threads == 0 || duration_ms == 0) {
+        fprintf(stderr, "usage: %s [-p PROCS] [-t THREADS] [-g GPU_COUNTS] [-d MS] [-w WORKLOAD] [-S] LIBRARY\n",
+                argv[0]);
+        return 2;
+    }
+    const char *library = argv[optind];
+
+    // A private statistics segment, so that concurrent users of the default one are unaffected.
+    char shm_name[64], shm_path[96];
+    snprintf(shm_name, sizeof(shm_name), "/fake-nvml-scaling-%d", getpid());
+    snprintf(shm_path, sizeof(shm_path), "/dev/shm%s", shm_name);
+    if (stats) {
+        setenv("FAKE_NVML_STATS", "1", 1);
+        setenv("FAKE_NVML_STATS_SHM", shm_name, 1);
+    } else {
+        unsetenv("FAKE_NVML_STATS");
+    }
+
+    unsigned int max_procs = 0;
+    char *list = strdup(proc_counts), *save = NULL;
+    for (char *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        unsigned int p = (unsigned int)strtoul(tok, NULL, 10);
+        if (p > max_procs) max_procs = p;
+    }
+    free(list);
+    size_t results_size = max_procs * sizeof(procResult_t);
+    procResult_t *results = mmap(NULL, results_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    unsigned long long *hist = calloc(HIST_BUCKETS, sizeof(*hist));
+    if (max_procs == 0 || results == MAP_FAILED || hist == NULL) return 1;
+
+    printf("%-10s %6s %6s %7s %12s %9s %9s %9s %8s %9s %10s %8s\n", "workload", "gpus", "procs", "threads",
+           "ops/s", "p50_ns", "p99_ns", "p999_ns", "errors", "rss_kib", "delta_kib", "shm_kib");
+    fflush(stdout);
+    for (size_t w = 0; w < WORKLOAD_COUNT; ++w) {
+        const workload_t *workload = &g_workloads[w];
+        if (only != NULL && strcmp(only, workload->name) != 0) continue;
+        char *glist = strdup(gpu_counts), *gsave = NULL;
+        for (char *gtok = strtok_r(glist, ",", &gsave); gtok != NULL; gtok = strtok_r(NULL, ",", &gsave)) {
+            unsigned int gpus = (unsigned int)strtoul(gtok, NULL, 10);
+            setenv("FAKE_NVML_GPU_COUNT", gtok, 1);
+            char *plist = strdup(proc_counts), *psave = NULL;
+            for (char *ptok = strtok_r(plist, ",", &psave); ptok != NULL; ptok = strtok_r(NULL, ",", &psave)) {
+                unsigned int procs = (unsigned int)strtoul(ptok, NULL, 10);
+                if (procs == 0) continue;
+                if (stats) shm_unlink(shm_name);
+                if (run_config(library, workload, procs, threads, duration_ms * 1000000ULL, results) != 0) {
+                    fprintf(stderr, "scaling_bench: %s with %u GPUs x %u processes failed\n",
+                            workload->name, gpus, procs);
+                    return 1;
+                }
+                // Throughput over the span from the first thread's start to the last one's end.
+                unsigned long long ops = 0, errors = 0, begin = results[0].begin_ns, end = 0;
+                long rss = 0, delta = 0;
+                memset(hist, 0, HIST_BUCKETS * sizeof(*hist));
+                for (unsigned int i = 0; i < procs; ++i) {
+                    ops += results[i].ops;
+                    errors += results[i].errors;
+                    if (results[i].begin_ns < begin) begin = results[i].begin_ns;
+                    if (results[i].end_ns > end) end = results[i].end_ns;
+                    rss += results[i].rss_kib;
+                    delta += results[i].rss_kib - results[i].rss_base_kib;
+                    for (unsigned int b = 0; b < HIST_BUCKETS; ++b) hist[b] += results[i].hist[b];
+                }
+                char shm_kib[24] = "-";
+                struct stat st;
+                if (stats && stat(shm_path, &st) == 0) {
+                    snprintf(shm_kib, sizeof(shm_kib), "%lld", (long long)st.st_blocks * 512 / 1024);
+                }
+                printf("%-10s %6u %6u %7u %12.0f %9llu %9llu %9llu %8llu %9ld %10ld %8s\n", workload->name,
+                       gpus, procs, threads, end > begin ? ops * 1e9 / (double)(end - begin) : 0.0, hist_percentile(hist, ops, 0.50),
+                       hist_percentile(hist, ops, 0.99), hist_percentile(hist, ops, 0.999), errors,
+                       rss / (long)procs, delta / (long)procs, shm_kib);
+                fflush(stdout);
+            }
+            free(plist);
+        }
+        free(glist);
+    }
+    if (stats) shm_unlink(shm_name);
+    munmap(results, results_size);
+    free(hist);
+    return 0;
+}
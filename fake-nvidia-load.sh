@@ -0,0 +1,70 @@
+#!/bin/bash
+# fake-nvidia-load: load fake_nvidia_driver with the parameters of /etc/fake-nvidia.conf.
+#
+#   fake-nvidia-load                     load the module, or reload it with --reload
+#   fake-nvidia-load --print             print the parameters the configuration gives
+#   fake-nvidia-load --modprobe [opts]   modprobe "install" hook (/etc/modprobe.d/fake-nvidia.conf),
+#                                        so that every load of the module, boot included, reads the
+#                                        file; opts from the modprobe command line come last and win
+#
+# FAKE_NVIDIA_CONFIG names another configuration file.
+set -euo pipefail
+
+CONFIG=${FAKE_NVIDIA_CONFIG:-/etc/fake-nvidia.conf}
+MODULE=fake_nvidia_driver
+PARAMS=()
+
+trim() {
+  local s=$1
+  s=${s#"${s%%[![:space:]]*}"}
+  s=${s%"${s##*[![:space:]]}"}
+  echo "$s"
+}
+
+read_config() {
+  [ -r "$CONFIG" ] || return 0
+  local line key value n=0
+  while IFS= read -r line || [ -n "$line" ]; do
+    n=$((n + 1))
+    line=${line%%#*}
+    [[ $line == *=* ]] || continue
+    key=$(trim "${line%%=*}")
+    value=$(trim "${line#*=}")
+    if [[ $value == \"*\" ]]; then
+      value=${value:1:${#value}-2}
+    fi
+    if [[ ! $key =~ ^[A-Za-z_][A-Za-z0-9_]*$ || $value == *\"* ]]; then
+      echo "fake-nvidia-load: $CONFIG:$n: invalid line" >&2
+      exit 1
+    fi
+    if [[ $value == *[[:space:]]* || -z $value ]]; then
+      PARAMS+=("$key=\"$value\"")
+    else
+      PARAMS+=("$key=$value")
+    fi
+  done < "$CONFIG"
+}
+
+read_config
+case "${1:-}" in
+  --print)
+    echo "${PARAMS[*]}"
+    ;;
+  --modprobe)
+    shift
+    exec modprobe --ignore-install "$MODULE" "${PARAMS[@]}" "$@"
+    ;;
+  --reload)
+    if [ -d "/sys/module/$MODULE" ]; then
+      modprobe -r "$MODULE"
+    fi
+    exec modprobe --ignore-install "$MODULE" "${PARAMS[@]}"
+    ;;
+  "")
+    exec modprobe --ignore-install "$MODULE" "${PARAMS[@]}"
+    ;;
+  *)
+    echo "usage: fake-nvidia-load [--print | --reload | --modprobe [options]]" >&2
+    exit 2
+    ;;
+esac
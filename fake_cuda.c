@@ -0,0 +1,1841 @@
+/**
+ * fake_cuda.c
+ *
+ * A fake CUDA driver library (libcuda.so.1) for the fake GPUs of this repository: enough of the
+ * driver API for frameworks to initialize, enumerate devices, create contexts and move data
+ * through device memory, so that allocation-heavy code paths and the NVML view of them can be
+ * exercised without a GPU.
+ *
+ * Compilation:
+ *   gcc -shared -fPIC -pthread -O2 -Wl,-soname,libcuda.so.1 -o libcuda.so fake_cuda.c -ldl
+ *
+ * Behaviour:
+ *   - Devices are the GPUs NVML reports: cuInit() loads NVML (FAKE_CUDA_NVML_LIB, default
+ *     libnvidia-ml.so.1, which is the shim when it is installed) and takes each GPU's name, UUID,
+ *     PCI address and memory size from it. CUDA_VISIBLE_DEVICES selects and orders them by index
+ *     or UUID prefix, stopping at the first entry that matches no GPU, as the real driver does.
+ *   - Device attributes come from a profile of the GPU model (fake_gpu_profiles.h; an unknown
+ *     model gets the T4 profile).
+ *   - Device memory is host memory: cuMemAlloc() maps anonymous MAP_NORESERVE memory, so sizes up
+ *     to the GPU's memory cost nothing until touched. Each allocation is charged to the GPU's
+ *     memory ledger through /dev/nvidiactl, which makes it show up in NVML's memory usage and
+ *     process list and fail with CUDA_ERROR_OUT_OF_MEMORY once the GPU is full, or with
+ *     CUDA_ERROR_NOT_PERMITTED on a GPU the device cgroup does not grant. Without
+ *     fake_nvidia_driver the library keeps the per-process account itself.
+ *   - Contexts are bookkeeping only; destroying one (or resetting a primary context) waits for its
+ *     streams and frees its allocations.
+ *   - Streams run on a work-stealing pool of FAKE_CUDA_STREAM_THREADS (default 4) host threads per
+ *     device, created with the first stream of the device. Operations of a stream run in order,
+ *     streams run concurrently, events are timestamped when they are reached. The NULL stream is
+ *     an ordinary stream of the context; synchronous copies wait for it first. cuStreamSynchronize
+ *     also waits for the cuFile operations queued on the stream when libcufile is loaded.
+ *   - Copies are timed against the GPUs' PCIe and NVLink bandwidths and counted for NVML's PCIe
+ *     throughput and NVLink counters (see Link Model); FAKE_CUDA_LINK_MODEL=0 turns the timing off.
+ *
+ * Kernel launches and modules are not implemented: programs that only need the driver for memory
+ * and enumeration run, the rest fail at cuModuleLoad* lookup.
+ */
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_cuda.h"
+#include "fake_cufile.h"
+#include "fake_gpu_profiles.h"
+#include "fake_nvml.h"
+#include "fake_nvml_stats.h"
+#include "fake_nvidia_uapi.h"
+
+#define FAKE_CUDA_NVML_LIB_DEFAULT "libnvidia-ml.so.1"
+#define FAKE_CUDA_CTX_STACK 16
+#define FAKE_CUDA_PAGE 4096UL
+#define FAKE_CUDA_DEFAULT_STREAM_THREADS 4
+#define FAKE_CUDA_MAX_STREAM_THREADS 64
+#define FAKE_CUDA_COPY_CHUNK_NS 250000UL  // link time booked per chunk of a copy
+#define FAKE_CUDA_COPY_CHUNK_MIN (256UL << 10)
+#define FAKE_CUDA_COPY_LATENCY_NS 5000UL  // shortest copy
+#define FAKE_CUDA_SPIN_NS 100000UL
+
+#define LOG(fmt, ...)                                                                              \
+    do {                                                                                           \
+        if (getenv("FAKE_CUDA_DEBUG")) fprintf(stderr, "[FAKE-CUDA %d] " fmt "\n", getpid(), ##__VA_ARGS__); \
+    } while (0)
+
+// --- NVML ---
+// Resolved at cuInit() from whichever libnvidia-ml the dynamic linker finds; NVML stays
+// initialized for the life of the process.
+static struct {
+    nvmlReturn_t (*init)(void);
+    nvmlReturn_t (*get_count)(unsigned int *);
+    nvmlReturn_t (*get_handle)(unsigned int, nvmlDevice_t *);
+    nvmlReturn_t (*get_name)(nvmlDevice_t, char *, unsigned int);
+    nvmlReturn_t (*get_uuid)(nvmlDevice_t, char *, unsigned int);
+    nvmlReturn_t (*get_pci)(nvmlDevice_t, nvmlPciInfo_t *);
+    nvmlReturn_t (*get_memory)(nvmlDevice_t, nvmlMemory_t *);
+    nvmlReturn_t (*get_minor)(nvmlDevice_t, unsigned int *);
+    nvmlReturn_t (*cuda_version)(int *);
+} g_nvml;
+
+static int nvml_load(void) {
+    const char *lib = getenv("FAKE_CUDA_NVML_LIB");
+    if (lib == NULL || lib[0] == '\0') lib = FAKE_CUDA_NVML_LIB_DEFAULT;
+    void *h = dlopen(lib, RTLD_NOW | RTLD_LOCAL);
+    if (h == NULL) {
+        LOG("cannot load %s: %s", lib, dlerror());
+        return -1;
+    }
+    g_nvml.init = (nvmlReturn_t(*)(void))dlsym(h, "nvmlInit_v2");
+    g_nvml.get_count = (nvmlReturn_t(*)(unsigned int *))dlsym(h, "nvmlDeviceGetCount_v2");
+    g_nvml.get_handle = (nvmlReturn_t(*)(unsigned int, nvmlDevice_t *))dlsym(h, "nvmlDeviceGetHandleByIndex_v2");
+    g_nvml.get_name = (nvmlReturn_t(*)(nvmlDevice_t, char *, unsigned int))dlsym(h, "nvmlDeviceGetName");
+    g_nvml.get_uuid = (nvmlReturn_t(*)(nvmlDevice_t, char *, unsigned int))dlsym(h, "nvmlDeviceGetUUID");
+    g_nvml.get_pci = (nvmlReturn_t(*)(nvmlDevice_t, nvmlPciInfo_t *))dlsym(h, "nvmlDeviceGetPciInfo_v3");
+    g_nvml.get_memory = (nvmlReturn_t(*)(nvmlDevice_t, nvmlMemory_t *))dlsym(h, "nvmlDeviceGetMemoryInfo");
+    g_nvml.get_minor = (nvmlReturn_t(*)(nvmlDevice_t, unsigned int *))dlsym(h, "nvmlDeviceGetMinorNumber");
+    g_nvml.cuda_version = (nvmlReturn_t(*)(int *))dlsym(h, "nvmlSystemGetCudaDriverVersion");
+    if (!g_nvml.init || !g_nvml.get_count || !g_nvml.get_handle || !g_nvml.get_name || !g_nvml.get_uuid ||
+        !g_nvml.get_pci || !g_nvml.get_memory || !g_nvml.get_minor) {
+        LOG("%s lacks the NVML entry points needed", lib);
+        return -1;
+    }
+    nvmlReturn_t r = g_nvml.init();
+    if (r != NVML_SUCCESS) {
+        LOG("nvmlInit_v2 failed: %d", (int)r);
+        return -1;
+    }
+    return 0;
+}
+
+// --- Devices ---
+typedef struct fakeCudaDevice fakeCudaDevice_t;
+typedef struct fakeCudaPool fakeCudaPool_t;
+
+// The directions of a GPU's links, as seen from the GPU.
+typedef enum {
+    FAKE_CUDA_LINK_PCIE_RX,
+    FAKE_CUDA_LINK_PCIE_TX,
+    FAKE_CUDA_LINK_NVLINK_RX,
+    FAKE_CUDA_LINK_NVLINK_TX,
+    FAKE_CUDA_LINK_COUNT
+} fakeCudaLinkDir_t;
+
+typedef struct {
+    double bytes_per_ns;
+    unsigned long long busy_until_ns; // end of the last chunk booked; guarded by g_link_lock
+} fakeCudaLink_t;
+
+struct CUctx_st {
+    fakeCudaDevice_t *dev;
+    unsigned int flags;
+    int primary;
+    int destroyed;
+    unsigned long pending; // stream operations queued or running
+    CUstream null_stream;  // created with the first use of the NULL stream
+};
+
+struct fakeCudaDevice {
+    nvmlDevice_t nvml;
+    char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+    char uuid_str[NVML_DEVICE_UUID_BUFFER_SIZE];
+    CUuuid uuid;
+    unsigned int domain, bus, device, pci_device_id;
+    unsigned int minor;
+    size_t total;
+    size_t used; // allocations of this process, charged locally when there is no ledger
+    const fakeGpuProfile_t *profile;
+    struct CUctx_st primary;
+    unsigned int primary_refs;
+    fakeCudaPool_t *pool; // created with the first stream
+    fakeCudaLink_t links[FAKE_CUDA_LINK_COUNT];
+};
+
+static pthread_once_t g_init_once = PTHREAD_ONCE_INIT;
+static CUresult g_init_result = CUDA_ERROR_NOT_INITIALIZED;
+static int g_initialized;
+static fakeCudaDevice_t *g_devices;
+static int g_device_count;
+static int g_ledger_fd = -1; // set once by cuInit, open for the life of the process
+static int g_link_model = 1;
+// Protects allocations, memory accounts and primary context reference counts.
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int hex_value(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// The 16 bytes of "GPU-xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx", or an FNV-1a hash of the string when
+// it does not hold 32 hex digits.
+static void uuid_parse(const char *s, CUuuid *out) {
+    const char *p = strncmp(s, "GPU-", 4) == 0 ? s + 4 : s;
+    unsigned char bytes[16];
+    int n = 0;
+    for (; *p && n < 32; p++) {
+        if (*p == '-') continue;
+        int v = hex_value((unsigned char)*p);
+        if (v < 0) break;
+        if (n % 2 == 0) bytes[n / 2] = (unsigned char)(v << 4);
+        else bytes[n / 2] |= (unsigned char)v;
+        n++;
+    }
+    if (n == 32 && *p == '\0') {
+        memcpy(out->bytes, bytes, 16);
+        return;
+    }
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int half = 0; half < 2; half++) {
+        for (const char *q = s; *q; q++) h = (h ^ (unsigned char)*q) * 0x100000001b3ULL;
+        memcpy(out->bytes + half * 8, &h, 8);
+    }
+}
+
+static int device_fill(fakeCudaDevice_t *d, unsigned int index) {
+    nvmlPciInfo_t pci;
+    nvmlMemory_t mem;
+    if (g_nvml.get_handle(index, &d->nvml) != NVML_SUCCESS) return -1;
+    if (g_nvml.get_name(d->nvml, d->name, sizeof(d->name)) != NVML_SUCCESS ||
+        g_nvml.get_uuid(d->nvml, d->uuid_str, sizeof(d->uuid_str)) != NVML_SUCCESS ||
+        g_nvml.get_pci(d->nvml, &pci) != NVML_SUCCESS || g_nvml.get_memory(d->nvml, &mem) != NVML_SUCCESS ||
+        g_nvml.get_minor(d->nvml, &d->minor) != NVML_SUCCESS)
+        return -1;
+    uuid_parse(d->uuid_str, &d->uuid);
+    d->domain = pci.domain;
+    d->bus = pci.bus;
+    d->device = pci.device;
+    d->pci_device_id = pci.pciDeviceId;
+    d->total = mem.total;
+    d->profile = fake_gpu_profile(d->name);
+    double pcie = fake_gpu_pcie_bandwidth(d->profile) / 1e9, nvlink = fake_gpu_nvlink_bandwidth(d->profile) / 1e9;
+    d->links[FAKE_CUDA_LINK_PCIE_RX].bytes_per_ns = pcie;
+    d->links[FAKE_CUDA_LINK_PCIE_TX].bytes_per_ns = pcie;
+    d->links[FAKE_CUDA_LINK_NVLINK_RX].bytes_per_ns = nvlink;
+    d->links[FAKE_CUDA_LINK_NVLINK_TX].bytes_per_ns = nvlink;
+    d->primary.dev = d;
+    d->primary.primary = 1;
+    return 0;
+}
+
+// NVML indices of the visible GPUs, in CUDA_VISIBLE_DEVICES order. Returns the number stored.
+static int visible_devices(unsigned int nvml_count, unsigned int *out) {
+    const char *env = getenv("CUDA_VISIBLE_DEVICES");
+    if (env == NULL) {
+        for (unsigned int i = 0; i < nvml_count; i++) out[i] = i;
+        return (int)nvml_count;
+    }
+    char *list = strdup(env), *save = NULL;
+    int n = 0;
+    if (list == NULL) return 0;
+    for (char *tok = strtok_r(list, ",", &save); tok && n < (int)nvml_count; tok = strtok_r(NULL, ",", &save)) {
+        while (isspace((unsigned char)*tok)) tok++;
+        long idx = -1;
+        if (strncmp(tok, "GPU-", 4) == 0) {
+            for (unsigned int i = 0; i < nvml_count; i++) {
+                nvmlDevice_t h;
+                char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+                if (g_nvml.get_handle(i, &h) == NVML_SUCCESS &&
+                    g_nvml.get_uuid(h, uuid, sizeof(uuid)) == NVML_SUCCESS && strncmp(uuid, tok, strlen(tok)) == 0) {
+                    idx = i;
+                    break;
+                }
+            }
+        } else {
+            char *end;
+            idx = strtol(tok, &end, 10);
+            if (end == tok || *end != '\0' || idx < 0 || idx >= (long)nvml_count) idx = -1;
+        }
+        if (idx < 0) break;
+        int dup = 0;
+        for (int j = 0; j < n; j++) dup |= out[j] == (unsigned int)idx;
+        if (dup) break;
+        out[n++] = (unsigned int)idx;
+    }
+    free(list);
+    return n;
+}
+
+// Whether the module keeps a memory ledger is decided here, once: a zero-byte charge succeeds,
+// or fails with EPERM for a GPU the device cgroup does not grant, on a module that has one. The
+// descriptor is never closed afterwards, as closing it would release every charge it holds.
+static void ledger_open(void) {
+    g_ledger_fd = open(FAKE_NVIDIA_CONTROL_DEVICE, O_RDWR | O_CLOEXEC);
+    if (g_ledger_fd < 0) return;
+    struct fake_nvidia_ledger l = {.minor = g_devices[0].minor, .bytes = 0};
+    if (ioctl(g_ledger_fd, FAKE_NVIDIA_IOC_LEDGER, &l) == 0 || errno == EPERM) return;
+    LOG("memory ledger unavailable (%s)", strerror(errno));
+    close(g_ledger_fd);
+    g_ledger_fd = -1;
+}
+
+static void init_once(void) {
+    unsigned int nvml_count = 0;
+    if (nvml_load() != 0 || g_nvml.get_count(&nvml_count) != NVML_SUCCESS || nvml_count == 0) {
+        g_init_result = CUDA_ERROR_NO_DEVICE;
+        return;
+    }
+    unsigned int *order = calloc(nvml_count, sizeof(*order));
+    g_devices = calloc(nvml_count, sizeof(*g_devices));
+    if (order == NULL || g_devices == NULL) {
+        free(order);
+        g_init_result = CUDA_ERROR_OUT_OF_MEMORY;
+        return;
+    }
+    int n = visible_devices(nvml_count, order);
+    for (int i = 0; i < n; i++) {
+        if (device_fill(&g_devices[g_device_count], order[i]) == 0) g_device_count++;
+    }
+    free(order);
+    if (g_device_count == 0) {
+        g_init_result = CUDA_ERROR_NO_DEVICE;
+        return;
+    }
+    ledger_open();
+    const char *model = getenv("FAKE_CUDA_LINK_MODEL");
+    g_link_model = !(model && strcmp(model, "0") == 0);
+    LOG("%d device(s), memory ledger %s", g_device_count, g_ledger_fd >= 0 ? "on" : "off (per-process account)");
+    g_init_result = CUDA_SUCCESS;
+    __atomic_store_n(&g_initialized, 1, __ATOMIC_RELEASE);
+}
+
+CUresult cuInit(unsigned int flags) {
+    if (flags != 0) return CUDA_ERROR_INVALID_VALUE;
+    pthread_once(&g_init_once, init_once);
+    return g_init_result;
+}
+
+static inline CUresult check_init(void) {
+    return __atomic_load_n(&g_initialized, __ATOMIC_ACQUIRE) ? CUDA_SUCCESS : CUDA_ERROR_NOT_INITIALIZED;
+}
+
+static CUresult get_device(CUdevice ordinal, fakeCudaDevice_t **out) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (ordinal < 0 || ordinal >= g_device_count) return CUDA_ERROR_INVALID_DEVICE;
+    *out = &g_devices[ordinal];
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDriverGetVersion(int *driverVersion) {
+    if (driverVersion == NULL) return CUDA_ERROR_INVALID_VALUE;
+    int v = 0;
+    if (__atomic_load_n(&g_initialized, __ATOMIC_ACQUIRE) && g_nvml.cuda_version &&
+        g_nvml.cuda_version(&v) == NVML_SUCCESS && v > 0)
+        *driverVersion = v;
+    else
+        *driverVersion = CUDA_VERSION;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGet(CUdevice *device, int ordinal) {
+    fakeCudaDevice_t *d;
+    if (device == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(ordinal, &d);
+    if (r == CUDA_SUCCESS) *device = ordinal;
+    return r;
+}
+
+CUresult cuDeviceGetCount(int *count) {
+    if (count == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    *count = g_device_count;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGetName(char *name, int len, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (name == NULL || len <= 0) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    snprintf(name, (size_t)len, "%s", d->name);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGetUuid_v2(CUuuid *uuid, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (uuid == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r == CUDA_SUCCESS) *uuid = d->uuid;
+    return r;
+}
+
+CUresult cuDeviceTotalMem_v2(size_t *bytes, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (bytes == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r == CUDA_SUCCESS) *bytes = d->total;
+    return r;
+}
+
+CUresult cuDeviceGetAttribute(int *pi, CUdevice_attribute attrib, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (pi == NULL || (int)attrib <= 0 || attrib >= CU_DEVICE_ATTRIBUTE_MAX) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    const fakeGpuProfile_t *p = d->profile;
+    switch (attrib) {
+    case CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK: *pi = 1024; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X:
+    case CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_Y: *pi = 1024; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_Z: *pi = 64; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_X: *pi = 2147483647; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_Y:
+    case CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_Z: *pi = 65535; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK: *pi = 49152; break;
+    case CU_DEVICE_ATTRIBUTE_TOTAL_CONSTANT_MEMORY: *pi = 65536; break;
+    case CU_DEVICE_ATTRIBUTE_WARP_SIZE: *pi = 32; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_PITCH: *pi = 2147483647; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_REGISTERS_PER_BLOCK:
+    case CU_DEVICE_ATTRIBUTE_MAX_REGISTERS_PER_MULTIPROCESSOR: *pi = 65536; break;
+    case CU_DEVICE_ATTRIBUTE_CLOCK_RATE: *pi = p->clock_khz; break;
+    case CU_DEVICE_ATTRIBUTE_TEXTURE_ALIGNMENT: *pi = 512; break;
+    case CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT: *pi = p->sm_count; break;
+    case CU_DEVICE_ATTRIBUTE_PCI_BUS_ID: *pi = (int)d->bus; break;
+    case CU_DEVICE_ATTRIBUTE_PCI_DEVICE_ID: *pi = (int)d->device; break;
+    case CU_DEVICE_ATTRIBUTE_PCI_DOMAIN_ID: *pi = (int)d->domain; break;
+    case CU_DEVICE_ATTRIBUTE_MEMORY_CLOCK_RATE: *pi = p->memory_clock_khz; break;
+    case CU_DEVICE_ATTRIBUTE_GLOBAL_MEMORY_BUS_WIDTH: *pi = p->bus_width; break;
+    case CU_DEVICE_ATTRIBUTE_L2_CACHE_SIZE: *pi = p->l2_bytes; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_MULTIPROCESSOR: *pi = p->threads_per_sm; break;
+    case CU_DEVICE_ATTRIBUTE_ASYNC_ENGINE_COUNT: *pi = 2; break;
+    case CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR: *pi = p->cc_major; break;
+    case CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR: *pi = p->cc_minor; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_MULTIPROCESSOR: *pi = p->smem_per_sm; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN: *pi = p->smem_per_block_optin; break;
+    case CU_DEVICE_ATTRIBUTE_MULTI_GPU_BOARD_GROUP_ID: *pi = dev; break;
+    case CU_DEVICE_ATTRIBUTE_GPU_OVERLAP:
+    case CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY:
+    case CU_DEVICE_ATTRIBUTE_CONCURRENT_KERNELS:
+    case CU_DEVICE_ATTRIBUTE_ECC_ENABLED:
+    case CU_DEVICE_ATTRIBUTE_UNIFIED_ADDRESSING:
+    case CU_DEVICE_ATTRIBUTE_MANAGED_MEMORY:
+    case CU_DEVICE_ATTRIBUTE_CONCURRENT_MANAGED_ACCESS:
+    case CU_DEVICE_ATTRIBUTE_COOPERATIVE_LAUNCH: *pi = 1; break;
+    default: *pi = 0; break; // not modelled: integrated, TCC, kernel timeout, compute mode default, ...
+    }
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceComputeCapability(int *major, int *minor, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (major == NULL || minor == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    *major = d->profile->cc_major;
+    *minor = d->profile->cc_minor;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGetPCIBusId(char *pciBusId, int len, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (pciBusId == NULL || len <= 0) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    snprintf(pciBusId, (size_t)len, "%04X:%02X:%02X.0", d->domain, d->bus, d->device);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGetByPCIBusId(CUdevice *dev, const char *pciBusId) {
+    unsigned int domain = 0, bus, device, function;
+    if (dev == NULL || pciBusId == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (sscanf(pciBusId, "%x:%x:%x.%x", &domain, &bus, &device, &function) != 4) {
+        domain = 0;
+        if (sscanf(pciBusId, "%x:%x.%x", &bus, &device, &function) != 3) return CUDA_ERROR_INVALID_VALUE;
+    }
+    for (int i = 0; i < g_device_count; i++) {
+        const fakeCudaDevice_t *d = &g_devices[i];
+        if (d->domain == domain && d->bus == bus && d->device == device && function == 0) {
+            *dev = i;
+            return CUDA_SUCCESS;
+        }
+    }
+    return CUDA_ERROR_INVALID_DEVICE;
+}
+
+// Every pair of distinct GPUs can copy to each other: over NVLink when both have it, else PCIe.
+CUresult cuDeviceCanAccessPeer(int *canAccessPeer, CUdevice dev, CUdevice peerDev) {
+    fakeCudaDevice_t *d, *peer;
+    if (canAccessPeer == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r == CUDA_SUCCESS) r = get_device(peerDev, &peer);
+    if (r != CUDA_SUCCESS) return r;
+    *canAccessPeer = d != peer;
+    return CUDA_SUCCESS;
+}
+
+// --- Memory Accounting ---
+// Charges go to the module's ledger, which fails with ENOMEM when the GPU is full and EPERM for a
+// GPU the device cgroup does not grant; without the module (or with one that predates the ledger)
+// the process keeps its own account. An allocation the ledger refuses for another reason is
+// charged locally instead; *ledger records which account took it, for memory_release().
+static CUresult memory_charge(fakeCudaDevice_t *d, size_t bytes, int *ledger) {
+    *ledger = 0;
+    if (g_ledger_fd >= 0) {
+        struct fake_nvidia_ledger l = {.minor = d->minor, .bytes = (__s64)bytes};
+        if (ioctl(g_ledger_fd, FAKE_NVIDIA_IOC_LEDGER, &l) == 0) {
+            *ledger = 1;
+            return CUDA_SUCCESS;
+        }
+        if (errno == ENOMEM) return CUDA_ERROR_OUT_OF_MEMORY;
+        if (errno == EPERM) return CUDA_ERROR_NOT_PERMITTED;
+        LOG("memory ledger charge failed (%s), charging locally", strerror(errno));
+    }
+    if (bytes > d->total - d->used) return CUDA_ERROR_OUT_OF_MEMORY;
+    d->used += bytes;
+    return CUDA_SUCCESS;
+}
+
+static void memory_release(fakeCudaDevice_t *d, size_t bytes, int ledger) {
+    if (ledger) {
+        struct fake_nvidia_ledger l = {.minor = d->minor, .bytes = -(__s64)bytes};
+        if (ioctl(g_ledger_fd, FAKE_NVIDIA_IOC_LEDGER, &l) != 0) LOG("ledger release failed: %s", strerror(errno));
+        return;
+    }
+    d->used = bytes > d->used ? 0 : d->used - bytes;
+}
+
+// --- Allocations ---
+// Sorted by address, so that a device pointer anywhere inside an allocation resolves with a binary
+// search. Guarded by g_lock.
+typedef struct {
+    uintptr_t base;
+    size_t size;    // as requested
+    size_t mapped;  // rounded up to pages: the mapping and the charge
+    int ledger;     // charged to the module's ledger, not the local account
+    CUcontext ctx;
+} fakeCudaAlloc_t;
+
+static fakeCudaAlloc_t *g_allocs;
+static size_t g_alloc_count, g_alloc_cap;
+
+// Index of the last allocation starting at or below addr, or -1.
+static long alloc_floor(uintptr_t addr) {
+    long lo = 0, hi = (long)g_alloc_count - 1, found = -1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (g_allocs[mid].base <= addr) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+static long alloc_find(uintptr_t addr) {
+    long i = alloc_floor(addr);
+    if (i < 0 || addr >= g_allocs[i].base + g_allocs[i].size) return -1;
+    return i;
+}
+
+static int alloc_insert(const fakeCudaAlloc_t *a) {
+    if (g_alloc_count == g_alloc_cap) {
+        size_t cap = g_alloc_cap ? g_alloc_cap * 2 : 64;
+        fakeCudaAlloc_t *n = realloc(g_allocs, cap * sizeof(*n));
+        if (n == NULL) return -1;
+        g_allocs = n;
+        g_alloc_cap = cap;
+    }
+    size_t at = (size_t)(alloc_floor(a->base) + 1);
+    memmove(&g_allocs[at + 1], &g_allocs[at], (g_alloc_count - at) * sizeof(*g_allocs));
+    g_allocs[at] = *a;
+    g_alloc_count++;
+    return 0;
+}
+
+static void alloc_release(size_t i) {
+    fakeCudaAlloc_t a = g_allocs[i];
+    memmove(&g_allocs[i], &g_allocs[i + 1], (g_alloc_count - i - 1) * sizeof(*g_allocs));
+    g_alloc_count--;
+    munmap((void *)a.base, a.mapped);
+    memory_release(a.ctx->dev, a.mapped, a.ledger);
+}
+
+static void alloc_release_ctx(CUcontext ctx) {
+    for (size_t i = g_alloc_count; i-- > 0;) {
+        if (g_allocs[i].ctx == ctx) alloc_release(i);
+    }
+}
+
+// The range [addr, addr + len) must lie inside one allocation; its device is stored in *dev when
+// dev is not NULL.
+static CUresult device_range(CUdeviceptr addr, size_t len, fakeCudaDevice_t **dev) {
+    pthread_mutex_lock(&g_lock);
+    long i = alloc_find((uintptr_t)addr);
+    int ok = i >= 0 && len <= g_allocs[i].base + g_allocs[i].size - (uintptr_t)addr;
+    if (ok && dev) *dev = g_allocs[i].ctx->dev;
+    pthread_mutex_unlock(&g_lock);
+    return ok ? CUDA_SUCCESS : CUDA_ERROR_INVALID_VALUE;
+}
+
+// The device owning addr, or NULL for host memory.
+static fakeCudaDevice_t *device_of(uintptr_t addr) {
+    pthread_mutex_lock(&g_lock);
+    long i = alloc_find(addr);
+    fakeCudaDevice_t *d = i >= 0 ? g_allocs[i].ctx->dev : NULL;
+    pthread_mutex_unlock(&g_lock);
+    return d;
+}
+
+// --- Link Model ---
+// Copies take the time the links they cross would need. Host-to-device and device-to-host copies
+// cross the GPU's PCIe link; copies between GPUs cross the NVLinks of both when both have them,
+// and otherwise both PCIe links; copies within a GPU or within the host are free. Bandwidths come
+// from the GPU profile (fake_gpu_profiles.h), per direction.
+//
+// A copy is cut into chunks of FAKE_CUDA_COPY_CHUNK_NS of link time. Each chunk books every link
+// on its path from the later of the copy's previous chunk and the links' last booking, is copied,
+// and then waits for the end of its booking, so concurrent copies over a link interleave and
+// share its bandwidth. Bookings are kept per process. Every chunk is counted in the GPUs' state
+// slots through /dev/nvidiactl, which is what NVML's PCIe throughput and NVLink counters report.
+// FAKE_CUDA_LINK_MODEL=0 turns the timing off; copies are still counted.
+static pthread_mutex_t g_link_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_link_traffic = 1; // cleared when the module does not count traffic
+
+static void link_count(fakeCudaDevice_t *d, int nvlink, size_t tx, size_t rx) {
+    if (g_ledger_fd < 0 || !__atomic_load_n(&g_link_traffic, __ATOMIC_RELAXED)) return;
+    struct fake_nvidia_link_traffic t = {
+        .minor = d->minor,
+        .link = nvlink ? FAKE_NVIDIA_LINK_NVLINK : FAKE_NVIDIA_LINK_PCIE,
+        .tx_bytes = tx,
+        .rx_bytes = rx,
+    };
+    if (ioctl(g_ledger_fd, FAKE_NVIDIA_IOC_LINK_TRAFFIC, &t) != 0 && errno == ENOTTY) {
+        LOG("module does not count link traffic");
+        __atomic_store_n(&g_link_traffic, 0, __ATOMIC_RELAXED);
+    }
+}
+
+// Sleeps to within FAKE_CUDA_SPIN_NS of the deadline (timer slack alone is 50 us) and spins the
+// rest, as the driver spins on short synchronous copies.
+static void sleep_until(unsigned long long ns) {
+    if (ns > FAKE_CUDA_SPIN_NS) {
+        unsigned long long wake = ns - FAKE_CUDA_SPIN_NS;
+        struct timespec ts = {.tv_sec = (time_t)(wake / 1000000000ULL), .tv_nsec = (long)(wake % 1000000000ULL)};
+        if (fake_nvml_stats_now() < wake) {
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+            }
+        }
+    }
+    while (fake_nvml_stats_now() < ns) sched_yield();
+}
+
+// Copies n bytes from src on src_dev to dst on dst_dev; a NULL device is the host.
+static void link_copy(fakeCudaDevice_t *dst_dev, void *dst, fakeCudaDevice_t *src_dev, const void *src, size_t n) {
+    if (dst_dev == src_dev || n == 0) {
+        memmove(dst, src, n);
+        return;
+    }
+    int nvlink = dst_dev && src_dev && dst_dev->profile->nvlinks && src_dev->profile->nvlinks;
+    // At least one side is a GPU: the devices differ.
+    fakeCudaLink_t *path[2] = {NULL, NULL};
+    int hops = 0;
+    if (src_dev) path[hops++] = &src_dev->links[nvlink ? FAKE_CUDA_LINK_NVLINK_TX : FAKE_CUDA_LINK_PCIE_TX];
+    if (dst_dev) path[hops++] = &dst_dev->links[nvlink ? FAKE_CUDA_LINK_NVLINK_RX : FAKE_CUDA_LINK_PCIE_RX];
+    double rate = 0;
+    for (int h = 0; h < hops; h++) {
+        if (h == 0 || path[h]->bytes_per_ns < rate) rate = path[h]->bytes_per_ns;
+    }
+    size_t chunk = (size_t)(rate * FAKE_CUDA_COPY_CHUNK_NS);
+    if (chunk < FAKE_CUDA_COPY_CHUNK_MIN) chunk = FAKE_CUDA_COPY_CHUNK_MIN;
+    if (chunk > FAKE_NVIDIA_LINK_TRAFFIC_MAX) chunk = FAKE_NVIDIA_LINK_TRAFFIC_MAX;
+
+    unsigned long long start = g_link_model ? fake_nvml_stats_now() : 0, end = start;
+    for (size_t off = 0; off < n;) {
+        size_t c = n - off < chunk ? n - off : chunk;
+        if (g_link_model) {
+            pthread_mutex_lock(&g_link_lock);
+            unsigned long long at = end;
+            for (int h = 0; h < hops; h++) {
+                if (path[h]->busy_until_ns > at) at = path[h]->busy_until_ns;
+            }
+            end = at + (unsigned long long)(c / rate);
+            for (int h = 0; h < hops; h++) path[h]->busy_until_ns = end;
+            pthread_mutex_unlock(&g_link_lock);
+        }
+        memmove((char *)dst + off, (const char *)src + off, c);
+        if (src_dev) link_count(src_dev, nvlink, c, 0);
+        if (dst_dev) link_count(dst_dev, nvlink, 0, c);
+        off += c;
+        if (g_link_model) sleep_until(end);
+    }
+    if (g_link_model && end < start + FAKE_CUDA_COPY_LATENCY_NS) sleep_until(start + FAKE_CUDA_COPY_LATENCY_NS);
+}
+
+// --- Contexts ---
+static void ctx_drain(CUcontext ctx);
+static void ctx_sync_default(CUcontext ctx);
+
+// Each thread has a stack of current contexts; the top is the current one.
+static __thread CUcontext t_ctx[FAKE_CUDA_CTX_STACK];
+static __thread int t_ctx_depth;
+
+static inline CUcontext ctx_top(void) {
+    return t_ctx_depth ? t_ctx[t_ctx_depth - 1] : NULL;
+}
+
+// A primary context is usable while it is retained.
+static inline int ctx_alive(CUcontext ctx) {
+    return ctx->primary ? __atomic_load_n(&ctx->dev->primary_refs, __ATOMIC_RELAXED) > 0 : !ctx->destroyed;
+}
+
+static CUresult ctx_current(CUcontext *out) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    CUcontext ctx = ctx_top();
+    if (ctx == NULL) return CUDA_ERROR_INVALID_CONTEXT;
+    if (!ctx_alive(ctx)) return CUDA_ERROR_CONTEXT_IS_DESTROYED;
+    *out = ctx;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDevicePrimaryCtxRetain(CUcontext *pctx, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (pctx == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    pthread_mutex_lock(&g_lock);
+    d->primary_refs++;
+    pthread_mutex_unlock(&g_lock);
+    *pctx = &d->primary;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDevicePrimaryCtxRelease_v2(CUdevice dev) {
+    fakeCudaDevice_t *d;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    if (__atomic_load_n(&d->primary_refs, __ATOMIC_RELAXED) <= 1) ctx_drain(&d->primary);
+    pthread_mutex_lock(&g_lock);
+    if (d->primary_refs == 0) {
+        r = CUDA_ERROR_INVALID_CONTEXT;
+    } else if (--d->primary_refs == 0) {
+        alloc_release_ctx(&d->primary);
+    }
+    pthread_mutex_unlock(&g_lock);
+    return r;
+}
+
+CUresult cuDevicePrimaryCtxReset_v2(CUdevice dev) {
+    fakeCudaDevice_t *d;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    ctx_drain(&d->primary);
+    pthread_mutex_lock(&g_lock);
+    alloc_release_ctx(&d->primary);
+    d->primary_refs = 0;
+    d->primary.flags = 0;
+    pthread_mutex_unlock(&g_lock);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDevicePrimaryCtxGetState(CUdevice dev, unsigned int *flags, int *active) {
+    fakeCudaDevice_t *d;
+    if (flags == NULL || active == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    pthread_mutex_lock(&g_lock);
+    *flags = d->primary.flags;
+    *active = d->primary_refs > 0;
+    pthread_mutex_unlock(&g_lock);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuDevicePrimaryCtxSetFlags_v2(CUdevice dev, unsigned int flags) {
+    fakeCudaDevice_t *d;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    pthread_mutex_lock(&g_lock);
+    d->primary.flags = flags;
+    pthread_mutex_unlock(&g_lock);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuCtxCreate_v2(CUcontext *pctx, unsigned int flags, CUdevice dev) {
+    fakeCudaDevice_t *d;
+    if (pctx == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = get_device(dev, &d);
+    if (r != CUDA_SUCCESS) return r;
+    if (t_ctx_depth == FAKE_CUDA_CTX_STACK) return CUDA_ERROR_OUT_OF_MEMORY;
+    CUcontext ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) return CUDA_ERROR_OUT_OF_MEMORY;
+    ctx->dev = d;
+    ctx->flags = flags;
+    t_ctx[t_ctx_depth++] = ctx;
+    *pctx = ctx;
+    return CUDA_SUCCESS;
+}
+
+// The context object itself is never freed, so that stale handles fail with
+// CUDA_ERROR_CONTEXT_IS_DESTROYED instead of reading freed memory.
+CUresult cuCtxDestroy_v2(CUcontext ctx) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (ctx == NULL || ctx->primary) return CUDA_ERROR_INVALID_CONTEXT;
+    if (!ctx->destroyed) ctx_drain(ctx);
+    pthread_mutex_lock(&g_lock);
+    if (ctx->destroyed) {
+        r = CUDA_ERROR_CONTEXT_IS_DESTROYED;
+    } else {
+        alloc_release_ctx(ctx);
+        ctx->destroyed = 1;
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (r == CUDA_SUCCESS && ctx_top() == ctx) t_ctx_depth--;
+    return r;
+}
+
+CUresult cuCtxGetCurrent(CUcontext *pctx) {
+    if (pctx == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = check_init();
+    if (r == CUDA_SUCCESS) *pctx = ctx_top();
+    return r;
+}
+
+CUresult cuCtxSetCurrent(CUcontext ctx) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (ctx == NULL) {
+        if (t_ctx_depth) t_ctx_depth--;
+        return CUDA_SUCCESS;
+    }
+    if (!ctx_alive(ctx)) return CUDA_ERROR_CONTEXT_IS_DESTROYED;
+    if (t_ctx_depth == 0) t_ctx_depth = 1;
+    t_ctx[t_ctx_depth - 1] = ctx;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuCtxPushCurrent_v2(CUcontext ctx) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (ctx == NULL) return CUDA_ERROR_INVALID_CONTEXT;
+    if (!ctx_alive(ctx)) return CUDA_ERROR_CONTEXT_IS_DESTROYED;
+    if (t_ctx_depth == FAKE_CUDA_CTX_STACK) return CUDA_ERROR_OUT_OF_MEMORY;
+    t_ctx[t_ctx_depth++] = ctx;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuCtxPopCurrent_v2(CUcontext *pctx) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (t_ctx_depth == 0) return CUDA_ERROR_INVALID_CONTEXT;
+    CUcontext ctx = t_ctx[--t_ctx_depth];
+    if (pctx) *pctx = ctx;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuCtxGetDevice(CUdevice *device) {
+    CUcontext ctx;
+    if (device == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = ctx_current(&ctx);
+    if (r == CUDA_SUCCESS) *device = (CUdevice)(ctx->dev - g_devices);
+    return r;
+}
+
+CUresult cuCtxSynchronize(void) {
+    CUcontext ctx;
+    CUresult r = ctx_current(&ctx);
+    if (r == CUDA_SUCCESS) ctx_drain(ctx);
+    return r;
+}
+
+// --- Memory ---
+CUresult cuMemGetInfo_v2(size_t *free, size_t *total) {
+    CUcontext ctx;
+    if (free == NULL || total == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = ctx_current(&ctx);
+    if (r != CUDA_SUCCESS) return r;
+    fakeCudaDevice_t *d = ctx->dev;
+    nvmlMemory_t mem;
+    // With the ledger, NVML reports every process's charges; allocations charged locally after a
+    // ledger failure come off the free memory it reports.
+    int ledger = g_ledger_fd >= 0 && g_nvml.get_memory(d->nvml, &mem) == NVML_SUCCESS;
+    pthread_mutex_lock(&g_lock);
+    if (ledger) {
+        *free = mem.free > d->used ? mem.free - d->used : 0;
+        *total = mem.total;
+    } else {
+        *free = d->total - d->used;
+        *total = d->total;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuMemAlloc_v2(CUdeviceptr *dptr, size_t bytesize) {
+    CUcontext ctx;
+    if (dptr == NULL || bytesize == 0) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = ctx_current(&ctx);
+    if (r != CUDA_SUCCESS) return r;
+    fakeCudaAlloc_t a = {.size = bytesize, .mapped = (bytesize + FAKE_CUDA_PAGE - 1) & ~(FAKE_CUDA_PAGE - 1), .ctx = ctx};
+    if (a.mapped < bytesize) return CUDA_ERROR_OUT_OF_MEMORY;
+    void *p = mmap(NULL, a.mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return CUDA_ERROR_OUT_OF_MEMORY;
+    a.base = (uintptr_t)p;
+    pthread_mutex_lock(&g_lock);
+    r = memory_charge(ctx->dev, a.mapped, &a.ledger);
+    if (r == CUDA_SUCCESS && alloc_insert(&a) != 0) {
+        memory_release(ctx->dev, a.mapped, a.ledger);
+        r = CUDA_ERROR_OUT_OF_MEMORY;
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (r != CUDA_SUCCESS) {
+        munmap(p, a.mapped);
+        return r;
+    }
+    *dptr = (CUdeviceptr)a.base;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuMemFree_v2(CUdeviceptr dptr) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (dptr == 0) return CUDA_SUCCESS;
+    // Like the real driver, freeing waits for the work queued in the allocation's context.
+    for (;;) {
+        pthread_mutex_lock(&g_lock);
+        long i = alloc_find((uintptr_t)dptr);
+        if (i < 0 || g_allocs[i].base != (uintptr_t)dptr) {
+            r = CUDA_ERROR_INVALID_VALUE;
+        } else if (__atomic_load_n(&g_allocs[i].ctx->pending, __ATOMIC_ACQUIRE) != 0) {
+            CUcontext ctx = g_allocs[i].ctx;
+            pthread_mutex_unlock(&g_lock);
+            ctx_drain(ctx);
+            continue;
+        } else {
+            alloc_release((size_t)i);
+        }
+        pthread_mutex_unlock(&g_lock);
+        return r;
+    }
+}
+
+CUresult cuMemGetAddressRange_v2(CUdeviceptr *pbase, size_t *psize, CUdeviceptr dptr) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    pthread_mutex_lock(&g_lock);
+    long i = alloc_find((uintptr_t)dptr);
+    if (i < 0) {
+        r = CUDA_ERROR_NOT_FOUND;
+    } else {
+        if (pbase) *pbase = (CUdeviceptr)g_allocs[i].base;
+        if (psize) *psize = g_allocs[i].size;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return r;
+}
+
+// Page-locked host memory is ordinary page-aligned host memory.
+CUresult cuMemHostAlloc(void **pp, size_t bytesize, unsigned int Flags) {
+    CUcontext ctx;
+    (void)Flags;
+    if (pp == NULL || bytesize == 0) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = ctx_current(&ctx);
+    if (r != CUDA_SUCCESS) return r;
+    if (posix_memalign(pp, FAKE_CUDA_PAGE, bytesize) != 0) return CUDA_ERROR_OUT_OF_MEMORY;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuMemAllocHost_v2(void **pp, size_t bytesize) {
+    return cuMemHostAlloc(pp, bytesize, 0);
+}
+
+CUresult cuMemFreeHost(void *p) {
+    CUresult r = check_init();
+    if (r == CUDA_SUCCESS) free(p);
+    return r;
+}
+
+// Copies between device allocations and host memory. Device arguments must lie inside an
+// allocation; with unified addressing, cuMemcpy() accepts any mix of the two. Like copies on the
+// legacy default stream, they start after the work queued on the NULL stream.
+CUresult cuMemcpy(CUdeviceptr dst, CUdeviceptr src, size_t ByteCount) {
+    CUcontext ctx;
+    CUresult r = ctx_current(&ctx);
+    if (r != CUDA_SUCCESS) return r;
+    ctx_sync_default(ctx);
+    if (ByteCount && (dst == 0 || src == 0)) return CUDA_ERROR_INVALID_VALUE;
+    if (ByteCount)
+        link_copy(device_of((uintptr_t)dst), (void *)(uintptr_t)dst, device_of((uintptr_t)src),
+                  (const void *)(uintptr_t)src, ByteCount);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuMemcpyHtoD_v2(CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount) {
+    CUcontext ctx;
+    fakeCudaDevice_t *d = NULL;
+    CUresult r = ctx_current(&ctx);
+    if (r == CUDA_SUCCESS) ctx_sync_default(ctx);
+    if (r == CUDA_SUCCESS && ByteCount) r = srcHost ? device_range(dstDevice, ByteCount, &d) : CUDA_ERROR_INVALID_VALUE;
+    if (r == CUDA_SUCCESS && ByteCount) link_copy(d, (void *)(uintptr_t)dstDevice, NULL, srcHost, ByteCount);
+    return r;
+}
+
+CUresult cuMemcpyDtoH_v2(void *dstHost, CUdeviceptr srcDevice, size_t ByteCount) {
+    CUcontext ctx;
+    fakeCudaDevice_t *d = NULL;
+    CUresult r = ctx_current(&ctx);
+    if (r == CUDA_SUCCESS) ctx_sync_default(ctx);
+    if (r == CUDA_SUCCESS && ByteCount) r = dstHost ? device_range(srcDevice, ByteCount, &d) : CUDA_ERROR_INVALID_VALUE;
+    if (r == CUDA_SUCCESS && ByteCount) link_copy(NULL, dstHost, d, (const void *)(uintptr_t)srcDevice, ByteCount);
+    return r;
+}
+
+CUresult cuMemcpyDtoD_v2(CUdeviceptr dstDevice, CUdeviceptr srcDevice, size_t ByteCount) {
+    CUcontext ctx;
+    fakeCudaDevice_t *dd = NULL, *sd = NULL;
+    CUresult r = ctx_current(&ctx);
+    if (r == CUDA_SUCCESS) ctx_sync_default(ctx);
+    if (r == CUDA_SUCCESS && ByteCount) r = device_range(dstDevice, ByteCount, &dd);
+    if (r == CUDA_SUCCESS && ByteCount) r = device_range(srcDevice, ByteCount, &sd);
+    if (r == CUDA_SUCCESS && ByteCount)
+        link_copy(dd, (void *)(uintptr_t)dstDevice, sd, (const void *)(uintptr_t)srcDevice, ByteCount);
+    return r;
+}
+
+CUresult cuMemsetD8_v2(CUdeviceptr dstDevice, unsigned char uc, size_t N) {
+    CUcontext ctx;
+    CUresult r = ctx_current(&ctx);
+    if (r == CUDA_SUCCESS) ctx_sync_default(ctx);
+    if (r == CUDA_SUCCESS && N) r = device_range(dstDevice, N, NULL);
+    if (r == CUDA_SUCCESS) memset((void *)(uintptr_t)dstDevice, uc, N);
+    return r;
+}
+
+CUresult cuMemsetD32_v2(CUdeviceptr dstDevice, unsigned int ui, size_t N) {
+    CUcontext ctx;
+    CUresult r = ctx_current(&ctx);
+    if (r != CUDA_SUCCESS) return r;
+    ctx_sync_default(ctx);
+    if ((dstDevice & 3) || N > SIZE_MAX / 4) return CUDA_ERROR_INVALID_VALUE;
+    if (N && (r = device_range(dstDevice, N * 4, NULL)) != CUDA_SUCCESS) return r;
+    uint32_t *p = (uint32_t *)(uintptr_t)dstDevice;
+    for (size_t i = 0; i < N; i++) p[i] = ui;
+    return CUDA_SUCCESS;
+}
+
+// --- Stream Pool ---
+// Each device runs its streams on a pool of worker threads. A stream with queued work is a task in
+// one worker's deque: the worker runs the stream's first operation and, while more are queued,
+// pushes the stream back onto its own deque. A stream's operations therefore run one at a time and
+// in order, and different streams run concurrently. Workers pop from the bottom of their own deque
+// and, when it is empty, steal from the top of the others'.
+typedef enum {
+    FAKE_CUDA_OP_COPY,
+    FAKE_CUDA_OP_SET8,
+    FAKE_CUDA_OP_SET32,
+    FAKE_CUDA_OP_HOST_FUNC,
+    FAKE_CUDA_OP_EVENT_RECORD,
+    FAKE_CUDA_OP_EVENT_WAIT,
+} fakeCudaOpKind_t;
+
+typedef struct fakeCudaOp {
+    struct fakeCudaOp *next;
+    fakeCudaOpKind_t kind;
+    union {
+        struct {
+            void *dst;
+            const void *src;
+            size_t n;
+            fakeCudaDevice_t *dst_dev, *src_dev; // NULL for host memory
+        } copy;
+        struct {
+            void *dst;
+            unsigned int value;
+            size_t n;
+        } set;
+        struct {
+            CUhostFn fn;
+            void *arg;
+        } host;
+        struct {
+            CUevent ev;
+            unsigned long long gen;   // record to complete, or to wait for
+            CUstream stream;          // waiting: the parked stream
+            struct fakeCudaOp *wait_next;
+        } event;
+    } u;
+} fakeCudaOp_t;
+
+struct CUstream_st {
+    CUcontext ctx;
+    unsigned int flags;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    fakeCudaOp_t *head, *tail; // head is running, or waiting for an event
+    unsigned long pending;     // queued and running operations
+    int active;                // in a deque, running or parked on an event
+};
+
+struct CUevent_st {
+    unsigned int flags;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    unsigned long long gen;      // records issued
+    unsigned long long done_gen; // latest record reached
+    unsigned long long timestamp_ns;
+    unsigned int refs;           // the handle and each queued operation naming the event
+    fakeCudaOp_t *waiters;       // FAKE_CUDA_OP_EVENT_WAIT heads of parked streams
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    CUstream *tasks;
+    unsigned int top, bottom, cap; // tasks[top % cap] .. tasks[(bottom - 1) % cap]
+} fakeCudaDeque_t;
+
+struct fakeCudaPool {
+    fakeCudaDeque_t *deques;
+    unsigned int workers;
+    unsigned int next;          // deque for the next submission from outside the pool
+    unsigned long queued;       // streams in the deques
+    unsigned int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t drained;     // some context's pending count reached 0
+};
+
+typedef struct {
+    fakeCudaPool_t *pool;
+    unsigned int index;
+} fakeCudaWorkerArg_t;
+
+static __thread fakeCudaPool_t *t_pool; // the pool of the calling worker thread
+static __thread unsigned int t_worker;
+
+static int deque_push(fakeCudaDeque_t *q, CUstream s) {
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom - q->top == q->cap) {
+        unsigned int cap = q->cap ? q->cap * 2 : 64;
+        CUstream *tasks = malloc(cap * sizeof(*tasks));
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+        for (unsigned int i = 0; i < q->cap; i++) tasks[i] = q->tasks[(q->top + i) % q->cap];
+        free(q->tasks);
+        q->tasks = tasks;
+        q->bottom -= q->top;
+        q->top = 0;
+        q->cap = cap;
+    }
+    q->tasks[q->bottom++ % q->cap] = s;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+// The owner takes the task it pushed last, thieves the oldest one.
+static CUstream deque_take(fakeCudaDeque_t *q, int steal) {
+    CUstream s = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom != q->top) s = steal ? q->tasks[q->top++ % q->cap] : q->tasks[--q->bottom % q->cap];
+    pthread_mutex_unlock(&q->lock);
+    return s;
+}
+
+static void pool_push(fakeCudaPool_t *p, CUstream s) {
+    unsigned int i = t_pool == p ? t_worker : __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED) % p->workers;
+    // A deque that cannot grow leaves the stream to the next one.
+    for (unsigned int n = 0; deque_push(&p->deques[i], s) != 0; n++, i = (i + 1) % p->workers) {
+        if (n >= p->workers) {
+            n = 0;
+            sched_yield();
+        }
+    }
+    __atomic_add_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&p->sleepers, __ATOMIC_SEQ_CST) != 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void ctx_op_done(CUcontext ctx) {
+    if (__atomic_sub_fetch(&ctx->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        fakeCudaPool_t *p = ctx->dev->pool;
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->drained);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void event_put(CUevent ev) {
+    pthread_mutex_lock(&ev->lock);
+    unsigned int refs = --ev->refs;
+    pthread_mutex_unlock(&ev->lock);
+    if (refs == 0) {
+        pthread_mutex_destroy(&ev->lock);
+        pthread_cond_destroy(&ev->done);
+        free(ev);
+    }
+}
+
+// Marks a record as reached and resumes the streams waiting for it.
+static void event_complete(fakeCudaPool_t *p, CUevent ev, unsigned long long gen) {
+    fakeCudaOp_t *wake = NULL;
+    pthread_mutex_lock(&ev->lock);
+    if (gen > ev->done_gen) {
+        ev->done_gen = gen;
+        ev->timestamp_ns = fake_nvml_stats_now();
+    }
+    for (fakeCudaOp_t **w = &ev->waiters; *w;) {
+        fakeCudaOp_t *op = *w;
+        if (op->u.event.gen <= ev->done_gen) {
+            *w = op->u.event.wait_next;
+            op->u.event.wait_next = wake;
+            wake = op;
+        } else {
+            w = &op->u.event.wait_next;
+        }
+    }
+    pthread_cond_broadcast(&ev->done);
+    pthread_mutex_unlock(&ev->lock);
+    while (wake) {
+        fakeCudaOp_t *next = wake->u.event.wait_next;
+        pool_push(p, wake->u.event.stream); // still active: it resumes at the wait
+        wake = next;
+    }
+}
+
+static void op_run(fakeCudaPool_t *p, fakeCudaOp_t *op) {
+    switch (op->kind) {
+    case FAKE_CUDA_OP_COPY:
+        link_copy(op->u.copy.dst_dev, op->u.copy.dst, op->u.copy.src_dev, op->u.copy.src, op->u.copy.n);
+        break;
+    case FAKE_CUDA_OP_SET8: memset(op->u.set.dst, (int)op->u.set.value, op->u.set.n); break;
+    case FAKE_CUDA_OP_SET32: {
+        uint32_t *d = op->u.set.dst;
+        for (size_t i = 0; i < op->u.set.n; i++) d[i] = op->u.set.value;
+        break;
+    }
+    case FAKE_CUDA_OP_HOST_FUNC: op->u.host.fn(op->u.host.arg); break;
+    case FAKE_CUDA_OP_EVENT_RECORD: event_complete(p, op->u.event.ev, op->u.event.gen); break;
+    case FAKE_CUDA_OP_EVENT_WAIT: break;
+    }
+}
+
+// Runs the first operation of a stream the worker took from a deque.
+static void stream_run(fakeCudaPool_t *p, CUstream s) {
+    pthread_mutex_lock(&s->lock);
+    fakeCudaOp_t *op = s->head;
+    if (op->kind == FAKE_CUDA_OP_EVENT_WAIT) {
+        // Park the stream on the event until the record it waits for is reached; the stream stays
+        // active, so new work only queues behind the wait.
+        CUevent ev = op->u.event.ev;
+        pthread_mutex_lock(&ev->lock);
+        int ready = ev->done_gen >= op->u.event.gen;
+        if (!ready) {
+            op->u.event.stream = s;
+            op->u.event.wait_next = ev->waiters;
+            ev->waiters = op;
+        }
+        pthread_mutex_unlock(&ev->lock);
+        if (!ready) {
+            pthread_mutex_unlock(&s->lock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    op_run(p, op);
+
+    pthread_mutex_lock(&s->lock);
+    s->head = op->next;
+    if (s->head == NULL) s->tail = NULL;
+    int more = s->head != NULL;
+    if (!more) s->active = 0;
+    if (--s->pending == 0) pthread_cond_broadcast(&s->idle);
+    CUcontext ctx = s->ctx;
+    pthread_mutex_unlock(&s->lock);
+    // Without more work the stream may be destroyed from here on.
+    if (op->kind == FAKE_CUDA_OP_EVENT_RECORD || op->kind == FAKE_CUDA_OP_EVENT_WAIT) event_put(op->u.event.ev);
+    free(op);
+    if (more) pool_push(p, s);
+    ctx_op_done(ctx);
+}
+
+static void *pool_worker(void *arg) {
+    fakeCudaWorkerArg_t *w = arg;
+    fakeCudaPool_t *p = w->pool;
+    unsigned int self = w->index;
+    free(w);
+    t_pool = p;
+    t_worker = self;
+    for (;;) {
+        CUstream s = deque_take(&p->deques[self], 0);
+        for (unsigned int i = 1; s == NULL && i < p->workers; i++) s = deque_take(&p->deques[(self + i) % p->workers], 1);
+        if (s) {
+            __atomic_sub_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+            stream_run(p, s);
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        __atomic_add_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0) pthread_cond_wait(&p->wake, &p->lock);
+        __atomic_sub_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return NULL;
+}
+
+static unsigned int stream_threads(void) {
+    const char *v = getenv("FAKE_CUDA_STREAM_THREADS");
+    if (v == NULL || v[0] == '\0') return FAKE_CUDA_DEFAULT_STREAM_THREADS;
+    char *end;
+    unsigned long n = strtoul(v, &end, 10);
+    if (*end != '\0' || n < 1 || n > FAKE_CUDA_MAX_STREAM_THREADS) {
+        fprintf(stderr, "[FAKE-CUDA %d] ignoring FAKE_CUDA_STREAM_THREADS=%s\n", getpid(), v);
+        return FAKE_CUDA_DEFAULT_STREAM_THREADS;
+    }
+    return (unsigned int)n;
+}
+
+// The device's pool, started on first use. Workers live as long as the process.
+static fakeCudaPool_t *device_pool(fakeCudaDevice_t *d) {
+    fakeCudaPool_t *p = __atomic_load_n(&d->pool, __ATOMIC_ACQUIRE);
+    if (p) return p;
+    pthread_mutex_lock(&g_lock);
+    p = d->pool;
+    if (p == NULL && (p = calloc(1, sizeof(*p))) != NULL) {
+        unsigned int n = stream_threads();
+        p->deques = calloc(n, sizeof(*p->deques));
+        pthread_mutex_init(&p->lock, NULL);
+        pthread_cond_init(&p->wake, NULL);
+        pthread_cond_init(&p->drained, NULL);
+        for (unsigned int i = 0; p->deques && i < n; i++) pthread_mutex_init(&p->deques[i].lock, NULL);
+        // Workers index the deques of all n, so the count is fixed before the first one starts.
+        p->workers = p->deques ? n : 0;
+        unsigned int started = 0;
+        for (unsigned int i = 0; i < p->workers; i++) {
+            pthread_t t;
+            fakeCudaWorkerArg_t *w = malloc(sizeof(*w));
+            if (w == NULL) break;
+            *w = (fakeCudaWorkerArg_t){.pool = p, .index = i};
+            if (pthread_create(&t, NULL, pool_worker, w) != 0) {
+                free(w);
+                break;
+            }
+            pthread_detach(t);
+            started++;
+        }
+        // Deques of missing workers are still drained by stealing; with no worker there is no pool.
+        if (started == 0) {
+            free(p->deques);
+            free(p);
+            p = NULL;
+        } else {
+            LOG("device %s: %u stream worker(s)", d->name, started);
+            __atomic_store_n(&d->pool, p, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return p;
+}
+
+static void ctx_drain(CUcontext ctx) {
+    fakeCudaPool_t *p = __atomic_load_n(&ctx->dev->pool, __ATOMIC_ACQUIRE);
+    if (p == NULL || __atomic_load_n(&ctx->pending, __ATOMIC_ACQUIRE) == 0) return;
+    pthread_mutex_lock(&p->lock);
+    while (__atomic_load_n(&ctx->pending, __ATOMIC_ACQUIRE) != 0) pthread_cond_wait(&p->drained, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// --- Streams ---
+static void stream_wait_idle(CUstream s) {
+    pthread_mutex_lock(&s->lock);
+    while (s->pending) pthread_cond_wait(&s->idle, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void ctx_sync_default(CUcontext ctx) {
+    CUstream s = __atomic_load_n(&ctx->null_stream, __ATOMIC_ACQUIRE);
+    if (s && __atomic_load_n(&s->pending, __ATOMIC_ACQUIRE)) stream_wait_idle(s);
+}
+
+static CUstream stream_new(CUcontext ctx, unsigned int flags) {
+    if (device_pool(ctx->dev) == NULL) return NULL;
+    CUstream s = calloc(1, sizeof(*s));
+    if (s == NULL) return NULL;
+    s->ctx = ctx;
+    s->flags = flags;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->idle, NULL);
+    return s;
+}
+
+static inline int stream_is_null(CUstream h) {
+    return h == NULL || h == CU_STREAM_LEGACY || h == CU_STREAM_PER_THREAD;
+}
+
+// The stream a handle names: the NULL stream handles name the current context's NULL stream.
+static CUresult stream_resolve(CUstream h, CUstream *out) {
+    CUcontext ctx;
+    CUresult r;
+    if (!stream_is_null(h)) {
+        if ((r = check_init()) != CUDA_SUCCESS) return r;
+        if (!ctx_alive(h->ctx)) return CUDA_ERROR_CONTEXT_IS_DESTROYED;
+        *out = h;
+        return CUDA_SUCCESS;
+    }
+    if ((r = ctx_current(&ctx)) != CUDA_SUCCESS) return r;
+    CUstream s = __atomic_load_n(&ctx->null_stream, __ATOMIC_ACQUIRE);
+    if (s == NULL) {
+        CUstream n = stream_new(ctx, 0);
+        if (n == NULL) return CUDA_ERROR_OUT_OF_MEMORY;
+        pthread_mutex_lock(&g_lock);
+        s = ctx->null_stream;
+        if (s == NULL) __atomic_store_n(&ctx->null_stream, s = n, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&g_lock);
+        if (s != n) {
+            pthread_mutex_destroy(&n->lock);
+            pthread_cond_destroy(&n->idle);
+            free(n);
+        }
+    }
+    *out = s;
+    return CUDA_SUCCESS;
+}
+
+static void stream_enqueue(CUstream s, fakeCudaOp_t *op) {
+    op->next = NULL;
+    __atomic_add_fetch(&s->ctx->pending, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&s->lock);
+    if (s->tail) s->tail->next = op;
+    else s->head = op;
+    s->tail = op;
+    s->pending++;
+    int schedule = !s->active;
+    s->active = 1;
+    pthread_mutex_unlock(&s->lock);
+    if (schedule) pool_push(s->ctx->dev->pool, s);
+}
+
+// Resolves the stream and allocates an operation of the given kind for it.
+static CUresult op_new(CUstream h, fakeCudaOpKind_t kind, CUstream *s, fakeCudaOp_t **op) {
+    CUresult r = stream_resolve(h, s);
+    if (r != CUDA_SUCCESS) return r;
+    if ((*op = calloc(1, sizeof(**op))) == NULL) return CUDA_ERROR_OUT_OF_MEMORY;
+    (*op)->kind = kind;
+    return CUDA_SUCCESS;
+}
+
+CUresult cuStreamCreate(CUstream *phStream, unsigned int Flags) {
+    CUcontext ctx;
+    if (phStream == NULL || (Flags & ~CU_STREAM_NON_BLOCKING)) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = ctx_current(&ctx);
+    if (r != CUDA_SUCCESS) return r;
+    if ((*phStream = stream_new(ctx, Flags)) == NULL) return CUDA_ERROR_OUT_OF_MEMORY;
+    return CUDA_SUCCESS;
+}
+
+// Waits for the stream's work before freeing it, where the real driver returns at once and frees
+// the stream once its work is done; the difference is only visible in timing.
+CUresult cuStreamDestroy_v2(CUstream hStream) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (stream_is_null(hStream)) return CUDA_ERROR_INVALID_HANDLE;
+    stream_wait_idle(hStream);
+    pthread_mutex_destroy(&hStream->lock);
+    pthread_cond_destroy(&hStream->idle);
+    free(hStream);
+    return CUDA_SUCCESS;
+}
+
+// libcufile queues its stream-ordered operations itself; when it is loaded, synchronizing a
+// stream waits for those too.
+static CUfileError_t (*g_cufile_sync)(CUstream);
+static pthread_once_t g_cufile_once = PTHREAD_ONCE_INIT;
+
+static void cufile_sync_resolve(void) {
+    g_cufile_sync = (CUfileError_t(*)(CUstream))dlsym(RTLD_DEFAULT, "fake_cufile_stream_synchronize");
+}
+
+CUresult cuStreamSynchronize(CUstream hStream) {
+    CUstream s;
+    CUresult r = stream_resolve(hStream, &s);
+    if (r != CUDA_SUCCESS) return r;
+    stream_wait_idle(s);
+    pthread_once(&g_cufile_once, cufile_sync_resolve);
+    if (g_cufile_sync) g_cufile_sync(hStream);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuStreamQuery(CUstream hStream) {
+    CUstream s;
+    CUresult r = stream_resolve(hStream, &s);
+    if (r != CUDA_SUCCESS) return r;
+    return __atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) ? CUDA_ERROR_NOT_READY : CUDA_SUCCESS;
+}
+
+CUresult cuLaunchHostFunc(CUstream hStream, CUhostFn fn, void *userData) {
+    CUstream s;
+    fakeCudaOp_t *op;
+    if (fn == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = op_new(hStream, FAKE_CUDA_OP_HOST_FUNC, &s, &op);
+    if (r != CUDA_SUCCESS) return r;
+    op->u.host.fn = fn;
+    op->u.host.arg = userData;
+    stream_enqueue(s, op);
+    return CUDA_SUCCESS;
+}
+
+static CUresult copy_async(fakeCudaDevice_t *dst_dev, CUdeviceptr dst, fakeCudaDevice_t *src_dev, CUdeviceptr src,
+                           size_t n, CUstream hStream) {
+    CUstream s;
+    fakeCudaOp_t *op;
+    if (n == 0) return CUDA_SUCCESS;
+    CUresult r = op_new(hStream, FAKE_CUDA_OP_COPY, &s, &op);
+    if (r != CUDA_SUCCESS) return r;
+    op->u.copy.dst = (void *)(uintptr_t)dst;
+    op->u.copy.src = (const void *)(uintptr_t)src;
+    op->u.copy.n = n;
+    op->u.copy.dst_dev = dst_dev;
+    op->u.copy.src_dev = src_dev;
+    stream_enqueue(s, op);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuMemcpyAsync(CUdeviceptr dst, CUdeviceptr src, size_t ByteCount, CUstream hStream) {
+    if (ByteCount == 0) return CUDA_SUCCESS;
+    if (dst == 0 || src == 0) return CUDA_ERROR_INVALID_VALUE;
+    return copy_async(device_of((uintptr_t)dst), dst, device_of((uintptr_t)src), src, ByteCount, hStream);
+}
+
+CUresult cuMemcpyHtoDAsync_v2(CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount, CUstream hStream) {
+    fakeCudaDevice_t *d = NULL;
+    if (ByteCount == 0) return CUDA_SUCCESS;
+    CUresult r = srcHost ? device_range(dstDevice, ByteCount, &d) : CUDA_ERROR_INVALID_VALUE;
+    return r == CUDA_SUCCESS ? copy_async(d, dstDevice, NULL, (CUdeviceptr)(uintptr_t)srcHost, ByteCount, hStream) : r;
+}
+
+CUresult cuMemcpyDtoHAsync_v2(void *dstHost, CUdeviceptr srcDevice, size_t ByteCount, CUstream hStream) {
+    fakeCudaDevice_t *d = NULL;
+    if (ByteCount == 0) return CUDA_SUCCESS;
+    CUresult r = dstHost ? device_range(srcDevice, ByteCount, &d) : CUDA_ERROR_INVALID_VALUE;
+    return r == CUDA_SUCCESS ? copy_async(NULL, (CUdeviceptr)(uintptr_t)dstHost, d, srcDevice, ByteCount, hStream) : r;
+}
+
+CUresult cuMemcpyDtoDAsync_v2(CUdeviceptr dstDevice, CUdeviceptr srcDevice, size_t ByteCount, CUstream hStream) {
+    fakeCudaDevice_t *dd = NULL, *sd = NULL;
+    if (ByteCount == 0) return CUDA_SUCCESS;
+    CUresult r = device_range(dstDevice, ByteCount, &dd);
+    if (r == CUDA_SUCCESS) r = device_range(srcDevice, ByteCount, &sd);
+    return r == CUDA_SUCCESS ? copy_async(dd, dstDevice, sd, srcDevice, ByteCount, hStream) : r;
+}
+
+// Peer copies name each side's context; the ranges must belong to those contexts' devices.
+static CUresult peer_range(CUdeviceptr addr, CUcontext ctx, size_t n, fakeCudaDevice_t **dev) {
+    if (ctx == NULL) return CUDA_ERROR_INVALID_CONTEXT;
+    if (!ctx_alive(ctx)) return CUDA_ERROR_CONTEXT_IS_DESTROYED;
+    CUresult r = device_range(addr, n, dev);
+    return r == CUDA_SUCCESS && *dev != ctx->dev ? CUDA_ERROR_INVALID_VALUE : r;
+}
+
+CUresult cuMemcpyPeerAsync(CUdeviceptr dstDevice, CUcontext dstContext, CUdeviceptr srcDevice, CUcontext srcContext,
+                           size_t ByteCount, CUstream hStream) {
+    fakeCudaDevice_t *dd = NULL, *sd = NULL;
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS || ByteCount == 0) return r;
+    r = peer_range(dstDevice, dstContext, ByteCount, &dd);
+    if (r == CUDA_SUCCESS) r = peer_range(srcDevice, srcContext, ByteCount, &sd);
+    return r == CUDA_SUCCESS ? copy_async(dd, dstDevice, sd, srcDevice, ByteCount, hStream) : r;
+}
+
+CUresult cuMemcpyPeer(CUdeviceptr dstDevice, CUcontext dstContext, CUdeviceptr srcDevice, CUcontext srcContext,
+                      size_t ByteCount) {
+    CUcontext ctx;
+    fakeCudaDevice_t *dd = NULL, *sd = NULL;
+    CUresult r = ctx_current(&ctx);
+    if (r == CUDA_SUCCESS) ctx_sync_default(ctx);
+    if (r == CUDA_SUCCESS && ByteCount) r = peer_range(dstDevice, dstContext, ByteCount, &dd);
+    if (r == CUDA_SUCCESS && ByteCount) r = peer_range(srcDevice, srcContext, ByteCount, &sd);
+    if (r == CUDA_SUCCESS && ByteCount)
+        link_copy(dd, (void *)(uintptr_t)dstDevice, sd, (const void *)(uintptr_t)srcDevice, ByteCount);
+    return r;
+}
+
+static CUresult set_async(CUdeviceptr dst, unsigned int value, size_t n, int width, CUstream hStream) {
+    CUstream s;
+    fakeCudaOp_t *op;
+    if (n == 0) return CUDA_SUCCESS;
+    if (width == 4 && ((dst & 3) || n > SIZE_MAX / 4)) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = device_range(dst, n * (size_t)width, NULL);
+    if (r == CUDA_SUCCESS) r = op_new(hStream, width == 4 ? FAKE_CUDA_OP_SET32 : FAKE_CUDA_OP_SET8, &s, &op);
+    if (r != CUDA_SUCCESS) return r;
+    op->u.set.dst = (void *)(uintptr_t)dst;
+    op->u.set.value = value;
+    op->u.set.n = n;
+    stream_enqueue(s, op);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuMemsetD8Async(CUdeviceptr dstDevice, unsigned char uc, size_t N, CUstream hStream) {
+    return set_async(dstDevice, uc, N, 1, hStream);
+}
+
+CUresult cuMemsetD32Async(CUdeviceptr dstDevice, unsigned int ui, size_t N, CUstream hStream) {
+    return set_async(dstDevice, ui, N, 4, hStream);
+}
+
+// --- Events ---
+CUresult cuEventCreate(CUevent *phEvent, unsigned int Flags) {
+    CUcontext ctx;
+    if (phEvent == NULL || (Flags & ~(CU_EVENT_BLOCKING_SYNC | CU_EVENT_DISABLE_TIMING | CU_EVENT_INTERPROCESS)))
+        return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = ctx_current(&ctx);
+    if (r != CUDA_SUCCESS) return r;
+    CUevent ev = calloc(1, sizeof(*ev));
+    if (ev == NULL) return CUDA_ERROR_OUT_OF_MEMORY;
+    ev->flags = Flags;
+    ev->refs = 1;
+    pthread_mutex_init(&ev->lock, NULL);
+    pthread_cond_init(&ev->done, NULL);
+    *phEvent = ev;
+    return CUDA_SUCCESS;
+}
+
+// Queued records and waits keep the event alive until they have run.
+CUresult cuEventDestroy_v2(CUevent hEvent) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (hEvent == NULL) return CUDA_ERROR_INVALID_HANDLE;
+    event_put(hEvent);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuEventRecord(CUevent hEvent, CUstream hStream) {
+    CUstream s;
+    fakeCudaOp_t *op;
+    if (hEvent == NULL) return CUDA_ERROR_INVALID_HANDLE;
+    CUresult r = op_new(hStream, FAKE_CUDA_OP_EVENT_RECORD, &s, &op);
+    if (r != CUDA_SUCCESS) return r;
+    pthread_mutex_lock(&hEvent->lock);
+    op->u.event.ev = hEvent;
+    op->u.event.gen = ++hEvent->gen;
+    hEvent->refs++;
+    pthread_mutex_unlock(&hEvent->lock);
+    stream_enqueue(s, op);
+    return CUDA_SUCCESS;
+}
+
+// Work queued on the stream after the wait starts once the event's latest record is reached.
+CUresult cuStreamWaitEvent(CUstream hStream, CUevent hEvent, unsigned int Flags) {
+    CUstream s;
+    fakeCudaOp_t *op;
+    if (hEvent == NULL) return CUDA_ERROR_INVALID_HANDLE;
+    if (Flags != 0) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = op_new(hStream, FAKE_CUDA_OP_EVENT_WAIT, &s, &op);
+    if (r != CUDA_SUCCESS) return r;
+    pthread_mutex_lock(&hEvent->lock);
+    int reached = hEvent->done_gen >= hEvent->gen;
+    if (!reached) {
+        op->u.event.ev = hEvent;
+        op->u.event.gen = hEvent->gen;
+        hEvent->refs++;
+    }
+    pthread_mutex_unlock(&hEvent->lock);
+    if (reached) {
+        free(op);
+        return CUDA_SUCCESS;
+    }
+    stream_enqueue(s, op);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuEventQuery(CUevent hEvent) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (hEvent == NULL) return CUDA_ERROR_INVALID_HANDLE;
+    pthread_mutex_lock(&hEvent->lock);
+    int reached = hEvent->done_gen >= hEvent->gen;
+    pthread_mutex_unlock(&hEvent->lock);
+    return reached ? CUDA_SUCCESS : CUDA_ERROR_NOT_READY;
+}
+
+CUresult cuEventSynchronize(CUevent hEvent) {
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    if (hEvent == NULL) return CUDA_ERROR_INVALID_HANDLE;
+    pthread_mutex_lock(&hEvent->lock);
+    unsigned long long gen = hEvent->gen;
+    while (hEvent->done_gen < gen) pthread_cond_wait(&hEvent->done, &hEvent->lock);
+    pthread_mutex_unlock(&hEvent->lock);
+    return CUDA_SUCCESS;
+}
+
+CUresult cuEventElapsedTime(float *pMilliseconds, CUevent hStart, CUevent hEnd) {
+    unsigned long long ts[2];
+    CUevent evs[2] = {hStart, hEnd};
+    if (pMilliseconds == NULL) return CUDA_ERROR_INVALID_VALUE;
+    CUresult r = check_init();
+    if (r != CUDA_SUCCESS) return r;
+    for (int i = 0; i < 2; i++) {
+        CUevent ev = evs[i];
+        if (ev == NULL || (ev->flags & CU_EVENT_DISABLE_TIMING)) return CUDA_ERROR_INVALID_HANDLE;
+        pthread_mutex_lock(&ev->lock);
+        unsigned long long gen = ev->gen, done = ev->done_gen;
+        ts[i] = ev->timestamp_ns;
+        pthread_mutex_unlock(&ev->lock);
+        if (gen == 0) return CUDA_ERROR_INVALID_HANDLE;
+        if (done < gen) return CUDA_ERROR_NOT_READY;
+    }
+    *pMilliseconds = (float)((double)(long long)(ts[1] - ts[0]) / 1e6);
+    return CUDA_SUCCESS;
+}
+
+// --- Errors ---
+static const struct {
+    CUresult code;
+    const char *name;
+    const char *text;
+} g_errors[] = {
+    {CUDA_SUCCESS, "CUDA_SUCCESS", "no error"},
+    {CUDA_ERROR_INVALID_VALUE, "CUDA_ERROR_INVALID_VALUE", "invalid argument"},
+    {CUDA_ERROR_OUT_OF_MEMORY, "CUDA_ERROR_OUT_OF_MEMORY", "out of memory"},
+    {CUDA_ERROR_NOT_INITIALIZED, "CUDA_ERROR_NOT_INITIALIZED", "initialization error"},
+    {CUDA_ERROR_DEINITIALIZED, "CUDA_ERROR_DEINITIALIZED", "driver shutting down"},
+    {CUDA_ERROR_NO_DEVICE, "CUDA_ERROR_NO_DEVICE", "no CUDA-capable device is detected"},
+    {CUDA_ERROR_INVALID_DEVICE, "CUDA_ERROR_INVALID_DEVICE", "invalid device ordinal"},
+    {CUDA_ERROR_INVALID_CONTEXT, "CUDA_ERROR_INVALID_CONTEXT", "invalid device context"},
+    {CUDA_ERROR_INVALID_HANDLE, "CUDA_ERROR_INVALID_HANDLE", "invalid resource handle"},
+    {CUDA_ERROR_NOT_FOUND, "CUDA_ERROR_NOT_FOUND", "named symbol not found"},
+    {CUDA_ERROR_NOT_READY, "CUDA_ERROR_NOT_READY", "device not ready"},
+    {CUDA_ERROR_PRIMARY_CONTEXT_ACTIVE, "CUDA_ERROR_PRIMARY_CONTEXT_ACTIVE", "primary context active"},
+    {CUDA_ERROR_CONTEXT_IS_DESTROYED, "CUDA_ERROR_CONTEXT_IS_DESTROYED", "context is destroyed"},
+    {CUDA_ERROR_NOT_PERMITTED, "CUDA_ERROR_NOT_PERMITTED", "operation not permitted"},
+    {CUDA_ERROR_NOT_SUPPORTED, "CUDA_ERROR_NOT_SUPPORTED", "operation not supported"},
+    {CUDA_ERROR_UNKNOWN, "CUDA_ERROR_UNKNOWN", "unknown error"},
+};
+
+static int error_index(CUresult error) {
+    for (size_t i = 0; i < sizeof(g_errors) / sizeof(g_errors[0]); i++) {
+        if (g_errors[i].code == error) return (int)i;
+    }
+    return -1;
+}
+
+CUresult cuGetErrorString(CUresult error, const char **pStr) {
+    int i = error_index(error);
+    if (pStr == NULL) return CUDA_ERROR_INVALID_VALUE;
+    *pStr = i < 0 ? NULL : g_errors[i].text;
+    return i < 0 ? CUDA_ERROR_INVALID_VALUE : CUDA_SUCCESS;
+}
+
+CUresult cuGetErrorName(CUresult error, const char **pStr) {
+    int i = error_index(error);
+    if (pStr == NULL) return CUDA_ERROR_INVALID_VALUE;
+    *pStr = i < 0 ? NULL : g_errors[i].name;
+    return i < 0 ? CUDA_ERROR_INVALID_VALUE : CUDA_SUCCESS;
+}
+
+// --- Entry Points ---
+// cudart resolves the driver through cuGetProcAddress() with the base names; each maps to the
+// versioned symbol implemented here. Every entry exists since CUDA 3.2 or earlier, so the
+// requested version and flags never reject one.
+#define FAKE_CUDA_ENTRY(name, fn) {#name, (void *)fn}
+static const struct {
+    const char *name;
+    void *fn;
+} g_entry_points[] = {
+    FAKE_CUDA_ENTRY(cuInit, cuInit),
+    FAKE_CUDA_ENTRY(cuDriverGetVersion, cuDriverGetVersion),
+    FAKE_CUDA_ENTRY(cuGetErrorString, cuGetErrorString),
+    FAKE_CUDA_ENTRY(cuGetErrorName, cuGetErrorName),
+    {"cuGetProcAddress", (void *)cuGetProcAddress_v2},
+    FAKE_CUDA_ENTRY(cuDeviceGet, cuDeviceGet),
+    FAKE_CUDA_ENTRY(cuDeviceGetCount, cuDeviceGetCount),
+    FAKE_CUDA_ENTRY(cuDeviceGetName, cuDeviceGetName),
+    {"cuDeviceGetUuid", (void *)cuDeviceGetUuid_v2},
+    {"cuDeviceTotalMem", (void *)cuDeviceTotalMem_v2},
+    FAKE_CUDA_ENTRY(cuDeviceGetAttribute, cuDeviceGetAttribute),
+    FAKE_CUDA_ENTRY(cuDeviceComputeCapability, cuDeviceComputeCapability),
+    FAKE_CUDA_ENTRY(cuDeviceGetPCIBusId, cuDeviceGetPCIBusId),
+    FAKE_CUDA_ENTRY(cuDeviceGetByPCIBusId, cuDeviceGetByPCIBusId),
+    FAKE_CUDA_ENTRY(cuDeviceCanAccessPeer, cuDeviceCanAccessPeer),
+    FAKE_CUDA_ENTRY(cuDevicePrimaryCtxRetain, cuDevicePrimaryCtxRetain),
+    {"cuDevicePrimaryCtxRelease", (void *)cuDevicePrimaryCtxRelease_v2},
+    {"cuDevicePrimaryCtxReset", (void *)cuDevicePrimaryCtxReset_v2},
+    FAKE_CUDA_ENTRY(cuDevicePrimaryCtxGetState, cuDevicePrimaryCtxGetState),
+    {"cuDevicePrimaryCtxSetFlags", (void *)cuDevicePrimaryCtxSetFlags_v2},
+    {"cuCtxCreate", (void *)cuCtxCreate_v2},
+    {"cuCtxDestroy", (void *)cuCtxDestroy_v2},
+    FAKE_CUDA_ENTRY(cuCtxGetCurrent, cuCtxGetCurrent),
+    FAKE_CUDA_ENTRY(cuCtxSetCurrent, cuCtxSetCurrent),
+    {"cuCtxPushCurrent", (void *)cuCtxPushCurrent_v2},
+    {"cuCtxPopCurrent", (void *)cuCtxPopCurrent_v2},
+    FAKE_CUDA_ENTRY(cuCtxGetDevice, cuCtxGetDevice),
+    FAKE_CUDA_ENTRY(cuCtxSynchronize, cuCtxSynchronize),
+    {"cuMemGetInfo", (void *)cuMemGetInfo_v2},
+    {"cuMemAlloc", (void *)cuMemAlloc_v2},
+    {"cuMemFree", (void *)cuMemFree_v2},
+    {"cuMemGetAddressRange", (void *)cuMemGetAddressRange_v2},
+    {"cuMemAllocHost", (void *)cuMemAllocHost_v2},
+    FAKE_CUDA_ENTRY(cuMemHostAlloc, cuMemHostAlloc),
+    FAKE_CUDA_ENTRY(cuMemFreeHost, cuMemFreeHost),
+    FAKE_CUDA_ENTRY(cuMemcpy, cuMemcpy),
+    {"cuMemcpyHtoD", (void *)cuMemcpyHtoD_v2},
+    {"cuMemcpyDtoH", (void *)cuMemcpyDtoH_v2},
+    {"cuMemcpyDtoD", (void *)cuMemcpyDtoD_v2},
+    {"cuMemsetD8", (void *)cuMemsetD8_v2},
+    {"cuMemsetD32", (void *)cuMemsetD32_v2},
+    FAKE_CUDA_ENTRY(cuStreamCreate, cuStreamCreate),
+    {"cuStreamDestroy", (void *)cuStreamDestroy_v2},
+    FAKE_CUDA_ENTRY(cuStreamSynchronize, cuStreamSynchronize),
+    FAKE_CUDA_ENTRY(cuStreamQuery, cuStreamQuery),
+    FAKE_CUDA_ENTRY(cuStreamWaitEvent, cuStreamWaitEvent),
+    FAKE_CUDA_ENTRY(cuLaunchHostFunc, cuLaunchHostFunc),
+    FAKE_CUDA_ENTRY(cuMemcpyAsync, cuMemcpyAsync),
+    {"cuMemcpyHtoDAsync", (void *)cuMemcpyHtoDAsync_v2},
+    {"cuMemcpyDtoHAsync", (void *)cuMemcpyDtoHAsync_v2},
+    {"cuMemcpyDtoDAsync", (void *)cuMemcpyDtoDAsync_v2},
+    FAKE_CUDA_ENTRY(cuMemcpyPeer, cuMemcpyPeer),
+    FAKE_CUDA_ENTRY(cuMemcpyPeerAsync, cuMemcpyPeerAsync),
+    FAKE_CUDA_ENTRY(cuMemsetD8Async, cuMemsetD8Async),
+    FAKE_CUDA_ENTRY(cuMemsetD32Async, cuMemsetD32Async),
+    FAKE_CUDA_ENTRY(cuEventCreate, cuEventCreate),
+    {"cuEventDestroy", (void *)cuEventDestroy_v2},
+    FAKE_CUDA_ENTRY(cuEventRecord, cuEventRecord),
+    FAKE_CUDA_ENTRY(cuEventQuery, cuEventQuery),
+    FAKE_CUDA_ENTRY(cuEventSynchronize, cuEventSynchronize),
+    FAKE_CUDA_ENTRY(cuEventElapsedTime, cuEventElapsedTime),
+};
+
+CUresult cuGetProcAddress_v2(const char *symbol, void **pfn, int cudaVersion, cuuint64_t flags,
+                             CUdriverProcAddressQueryResult *symbolStatus) {
+    (void)cudaVersion;
+    (void)flags;
+    if (symbol == NULL || pfn == NULL) return CUDA_ERROR_INVALID_VALUE;
+    for (size_t i = 0; i < sizeof(g_entry_points) / sizeof(g_entry_points[0]); i++) {
+        if (strcmp(symbol, g_entry_points[i].name) == 0) {
+            *pfn = g_entry_points[i].fn;
+            if (symbolStatus) *symbolStatus = CU_GET_PROC_ADDRESS_SUCCESS;
+            return CUDA_SUCCESS;
+        }
+    }
+    *pfn = NULL;
+    if (symbolStatus) *symbolStatus = CU_GET_PROC_ADDRESS_SYMBOL_NOT_FOUND;
+    return CUDA_ERROR_NOT_FOUND;
+}
+
+// The CUDA 11.3 entry point, without the query result; cuda.h maps the name to _v2.
+#undef cuGetProcAddress
+CUresult cuGetProcAddress(const char *symbol, void **pfn, int cudaVersion, cuuint64_t flags);
+CUresult cuGetProcAddress(const char *symbol, void **pfn, int cudaVersion, cuuint64_t flags) {
+    return cuGetProcAddress_v2(symbol, pfn, cudaVersion, flags, NULL);
+}
@@ -0,0 +1,937 @@
+/**
+ * fake_cufile.c
+ *
+ * A fake GPUDirect Storage library (libcufile.so) for the fake GPUs of this repository. Reads and
+ * writes go between files and host buffers that stand in for GPU memory, through io_uring with
+ * O_DIRECT wherever the request is block aligned, so that storage benchmarks and data loaders
+ * exercise the same storage path and see realistic throughput without a GPU.
+ *
+ * Compilation:
+ *   gcc -shared -fPIC -pthread -O2 -o libcufile.so fake_cufile.c
+ *
+ * Behaviour:
+ *   - Each registered file handle is reopened through /proc/self/fd with and without O_DIRECT.
+ *     Requests whose buffer, offset and size are 4 KiB aligned use the O_DIRECT descriptor; the
+ *     rest use the buffered one (the "compat mode" of the real library).
+ *   - Requests are split into chunks of FAKE_CUFILE_MAX_IO_KB (default 16384) submitted together.
+ *   - cuFileBufRegister() registers the buffer with each thread's ring as an io_uring fixed
+ *     buffer (READ_FIXED / WRITE_FIXED, no per-I/O page pinning). Buffers over 1 GiB, and
+ *     buffers the kernel refuses to pin, are used as plain buffers; the others stay fixed.
+ *   - Stream-ordered operations run on FAKE_CUFILE_ASYNC_THREADS (default 4) worker threads, in
+ *     order within a stream and concurrently across streams.
+ *   - When io_uring is unavailable (kernel before 5.6, or blocked by a seccomp profile) every
+ *     chunk is a pread()/pwrite().
+ *   - cuFileDriverOpen() reports the nvidia-fs mode when fake_nvidia_driver created
+ *     /dev/nvidia-fs0, and compat mode otherwise; I/O works the same in both.
+ *
+ * With FAKE_CUFILE_STATS=1 operation counts, bytes, throughput and latency per operation kind
+ * are printed at exit, to stderr or appended to the file named by FAKE_CUFILE_STATS_OUT.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include "fake_cufile.h"
+#include "fake_nvml_stats.h"
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#define __NR_io_uring_register 427
+#endif
+
+#define FAKE_CUFILE_DIO_ALIGN 4096
+#define FAKE_CUFILE_DEFAULT_MAX_IO_KB 16384
+#define FAKE_CUFILE_DEFAULT_ASYNC_THREADS 4
+#define FAKE_CUFILE_MAX_ASYNC_THREADS 64
+#define FAKE_CUFILE_RING_ENTRIES 64
+// Largest buffer io_uring accepts as a fixed buffer.
+#define FAKE_CUFILE_MAX_FIXED_BUF (1UL << 30)
+
+#define CUFILE_ERR(code) ((CUfileError_t){.err = (code), .cu_err = 0})
+
+static size_t g_max_io = (size_t)FAKE_CUFILE_DEFAULT_MAX_IO_KB * 1024;
+static unsigned int g_async_threads = FAKE_CUFILE_DEFAULT_ASYNC_THREADS;
+
+static unsigned long env_ulong(const char *name, unsigned long def, unsigned long min, unsigned long max) {
+    const char *v = getenv(name);
+    if (v == NULL || v[0] == '\0') return def;
+    char *end;
+    unsigned long n = strtoul(v, &end, 10);
+    if (*end != '\0' || n < min || n > max) {
+        fprintf(stderr, "[FAKE-CUFILE %d] ignoring %s=%s\n", getpid(), name, v);
+        return def;
+    }
+    return n;
+}
+
+// --- Statistics ---
+// Latency histograms reuse the per-symbol record of the NVML statistics (fake_nvml_stats.h);
+// bytes, O_DIRECT operations and the busy window are kept alongside.
+typedef struct {
+    fakeNvmlSymStats_t lat;
+    unsigned long long bytes;
+    unsigned long long direct_ops;
+    unsigned long long first_ns;
+    unsigned long long last_ns;
+} fakeCufileStats_t;
+
+static fakeCufileStats_t g_stats[FAKE_CUFILE_OP_COUNT];
+static const char *const g_op_names[FAKE_CUFILE_OP_COUNT] = {
+    [FAKE_CUFILE_OP_READ] = "cuFileRead",
+    [FAKE_CUFILE_OP_WRITE] = "cuFileWrite",
+    [FAKE_CUFILE_OP_READ_ASYNC] = "cuFileReadAsync",
+    [FAKE_CUFILE_OP_WRITE_ASYNC] = "cuFileWriteAsync",
+};
+
+static void stats_record(fakeCufileOp_t op, unsigned long long start, ssize_t ret, int direct) {
+    fakeCufileStats_t *st = &g_stats[op];
+    unsigned long long end = fake_nvml_stats_now();
+    fake_nvml_stats_record(&st->lat, end - start, ret < 0);
+    if (ret > 0) __atomic_fetch_add(&st->bytes, (unsigned long long)ret, __ATOMIC_RELAXED);
+    if (direct) __atomic_fetch_add(&st->direct_ops, 1, __ATOMIC_RELAXED);
+    unsigned long long first = __atomic_load_n(&st->first_ns, __ATOMIC_RELAXED);
+    while ((first == 0 || start < first) &&
+           !__atomic_compare_exchange_n(&st->first_ns, &first, start, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    unsigned long long last = __atomic_load_n(&st->last_ns, __ATOMIC_RELAXED);
+    while (end > last &&
+           !__atomic_compare_exchange_n(&st->last_ns, &last, end, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+CUfileError_t fake_cufile_stats_get(fakeCufileOp_t op, fakeCufileOpStats_t *out) {
+    if ((unsigned)op >= FAKE_CUFILE_OP_COUNT || out == NULL) return CUFILE_ERR(CU_FILE_INVALID_VALUE);
+    const fakeCufileStats_t *st = &g_stats[op];
+    out->ops = __atomic_load_n(&st->lat.calls, __ATOMIC_RELAXED);
+    out->errors = __atomic_load_n(&st->lat.errors, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&st->bytes, __ATOMIC_RELAXED);
+    out->direct_ops = __atomic_load_n(&st->direct_ops, __ATOMIC_RELAXED);
+    out->total_ns = __atomic_load_n(&st->lat.total_ns, __ATOMIC_RELAXED);
+    out->max_ns = __atomic_load_n(&st->lat.max_ns, __ATOMIC_RELAXED);
+    unsigned long long first = __atomic_load_n(&st->first_ns, __ATOMIC_RELAXED);
+    unsigned long long last = __atomic_load_n(&st->last_ns, __ATOMIC_RELAXED);
+    out->busy_ns = last > first ? last - first : 0;
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+// --- Registered Buffers ---
+// The process-wide table; every change bumps g_bufs_gen, and each ring re-registers the table
+// with the kernel before its next fixed-buffer I/O. A ring that has not done I/O since a buffer
+// was deregistered keeps that buffer's pages pinned until it does.
+typedef struct {
+    uintptr_t base;
+    size_t len;
+    int fixed_index; // index in the io_uring buffer table, or -1 if too large to register
+} fakeCufileBuf_t;
+
+static pthread_rwlock_t g_bufs_lock = PTHREAD_RWLOCK_INITIALIZER;
+static fakeCufileBuf_t *g_bufs = NULL;
+static unsigned int g_buf_count = 0;
+static unsigned int g_buf_cap = 0;
+static unsigned int g_bufs_gen = 1;
+
+static int buf_find_locked(uintptr_t base) {
+    for (unsigned int i = 0; i < g_buf_count; ++i) {
+        if (g_bufs[i].base == base) return (int)i;
+    }
+    return -1;
+}
+
+static void buf_reindex_locked(void) {
+    int next = 0;
+    for (unsigned int i = 0; i < g_buf_count; ++i) {
+        g_bufs[i].fixed_index = g_bufs[i].len <= FAKE_CUFILE_MAX_FIXED_BUF ? next++ : -1;
+    }
+    ++g_bufs_gen;
+}
+
+CUfileError_t cuFileBufRegister(const void *bufPtr_base, size_t length, int flags) {
+    (void)flags;
+    if (bufPtr_base == NULL || length == 0) return CUFILE_ERR(CU_FILE_INVALID_VALUE);
+    CUfileOpError err = CU_FILE_SUCCESS;
+    pthread_rwlock_wrlock(&g_bufs_lock);
+    if (buf_find_locked((uintptr_t)bufPtr_base) >= 0) {
+        err = CU_FILE_MEMORY_ALREADY_REGISTERED;
+    } else {
+        if (g_buf_count == g_buf_cap) {
+            unsigned int cap = g_buf_cap ? g_buf_cap * 2 : 16;
+            fakeCufileBuf_t *bufs = realloc(g_bufs, cap * sizeof(*bufs));
+            if (bufs == NULL) {
+                pthread_rwlock_unlock(&g_bufs_lock);
+                return CUFILE_ERR(CU_FILE_INTERNAL_ERROR);
+            }
+            g_bufs = bufs;
+            g_buf_cap = cap;
+        }
+        g_bufs[g_buf_count++] = (fakeCufileBuf_t){.base = (uintptr_t)bufPtr_base, .len = length};
+        buf_reindex_locked();
+    }
+    pthread_rwlock_unlock(&g_bufs_lock);
+    return CUFILE_ERR(err);
+}
+
+CUfileError_t cuFileBufDeregister(const void *bufPtr_base) {
+    pthread_rwlock_wrlock(&g_bufs_lock);
+    int i = buf_find_locked((uintptr_t)bufPtr_base);
+    if (i >= 0) {
+        memmove(&g_bufs[i], &g_bufs[i + 1], (g_buf_count - (unsigned)i - 1) * sizeof(*g_bufs));
+        --g_buf_count;
+        buf_reindex_locked();
+    }
+    pthread_rwlock_unlock(&g_bufs_lock);
+    return CUFILE_ERR(i >= 0 ? CU_FILE_SUCCESS : CU_FILE_MEMORY_NOT_REGISTERED);
+}
+
+// --- io_uring ---
+// One ring per thread, created on the thread's first I/O and closed when the thread exits.
+typedef struct {
+    int fd;
+    unsigned int *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+    unsigned int bufs_gen; // generation of the table registered with this ring
+    int bufs_registered;   // some buffers of that generation are registered
+    int *fixed;            // per table entry: its index in this ring's buffer table, or -1
+    unsigned int fixed_cap;
+} fakeRing_t;
+
+static pthread_key_t g_ring_key;
+static pthread_once_t g_ring_once = PTHREAD_ONCE_INIT;
+static int g_uring_disabled = 0; // set once io_uring_setup() fails for lack of support
+// Stands in for the ring of a thread whose io_uring_setup() failed.
+static fakeRing_t g_no_ring = {.fd = -1};
+
+static void ring_free(void *p) {
+    fakeRing_t *r = p;
+    if (r == NULL || r == &g_no_ring) return;
+    munmap(r->sqes, r->sqes_len);
+    if (r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_len);
+    munmap(r->sq_map, r->sq_map_len);
+    close(r->fd);
+    free(r->fixed);
+    free(r);
+}
+
+static void ring_key_init(void) {
+    pthread_key_create(&g_ring_key, ring_free);
+}
+
+static fakeRing_t *ring_create(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, FAKE_CUFILE_RING_ENTRIES, &p);
+    if (fd < 0) {
+        if (errno == ENOSYS || errno == EPERM) __atomic_store_n(&g_uring_disabled, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    // IORING_OP_READ / IORING_OP_WRITE arrived in 5.6 together with this feature bit.
+    if (!(p.features & IORING_FEAT_CUR_PERSONALITY)) {
+        close(fd);
+        __atomic_store_n(&g_uring_disabled, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    fakeRing_t *r = calloc(1, sizeof(*r));
+    if (r == NULL) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_len > r->sq_map_len) r->sq_map_len = r->cq_map_len;
+        r->cq_map_len = r->sq_map_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) goto err;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) goto err_sq;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto err_cq;
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return r;
+
+err_cq:
+    if (r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_len);
+err_sq:
+    munmap(r->sq_map, r->sq_map_len);
+err:
+    close(fd);
+    free(r);
+    return NULL;
+}
+
+// The calling thread's ring, or NULL when I/O has to use pread()/pwrite().
+static fakeRing_t *ring_get(void) {
+    if (__atomic_load_n(&g_uring_disabled, __ATOMIC_RELAXED)) return NULL;
+    pthread_once(&g_ring_once, ring_key_init);
+    fakeRing_t *r = pthread_getspecific(g_ring_key);
+    if (r == NULL) {
+        r = ring_create();
+        pthread_setspecific(g_ring_key, r != NULL ? r : &g_no_ring);
+    }
+    return r == &g_no_ring ? NULL : r;
+}
+
+static int ring_register_bufs(fakeRing_t *r, const struct iovec *iov, unsigned int n) {
+    return syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, n) == 0;
+}
+
+static void ring_unregister_bufs(fakeRing_t *r) {
+    syscall(__NR_io_uring_register, r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+}
+
+// Bring the ring's fixed buffers up to date with the table. The kernel registers a buffer table
+// as a whole, so when it refuses one buffer (it cannot pin its pages, or RLIMIT_MEMLOCK is
+// reached), the buffers it accepts on their own are registered again without the others, dropping
+// the last ones while the set is still refused; only the buffers left out use plain I/O. Called
+// with g_bufs_lock held for reading.
+static void ring_sync_bufs(fakeRing_t *r) {
+    if (r->bufs_gen == g_bufs_gen) return;
+    if (r->bufs_registered) ring_unregister_bufs(r);
+    r->bufs_gen = g_bufs_gen;
+    r->bufs_registered = 0;
+    if (g_buf_count > r->fixed_cap) {
+        int *fixed = realloc(r->fixed, g_buf_count * sizeof(*fixed));
+        if (fixed == NULL) return;
+        r->fixed = fixed;
+        r->fixed_cap = g_buf_count;
+    }
+
+    struct iovec *iov = malloc((g_buf_count ? g_buf_count : 1) * sizeof(*iov));
+    if (iov == NULL) return;
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < g_buf_count; ++i) {
+        r->fixed[i] = -1;
+        if (g_bufs[i].fixed_index < 0) continue;
+        r->fixed[i] = (int)n;
+        iov[n++] = (struct iovec){.iov_base = (void *)g_bufs[i].base, .iov_len = g_bufs[i].len};
+    }
+    if (n > 0 && !ring_register_bufs(r, iov, n)) {
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < g_buf_count; ++i) {
+            if (r->fixed[i] < 0) continue;
+            struct iovec one = iov[r->fixed[i]];
+            r->fixed[i] = -1;
+            if (!ring_register_bufs(r, &one, 1)) continue;
+            ring_unregister_bufs(r);
+            r->fixed[i] = (int)kept;
+            iov[kept++] = one;
+        }
+        while (kept > 0 && !ring_register_bufs(r, iov, kept)) {
+            --kept;
+            for (unsigned int i = 0; i < g_buf_count; ++i) {
+                if (r->fixed[i] == (int)kept) r->fixed[i] = -1;
+            }
+        }
+        n = kept;
+    }
+    r->bufs_registered = n > 0;
+    free(iov);
+}
+
+// The fixed buffer index covering [addr, addr + len), or -1. Called with g_bufs_lock held.
+static int ring_fixed_index(const fakeRing_t *r, uintptr_t addr, size_t len) {
+    if (!r->bufs_registered) return -1;
+    for (unsigned int i = 0; i < g_buf_count; ++i) {
+        const fakeCufileBuf_t *b = &g_bufs[i];
+        if (r->fixed[i] >= 0 && addr >= b->base && addr - b->base + len <= b->len) return r->fixed[i];
+    }
+    return -1;
+}
+
+// --- File Handles ---
+typedef struct {
+    int fd;          // the caller's descriptor
+    int direct_fd;   // O_DIRECT descriptor, or -1 when the file system does not support it
+    int buffered_fd; // descriptor without O_DIRECT for unaligned requests
+    int own_direct, own_buffered;
+} fakeCufileHandle_t;
+
+static int reopen_fd(int fd, int flags) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return open(path, flags | O_CLOEXEC);
+}
+
+// --- Transfers ---
+// A request is cut into chunks of at most g_max_io bytes with up to FAKE_CUFILE_RING_ENTRIES in
+// flight. A chunk that completes short is resubmitted for its remainder; a chunk that reads 0
+// bytes (end of file) or fails caps the result at its position, so the return value is always
+// the length of a contiguous prefix of the request.
+typedef struct {
+    int write;
+    const fakeCufileHandle_t *h;
+    char *buf;
+    size_t size;
+    off_t offset;
+    size_t limit;   // bytes known to be transferable
+    int error;      // errno of the failure at `limit`, if any
+    int all_direct; // every chunk used O_DIRECT
+    int ring_error; // errno of a failed io_uring_enter(); the request is redone without the ring
+} fakeXfer_t;
+
+static int xfer_aligned(uintptr_t addr, off_t off, size_t len) {
+    return ((addr | (uintptr_t)off | len) & (FAKE_CUFILE_DIO_ALIGN - 1)) == 0;
+}
+
+static int xfer_fd(fakeXfer_t *x, size_t pos, size_t len) {
+    if (x->h->direct_fd >= 0 && xfer_aligned((uintptr_t)x->buf + pos, x->offset + (off_t)pos, len))
+        return x->h->direct_fd;
+    x->all_direct = 0;
+    return x->h->buffered_fd;
+}
+
+// Account for `res` bytes (or -errno) transferred by a chunk starting at `pos` of `len` bytes.
+// Returns the length still to transfer for that chunk.
+static size_t xfer_complete(fakeXfer_t *x, size_t pos, size_t len, long res) {
+    if (res > 0 && (size_t)res < len) return len - (size_t)res;
+    if (res <= 0 && pos < x->limit) {
+        x->limit = pos;
+        x->error = res < 0 ? (int)-res : 0;
+    }
+    return 0;
+}
+
+static void xfer_sync(fakeXfer_t *x) {
+    for (size_t pos = 0; pos < x->limit;) {
+        size_t len = x->limit - pos < g_max_io ? x->limit - pos : g_max_io;
+        while (len > 0) {
+            int fd = xfer_fd(x, pos, len);
+            ssize_t res = x->write ? pwrite(fd, x->buf + pos, len, x->offset + (off_t)pos)
+                                   : pread(fd, x->buf + pos, len, x->offset + (off_t)pos);
+            if (res < 0 && errno == EINTR) continue;
+            size_t left = xfer_complete(x, pos, len, res < 0 ? -errno : res);
+            pos += len - left;
+            len = left;
+            if (res <= 0) return;
+        }
+    }
+}
+
+typedef struct {
+    size_t pos;
+    size_t len;
+} fakeChunk_t;
+
+static void ring_prep(fakeRing_t *r, fakeXfer_t *x, fakeChunk_t *c, unsigned int slot) {
+    unsigned int tail = *r->sq_tail;
+    unsigned int idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    uintptr_t addr = (uintptr_t)x->buf + c->pos;
+    int fixed = ring_fixed_index(r, addr, c->len);
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (fixed >= 0) {
+        sqe->opcode = x->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = (unsigned short)fixed;
+    } else {
+        sqe->opcode = x->write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = xfer_fd(x, c->pos, c->len);
+    sqe->addr = addr;
+    sqe->len = (unsigned int)c->len;
+    sqe->off = (unsigned long long)(x->offset + (off_t)c->pos);
+    sqe->user_data = slot;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Wait for a completion without io_uring_enter(), once it has failed: the task work that posts
+// completions runs on the way back from any system call.
+static void ring_poll_cq(fakeRing_t *r) {
+    const struct timespec pause = {.tv_sec = 0, .tv_nsec = 20000};
+    while (__atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) == *r->cq_head) nanosleep(&pause, NULL);
+}
+
+static void xfer_ring(fakeRing_t *r, fakeXfer_t *x) {
+    fakeChunk_t chunks[FAKE_CUFILE_RING_ENTRIES];
+    unsigned int free_slots[FAKE_CUFILE_RING_ENTRIES];
+    unsigned int nfree = FAKE_CUFILE_RING_ENTRIES, inflight = 0, to_submit = 0;
+    size_t next = 0;
+
+    for (unsigned int i = 0; i < FAKE_CUFILE_RING_ENTRIES; ++i) free_slots[i] = FAKE_CUFILE_RING_ENTRIES - 1 - i;
+    pthread_rwlock_rdlock(&g_bufs_lock);
+    ring_sync_bufs(r);
+    for (;;) {
+        while (nfree > 0 && next < x->limit) {
+            unsigned int slot = free_slots[--nfree];
+            size_t len = x->limit - next < g_max_io ? x->limit - next : g_max_io;
+            chunks[slot] = (fakeChunk_t){.pos = next, .len = len};
+            ring_prep(r, x, &chunks[slot], slot);
+            next += len;
+            ++inflight;
+            ++to_submit;
+        }
+        if (inflight == 0) break;
+        if (x->ring_error == 0) {
+            int ret = (int)syscall(__NR_io_uring_enter, r->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (ret < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                // Nothing was consumed: withdraw the unsubmitted entries. The ones in flight may
+                // still write to the buffer, so they are reaped before the request is redone
+                // without the ring.
+                x->ring_error = errno;
+                x->limit = 0;
+                __atomic_store_n(r->sq_tail, *r->sq_tail - to_submit, __ATOMIC_RELEASE);
+                inflight -= to_submit;
+                to_submit = 0;
+                continue;
+            }
+            to_submit -= (unsigned int)ret < to_submit ? (unsigned int)ret : to_submit;
+        } else {
+            ring_poll_cq(r);
+        }
+
+        unsigned int head = *r->cq_head;
+        unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            unsigned int slot = (unsigned int)cqe->user_data;
+            fakeChunk_t *c = &chunks[slot];
+            size_t left = xfer_complete(x, c->pos, c->len, cqe->res);
+            if (left > 0 && c->pos < x->limit) {
+                c->pos += c->len - left;
+                c->len = left;
+                ring_prep(r, x, c, slot);
+                ++to_submit;
+            } else {
+                free_slots[nfree++] = slot;
+                --inflight;
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&g_bufs_lock);
+}
+
+static ssize_t xfer(int write, CUfileHandle_t fh, void *buf_base, size_t size, off_t file_offset, off_t buf_offset,
+                    int *direct) {
+    const fakeCufileHandle_t *h = fh;
+    *direct = 0;
+    if (h == NULL) return -CU_FILE_HANDLE_NOT_REGISTERED;
+    if (buf_base == NULL || file_offset < 0 || buf_offset < 0 || size > SSIZE_MAX)
+        return -CU_FILE_INVALID_VALUE;
+    if (size == 0) return 0;
+
+    fakeXfer_t x = {
+        .write = write, .h = h, .buf = (char *)buf_base + buf_offset, .size = size, .offset = file_offset,
+        .limit = size, .all_direct = 1,
+    };
+    fakeRing_t *r = ring_get();
+    if (r != NULL) xfer_ring(r, &x);
+    if (r == NULL || x.ring_error != 0) {
+        if (r != NULL) {
+            // The thread gives up on its ring for good.
+            pthread_setspecific(g_ring_key, &g_no_ring);
+            ring_free(r);
+        }
+        x = (fakeXfer_t){
+            .write = write, .h = h, .buf = x.buf, .size = size, .offset = file_offset, .limit = size, .all_direct = 1,
+        };
+        xfer_sync(&x);
+    }
+    *direct = x.all_direct;
+    if (x.limit == 0 && x.error != 0) {
+        errno = x.error;
+        return -1;
+    }
+    return (ssize_t)x.limit;
+}
+
+ssize_t cuFileRead(CUfileHandle_t fh, void *bufPtr_base, size_t size, off_t file_offset, off_t bufPtr_offset) {
+    unsigned long long start = fake_nvml_stats_now();
+    int direct;
+    ssize_t ret = xfer(0, fh, bufPtr_base, size, file_offset, bufPtr_offset, &direct);
+    stats_record(FAKE_CUFILE_OP_READ, start, ret, direct);
+    return ret;
+}
+
+ssize_t cuFileWrite(CUfileHandle_t fh, const void *bufPtr_base, size_t size, off_t file_offset,
+                    off_t bufPtr_offset) {
+    unsigned long long start = fake_nvml_stats_now();
+    int direct;
+    ssize_t ret = xfer(1, fh, (void *)bufPtr_base, size, file_offset, bufPtr_offset, &direct);
+    stats_record(FAKE_CUFILE_OP_WRITE, start, ret, direct);
+    return ret;
+}
+
+// --- Streams ---
+// Operations are queued per stream; a stream with queued work and no running operation sits on
+// the ready list, from which the workers take one operation at a time, so that streams share
+// the workers fairly and each stream's operations run in order.
+typedef struct fakeCufileWork {
+    struct fakeCufileWork *next;
+    int write;
+    CUfileHandle_t fh;
+    void *buf;
+    size_t *size_p;
+    off_t *file_offset_p;
+    off_t *buf_offset_p;
+    ssize_t *bytes_p;
+    unsigned long long enqueued_ns;
+} fakeCufileWork_t;
+
+typedef struct fakeCufileStream {
+    struct fakeCufileStream *next;       // hash chain
+    struct fakeCufileStream *next_ready; // ready list
+    CUstream stream;
+    fakeCufileWork_t *head, *tail;
+    unsigned long pending; // queued or running
+    int running;
+    pthread_cond_t idle;
+} fakeCufileStream_t;
+
+#define FAKE_CUFILE_STREAM_BUCKETS 64
+
+static pthread_mutex_t g_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_async_work = PTHREAD_COND_INITIALIZER;
+static fakeCufileStream_t *g_streams[FAKE_CUFILE_STREAM_BUCKETS];
+static fakeCufileStream_t *g_ready_head = NULL, *g_ready_tail = NULL;
+static pthread_t g_workers[FAKE_CUFILE_MAX_ASYNC_THREADS];
+static unsigned int g_worker_count = 0;
+// Workers exit once the generation they were started in has passed.
+static unsigned int g_async_gen = 0;
+
+static unsigned int stream_bucket(CUstream stream) {
+    uintptr_t k = (uintptr_t)stream;
+    return (unsigned int)((k >> 4) ^ (k >> 12)) % FAKE_CUFILE_STREAM_BUCKETS;
+}
+
+// Called with g_async_lock held.
+static fakeCufileStream_t *stream_lookup(CUstream stream, int create) {
+    fakeCufileStream_t **bucket = &g_streams[stream_bucket(stream)];
+    for (fakeCufileStream_t *s = *bucket; s != NULL; s = s->next) {
+        if (s->stream == stream) return s;
+    }
+    if (!create) return NULL;
+    fakeCufileStream_t *s = calloc(1, sizeof(*s));
+    if (s == NULL) return NULL;
+    s->stream = stream;
+    pthread_cond_init(&s->idle, NULL);
+    s->next = *bucket;
+    *bucket = s;
+    return s;
+}
+
+static void stream_make_ready(fakeCufileStream_t *s) {
+    s->next_ready = NULL;
+    if (g_ready_tail != NULL) g_ready_tail->next_ready = s;
+    else g_ready_head = s;
+    g_ready_tail = s;
+    pthread_cond_signal(&g_async_work);
+}
+
+static void run_work(fakeCufileWork_t *w) {
+    int direct = 0;
+    ssize_t ret;
+    if (w->size_p == NULL || w->file_offset_p == NULL || w->buf_offset_p == NULL) {
+        ret = -CU_FILE_INVALID_VALUE;
+    } else {
+        ret = xfer(w->write, w->fh, w->buf, *w->size_p, *w->file_offset_p, *w->buf_offset_p, &direct);
+        if (ret == -1) ret = -errno;
+    }
+    if (w->bytes_p != NULL) *w->bytes_p = ret;
+    stats_record(w->write ? FAKE_CUFILE_OP_WRITE_ASYNC : FAKE_CUFILE_OP_READ_ASYNC, w->enqueued_ns, ret, direct);
+}
+
+static void *async_worker(void *arg) {
+    unsigned int gen = (unsigned int)(uintptr_t)arg;
+    pthread_mutex_lock(&g_async_lock);
+    for (;;) {
+        while (g_ready_head == NULL && gen == g_async_gen) pthread_cond_wait(&g_async_work, &g_async_lock);
+        if (gen != g_async_gen) break;
+        fakeCufileStream_t *s = g_ready_head;
+        g_ready_head = s->next_ready;
+        if (g_ready_head == NULL) g_ready_tail = NULL;
+
+        fakeCufileWork_t *w = s->head;
+        s->head = w->next;
+        if (s->head == NULL) s->tail = NULL;
+        s->running = 1;
+        pthread_mutex_unlock(&g_async_lock);
+
+        run_work(w);
+        free(w);
+
+        pthread_mutex_lock(&g_async_lock);
+        s->running = 0;
+        if (--s->pending == 0) pthread_cond_broadcast(&s->idle);
+        if (s->head != NULL) stream_make_ready(s);
+    }
+    pthread_mutex_unlock(&g_async_lock);
+    return NULL;
+}
+
+// Called with g_async_lock held.
+static int async_start_locked(void) {
+    if (g_worker_count > 0) return 0;
+    for (unsigned int i = 0; i < g_async_threads; ++i) {
+        if (pthread_create(&g_workers[i], NULL, async_worker, (void *)(uintptr_t)g_async_gen) != 0) break;
+        ++g_worker_count;
+    }
+    return g_worker_count > 0 ? 0 : -1;
+}
+
+// Drain every stream and join the workers.
+static void async_stop(void) {
+    pthread_mutex_lock(&g_async_lock);
+    for (unsigned int b = 0; b < FAKE_CUFILE_STREAM_BUCKETS; ++b) {
+        for (fakeCufileStream_t *s = g_streams[b]; s != NULL; s = s->next) {
+            while (s->pending > 0) pthread_cond_wait(&s->idle, &g_async_lock);
+        }
+    }
+    pthread_t workers[FAKE_CUFILE_MAX_ASYNC_THREADS];
+    unsigned int n = g_worker_count;
+    memcpy(workers, g_workers, n * sizeof(*workers));
+    g_worker_count = 0;
+    ++g_async_gen;
+    pthread_cond_broadcast(&g_async_work);
+    pthread_mutex_unlock(&g_async_lock);
+    for (unsigned int i = 0; i < n; ++i) pthread_join(workers[i], NULL);
+}
+
+static CUfileError_t enqueue(int write, CUfileHandle_t fh, void *buf, size_t *size_p, off_t *file_offset_p,
+                             off_t *buf_offset_p, ssize_t *bytes_p, CUstream stream) {
+    if (fh == NULL) return CUFILE_ERR(CU_FILE_HANDLE_NOT_REGISTERED);
+    if (buf == NULL || size_p == NULL || file_offset_p == NULL || buf_offset_p == NULL || bytes_p == NULL)
+        return CUFILE_ERR(CU_FILE_INVALID_VALUE);
+    fakeCufileWork_t *w = malloc(sizeof(*w));
+    if (w == NULL) return CUFILE_ERR(CU_FILE_INTERNAL_ERROR);
+    *w = (fakeCufileWork_t){
+        .write = write, .fh = fh, .buf = buf, .size_p = size_p, .file_offset_p = file_offset_p,
+        .buf_offset_p = buf_offset_p, .bytes_p = bytes_p, .enqueued_ns = fake_nvml_stats_now(),
+    };
+
+    pthread_mutex_lock(&g_async_lock);
+    fakeCufileStream_t *s = stream_lookup(stream, 1);
+    if (s == NULL || async_start_locked() != 0) {
+        pthread_mutex_unlock(&g_async_lock);
+        free(w);
+        return CUFILE_ERR(s == NULL ? CU_FILE_INTERNAL_ERROR : CU_FILE_ASYNC_NOT_SUPPORTED);
+    }
+    int was_idle = s->head == NULL && !s->running;
+    if (s->tail != NULL) s->tail->next = w;
+    else s->head = w;
+    s->tail = w;
+    ++s->pending;
+    if (was_idle) stream_make_ready(s);
+    pthread_mutex_unlock(&g_async_lock);
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+CUfileError_t cuFileReadAsync(CUfileHandle_t fh, void *bufPtr_base, size_t *size_p, off_t *file_offset_p,
+                              off_t *bufPtr_offset_p, ssize_t *bytes_read_p, CUstream stream) {
+    return enqueue(0, fh, bufPtr_base, size_p, file_offset_p, bufPtr_offset_p, bytes_read_p, stream);
+}
+
+CUfileError_t cuFileWriteAsync(CUfileHandle_t fh, void *bufPtr_base, size_t *size_p, off_t *file_offset_p,
+                               off_t *bufPtr_offset_p, ssize_t *bytes_written_p, CUstream stream) {
+    return enqueue(1, fh, bufPtr_base, size_p, file_offset_p, bufPtr_offset_p, bytes_written_p, stream);
+}
+
+CUfileError_t cuFileStreamRegister(CUstream stream, unsigned flags) {
+    (void)flags;
+    pthread_mutex_lock(&g_async_lock);
+    fakeCufileStream_t *s = stream_lookup(stream, 1);
+    pthread_mutex_unlock(&g_async_lock);
+    return CUFILE_ERR(s != NULL ? CU_FILE_SUCCESS : CU_FILE_INTERNAL_ERROR);
+}
+
+CUfileError_t fake_cufile_stream_synchronize(CUstream stream) {
+    pthread_mutex_lock(&g_async_lock);
+    fakeCufileStream_t *s = stream_lookup(stream, 0);
+    while (s != NULL && s->pending > 0) pthread_cond_wait(&s->idle, &g_async_lock);
+    pthread_mutex_unlock(&g_async_lock);
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+// Waits for the stream's queued operations, then forgets it.
+CUfileError_t cuFileStreamDeregister(CUstream stream) {
+    pthread_mutex_lock(&g_async_lock);
+    fakeCufileStream_t **link = &g_streams[stream_bucket(stream)];
+    while (*link != NULL && (*link)->stream != stream) link = &(*link)->next;
+    fakeCufileStream_t *s = *link;
+    if (s != NULL) {
+        while (s->pending > 0) pthread_cond_wait(&s->idle, &g_async_lock);
+        *link = s->next;
+    }
+    pthread_mutex_unlock(&g_async_lock);
+    if (s == NULL) return CUFILE_ERR(CU_FILE_INVALID_VALUE);
+    pthread_cond_destroy(&s->idle);
+    free(s);
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+// --- Driver ---
+static pthread_mutex_t g_driver_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_driver_open = 0;
+
+static void driver_open_locked(void) {
+    if (g_driver_open) return;
+    g_driver_open = 1;
+    const char *mode = access("/dev/nvidia-fs0", F_OK) == 0 ? "nvidia-fs" : "compat";
+    if (getenv("FAKE_CUFILE_DEBUG") != NULL)
+        fprintf(stderr, "[FAKE-CUFILE %d] driver open (%s mode, io_uring %s)\n", getpid(), mode,
+                ring_get() != NULL ? "on" : "off");
+}
+
+CUfileError_t cuFileDriverOpen(void) {
+    pthread_mutex_lock(&g_driver_lock);
+    driver_open_locked();
+    pthread_mutex_unlock(&g_driver_lock);
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+CUfileError_t cuFileDriverClose(void) {
+    pthread_mutex_lock(&g_driver_lock);
+    int was_open = g_driver_open;
+    g_driver_open = 0;
+    pthread_mutex_unlock(&g_driver_lock);
+    if (!was_open) return CUFILE_ERR(CU_FILE_DRIVER_NOT_INITIALIZED);
+    async_stop();
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+CUfileError_t cuFileDriverClose_v2(void) {
+    return cuFileDriverClose();
+}
+
+CUfileError_t cuFileGetVersion(int *version) {
+    if (version == NULL) return CUFILE_ERR(CU_FILE_INVALID_VALUE);
+    *version = CUFILE_VERSION;
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+// Like the real library, the first handle registration opens the driver implicitly.
+CUfileError_t cuFileHandleRegister(CUfileHandle_t *fh, CUfileDescr_t *descr) {
+    if (fh == NULL || descr == NULL) return CUFILE_ERR(CU_FILE_INVALID_VALUE);
+    if (descr->type != CU_FILE_HANDLE_TYPE_OPAQUE_FD) return CUFILE_ERR(CU_FILE_INVALID_FILE_TYPE);
+    int fd = descr->handle.fd;
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0) return CUFILE_ERR(CU_FILE_INVALID_VALUE);
+    if ((fl & O_ACCMODE) != O_RDONLY && (fl & O_APPEND)) return CUFILE_ERR(CU_FILE_INVALID_FILE_OPEN_FLAG);
+
+    pthread_mutex_lock(&g_driver_lock);
+    driver_open_locked();
+    pthread_mutex_unlock(&g_driver_lock);
+
+    fakeCufileHandle_t *h = calloc(1, sizeof(*h));
+    if (h == NULL) return CUFILE_ERR(CU_FILE_INTERNAL_ERROR);
+    h->fd = fd;
+    if (fl & O_DIRECT) {
+        h->direct_fd = fd;
+        h->buffered_fd = reopen_fd(fd, fl & O_ACCMODE);
+        h->own_buffered = h->buffered_fd >= 0;
+        if (h->buffered_fd < 0) h->buffered_fd = fd;
+    } else {
+        h->buffered_fd = fd;
+        h->direct_fd = reopen_fd(fd, (fl & O_ACCMODE) | O_DIRECT);
+        h->own_direct = h->direct_fd >= 0;
+    }
+    *fh = h;
+    return CUFILE_ERR(CU_FILE_SUCCESS);
+}
+
+void cuFileHandleDeregister(CUfileHandle_t fh) {
+    fakeCufileHandle_t *h = fh;
+    if (h == NULL) return;
+    if (h->own_direct) close(h->direct_fd);
+    if (h->own_buffered) close(h->buffered_fd);
+    free(h);
+}
+
+const char *cufileop_status_error(CUfileOpError status) {
+    switch (status) {
+    case CU_FILE_SUCCESS: return "cufile success";
+    case CU_FILE_DRIVER_NOT_INITIALIZED: return "nvidia-fs driver is not loaded";
+    case CU_FILE_INVALID_FILE_TYPE: return "unsupported file type";
+    case CU_FILE_INVALID_FILE_OPEN_FLAG: return "unsupported file open flags";
+    case CU_FILE_INVALID_VALUE: return "invalid arguments";
+    case CU_FILE_MEMORY_ALREADY_REGISTERED: return "device pointer already registered";
+    case CU_FILE_MEMORY_NOT_REGISTERED: return "device pointer lookup failure";
+    case CU_FILE_HANDLE_NOT_REGISTERED: return "file descriptor is not registered";
+    case CU_FILE_INTERNAL_ERROR: return "internal error";
+    case CU_FILE_ASYNC_NOT_SUPPORTED: return "async IO not supported";
+    default: return "unknown cufile error";
+    }
+}
+
+// --- Setup and Exit Report ---
+__attribute__((constructor))
+static void cufile_init(void) {
+    g_max_io = env_ulong("FAKE_CUFILE_MAX_IO_KB", FAKE_CUFILE_DEFAULT_MAX_IO_KB, 4, 1UL << 20) * 1024;
+    // io_uring takes a 32-bit length per operation.
+    if (g_max_io > (1UL << 30)) g_max_io = 1UL << 30;
+    g_async_threads = (unsigned int)env_ulong("FAKE_CUFILE_ASYNC_THREADS", FAKE_CUFILE_DEFAULT_ASYNC_THREADS, 1,
+                                              FAKE_CUFILE_MAX_ASYNC_THREADS);
+}
+
+// Latency percentile estimated from the histogram, as in the profiling interposer.
+static unsigned long long stats_percentile(const fakeNvmlSymStats_t *st, double q) {
+    unsigned long long rank = (unsigned long long)(q * (double)st->calls);
+    unsigned long long seen = 0;
+    for (unsigned int b = 0; b < FAKE_NVML_STATS_BUCKETS; ++b) {
+        seen += st->hist[b];
+        if (seen > rank) return (2ULL << b) < st->max_ns ? (2ULL << b) : st->max_ns;
+    }
+    return st->max_ns;
+}
+
+__attribute__((destructor))
+static void cufile_report(void) {
+    const char *on = getenv("FAKE_CUFILE_STATS");
+    if (on == NULL || strcmp(on, "1") != 0) return;
+    FILE *out = stderr;
+    const char *path = getenv("FAKE_CUFILE_STATS_OUT");
+    if (path != NULL && path[0] != '\0') {
+        out = fopen(path, "a");
+        if (out == NULL) out = stderr;
+    }
+
+    fprintf(out, "[FAKE-CUFILE %d] I/O profile\n", getpid());
+    fprintf(out, "  %-18s %10s %8s %14s %10s %10s %10s %10s %10s %10s\n", "operation", "ops", "errors", "bytes",
+            "direct", "MiB/s", "mean_us", "p50_us", "p99_us", "max_us");
+    for (int i = 0; i < FAKE_CUFILE_OP_COUNT; ++i) {
+        const fakeCufileStats_t *st = &g_stats[i];
+        if (st->lat.calls == 0) continue;
+        fakeCufileOpStats_t s;
+        fake_cufile_stats_get((fakeCufileOp_t)i, &s);
+        double mibs = s.busy_ns ? (double)s.bytes / (1024.0 * 1024.0) / ((double)s.busy_ns / 1e9) : 0.0;
+        fprintf(out, "  %-18s %10llu %8llu %14llu %10llu %10.1f %10llu %10llu %10llu %10llu\n", g_op_names[i],
+                s.ops, s.errors, s.bytes, s.direct_ops, mibs, s.total_ns / s.ops / 1000,
+                stats_percentile(&st->lat, 0.50) / 1000, stats_percentile(&st->lat, 0.99) / 1000, s.max_ns / 1000);
+    }
+    if (out != stderr) fclose(out);
+}
@@ -0,0 +1,160 @@
+/**
+ * fake_cufile.h
+ *
+ * The subset of the GPUDirect Storage (cuFile) API implemented by libcufile.so (fake_cufile.c):
+ * driver open/close, file handle and buffer registration, and synchronous and stream-ordered
+ * reads and writes. Type names, values and signatures follow NVIDIA's cufile.h, so that a program
+ * built against either header runs against either library.
+ *
+ * "Device memory" is host memory here: any buffer the caller passes is read or written in place.
+ */
+#ifndef FAKE_CUFILE_H
+#define FAKE_CUFILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CUFILE_VERSION 1130
+
+// --- Status Codes ---
+typedef enum CUfileOpError {
+    CU_FILE_SUCCESS = 0,
+    CU_FILE_DRIVER_NOT_INITIALIZED = 5001,
+    CU_FILE_DRIVER_INVALID_PROPS = 5002,
+    CU_FILE_DRIVER_UNSUPPORTED_LIMIT = 5003,
+    CU_FILE_DRIVER_VERSION_MISMATCH = 5004,
+    CU_FILE_DRIVER_VERSION_READ_ERROR = 5005,
+    CU_FILE_DRIVER_CLOSING = 5006,
+    CU_FILE_PLATFORM_NOT_SUPPORTED = 5007,
+    CU_FILE_IO_NOT_SUPPORTED = 5008,
+    CU_FILE_DEVICE_NOT_SUPPORTED = 5009,
+    CU_FILE_NVFS_DRIVER_ERROR = 5010,
+    CU_FILE_CUDA_DRIVER_ERROR = 5011,
+    CU_FILE_CUDA_POINTER_INVALID = 5012,
+    CU_FILE_CUDA_MEMORY_TYPE_INVALID = 5013,
+    CU_FILE_CUDA_POINTER_RANGE_ERROR = 5014,
+    CU_FILE_CUDA_CONTEXT_MISMATCH = 5015,
+    CU_FILE_INVALID_MAPPING_SIZE = 5016,
+    CU_FILE_INVALID_MAPPING_RANGE = 5017,
+    CU_FILE_INVALID_FILE_TYPE = 5018,
+    CU_FILE_INVALID_FILE_OPEN_FLAG = 5019,
+    CU_FILE_DIO_NOT_SET = 5020,
+    CU_FILE_INVALID_VALUE = 5022,
+    CU_FILE_MEMORY_ALREADY_REGISTERED = 5023,
+    CU_FILE_MEMORY_NOT_REGISTERED = 5024,
+    CU_FILE_PERMISSION_DENIED = 5025,
+    CU_FILE_DRIVER_ALREADY_OPEN = 5026,
+    CU_FILE_HANDLE_NOT_REGISTERED = 5027,
+    CU_FILE_HANDLE_ALREADY_REGISTERED = 5028,
+    CU_FILE_DEVICE_NOT_FOUND = 5029,
+    CU_FILE_INTERNAL_ERROR = 5030,
+    CU_FILE_GETNEWFD_FAILED = 5031,
+    CU_FILE_NVFS_SETUP_ERROR = 5033,
+    CU_FILE_IO_DISABLED = 5034,
+    CU_FILE_BATCH_SUBMIT_FAILED = 5035,
+    CU_FILE_GPU_MEMORY_PINNING_FAILED = 5036,
+    CU_FILE_BATCH_FULL = 5037,
+    CU_FILE_ASYNC_NOT_SUPPORTED = 5038,
+    CU_FILE_IO_MAX_ERROR = 5039,
+} CUfileOpError;
+
+#ifndef __cuda_cuda_h__
+typedef int CUresult;
+typedef struct CUstream_st *CUstream;
+#endif
+
+typedef struct CUfileError {
+    CUfileOpError err;
+    CUresult cu_err; // always 0: there is no CUDA driver underneath
+} CUfileError_t;
+
+#define IS_CUFILE_ERR(err) ((err) != CU_FILE_SUCCESS)
+#define CUFILE_ERRSTR(err) cufileop_status_error((CUfileOpError)(err))
+
+// --- Handles ---
+typedef enum CUfileFileHandleType {
+    CU_FILE_HANDLE_TYPE_OPAQUE_FD = 1,
+    CU_FILE_HANDLE_TYPE_OPAQUE_WIN32 = 2,
+    CU_FILE_HANDLE_TYPE_USERSPACE_FS = 3,
+} CUfileFileHandleType;
+
+typedef struct CUfileFSOps CUfileFSOps_t; // user-space file systems are not supported
+
+typedef struct CUfileDescr_t {
+    CUfileFileHandleType type;
+    union {
+        int fd;
+        void *handle;
+    } handle;
+    const CUfileFSOps_t *fs_ops;
+} CUfileDescr_t;
+
+typedef void *CUfileHandle_t;
+
+// --- API ---
+const char *cufileop_status_error(CUfileOpError status);
+
+CUfileError_t cuFileDriverOpen(void);
+CUfileError_t cuFileDriverClose(void);
+CUfileError_t cuFileDriverClose_v2(void);
+CUfileError_t cuFileGetVersion(int *version);
+
+CUfileError_t cuFileHandleRegister(CUfileHandle_t *fh, CUfileDescr_t *descr);
+void cuFileHandleDeregister(CUfileHandle_t fh);
+
+CUfileError_t cuFileBufRegister(const void *bufPtr_base, size_t length, int flags);
+CUfileError_t cuFileBufDeregister(const void *bufPtr_base);
+
+// Bytes transferred (short at end of file), -1 with errno set on a system error, or the negated
+// CUfileOpError.
+ssize_t cuFileRead(CUfileHandle_t fh, void *bufPtr_base, size_t size, off_t file_offset, off_t bufPtr_offset);
+ssize_t cuFileWrite(CUfileHandle_t fh, const void *bufPtr_base, size_t size, off_t file_offset,
+                    off_t bufPtr_offset);
+
+// Stream-ordered variants. The parameters are read through their pointers when the operation
+// reaches the head of `stream`, and the result is stored in *bytes_read_p / *bytes_written_p:
+// bytes transferred, a negated errno, or a negated CUfileOpError. A NULL stream is the default
+// stream.
+CUfileError_t cuFileReadAsync(CUfileHandle_t fh, void *bufPtr_base, size_t *size_p, off_t *file_offset_p,
+                              off_t *bufPtr_offset_p, ssize_t *bytes_read_p, CUstream stream);
+CUfileError_t cuFileWriteAsync(CUfileHandle_t fh, void *bufPtr_base, size_t *size_p, off_t *file_offset_p,
+                               off_t *bufPtr_offset_p, ssize_t *bytes_written_p, CUstream stream);
+CUfileError_t cuFileStreamRegister(CUstream stream, unsigned flags);
+CUfileError_t cuFileStreamDeregister(CUstream stream);
+
+// --- Extensions ---
+// Not part of the cuFile API; looked up with dlsym() by the other fake libraries.
+
+// Block until every operation queued on `stream` has completed.
+CUfileError_t fake_cufile_stream_synchronize(CUstream stream);
+
+typedef enum {
+    FAKE_CUFILE_OP_READ,
+    FAKE_CUFILE_OP_WRITE,
+    FAKE_CUFILE_OP_READ_ASYNC,
+    FAKE_CUFILE_OP_WRITE_ASYNC,
+    FAKE_CUFILE_OP_COUNT
+} fakeCufileOp_t;
+
+typedef struct {
+    unsigned long long ops;
+    unsigned long long errors;
+    unsigned long long bytes;
+    unsigned long long direct_ops;   // operations served entirely with O_DIRECT
+    unsigned long long total_ns;     // latency; for async operations, from enqueue to completion
+    unsigned long long max_ns;
+    unsigned long long busy_ns;      // first start to last completion, for throughput
+} fakeCufileOpStats_t;
+
+// Snapshot of the counters of one operation kind since the library was loaded.
+CUfileError_t fake_cufile_stats_get(fakeCufileOp_t op, fakeCufileOpStats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_CUFILE_H
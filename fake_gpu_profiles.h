@@ -0,0 +1,163 @@
+/**
+ * fake_gpu_profiles.h
+ *
+ * What the fake GPUs know about each GPU model: the compute capability, architecture, brand and
+ * memory size that NVML (fake_nvml.c), the kernel module's state page (fake_nvidia_driver.c) and
+ * libcuda (fake_cuda.c) report, libcuda's device attributes, and the PCIe and NVLink links that
+ * libcuda's copies are timed against. A GPU is matched by the words of its name, so the NVML name
+ * set by the module or the node configuration selects the profile everywhere.
+ *
+ * NVLink GPUs are modelled as HGX boards: every link goes to the NVSwitch fabric, so any two
+ * NVLink GPUs of a node reach each other with the links of the one that has fewer. The PCIe
+ * variants of the same chips have no NVLink.
+ *
+ * Also built into the kernel module: no libc, no floating point outside the userspace helpers.
+ */
+#ifndef FAKE_GPU_PROFILES_H
+#define FAKE_GPU_PROFILES_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#endif
+
+// Payload bandwidth of one PCIe lane per generation, in MB/s (after 128b/130b encoding), and the
+// share of it that bulk copies achieve after packet overhead.
+#define FAKE_GPU_PCIE_LANE_MBPS(gen) ((gen) >= 5 ? 3938 : (gen) == 4 ? 1969 : (gen) == 3 ? 985 : 500)
+#define FAKE_GPU_PCIE_EFFICIENCY 0.80
+// Per link and direction, for NVLink 2 to 4, in MB/s, and the share achieved by copies.
+#define FAKE_GPU_NVLINK_MBPS 25000
+#define FAKE_GPU_NVLINK_EFFICIENCY 0.90
+// NVML_NVLINK_MAX_LINKS
+#define FAKE_GPU_NVLINK_MAX 18
+
+// nvmlDeviceArchitecture_t and nvmlBrandType_t values, for the module, which has no NVML header.
+#define FAKE_GPU_ARCH_VOLTA 5
+#define FAKE_GPU_ARCH_TURING 6
+#define FAKE_GPU_ARCH_AMPERE 7
+#define FAKE_GPU_ARCH_ADA 8
+#define FAKE_GPU_ARCH_HOPPER 9
+#define FAKE_GPU_BRAND_TESLA 2
+#define FAKE_GPU_BRAND_NVIDIA 14
+
+typedef struct {
+    const char *match; // words that must all appear in the GPU name, case-insensitively
+    int cc_major, cc_minor;
+    int architecture;  // FAKE_GPU_ARCH_*
+    int brand;         // FAKE_GPU_BRAND_*
+    int memory_gib;    // unless the name says otherwise ("80GB")
+    int sm_count;
+    int clock_khz, memory_clock_khz;
+    int bus_width;
+    int l2_bytes;
+    int smem_per_sm, smem_per_block_optin;
+    int threads_per_sm;
+    int pcie_gen, pcie_width;
+    int nvlinks;        // links to the NVSwitch fabric; 0 for PCIe-only boards
+    int nvlink_version;
+} fakeGpuProfile_t;
+
+// First match wins: the PCIe variant of a chip comes before the SXM part, which matches any name
+// with the chip's word. The last entry is the default.
+static const fakeGpuProfile_t g_fake_gpu_profiles[] = {
+    {"H100 PCIe", 9, 0, FAKE_GPU_ARCH_HOPPER, FAKE_GPU_BRAND_NVIDIA, 80, 114, 1755000, 1593000, 5120, 52428800,
+     233472, 232448, 2048, 5, 16, 0, 0},
+    {"H100", 9, 0, FAKE_GPU_ARCH_HOPPER, FAKE_GPU_BRAND_NVIDIA, 80, 132, 1980000, 2619000, 5120, 52428800,
+     233472, 232448, 2048, 5, 16, 18, 4},
+    {"A100 PCIe", 8, 0, FAKE_GPU_ARCH_AMPERE, FAKE_GPU_BRAND_NVIDIA, 40, 108, 1410000, 1215000, 5120, 41943040,
+     167936, 166912, 2048, 4, 16, 0, 0},
+    {"A100", 8, 0, FAKE_GPU_ARCH_AMPERE, FAKE_GPU_BRAND_NVIDIA, 40, 108, 1410000, 1215000, 5120, 41943040,
+     167936, 166912, 2048, 4, 16, 12, 3},
+    {"A10G", 8, 6, FAKE_GPU_ARCH_AMPERE, FAKE_GPU_BRAND_NVIDIA, 24, 80, 1710000, 6251000, 384, 6291456,
+     102400, 101376, 1536, 4, 16, 0, 0},
+    {"A10", 8, 6, FAKE_GPU_ARCH_AMPERE, FAKE_GPU_BRAND_NVIDIA, 24, 72, 1695000, 6251000, 384, 6291456,
+     102400, 101376, 1536, 4, 16, 0, 0},
+    {"V100S PCIe", 7, 0, FAKE_GPU_ARCH_VOLTA, FAKE_GPU_BRAND_TESLA, 32, 80, 1597000, 1107000, 4096, 6291456,
+     98304, 98304, 2048, 3, 16, 0, 0},
+    {"V100 PCIe", 7, 0, FAKE_GPU_ARCH_VOLTA, FAKE_GPU_BRAND_TESLA, 16, 80, 1380000, 877000, 4096, 6291456,
+     98304, 98304, 2048, 3, 16, 0, 0},
+    {"V100", 7, 0, FAKE_GPU_ARCH_VOLTA, FAKE_GPU_BRAND_TESLA, 16, 80, 1530000, 877000, 4096, 6291456,
+     98304, 98304, 2048, 3, 16, 6, 2},
+    {"L40S", 8, 9, FAKE_GPU_ARCH_ADA, FAKE_GPU_BRAND_NVIDIA, 48, 142, 2520000, 9001000, 384, 100663296,
+     102400, 101376, 1536, 4, 16, 0, 0},
+    {"L40", 8, 9, FAKE_GPU_ARCH_ADA, FAKE_GPU_BRAND_NVIDIA, 48, 142, 2490000, 9001000, 384, 100663296,
+     102400, 101376, 1536, 4, 16, 0, 0},
+    {"L4", 8, 9, FAKE_GPU_ARCH_ADA, FAKE_GPU_BRAND_NVIDIA, 24, 58, 2040000, 6251000, 192, 50331648,
+     102400, 101376, 1536, 4, 16, 0, 0},
+    {"T4", 7, 5, FAKE_GPU_ARCH_TURING, FAKE_GPU_BRAND_TESLA, 16, 40, 1590000, 5001000, 256, 4194304,
+     65536, 65536, 1024, 3, 16, 0, 0},
+};
+#define FAKE_GPU_PROFILE_COUNT (sizeof(g_fake_gpu_profiles) / sizeof(g_fake_gpu_profiles[0]))
+
+static inline char fake_gpu_upper(char c) {
+    return c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c;
+}
+
+// Words of a GPU name are separated by spaces and dashes: "Tesla V100-PCIE-32GB".
+static inline int fake_gpu_word_end(char c) {
+    return c == '\0' || c == ' ' || c == '-';
+}
+
+// Whether `name` has the word of `len` characters at `word`, ignoring case.
+static inline int fake_gpu_name_has(const char *name, const char *word, size_t len) {
+    while (*name) {
+        const char *end = name;
+        size_t i = 0;
+        while (!fake_gpu_word_end(*end)) end++;
+        if ((size_t)(end - name) == len) {
+            while (i < len && fake_gpu_upper(name[i]) == fake_gpu_upper(word[i])) i++;
+            if (i == len) return 1;
+        }
+        name = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static inline int fake_gpu_profile_matches(const fakeGpuProfile_t *p, const char *name) {
+    const char *word = p->match;
+    while (*word) {
+        const char *end = word;
+        while (*end && *end != ' ') end++;
+        if (!fake_gpu_name_has(name, word, (size_t)(end - word))) return 0;
+        word = *end ? end + 1 : end;
+    }
+    return 1;
+}
+
+static inline const fakeGpuProfile_t *fake_gpu_profile(const char *name) {
+    size_t i;
+    for (i = 0; i < FAKE_GPU_PROFILE_COUNT; i++) {
+        if (fake_gpu_profile_matches(&g_fake_gpu_profiles[i], name)) return &g_fake_gpu_profiles[i];
+    }
+    return &g_fake_gpu_profiles[FAKE_GPU_PROFILE_COUNT - 1];
+}
+
+// Device memory of a GPU named `name`: a "<N>GB" word in the name picks the memory variant of the
+// model ("NVIDIA A100-SXM4-80GB"), else the profile's size.
+static inline unsigned long long fake_gpu_memory_bytes(const fakeGpuProfile_t *p, const char *name) {
+    while (*name) {
+        const char *end = name;
+        unsigned long long gib = 0;
+        while (*end >= '0' && *end <= '9' && gib < (1ULL << 20)) gib = gib * 10 + (unsigned long long)(*end++ - '0');
+        if (end > name && gib > 0 && gib < (1ULL << 20) && fake_gpu_upper(end[0]) == 'G' &&
+            fake_gpu_upper(end[1]) == 'B' && fake_gpu_word_end(end[2]))
+            return gib << 30;
+        while (!fake_gpu_word_end(*end)) end++;
+        name = *end ? end + 1 : end;
+    }
+    return (unsigned long long)p->memory_gib << 30;
+}
+
+#ifndef __KERNEL__
+// Bulk copy bandwidth of a GPU's PCIe link per direction, and of its NVLinks together, in bytes/s.
+static inline double fake_gpu_pcie_bandwidth(const fakeGpuProfile_t *p) {
+    return (double)FAKE_GPU_PCIE_LANE_MBPS(p->pcie_gen) * p->pcie_width * 1e6 * FAKE_GPU_PCIE_EFFICIENCY;
+}
+
+static inline double fake_gpu_nvlink_bandwidth(const fakeGpuProfile_t *p) {
+    return (double)FAKE_GPU_NVLINK_MBPS * p->nvlinks * 1e6 * FAKE_GPU_NVLINK_EFFICIENCY;
+}
+#endif
+
+#endif // FAKE_GPU_PROFILES_H
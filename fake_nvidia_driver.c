@@ -1,67 +1,2384 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/bitmap.h>
+#include <linux/capability.h>
+#include <linux/cdev.h>
+#include <linux/compat.h>
+#include <linux/configfs.h>
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/device_cgroup.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/nodemask.h>
+#include <linux/pci.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
 #include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/xarray.h>
+
+#include "fake_gpu_profiles.h"
+#include "fake_nvidia_uapi.h"
+
+#define CREATE_TRACE_POINTS
+#include "fake_nvidia_trace.h"
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,17,0)
+#define pde_data PDE_DATA
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,16,0)
+typedef unsigned int __poll_t;
+#define EPOLLIN POLLIN
+#define EPOLLRDNORM POLLRDNORM
+#define EPOLLOUT POLLOUT
+#define EPOLLWRNORM POLLWRNORM
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,3,0)
+static inline void vm_flags_set(struct vm_area_struct *vma, vm_flags_t flags) {
+    vma->vm_flags |= flags;
+}
+
+static inline void vm_flags_clear(struct vm_area_struct *vma, vm_flags_t flags) {
+    vma->vm_flags &= ~flags;
+}
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,17,0)
+typedef int vm_fault_t;
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,13,0)
+static inline void hrtimer_setup(struct hrtimer *timer, enum hrtimer_restart (*function)(struct hrtimer *),
+                                 clockid_t clock_id, enum hrtimer_mode mode) {
+    hrtimer_init(timer, clock_id, mode);
+    timer->function = function;
+}
+#endif
+
+// devcgroup_check_permission() covers both the cgroup v1 allowlist and cgroup v2 device programs
+// as an exported function since 5.9.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+#define FAKE_CGROUP_FILTER_SUPPORTED 1
+#endif
+
+// The virtual PCI bus picks the PCI domain of its root buses through the x86 pci_sysdata.
+#if defined(CONFIG_X86) && defined(CONFIG_PCI_DOMAINS) && LINUX_VERSION_CODE >= KERNEL_VERSION(4,20,0)
+#define FAKE_PCI_SUPPORTED 1
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,4,0)
+#define fake_class_create(name) class_create(name)
+#else
+#define fake_class_create(name) class_create(THIS_MODULE, name)
+#endif
+
+// Default driver version; the Makefile passes NVIDIA_DRIVER_VERSION so that it matches the shim.
+#ifndef FAKE_DRIVER_VERSION
+#define FAKE_DRIVER_VERSION "535.104.05"
+#endif
+// Same limit as the shim (FAKE_GPU_MAX in fake_nvml.c).
+#define FAKE_GPU_MAX 65535
+
+// Device numbers of the real driver: /dev/nvidia<minor> and the control nodes share major 195;
+// nvidia-uvm gets a dynamic major with /dev/nvidia-uvm at minor 0 and -tools at minor 1.
+#define NV_MAJOR_DEVICE_NUMBER 195
+#define NV_MINOR_DEVICE_COUNT 256
+#define NV_CONTROL_DEVICE_MINOR 255
+#define NV_MODESET_DEVICE_MINOR 254
+// GPUs with a minor at or above this have /proc entries but no device node.
+#define NV_GPU_DEVICE_MINOR_LIMIT NV_MODESET_DEVICE_MINOR
+#define NV_UVM_MINOR_COUNT 2
+// /dev/nvidia-fs0..15, with a dynamic major, as the GPUDirect Storage module creates them.
+#define NV_FS_MINOR_COUNT 16
+// The state page covers at least this many GPU minors (see Shared State Page).
+#define FAKE_STATE_MIN_SLOTS 256
+// Highest telemetry_hz; one tick walks every present slot.
+#define FAKE_TELEMETRY_MAX_HZ 1000
+// Events queued per reader of /dev/fake-nvidia-events before it starts missing them.
+#define FAKE_EVENT_QUEUE_LEN 256
+
+// --- Module Parameters ---
+// Read at load time, e.g.:
+//   modprobe fake_nvidia_driver gpu_count=8 model="NVIDIA A100-SXM4-80GB"
+//   modprobe fake_nvidia_driver gpu_count=2 bus_ids=0000:3b:00.0,0000:5e:00.0
+static unsigned int gpu_count = 4;
+module_param(gpu_count, uint, 0444);
+MODULE_PARM_DESC(gpu_count, "Number of fake GPUs (default 4, at most 65535)");
+
+static char *bus_ids = "";
+module_param(bus_ids, charp, 0444);
+MODULE_PARM_DESC(bus_ids, "Comma-separated PCI bus IDs (DDDD:BB:DD.F) of the GPUs, in index order; "
+                          "GPUs without one get the shim's default, bus index+1");
+
+static char *model = "NVIDIA Tesla T4";
+module_param(model, charp, 0444);
+MODULE_PARM_DESC(model, "Model name reported for every GPU");
+
+static char *driver_version = FAKE_DRIVER_VERSION;
+module_param(driver_version, charp, 0444);
+MODULE_PARM_DESC(driver_version, "Driver version reported in /proc/driver/nvidia/version");
+
+static unsigned int telemetry_hz = 0;
+module_param(telemetry_hz, uint, 0444);
+MODULE_PARM_DESC(telemetry_hz, "Rate at which the module advances the telemetry of every GPU "
+                               "(default 0: off, telemetry only changes through the ioctl; at most 1000)");
+
+static bool pci_bus = false;
+module_param(pci_bus, bool, 0444);
+MODULE_PARM_DESC(pci_bus, "Expose every GPU as a PCI function at its bus ID on a virtual PCI bus "
+                          "(default 0; x86 only)");
+
+static bool cgroup_filter = false;
+module_param(cgroup_filter, bool, 0444);
+MODULE_PARM_DESC(cgroup_filter, "Hide GPUs whose /dev/nvidia<minor> the reader's device cgroup denies from "
+                                "/proc/driver/nvidia and the event channel (default 0: list all, like the "
+                                "real driver)");
+
+static unsigned int bar1_size_mb = 256;
+module_param(bar1_size_mb, uint, 0444);
+MODULE_PARM_DESC(bar1_size_mb, "Size of the BAR1 region each /dev/nvidia<minor> maps, in MiB (default 256, "
+                               "as on a T4); pages are allocated when first touched");
+
+// The real driver's NVreg_* options that its clients read back from /proc/driver/nvidia/params
+// and registry, under the real names so that existing modprobe.d lines apply unchanged.
+// nvidia-container-cli and nvidia-modprobe read the device file settings to decide how to
+// create device nodes; DeviceFileMode also sets the mode of the nodes this module creates.
+static unsigned int NVreg_ModifyDeviceFiles = 1;
+module_param(NVreg_ModifyDeviceFiles, uint, 0444);
+MODULE_PARM_DESC(NVreg_ModifyDeviceFiles, "Whether clients may create and chmod /dev/nvidia* (default 1)");
+
+static unsigned int NVreg_DeviceFileUID = 0;
+module_param(NVreg_DeviceFileUID, uint, 0444);
+MODULE_PARM_DESC(NVreg_DeviceFileUID, "Owner reported for /dev/nvidia* (default 0)");
+
+static unsigned int NVreg_DeviceFileGID = 0;
+module_param(NVreg_DeviceFileGID, uint, 0444);
+MODULE_PARM_DESC(NVreg_DeviceFileGID, "Group reported for /dev/nvidia* (default 0)");
+
+static unsigned int NVreg_DeviceFileMode = 0666;
+module_param(NVreg_DeviceFileMode, uint, 0444);
+MODULE_PARM_DESC(NVreg_DeviceFileMode, "Mode of /dev/nvidia* (default 0666)");
+
+static char *NVreg_RegistryDwords = "";
+module_param(NVreg_RegistryDwords, charp, 0444);
+MODULE_PARM_DESC(NVreg_RegistryDwords, "Semicolon-separated key=value registry entries, listed in "
+                                       "/proc/driver/nvidia/registry");
+
+// --- GPU Registry ---
+// Every fake GPU, whether created at load time from the parameters above or at runtime through
+// configfs, is a struct fake_gpu on g_gpus, kept in minor-number order. Publishing a GPU creates
+// its /proc/driver/nvidia/gpus/<bus id> entry and links it into the registry under g_gpus_lock;
+// either all of it happens or none, so readers of the registry never see a half-created GPU.
+// The proc files render from the entry on every read, so a read costs a few seq_printf calls
+// regardless of the number of GPUs.
+struct fake_pci_bus;
+struct fake_bar1;
+
+struct fake_gpu {
+    struct list_head node;
+    unsigned int minor;
+    char bus_id[16]; // "DDDD:BB:DD.F", lower case, as the real driver names the proc directory
+    char uuid[48];
+    char model[64];
+    unsigned int defaults; // FAKE_GPU_DEFAULT_* fields filled in at publish, cleared at unpublish
+    struct proc_dir_entry *proc_dir;
+    struct device *dev; // /dev/nvidia<minor>, NULL past NV_GPU_DEVICE_MINOR_LIMIT
+    struct fake_bar1 *bar1;
+    // Its function on the virtual PCI bus; pci_bus is NULL when it has none.
+    struct fake_pci_bus *pci_bus;
+    struct list_head pci_node;
+    unsigned int pci_devfn;
+    u16 pci_command;
+};
+
+#define FAKE_GPU_DEFAULT_BUS_ID (1u << 0)
+#define FAKE_GPU_DEFAULT_UUID (1u << 1)
+#define FAKE_GPU_DEFAULT_MODEL (1u << 2)
+
+static LIST_HEAD(g_gpus);
+static DEFINE_MUTEX(g_gpus_lock);
+static DECLARE_BITMAP(g_gpu_minors, FAKE_GPU_MAX);
+
+// --- Access Counters ---
+// How often each /proc file and device node of the module is used, for attributing the cost of a
+// container start: /sys/kernel/debug/fake_nvidia/counters lists them, and writing to it resets
+// them. The counters are per CPU so that concurrent container starts do not bounce a shared cache
+// line; a read sums them. The tracepoints of fake_nvidia_trace.h carry the caller of each access.
+enum fake_stat {
+    FAKE_STAT_PROC_VERSION,
+    FAKE_STAT_PROC_INFORMATION,
+    FAKE_STAT_PROC_FAKE_GPUS,
+    FAKE_STAT_PROC_PARAMS,
+    FAKE_STAT_PROC_REGISTRY,
+    FAKE_STAT_PROC_CAPABILITIES,
+    FAKE_STAT_OPEN_GPU,
+    FAKE_STAT_OPEN_CTL,
+    FAKE_STAT_OPEN_MODESET,
+    FAKE_STAT_OPEN_UVM,
+    FAKE_STAT_OPEN_UVM_TOOLS,
+    FAKE_STAT_OPEN_NVFS,
+    FAKE_STAT_OPEN_EVENTS,
+    FAKE_STAT_MMAP,
+    FAKE_STAT_IOCTL,
+    FAKE_STAT_BAR1_FAULT,
+    FAKE_STAT_COUNT,
+};
+
+static const char *const g_stat_names[FAKE_STAT_COUNT] = {
+    [FAKE_STAT_PROC_VERSION]      = "proc_read_version",
+    [FAKE_STAT_PROC_INFORMATION]  = "proc_read_information",
+    [FAKE_STAT_PROC_FAKE_GPUS]    = "proc_read_fake_gpus",
+    [FAKE_STAT_PROC_PARAMS]       = "proc_read_params",
+    [FAKE_STAT_PROC_REGISTRY]     = "proc_read_registry",
+    [FAKE_STAT_PROC_CAPABILITIES] = "proc_read_capabilities",
+    [FAKE_STAT_OPEN_GPU]          = "open_nvidia_gpu",
+    [FAKE_STAT_OPEN_CTL]          = "open_nvidiactl",
+    [FAKE_STAT_OPEN_MODESET]      = "open_nvidia_modeset",
+    [FAKE_STAT_OPEN_UVM]          = "open_nvidia_uvm",
+    [FAKE_STAT_OPEN_UVM_TOOLS]    = "open_nvidia_uvm_tools",
+    [FAKE_STAT_OPEN_NVFS]         = "open_nvidia_fs",
+    [FAKE_STAT_OPEN_EVENTS]       = "open_fake_nvidia_events",
+    [FAKE_STAT_MMAP]              = "mmap",
+    [FAKE_STAT_IOCTL]             = "ioctl",
+    [FAKE_STAT_BAR1_FAULT]        = "bar1_fault",
+};
+
+struct fake_stats {
+    u64 count[FAKE_STAT_COUNT];
+};
+
+static DEFINE_PER_CPU(struct fake_stats, g_stats);
+static struct dentry *g_debugfs_dir = NULL;
+
+static inline void fake_stat_inc(enum fake_stat stat) {
+    this_cpu_inc(g_stats.count[stat]);
+}
+
+static int fake_stats_show(struct seq_file *m, void *v) {
+    unsigned int i;
+    int cpu;
+
+    for (i = 0; i < FAKE_STAT_COUNT; i++) {
+        u64 sum = 0;
+
+        for_each_possible_cpu(cpu)
+            sum += per_cpu(g_stats, cpu).count[i];
+        seq_printf(m, "%s %llu\n", g_stat_names[i], sum);
+    }
+    return 0;
+}
+
+static int fake_stats_open(struct inode *inode, struct file *file) {
+    return single_open(file, fake_stats_show, NULL);
+}
+
+// Any write resets the counters. Increments racing with it on other CPUs may survive.
+static ssize_t fake_stats_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(&g_stats, cpu), 0, sizeof(struct fake_stats));
+    return count;
+}
+
+static const struct file_operations g_stats_fops = {
+    .owner   = THIS_MODULE,
+    .open    = fake_stats_open,
+    .read    = seq_read,
+    .write   = fake_stats_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+// debugfs failures are not fatal: the module works the same without its counters.
+static void fake_stats_register(void) {
+    g_debugfs_dir = debugfs_create_dir("fake_nvidia", NULL);
+    debugfs_create_file("counters", 0600, g_debugfs_dir, NULL, &g_stats_fops);
+}
+
+static void fake_stats_unregister(void) {
+    debugfs_remove_recursive(g_debugfs_dir);
+    g_debugfs_dir = NULL;
+}
 
 // We just need a pointer to the root of the directory we create.
 static struct proc_dir_entry *g_proc_nvidia_dir = NULL;
+static struct proc_dir_entry *g_proc_gpus_dir = NULL;
+
+// GPU i sits at bus i+1, carrying into the PCI domain past bus 255, like the shim's defaults.
+static void fake_gpu_default_bus_id(unsigned int i, char *buf, size_t len) {
+    snprintf(buf, len, "%04x:%02x:00.0", (i + 1) >> 8, (i + 1) & 0xff);
+}
+
+// Parse "DDDD:BB:DD.F" (hex) into its normalized form; a trailing newline is accepted.
+static int fake_gpu_parse_bus_id(const char *text, char *buf, size_t len) {
+    unsigned int domain, bus, device, function;
+    char end = '\n', extra;
+    int n = sscanf(text, "%x:%x:%x.%x%c%c", &domain, &bus, &device, &function, &end, &extra);
+
+    if (n < 4 || n > 5 || end != '\n' || domain > 0xffff || bus > 0xff || device > 0x1f || function > 0x7)
+        return -EINVAL;
+    snprintf(buf, len, "%04x:%02x:%02x.%x", domain, bus, device, function);
+    return 0;
+}
+
+// --- GPU Visibility ---
+// With cgroup_filter=1 a reader only sees the GPUs whose device node its device cgroup lets it
+// read, as if the driver were namespaced: a container granted /dev/nvidia1 sees GPU 1 only. GPUs
+// without a node (minor at or above NV_GPU_DEVICE_MINOR_LIMIT) are hidden from filtered readers,
+// since no allowlist entry can name them. The allowlist is evaluated once, when a file is opened,
+// for every minor; the per-GPU checks afterwards are bit tests, also for GPUs added later and from
+// the event channel's atomic context.
+struct fake_gpu_view {
+    bool all;
+    DECLARE_BITMAP(visible, NV_GPU_DEVICE_MINOR_LIMIT);
+};
+
+static bool fake_gpu_allowed(unsigned int minor) {
+#ifdef FAKE_CGROUP_FILTER_SUPPORTED
+    if (!cgroup_filter)
+        return true;
+    return minor < NV_GPU_DEVICE_MINOR_LIMIT &&
+           devcgroup_check_permission(DEVCG_DEV_CHAR, NV_MAJOR_DEVICE_NUMBER, minor, DEVCG_ACC_READ) == 0;
+#else
+    return true;
+#endif
+}
+
+// Whether the caller may charge a GPU's memory or count its traffic through /dev/nvidiactl: its
+// device cgroup must let it open /dev/nvidia<minor> read-write, whatever cgroup_filter says, so a
+// container cannot exhaust or skew the GPUs of another. CAP_SYS_ADMIN may act on any GPU.
+static bool fake_gpu_usable(unsigned int minor) {
+#ifdef FAKE_CGROUP_FILTER_SUPPORTED
+    if (minor < NV_GPU_DEVICE_MINOR_LIMIT &&
+        devcgroup_check_permission(DEVCG_DEV_CHAR, NV_MAJOR_DEVICE_NUMBER, minor, DEVCG_ACC_READ | DEVCG_ACC_WRITE) == 0)
+        return true;
+    return capable(CAP_SYS_ADMIN);
+#else
+    return true;
+#endif
+}
+
+static void fake_gpu_view_init(struct fake_gpu_view *view) {
+    unsigned int minor;
+
+    view->all = !IS_ENABLED(FAKE_CGROUP_FILTER_SUPPORTED) || !cgroup_filter;
+    bitmap_zero(view->visible, NV_GPU_DEVICE_MINOR_LIMIT);
+    if (view->all)
+        return;
+    for (minor = 0; minor < NV_GPU_DEVICE_MINOR_LIMIT; minor++) {
+        if (fake_gpu_allowed(minor))
+            __set_bit(minor, view->visible);
+    }
+}
+
+static bool fake_gpu_view_test(const struct fake_gpu_view *view, unsigned int minor) {
+    return view->all || (minor < NV_GPU_DEVICE_MINOR_LIMIT && test_bit(minor, view->visible));
+}
+
+// --- /proc/driver/nvidia ---
+// This function is called when /proc/driver/nvidia/version is read.
+static int proc_version_show(struct seq_file *m, void *v) {
+    seq_printf(m, "Driver Version: %s\n", driver_version);
+    return 0;
+}
+
+// /proc/driver/nvidia/gpus/<bus id>/information, in the layout of the real driver.
+static int proc_information_show(struct seq_file *m, void *v) {
+    const struct fake_gpu *gpu = m->private;
+
+    seq_printf(m,
+               "Model: \t\t %s\n"
+               "IRQ:   \t\t 0\n"
+               "GPU UUID: \t %s\n"
+               "Video BIOS: \t 90.04.38.00.03\n"
+               "Bus Type: \t PCIe\n"
+               "DMA Size: \t 47 bits\n"
+               "DMA Mask: \t 0x7fffffffffff\n"
+               "Bus Location: \t %s\n"
+               "Device Minor: \t %u\n"
+               "GPU Excluded:\t No\n",
+               gpu->model, gpu->uuid, gpu->bus_id, gpu->minor);
+    return 0;
+}
+
+// /proc/driver/nvidia/params, in the real driver's "Name: value" layout. The options without a
+// module parameter report the 535 driver's defaults.
+static int proc_params_show(struct seq_file *m, void *v) {
+    static const struct {
+        const char *name;
+        unsigned int value;
+    } fixed[] = {
+        {"InitializeSystemMemoryAllocations", 1},
+        {"UsePageAttributeTable", 4294967295U},
+        {"EnableMSI", 1},
+        {"EnablePCIeGen3", 0},
+        {"MemoryPoolSize", 0},
+        {"KMallocHeapMaxSize", 0},
+        {"VMallocHeapMaxSize", 0},
+        {"IgnoreMMIOCheck", 0},
+        {"TCEBypassMode", 0},
+        {"EnableStreamMemOPs", 0},
+        {"EnableUserNUMAManagement", 1},
+        {"NvLinkDisable", 0},
+        {"RmProfilingAdminOnly", 1},
+        {"PreserveVideoMemoryAllocations", 0},
+        {"EnableS0ixPowerManagement", 0},
+        {"S0ixPowerManagementVideoMemoryThreshold", 256},
+        {"DynamicPowerManagement", 3},
+        {"DynamicPowerManagementVideoMemoryThreshold", 200},
+        {"RegisterPCIDriver", 1},
+        {"EnablePCIERelaxedOrderingMode", 0},
+        {"EnableResizableBar", 0},
+        {"EnableGpuFirmware", 18},
+        {"EnableGpuFirmwareLogs", 2},
+        {"EnableDbgBreakpoint", 0},
+        {"OpenRmEnableUnsupportedGpus", 0},
+        {"DmaRemapPeerMmio", 1},
+    };
+    unsigned int i;
+
+    seq_printf(m,
+               "ResmanDebugLevel: 4294967295\n"
+               "RmLogonRC: 1\n"
+               "ModifyDeviceFiles: %u\n"
+               "DeviceFileUID: %u\n"
+               "DeviceFileGID: %u\n"
+               "DeviceFileMode: %u\n",
+               NVreg_ModifyDeviceFiles, NVreg_DeviceFileUID, NVreg_DeviceFileGID, NVreg_DeviceFileMode);
+    for (i = 0; i < ARRAY_SIZE(fixed); i++)
+        seq_printf(m, "%s: %u\n", fixed[i].name, fixed[i].value);
+    seq_printf(m,
+               "RegistryDwords: \"%s\"\n"
+               "RegistryDwordsPerDevice: \"\"\n"
+               "RmMsg: \"\"\n"
+               "GpuBlacklist: \"\"\n"
+               "TemporaryFilePath: \"\"\n"
+               "ExcludedGpus: \"\"\n",
+               NVreg_RegistryDwords);
+    return 0;
+}
+
+// /proc/driver/nvidia/registry: the binary registry (always empty here), then one "key: value"
+// line per NVreg_RegistryDwords entry.
+static int proc_registry_show(struct seq_file *m, void *v) {
+    const char *entry = NVreg_RegistryDwords;
+
+    seq_puts(m, "Binary: \"\"\n");
+    while (*entry) {
+        size_t len = strcspn(entry, ";");
+        size_t key = strcspn(entry, "=");
+
+        if (key < len)
+            seq_printf(m, "%.*s: %.*s\n", (int)key, entry, (int)(len - key - 1), entry + key + 1);
+        entry += len + (entry[len] == ';');
+    }
+    return 0;
+}
+
+// /proc/driver/nvidia/capabilities/mig/{config,monitor}: the /dev/nvidia-caps minors that grant
+// MIG configuration and monitoring, which nvidia-container-cli reads to set up MIG devices.
+static int proc_cap_show(struct seq_file *m, unsigned int minor, unsigned int mode) {
+    seq_printf(m,
+               "DeviceFileMinor: %u\n"
+               "DeviceFileMode: %u\n"
+               "DeviceFileModify: %u\n",
+               minor, mode, NVreg_ModifyDeviceFiles);
+    return 0;
+}
+
+static int proc_cap_mig_config_show(struct seq_file *m, void *v) {
+    return proc_cap_show(m, 1, 0400);
+}
+
+static int proc_cap_mig_monitor_show(struct seq_file *m, void *v) {
+    return proc_cap_show(m, 2, 0444);
+}
+
+// /proc/driver/nvidia/fake_gpus: the whole registry, one "minor bus_id uuid model" line per GPU,
+// so that the shim can mirror the kernel's GPUs with a single read. Not a real driver file.
+static void *proc_fake_gpus_start(struct seq_file *m, loff_t *pos) {
+    mutex_lock(&g_gpus_lock);
+    return seq_list_start(&g_gpus, *pos);
+}
+
+static void *proc_fake_gpus_next(struct seq_file *m, void *v, loff_t *pos) {
+    return seq_list_next(v, &g_gpus, pos);
+}
+
+static void proc_fake_gpus_stop(struct seq_file *m, void *v) {
+    mutex_unlock(&g_gpus_lock);
+}
+
+static int proc_fake_gpus_show(struct seq_file *m, void *v) {
+    const struct fake_gpu *gpu = list_entry(v, struct fake_gpu, node);
+
+    if (!fake_gpu_view_test(m->private, gpu->minor))
+        return 0;
+    seq_printf(m, "%u %s %s %s\n", gpu->minor, gpu->bus_id, gpu->uuid, gpu->model);
+    return 0;
+}
+
+static const struct seq_operations g_fake_gpus_seq_ops = {
+    .start = proc_fake_gpus_start,
+    .next  = proc_fake_gpus_next,
+    .stop  = proc_fake_gpus_stop,
+    .show  = proc_fake_gpus_show,
+};
+
+static int proc_version_open(struct inode *inode, struct file *file) {
+    return single_open(file, proc_version_show, NULL);
+}
+
+// A GPU hidden from the reader has no information file, although its directory is listed.
+static int proc_information_open(struct inode *inode, struct file *file) {
+    const struct fake_gpu *gpu = pde_data(inode);
+
+    if (!fake_gpu_allowed(gpu->minor))
+        return -ENOENT;
+    return single_open(file, proc_information_show, pde_data(inode));
+}
+
+static int proc_fake_gpus_open(struct inode *inode, struct file *file) {
+    struct fake_gpu_view *view = __seq_open_private(file, &g_fake_gpus_seq_ops, sizeof(*view));
+
+    if (!view)
+        return -ENOMEM;
+    fake_gpu_view_init(view);
+    return 0;
+}
+
+// Every /proc/driver/nvidia file is read through here, to be counted and traced. The file's name
+// tells which one it is: all GPUs share "information", both capabilities share their directory.
+static ssize_t fake_proc_read(struct file *file, char __user *buf, size_t count, loff_t *ppos) {
+    const char *name = file->f_path.dentry->d_name.name;
+    enum fake_stat stat = FAKE_STAT_PROC_CAPABILITIES;
+
+    if (!strcmp(name, "information"))
+        stat = FAKE_STAT_PROC_INFORMATION;
+    else if (!strcmp(name, "version"))
+        stat = FAKE_STAT_PROC_VERSION;
+    else if (!strcmp(name, "params"))
+        stat = FAKE_STAT_PROC_PARAMS;
+    else if (!strcmp(name, "registry"))
+        stat = FAKE_STAT_PROC_REGISTRY;
+    else if (!strcmp(name, "fake_gpus"))
+        stat = FAKE_STAT_PROC_FAKE_GPUS;
+    fake_stat_inc(stat);
+    trace_fake_nvidia_proc_read(name, count, *ppos);
+    return seq_read(file, buf, count, ppos);
+}
+
+// The files rendered in one piece (params, registry, capabilities) share one set of operations;
+// the entry's data is the show function. The buffer is sized up front for the longest of them, so
+// seq_read never has to discard a partial render and retry with a bigger one, and a read with a
+// page-sized buffer, as nvidia-container-cli does, gets the whole file in one call.
+static int proc_single_open(struct inode *inode, struct file *file) {
+    return single_open_size(file, (int (*)(struct seq_file *, void *))pde_data(inode), NULL,
+                            PAGE_SIZE + 2 * strlen(NVreg_RegistryDwords));
+}
+
+// Bind the read operations to the functions.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+static const struct proc_ops g_version_fops = {
+    .proc_open    = proc_version_open,
+    .proc_read    = fake_proc_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = single_release,
+};
+
+static const struct proc_ops g_information_fops = {
+    .proc_open    = proc_information_open,
+    .proc_read    = fake_proc_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = single_release,
+};
+
+static const struct proc_ops g_fake_gpus_fops = {
+    .proc_open    = proc_fake_gpus_open,
+    .proc_read    = fake_proc_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = seq_release_private,
+};
+
+static const struct proc_ops g_single_fops = {
+    .proc_open    = proc_single_open,
+    .proc_read    = fake_proc_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = single_release,
+};
+#else
+static const struct file_operations g_version_fops = {
+    .owner   = THIS_MODULE,
+    .open    = proc_version_open,
+    .read    = fake_proc_read,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations g_information_fops = {
+    .owner   = THIS_MODULE,
+    .open    = proc_information_open,
+    .read    = fake_proc_read,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations g_fake_gpus_fops = {
+    .owner   = THIS_MODULE,
+    .open    = proc_fake_gpus_open,
+    .read    = fake_proc_read,
+    .llseek  = seq_lseek,
+    .release = seq_release_private,
+};
+
+static const struct file_operations g_single_fops = {
+    .owner   = THIS_MODULE,
+    .open    = proc_single_open,
+    .read    = fake_proc_read,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+#endif
+
+// Create params, registry, warnings/ and capabilities/ under /proc/driver/nvidia. warnings/ stays
+// empty: the real driver only adds files to it when it has something to warn about.
+static int fake_proc_create_driver_files(void) {
+    struct proc_dir_entry *caps, *mig;
+
+    if (!proc_create_data("params", 0444, g_proc_nvidia_dir, &g_single_fops, proc_params_show) ||
+        !proc_create_data("registry", 0444, g_proc_nvidia_dir, &g_single_fops, proc_registry_show) ||
+        !proc_mkdir("warnings", g_proc_nvidia_dir))
+        return -ENOMEM;
+    caps = proc_mkdir("capabilities", g_proc_nvidia_dir);
+    mig = caps ? proc_mkdir("mig", caps) : NULL;
+    if (!mig ||
+        !proc_create_data("config", 0444, mig, &g_single_fops, proc_cap_mig_config_show) ||
+        !proc_create_data("monitor", 0444, mig, &g_single_fops, proc_cap_mig_monitor_show))
+        return -ENOMEM;
+    return 0;
+}
+
+// --- Shared State Page ---
+// The state of every GPU (layout in fake_nvidia_uapi.h) lives in a vmalloc_user() area that
+// /dev/nvidiactl maps read-only into any process, in any container: every shim reads the same
+// device table, telemetry and memory ledger, without a copy and without a daemon. Slot i belongs
+// to minor i. The area is sized at load time for max(gpu_count, FAKE_STATE_MIN_SLOTS) minors, and
+// GPUs added at runtime beyond that are refused. Writers hold g_state_lock, with interrupts off so
+// that timer callbacks can update telemetry, and bracket each change of a slot with
+// fake_state_write_begin/end for the readers' retry loop.
+static struct fake_nvidia_state_header *g_state = NULL;
+static DEFINE_SPINLOCK(g_state_lock);
+
+static struct fake_nvidia_state_gpu *fake_state_slot(unsigned int minor) {
+    if (minor >= g_state->slot_count)
+        return NULL;
+    return (void *)g_state + g_state->slot_offset + (size_t)minor * g_state->slot_size;
+}
+
+static void fake_state_write_begin(struct fake_nvidia_state_gpu *slot) {
+    WRITE_ONCE(slot->seq, slot->seq + 1);
+    smp_wmb();
+}
+
+static void fake_state_write_end(struct fake_nvidia_state_gpu *slot) {
+    smp_wmb();
+    WRITE_ONCE(slot->seq, slot->seq + 1);
+}
+
+static int fake_state_alloc(void) {
+    unsigned int slots = max_t(unsigned int, gpu_count, FAKE_STATE_MIN_SLOTS);
+    size_t slot_offset = sizeof(struct fake_nvidia_state_gpu);
+    size_t size = PAGE_ALIGN(slot_offset + (size_t)slots * sizeof(struct fake_nvidia_state_gpu));
+
+    g_state = vmalloc_user(size);
+    if (!g_state)
+        return -ENOMEM;
+    g_state->magic = FAKE_NVIDIA_STATE_MAGIC;
+    g_state->version = FAKE_NVIDIA_STATE_VERSION;
+    g_state->size = size;
+    g_state->slot_offset = slot_offset;
+    g_state->slot_size = sizeof(struct fake_nvidia_state_gpu);
+    g_state->slot_count = slots;
+    g_state->telemetry_hz = telemetry_hz;
+    strscpy(g_state->driver_version, driver_version, sizeof(g_state->driver_version));
+    return 0;
+}
+
+static void fake_state_free(void) {
+    vfree(g_state);
+    g_state = NULL;
+}
+
+// Called with g_state_lock held, inside a write section.
+static void fake_state_accrue_energy(struct fake_nvidia_state_telemetry *t, u64 now) {
+    t->energy_mj += mul_u64_u32_div(now - t->timestamp_ns, t->power_mw, NSEC_PER_SEC);
+    t->timestamp_ns = now;
+}
+
+// Fill the slot of a GPU being published; the caller checked that it has one.
+static void fake_state_publish(const struct fake_gpu *gpu) {
+    struct fake_nvidia_state_gpu *slot = fake_state_slot(gpu->minor);
+    unsigned long flags;
+
+    spin_lock_irqsave(&g_state_lock, flags);
+    fake_state_write_begin(slot);
+    slot->flags = FAKE_NVIDIA_GPU_PRESENT;
+    slot->minor = gpu->minor;
+    strscpy(slot->bus_id, gpu->bus_id, sizeof(slot->bus_id));
+    strscpy(slot->uuid, gpu->uuid, sizeof(slot->uuid));
+    strscpy(slot->model, gpu->model, sizeof(slot->model));
+    slot->memory_total = fake_gpu_memory_bytes(fake_gpu_profile(gpu->model), gpu->model);
+    slot->memory_used = 0;
+    slot->process_count = 0;
+    memset(slot->procs, 0, sizeof(slot->procs));
+    memset(&slot->links, 0, sizeof(slot->links));
+    memset(&slot->telemetry, 0, sizeof(slot->telemetry));
+    slot->telemetry.timestamp_ns = ktime_get_ns();
+    slot->telemetry.power_mw = FAKE_NVIDIA_IDLE_POWER_MW;
+    slot->telemetry.power_limit_mw = FAKE_NVIDIA_IDLE_POWER_LIMIT_MW;
+    slot->telemetry.temperature_c = FAKE_NVIDIA_IDLE_TEMPERATURE_C;
+    fake_state_write_end(slot);
+    WRITE_ONCE(g_state->generation, g_state->generation + 1);
+    spin_unlock_irqrestore(&g_state_lock, flags);
+}
+
+static void fake_state_unpublish(const struct fake_gpu *gpu) {
+    struct fake_nvidia_state_gpu *slot = fake_state_slot(gpu->minor);
+    unsigned long flags;
+
+    spin_lock_irqsave(&g_state_lock, flags);
+    fake_state_write_begin(slot);
+    slot->flags = 0;
+    slot->memory_used = 0;
+    slot->process_count = 0;
+    fake_state_write_end(slot);
+    WRITE_ONCE(g_state->generation, g_state->generation + 1);
+    spin_unlock_irqrestore(&g_state_lock, flags);
+}
+
+static int fake_state_set_telemetry(const struct fake_nvidia_set_telemetry *t) {
+    struct fake_nvidia_state_gpu *slot = fake_state_slot(t->minor);
+    unsigned long flags;
+    int ret = 0;
+
+    if (t->flags & ~FAKE_NVIDIA_TELEMETRY_PRODUCER)
+        return -EINVAL;
+    if (!(t->flags & FAKE_NVIDIA_TELEMETRY_PRODUCER) && (t->gpu_util > 100 || t->memory_util > 100))
+        return -EINVAL;
+    if (!slot)
+        return -ENODEV;
+    spin_lock_irqsave(&g_state_lock, flags);
+    if (!(slot->flags & FAKE_NVIDIA_GPU_PRESENT)) {
+        ret = -ENODEV;
+    } else if (t->flags & FAKE_NVIDIA_TELEMETRY_PRODUCER) {
+        fake_state_write_begin(slot);
+        slot->flags &= ~FAKE_NVIDIA_GPU_TELEMETRY_SET;
+        fake_state_write_end(slot);
+    } else {
+        fake_state_write_begin(slot);
+        slot->flags |= FAKE_NVIDIA_GPU_TELEMETRY_SET;
+        fake_state_accrue_energy(&slot->telemetry, ktime_get_ns());
+        slot->telemetry.gpu_util = t->gpu_util;
+        slot->telemetry.memory_util = t->memory_util;
+        slot->telemetry.power_mw = t->power_mw;
+        slot->telemetry.temperature_c = t->temperature_c;
+        fake_state_write_end(slot);
+    }
+    spin_unlock_irqrestore(&g_state_lock, flags);
+    return ret;
+}
+
+// Charge `bytes` of a GPU's memory to process `pid`, or release -`bytes` of its charge. Releases
+// are clamped to what the ledger holds for the process: the GPU may have been removed and added
+// again since the charge.
+static int fake_state_charge(unsigned int minor, u32 pid, s64 bytes) {
+    struct fake_nvidia_state_gpu *slot = fake_state_slot(minor);
+    u64 amount = bytes > 0 ? (u64)bytes : -(u64)bytes;
+    unsigned long flags;
+    unsigned int i;
+    int ret = 0;
+
+    if (!slot)
+        return -ENODEV;
+    spin_lock_irqsave(&g_state_lock, flags);
+    for (i = 0; i < slot->process_count && slot->procs[i].pid != pid; i++)
+        ;
+    if (!(slot->flags & FAKE_NVIDIA_GPU_PRESENT)) {
+        ret = -ENODEV;
+    } else if (bytes > 0 && slot->memory_total - slot->memory_used < amount) {
+        ret = -ENOMEM;
+    } else if (bytes > 0 && i == FAKE_NVIDIA_STATE_PROCS) {
+        ret = -ENOSPC;
+    } else if (bytes > 0) {
+        fake_state_write_begin(slot);
+        if (i == slot->process_count) {
+            slot->procs[i].pid = pid;
+            slot->procs[i].used_memory = 0;
+            slot->process_count++;
+        }
+        slot->procs[i].used_memory += amount;
+        slot->memory_used += amount;
+        fake_state_write_end(slot);
+    } else if (bytes < 0 && i < slot->process_count) {
+        amount = min(amount, slot->procs[i].used_memory);
+        fake_state_write_begin(slot);
+        slot->procs[i].used_memory -= amount;
+        slot->memory_used -= amount;
+        if (slot->procs[i].used_memory == 0) {
+            slot->process_count--;
+            slot->procs[i] = slot->procs[slot->process_count];
+            memset(&slot->procs[slot->process_count], 0, sizeof(slot->procs[0]));
+        }
+        fake_state_write_end(slot);
+    }
+    spin_unlock_irqrestore(&g_state_lock, flags);
+    return ret;
+}
+
+// Count traffic on a GPU's PCIe link or NVLinks. The counters only grow (and wrap).
+static int fake_state_add_traffic(const struct fake_nvidia_link_traffic *t) {
+    struct fake_nvidia_state_gpu *slot = fake_state_slot(t->minor);
+    unsigned long flags;
+    int ret = 0;
+
+    if (!slot)
+        return -ENODEV;
+    if (t->link != FAKE_NVIDIA_LINK_PCIE && t->link != FAKE_NVIDIA_LINK_NVLINK)
+        return -EINVAL;
+    spin_lock_irqsave(&g_state_lock, flags);
+    if (!(slot->flags & FAKE_NVIDIA_GPU_PRESENT)) {
+        ret = -ENODEV;
+    } else {
+        fake_state_write_begin(slot);
+        if (t->link == FAKE_NVIDIA_LINK_PCIE) {
+            slot->links.pcie_tx_bytes += t->tx_bytes;
+            slot->links.pcie_rx_bytes += t->rx_bytes;
+        } else {
+            slot->links.nvlink_tx_bytes += t->tx_bytes;
+            slot->links.nvlink_rx_bytes += t->rx_bytes;
+        }
+        fake_state_write_end(slot);
+    }
+    spin_unlock_irqrestore(&g_state_lock, flags);
+    return ret;
+}
+
+// Every open of /dev/nvidiactl is a client whose ledger charges are released when it is closed.
+struct fake_ctl_charge {
+    unsigned int minor;
+    u64 bytes;
+};
+
+struct fake_ctl_client {
+    struct mutex lock;
+    u32 pid;
+    unsigned int count;
+    struct fake_ctl_charge *charges;
+};
+
+static int fake_ctl_charge(struct fake_ctl_client *client, unsigned int minor, s64 bytes) {
+    u64 amount = bytes > 0 ? (u64)bytes : -(u64)bytes;
+    unsigned int i;
+    int ret;
+
+    if (bytes == 0)
+        return 0;
+    mutex_lock(&client->lock);
+    for (i = 0; i < client->count && client->charges[i].minor != minor; i++)
+        ;
+    if (bytes < 0 && (i == client->count || client->charges[i].bytes < amount)) {
+        ret = -EINVAL; // only what this file charged can be released through it
+        goto out;
+    }
+    if (i == client->count) {
+        struct fake_ctl_charge *grown = krealloc(client->charges, (client->count + 1) * sizeof(*grown), GFP_KERNEL);
+
+        if (!grown) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        client->charges = grown;
+        client->charges[client->count++] = (struct fake_ctl_charge){.minor = minor, .bytes = 0};
+    }
+    ret = fake_state_charge(minor, client->pid, bytes);
+    if (!ret)
+        client->charges[i].bytes = bytes > 0 ? client->charges[i].bytes + amount : client->charges[i].bytes - amount;
+out:
+    mutex_unlock(&client->lock);
+    return ret;
+}
+
+static struct fake_ctl_client *fake_ctl_client_create(void) {
+    struct fake_ctl_client *client = kzalloc(sizeof(*client), GFP_KERNEL);
+
+    if (client) {
+        mutex_init(&client->lock);
+        client->pid = task_tgid_nr(current);
+    }
+    return client;
+}
+
+static void fake_ctl_client_destroy(struct fake_ctl_client *client) {
+    unsigned int i;
+
+    for (i = 0; i < client->count; i++) {
+        if (client->charges[i].bytes)
+            fake_state_charge(client->charges[i].minor, client->pid, -(s64)client->charges[i].bytes);
+    }
+    kfree(client->charges);
+    kfree(client);
+}
+
+// --- Telemetry Producer ---
+// With telemetry_hz set, an hrtimer advances the telemetry of every GPU whose telemetry was not set
+// through the ioctl, so that all processes read one time series instead of each synthesizing its
+// own. The timer is forwarded by whole periods from its expiry, not re-armed relative to the end of
+// the callback, so ticks do not drift however long a tick takes. It runs in softirq context on
+// kernels that support it and takes g_state_lock one slot at a time, keeping interrupts off only
+// for the update of a single slot.
+//
+// The workload follows the ledger: a GPU without processes idles, one with processes runs a
+// triangle wave between 40% and 100% over FAKE_TELEMETRY_PERIOD_NS, shifted by its minor so that
+// GPUs do not move in lockstep. Power follows utilization linearly between the idle draw and the
+// limit, memory utilization is the charged share of memory, and the temperature approaches
+// 30 + util/2 °C with a time constant of FAKE_TELEMETRY_THERMAL_NS.
+#define FAKE_TELEMETRY_PERIOD_NS (60ULL * NSEC_PER_SEC)
+#define FAKE_TELEMETRY_THERMAL_NS (10ULL * NSEC_PER_SEC)
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0)
+#define FAKE_TELEMETRY_TIMER_MODE HRTIMER_MODE_ABS_SOFT
+#else
+#define FAKE_TELEMETRY_TIMER_MODE HRTIMER_MODE_ABS
+#endif
+
+static struct hrtimer g_telemetry_timer;
+static ktime_t g_telemetry_period;
+
+static u32 fake_telemetry_util(const struct fake_nvidia_state_gpu *slot, u64 now) {
+    u64 offset, phase;
+
+    if (!slot->process_count)
+        return 0;
+    div64_u64_rem(now + (u64)slot->minor * (FAKE_TELEMETRY_PERIOD_NS / 8), FAKE_TELEMETRY_PERIOD_NS, &offset);
+    phase = div64_u64(offset * 120, FAKE_TELEMETRY_PERIOD_NS); // 0..119 over the period
+    return 40 + (phase < 60 ? phase : 120 - phase);
+}
+
+static void fake_telemetry_advance(struct fake_nvidia_state_gpu *slot, u64 now) {
+    struct fake_nvidia_state_telemetry *t = &slot->telemetry;
+    u64 elapsed = min_t(u64, now - t->timestamp_ns, FAKE_TELEMETRY_THERMAL_NS);
+    u32 util = fake_telemetry_util(slot, now);
+    u32 limit = max_t(u32, t->power_limit_mw, FAKE_NVIDIA_IDLE_POWER_MW);
+    s32 target = FAKE_NVIDIA_IDLE_TEMPERATURE_C + util / 2;
+    s32 step = (s32)div64_s64((s64)(target - (s32)t->temperature_c) * (s64)elapsed, FAKE_TELEMETRY_THERMAL_NS);
+
+    fake_state_write_begin(slot);
+    fake_state_accrue_energy(t, now); // at the power of the tick that ends here
+    t->gpu_util = util;
+    t->memory_util = slot->memory_total ? div64_u64(slot->memory_used * 100, slot->memory_total) : 0;
+    t->power_mw = FAKE_NVIDIA_IDLE_POWER_MW + (limit - FAKE_NVIDIA_IDLE_POWER_MW) * util / 100;
+    // Move at least a degree per tick towards the target so that it is reached at high rates too.
+    if (step == 0 && target != (s32)t->temperature_c)
+        step = target > (s32)t->temperature_c ? 1 : -1;
+    t->temperature_c += step;
+    fake_state_write_end(slot);
+}
+
+static enum hrtimer_restart fake_telemetry_tick(struct hrtimer *timer) {
+    u64 now = ktime_get_ns();
+    unsigned long flags;
+    unsigned int i;
+
+    for (i = 0; i < g_state->slot_count; i++) {
+        struct fake_nvidia_state_gpu *slot = fake_state_slot(i);
+
+        if ((READ_ONCE(slot->flags) & (FAKE_NVIDIA_GPU_PRESENT | FAKE_NVIDIA_GPU_TELEMETRY_SET)) !=
+            FAKE_NVIDIA_GPU_PRESENT)
+            continue;
+        spin_lock_irqsave(&g_state_lock, flags);
+        if ((slot->flags & (FAKE_NVIDIA_GPU_PRESENT | FAKE_NVIDIA_GPU_TELEMETRY_SET)) == FAKE_NVIDIA_GPU_PRESENT)
+            fake_telemetry_advance(slot, now);
+        spin_unlock_irqrestore(&g_state_lock, flags);
+    }
+    hrtimer_forward_now(timer, g_telemetry_period);
+    return HRTIMER_RESTART;
+}
+
+static void fake_telemetry_start(void) {
+    if (!telemetry_hz)
+        return;
+    g_telemetry_period = ns_to_ktime(div_u64(NSEC_PER_SEC, telemetry_hz));
+    hrtimer_setup(&g_telemetry_timer, fake_telemetry_tick, CLOCK_MONOTONIC, FAKE_TELEMETRY_TIMER_MODE);
+    hrtimer_start(&g_telemetry_timer, ktime_add(ktime_get(), g_telemetry_period), FAKE_TELEMETRY_TIMER_MODE);
+}
+
+static void fake_telemetry_stop(void) {
+    if (telemetry_hz)
+        hrtimer_cancel(&g_telemetry_timer);
+}
+
+// --- BAR1 Regions ---
+// Each GPU has a BAR1 region of bar1_size_mb that /dev/nvidia<minor> maps, shared and writable, so
+// that tools streaming through the aperture can be benchmarked. Pages are allocated on the first
+// fault at their offset and kept, zeroed at first, until the GPU is removed and the last mapping
+// is gone: the region is reference counted by its GPU and by every mapping, because open device
+// files do not pin the GPU. The node is world-writable and a page outlives its mappings, so pages
+// are charged to the memory cgroup of the task that faults them in. Every fault is counted per
+// GPU (faults, and pages the first time one is populated) in /sys/kernel/debug/fake_nvidia/bar1
+// and in the bar1_fault counter, and raises the fake_nvidia_bar1_fault tracepoint.
+struct fake_bar1 {
+    struct kref ref;
+    unsigned int minor;
+    pgoff_t page_count;
+    struct xarray pages; // page offset -> struct page
+    atomic64_t faults;
+    atomic64_t populated;
+};
+
+static struct fake_bar1 *fake_bar1_create(unsigned int minor) {
+    struct fake_bar1 *bar = kzalloc(sizeof(*bar), GFP_KERNEL);
+
+    if (!bar)
+        return NULL;
+    kref_init(&bar->ref);
+    bar->minor = minor;
+    bar->page_count = (pgoff_t)bar1_size_mb << (20 - PAGE_SHIFT);
+    xa_init(&bar->pages);
+    return bar;
+}
+
+static void fake_bar1_release(struct kref *ref) {
+    struct fake_bar1 *bar = container_of(ref, struct fake_bar1, ref);
+    struct page *page;
+    unsigned long index;
+
+    xa_for_each(&bar->pages, index, page)
+        put_page(page);
+    xa_destroy(&bar->pages);
+    kfree(bar);
+}
+
+static void fake_bar1_put(struct fake_bar1 *bar) {
+    kref_put(&bar->ref, fake_bar1_release);
+}
+
+static void fake_bar1_vm_open(struct vm_area_struct *vma) {
+    struct fake_bar1 *bar = vma->vm_private_data;
+
+    kref_get(&bar->ref);
+}
+
+static void fake_bar1_vm_close(struct vm_area_struct *vma) {
+    fake_bar1_put(vma->vm_private_data);
+}
+
+static vm_fault_t fake_bar1_fault(struct vm_fault *vmf) {
+    struct fake_bar1 *bar = vmf->vma->vm_private_data;
+    struct page *page, *old;
+    bool populated = false;
+
+    if (vmf->pgoff >= bar->page_count)
+        return VM_FAULT_SIGBUS;
+    page = xa_load(&bar->pages, vmf->pgoff);
+    if (!page) {
+        page = alloc_page(GFP_HIGHUSER | __GFP_ZERO | __GFP_ACCOUNT);
+        if (!page)
+            return VM_FAULT_OOM;
+        // Racing faults on the same offset keep whichever page got in first.
+        old = xa_cmpxchg(&bar->pages, vmf->pgoff, NULL, page, GFP_KERNEL);
+        if (xa_is_err(old)) {
+            __free_page(page);
+            return VM_FAULT_OOM;
+        }
+        if (old) {
+            __free_page(page);
+            page = old;
+        } else {
+            populated = true;
+            atomic64_inc(&bar->populated);
+        }
+    }
+    get_page(page);
+    vmf->page = page;
+    atomic64_inc(&bar->faults);
+    fake_stat_inc(FAKE_STAT_BAR1_FAULT);
+    trace_fake_nvidia_bar1_fault(bar->minor, vmf->pgoff, vmf->flags & FAULT_FLAG_WRITE, populated);
+    return 0;
+}
+
+static const struct vm_operations_struct g_bar1_vm_ops = {
+    .open  = fake_bar1_vm_open,
+    .close = fake_bar1_vm_close,
+    .fault = fake_bar1_fault,
+};
+
+static int fake_bar1_mmap(struct fake_bar1 *bar, struct vm_area_struct *vma) {
+    unsigned long pages = vma_pages(vma);
+
+    if (vma->vm_pgoff >= bar->page_count || pages > bar->page_count - vma->vm_pgoff)
+        return -EINVAL;
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    vma->vm_ops = &g_bar1_vm_ops;
+    vma->vm_private_data = bar;
+    fake_bar1_vm_open(vma);
+    return 0;
+}
+
+// A reference to the BAR1 region of GPU `minor`, or NULL when there is no such GPU.
+static struct fake_bar1 *fake_bar1_get(unsigned int minor) {
+    struct fake_bar1 *bar = NULL;
+    struct fake_gpu *gpu;
+
+    mutex_lock(&g_gpus_lock);
+    list_for_each_entry(gpu, &g_gpus, node) {
+        if (gpu->minor >= minor) {
+            if (gpu->minor == minor) {
+                bar = gpu->bar1;
+                kref_get(&bar->ref);
+            }
+            break;
+        }
+    }
+    mutex_unlock(&g_gpus_lock);
+    return bar;
+}
+
+// /sys/kernel/debug/fake_nvidia/bar1: "minor size faults pages" for every GPU.
+static int fake_bar1_stats_show(struct seq_file *m, void *v) {
+    struct fake_gpu *gpu;
+
+    mutex_lock(&g_gpus_lock);
+    list_for_each_entry(gpu, &g_gpus, node) {
+        seq_printf(m, "%u %llu %lld %lld\n", gpu->minor, (u64)gpu->bar1->page_count << PAGE_SHIFT,
+                   (long long)atomic64_read(&gpu->bar1->faults), (long long)atomic64_read(&gpu->bar1->populated));
+    }
+    mutex_unlock(&g_gpus_lock);
+    return 0;
+}
+
+static int fake_bar1_stats_open(struct inode *inode, struct file *file) {
+    return single_open(file, fake_bar1_stats_show, NULL);
+}
+
+static const struct file_operations g_bar1_stats_fops = {
+    .owner   = THIS_MODULE,
+    .open    = fake_bar1_stats_open,
+    .read    = seq_read,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+// Next to the counters; removed with them.
+static void fake_bar1_stats_register(void) {
+    debugfs_create_file("bar1", 0400, g_debugfs_dir, NULL, &g_bar1_stats_fops);
+}
+
+// --- Character Devices ---
+// /dev/nvidia<minor>, /dev/nvidiactl, /dev/nvidia-modeset, /dev/nvidia-uvm, /dev/nvidia-uvm-tools
+// and /dev/nvidia-fs0..15 are created through devtmpfs and udev by a device class, with mode
+// NVreg_DeviceFileMode (0666, as nvidia-modprobe sets them up) unless NVreg_ModifyDeviceFiles is 0,
+// which leaves the devtmpfs default. Opening a GPU node fails with ENODEV once that GPU has been
+// removed. poll() never reports readiness: no fake device has anything to read. /dev/nvidiactl
+// also maps the state page and takes the control ioctls of fake_nvidia_uapi.h. The nvidia-fs
+// nodes only have to exist: libcufile checks for them before it uses GPUDirect Storage, and the
+// fake libcufile does its I/O from user space.
+static dev_t g_uvm_devt;
+static dev_t g_nvfs_devt;
+static struct cdev g_nvidia_cdev;
+static struct cdev g_uvm_cdev;
+static struct cdev g_nvfs_cdev;
+static struct class *g_nvidia_class = NULL;
+static struct device *g_control_devs[2 + NV_UVM_MINOR_COUNT + NV_FS_MINOR_COUNT];
+static DECLARE_WAIT_QUEUE_HEAD(g_nvidia_wait);
+
+static bool fake_nvidia_is_gpu(const struct inode *inode) {
+    return imajor(inode) == NV_MAJOR_DEVICE_NUMBER && iminor(inode) < NV_GPU_DEVICE_MINOR_LIMIT;
+}
+
+static bool fake_nvidia_is_ctl(const struct inode *inode) {
+    return imajor(inode) == NV_MAJOR_DEVICE_NUMBER && iminor(inode) == NV_CONTROL_DEVICE_MINOR;
+}
 
-// Fake version information.
-static const char g_fake_version_string[] = "Driver Version: 535.104.05\n";
+// The private data of a GPU file is a reference to its BAR1 region, that of /dev/nvidiactl its
+// client; the other nodes have none.
+static int fake_nvidia_open(struct inode *inode, struct file *file) {
+    unsigned int minor = iminor(inode);
+    enum fake_stat stat;
+    int ret = 0;
 
-// This function is called when /proc/driver/nvidia/version is read.
-static ssize_t proc_version_read(struct file *file, char __user *usr_buf, size_t count, loff_t *ppos) {
-    return simple_read_from_buffer(usr_buf, count, ppos, g_fake_version_string, sizeof(g_fake_version_string));
+    file->private_data = NULL;
+    if (imajor(inode) == MAJOR(g_nvfs_devt)) {
+        stat = FAKE_STAT_OPEN_NVFS;
+    } else if (imajor(inode) != NV_MAJOR_DEVICE_NUMBER) {
+        stat = minor == 0 ? FAKE_STAT_OPEN_UVM : FAKE_STAT_OPEN_UVM_TOOLS;
+    } else if (minor < NV_GPU_DEVICE_MINOR_LIMIT) {
+        stat = FAKE_STAT_OPEN_GPU;
+        file->private_data = fake_bar1_get(minor);
+        if (!file->private_data)
+            ret = -ENODEV;
+    } else if (minor == NV_CONTROL_DEVICE_MINOR) {
+        stat = FAKE_STAT_OPEN_CTL;
+        file->private_data = fake_ctl_client_create();
+        if (!file->private_data)
+            ret = -ENOMEM;
+    } else {
+        stat = FAKE_STAT_OPEN_MODESET;
+    }
+    if (!ret)
+        ret = nonseekable_open(inode, file);
+    fake_stat_inc(stat);
+    trace_fake_nvidia_dev_open(inode->i_rdev, ret);
+    return ret;
 }
 
-// Bind the read operation to the function.
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
-static const struct proc_ops g_version_fops = {
-    .proc_read = proc_version_read,
+static int fake_nvidia_release(struct inode *inode, struct file *file) {
+    if (file->private_data && fake_nvidia_is_ctl(inode))
+        fake_ctl_client_destroy(file->private_data);
+    else if (file->private_data)
+        fake_bar1_put(file->private_data);
+    return 0;
+}
+
+// A GPU node maps its BAR1 region. /dev/nvidiactl maps the state page; writable mappings of it
+// are refused so that the module stays the page's only writer.
+static int fake_nvidia_mmap(struct file *file, struct vm_area_struct *vma) {
+    int ret;
+
+    if (!file->private_data) {
+        ret = -ENODEV;
+    } else if (fake_nvidia_is_gpu(file_inode(file))) {
+        ret = fake_bar1_mmap(file->private_data, vma);
+    } else if (vma->vm_flags & VM_WRITE) {
+        ret = -EPERM;
+    } else {
+        vm_flags_clear(vma, VM_MAYWRITE);
+        ret = remap_vmalloc_range(vma, g_state, vma->vm_pgoff);
+    }
+    fake_stat_inc(FAKE_STAT_MMAP);
+    trace_fake_nvidia_dev_mmap(file_inode(file)->i_rdev, vma->vm_end - vma->vm_start, vma->vm_pgoff, ret);
+    return ret;
+}
+
+static long fake_nvidia_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    struct fake_ctl_client *client = file->private_data;
+    void __user *uarg = (void __user *)arg;
+
+    if (!client || !fake_nvidia_is_ctl(file_inode(file)))
+        return -ENOTTY;
+    switch (cmd) {
+    case FAKE_NVIDIA_IOC_SET_TELEMETRY: {
+        struct fake_nvidia_set_telemetry t;
+
+        if (!capable(CAP_SYS_ADMIN))
+            return -EPERM;
+        if (copy_from_user(&t, uarg, sizeof(t)))
+            return -EFAULT;
+        return fake_state_set_telemetry(&t);
+    }
+    case FAKE_NVIDIA_IOC_LEDGER: {
+        struct fake_nvidia_ledger l;
+
+        if (!(file->f_mode & FMODE_WRITE))
+            return -EBADF;
+        if (copy_from_user(&l, uarg, sizeof(l)))
+            return -EFAULT;
+        if (!fake_gpu_usable(l.minor))
+            return -EPERM;
+        return fake_ctl_charge(client, l.minor, l.bytes);
+    }
+    case FAKE_NVIDIA_IOC_LINK_TRAFFIC: {
+        struct fake_nvidia_link_traffic t;
+
+        if (!(file->f_mode & FMODE_WRITE))
+            return -EBADF;
+        if (copy_from_user(&t, uarg, sizeof(t)))
+            return -EFAULT;
+        if (t.tx_bytes > FAKE_NVIDIA_LINK_TRAFFIC_MAX || t.rx_bytes > FAKE_NVIDIA_LINK_TRAFFIC_MAX)
+            return -EINVAL;
+        if (!fake_gpu_usable(t.minor))
+            return -EPERM;
+        return fake_state_add_traffic(&t);
+    }
+    }
+    return -ENOTTY;
+}
+
+static long fake_nvidia_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    long ret = fake_nvidia_do_ioctl(file, cmd, arg);
+
+    fake_stat_inc(FAKE_STAT_IOCTL);
+    trace_fake_nvidia_dev_ioctl(file_inode(file)->i_rdev, cmd, ret);
+    return ret;
+}
+
+#ifdef CONFIG_COMPAT
+// The ioctl structures have the same layout for 32-bit callers.
+static long fake_nvidia_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    return fake_nvidia_ioctl(file, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
+static __poll_t fake_nvidia_poll(struct file *file, poll_table *wait) {
+    poll_wait(file, &g_nvidia_wait, wait);
+    return 0;
+}
+
+static const struct file_operations g_nvidia_dev_fops = {
+    .owner   = THIS_MODULE,
+    .open    = fake_nvidia_open,
+    .release = fake_nvidia_release,
+    .poll    = fake_nvidia_poll,
+    .mmap    = fake_nvidia_mmap,
+    .unlocked_ioctl = fake_nvidia_ioctl,
+#ifdef CONFIG_COMPAT
+    .compat_ioctl = fake_nvidia_compat_ioctl,
+#endif
 };
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+static char *fake_nvidia_devnode(const struct device *dev, umode_t *mode)
 #else
-static const struct file_operations g_version_fops = {
-    .owner = THIS_MODULE,
-    .read  = proc_version_read,
+static char *fake_nvidia_devnode(struct device *dev, umode_t *mode)
+#endif
+{
+    if (mode && NVreg_ModifyDeviceFiles)
+        *mode = NVreg_DeviceFileMode & 0777;
+    return NULL;
+}
+
+static int fake_nvidia_chrdev_register(void) {
+    static const struct {
+        bool uvm;
+        unsigned int minor;
+        const char *name;
+    } nodes[] = {
+        {false, NV_CONTROL_DEVICE_MINOR, "nvidiactl"},
+        {false, NV_MODESET_DEVICE_MINOR, "nvidia-modeset"},
+        {true, 0, "nvidia-uvm"},
+        {true, 1, "nvidia-uvm-tools"},
+    };
+    dev_t base = MKDEV(NV_MAJOR_DEVICE_NUMBER, 0);
+    unsigned int i, n = 0;
+    int ret;
+
+    ret = register_chrdev_region(base, NV_MINOR_DEVICE_COUNT, "nvidia-frontend");
+    if (ret) {
+        printk(KERN_ERR "FAKE_NVIDIA: Major %d is taken (is the real driver loaded?).\n", NV_MAJOR_DEVICE_NUMBER);
+        return ret;
+    }
+    ret = alloc_chrdev_region(&g_uvm_devt, 0, NV_UVM_MINOR_COUNT, "nvidia-uvm");
+    if (ret)
+        goto err_region;
+    ret = alloc_chrdev_region(&g_nvfs_devt, 0, NV_FS_MINOR_COUNT, "nvidia-fs");
+    if (ret)
+        goto err_uvm_region;
+    cdev_init(&g_nvidia_cdev, &g_nvidia_dev_fops);
+    cdev_init(&g_uvm_cdev, &g_nvidia_dev_fops);
+    cdev_init(&g_nvfs_cdev, &g_nvidia_dev_fops);
+    g_nvidia_cdev.owner = THIS_MODULE;
+    g_uvm_cdev.owner = THIS_MODULE;
+    g_nvfs_cdev.owner = THIS_MODULE;
+    ret = cdev_add(&g_nvidia_cdev, base, NV_MINOR_DEVICE_COUNT);
+    if (ret)
+        goto err_nvfs_region;
+    ret = cdev_add(&g_uvm_cdev, g_uvm_devt, NV_UVM_MINOR_COUNT);
+    if (ret)
+        goto err_cdev;
+    ret = cdev_add(&g_nvfs_cdev, g_nvfs_devt, NV_FS_MINOR_COUNT);
+    if (ret)
+        goto err_uvm_cdev;
+
+    g_nvidia_class = fake_class_create("fake_nvidia");
+    if (IS_ERR(g_nvidia_class)) {
+        ret = PTR_ERR(g_nvidia_class);
+        g_nvidia_class = NULL;
+        goto err_nvfs_cdev;
+    }
+    g_nvidia_class->devnode = fake_nvidia_devnode;
+    for (i = 0; i < ARRAY_SIZE(nodes); i++, n++) {
+        dev_t devt = nodes[i].uvm ? MKDEV(MAJOR(g_uvm_devt), nodes[i].minor) : MKDEV(NV_MAJOR_DEVICE_NUMBER, nodes[i].minor);
+
+        g_control_devs[n] = device_create(g_nvidia_class, NULL, devt, NULL, "%s", nodes[i].name);
+        if (IS_ERR(g_control_devs[n]))
+            goto err_devices;
+    }
+    for (i = 0; i < NV_FS_MINOR_COUNT; i++, n++) {
+        g_control_devs[n] = device_create(g_nvidia_class, NULL, MKDEV(MAJOR(g_nvfs_devt), i), NULL, "nvidia-fs%u", i);
+        if (IS_ERR(g_control_devs[n]))
+            goto err_devices;
+    }
+    return 0;
+
+err_devices:
+    ret = PTR_ERR(g_control_devs[n]);
+    g_control_devs[n] = NULL;
+    while (n-- > 0)
+        device_unregister(g_control_devs[n]);
+    class_destroy(g_nvidia_class);
+    g_nvidia_class = NULL;
+err_nvfs_cdev:
+    cdev_del(&g_nvfs_cdev);
+err_uvm_cdev:
+    cdev_del(&g_uvm_cdev);
+err_cdev:
+    cdev_del(&g_nvidia_cdev);
+err_nvfs_region:
+    unregister_chrdev_region(g_nvfs_devt, NV_FS_MINOR_COUNT);
+err_uvm_region:
+    unregister_chrdev_region(g_uvm_devt, NV_UVM_MINOR_COUNT);
+err_region:
+    unregister_chrdev_region(base, NV_MINOR_DEVICE_COUNT);
+    return ret;
+}
+
+// Called after every GPU node is gone.
+static void fake_nvidia_chrdev_unregister(void) {
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(g_control_devs); i++)
+        device_unregister(g_control_devs[i]);
+    class_destroy(g_nvidia_class);
+    cdev_del(&g_nvfs_cdev);
+    cdev_del(&g_uvm_cdev);
+    cdev_del(&g_nvidia_cdev);
+    unregister_chrdev_region(g_nvfs_devt, NV_FS_MINOR_COUNT);
+    unregister_chrdev_region(g_uvm_devt, NV_UVM_MINOR_COUNT);
+    unregister_chrdev_region(MKDEV(NV_MAJOR_DEVICE_NUMBER, 0), NV_MINOR_DEVICE_COUNT);
+}
+
+// --- Event Channel ---
+// /dev/fake-nvidia-events (see fake_nvidia_uapi.h) broadcasts injected Xid and ECC errors and
+// GPU hot-plug to every reader, whichever container or mount namespace it runs in, and wakes
+// readers sleeping in read/poll/epoll directly. Each reader owns a kfifo: producers are
+// serialized by g_event_lock, and the single consumer (the reader, under its read_lock) drains
+// it without taking that lock, so a slow reader never holds up producers. A full queue drops
+// the event for that reader only, which learns about it from a FAKE_NVIDIA_EVENT_LOST record.
+// The node is 0644: anyone may listen, only root injects.
+struct fake_event_reader {
+    struct list_head node; // on g_event_readers
+    struct mutex read_lock;
+    wait_queue_head_t wait;
+    unsigned long dropped; // protected by g_event_lock
+    struct fake_gpu_view view;
+    DECLARE_KFIFO_PTR(fifo, struct fake_nvidia_event);
+};
+
+static LIST_HEAD(g_event_readers);
+static DEFINE_SPINLOCK(g_event_lock);
+
+static void fake_event_emit(u64 type, unsigned int minor, u64 data) {
+    struct fake_nvidia_event ev = {
+        .type = type,
+        .data = data,
+        .timestamp_ns = ktime_get_real_ns(),
+        .minor = minor,
+    };
+    struct fake_event_reader *r;
+    unsigned long flags;
+
+    spin_lock_irqsave(&g_event_lock, flags);
+    list_for_each_entry(r, &g_event_readers, node) {
+        if (!fake_gpu_view_test(&r->view, minor))
+            continue;
+        if (!kfifo_put(&r->fifo, ev))
+            r->dropped++;
+        wake_up_interruptible_poll(&r->wait, EPOLLIN | EPOLLRDNORM);
+    }
+    spin_unlock_irqrestore(&g_event_lock, flags);
+}
+
+static bool fake_event_pending(struct fake_event_reader *r) {
+    return !kfifo_is_empty(&r->fifo) || READ_ONCE(r->dropped);
+}
+
+// Only opens for reading subscribe; an injector's write-only open costs nothing.
+static int fake_events_open(struct inode *inode, struct file *file) {
+    struct fake_event_reader *r;
+    unsigned long flags;
+
+    file->private_data = NULL;
+    if (file->f_mode & FMODE_READ) {
+        r = kzalloc(sizeof(*r), GFP_KERNEL);
+        if (!r)
+            return -ENOMEM;
+        if (kfifo_alloc(&r->fifo, FAKE_EVENT_QUEUE_LEN, GFP_KERNEL)) {
+            kfree(r);
+            return -ENOMEM;
+        }
+        mutex_init(&r->read_lock);
+        init_waitqueue_head(&r->wait);
+        fake_gpu_view_init(&r->view);
+        spin_lock_irqsave(&g_event_lock, flags);
+        list_add_tail(&r->node, &g_event_readers);
+        spin_unlock_irqrestore(&g_event_lock, flags);
+        file->private_data = r;
+    }
+    fake_stat_inc(FAKE_STAT_OPEN_EVENTS);
+    trace_fake_nvidia_dev_open(inode->i_rdev, 0);
+    return nonseekable_open(inode, file);
+}
+
+static int fake_events_release(struct inode *inode, struct file *file) {
+    struct fake_event_reader *r = file->private_data;
+    unsigned long flags;
+
+    if (r) {
+        spin_lock_irqsave(&g_event_lock, flags);
+        list_del(&r->node);
+        spin_unlock_irqrestore(&g_event_lock, flags);
+        kfifo_free(&r->fifo);
+        kfree(r);
+    }
+    return 0;
+}
+
+// Returns as many whole records as fit in the buffer, the LOST record first.
+static ssize_t fake_events_read(struct file *file, char __user *buf, size_t count, loff_t *ppos) {
+    struct fake_event_reader *r = file->private_data;
+    struct fake_nvidia_event ev;
+    unsigned long flags, lost;
+    size_t copied = 0;
+    int ret = 0;
+
+    if (count < sizeof(ev))
+        return -EINVAL;
+    if (mutex_lock_interruptible(&r->read_lock))
+        return -ERESTARTSYS;
+    while (!fake_event_pending(r)) {
+        mutex_unlock(&r->read_lock);
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(r->wait, fake_event_pending(r));
+        if (ret)
+            return ret;
+        if (mutex_lock_interruptible(&r->read_lock))
+            return -ERESTARTSYS;
+    }
+
+    spin_lock_irqsave(&g_event_lock, flags);
+    lost = r->dropped;
+    r->dropped = 0;
+    spin_unlock_irqrestore(&g_event_lock, flags);
+    if (lost) {
+        memset(&ev, 0, sizeof(ev));
+        ev.type = FAKE_NVIDIA_EVENT_LOST;
+        ev.data = lost;
+        ev.timestamp_ns = ktime_get_real_ns();
+        if (copy_to_user(buf, &ev, sizeof(ev)))
+            ret = -EFAULT;
+        else
+            copied += sizeof(ev);
+    }
+    while (!ret && count - copied >= sizeof(ev) && kfifo_get(&r->fifo, &ev)) {
+        if (copy_to_user(buf + copied, &ev, sizeof(ev)))
+            ret = -EFAULT;
+        else
+            copied += sizeof(ev);
+    }
+    mutex_unlock(&r->read_lock);
+    return copied ? copied : ret;
+}
+
+// One command per write: "xid <minor> <code>", "sbe <minor> [count]" or "dbe <minor> [count]".
+static ssize_t fake_events_write(struct file *file, const char __user *ubuf, size_t count, loff_t *ppos) {
+    char buf[64], cmd[8];
+    unsigned int minor;
+    unsigned long long data = 1;
+    bool present;
+    u64 type;
+    int n;
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+    n = sscanf(buf, "%7s %u %llu", cmd, &minor, &data);
+    if (n < 2)
+        return -EINVAL;
+    if (strcmp(cmd, "xid") == 0 && n == 3)
+        type = FAKE_NVIDIA_EVENT_XID;
+    else if (strcmp(cmd, "sbe") == 0)
+        type = FAKE_NVIDIA_EVENT_SBE_ECC;
+    else if (strcmp(cmd, "dbe") == 0)
+        type = FAKE_NVIDIA_EVENT_DBE_ECC;
+    else
+        return -EINVAL;
+
+    mutex_lock(&g_gpus_lock);
+    present = minor < FAKE_GPU_MAX && test_bit(minor, g_gpu_minors);
+    mutex_unlock(&g_gpus_lock);
+    if (!present)
+        return -ENODEV;
+    fake_event_emit(type, minor, data);
+    return count;
+}
+
+static __poll_t fake_events_poll(struct file *file, poll_table *wait) {
+    struct fake_event_reader *r = file->private_data;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    if (r) {
+        poll_wait(file, &r->wait, wait);
+        if (fake_event_pending(r))
+            mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    return mask;
+}
+
+static const struct file_operations g_events_fops = {
+    .owner   = THIS_MODULE,
+    .open    = fake_events_open,
+    .release = fake_events_release,
+    .read    = fake_events_read,
+    .write   = fake_events_write,
+    .poll    = fake_events_poll,
+};
+
+static struct miscdevice g_events_misc = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name  = "fake-nvidia-events",
+    .fops  = &g_events_fops,
+    .mode  = 0644,
+};
+
+// --- Virtual PCI Bus ---
+// With pci_bus=1 every GPU is also a PCI function at its bus ID, so that tools that enumerate
+// /sys/bus/pci/devices for vendor 0x10de (device plugins, feature discovery, nvidia-ctk) find it.
+// Each (domain, bus) of a GPU gets a root bus of its own, created with the first GPU on it and
+// removed with the last; its pci_ops emulate the configuration space of a Tesla T4 (3D controller,
+// IDs of fake_nvidia_uapi.h, no BARs or capabilities) at the functions of its GPUs and nothing
+// anywhere else. The root bus carries the GPU's NUMA node: GPUs are spread over the online nodes
+// in minor order, as on a multi-socket server. A bus number the host already uses cannot be
+// shadowed, so GPUs whose bus ID collides with a host bus stay without a PCI function; pick
+// bus_ids in a domain the host does not use for those hosts.
+//
+// A "nvidia" PCI driver binds the fake functions, and only those, so that their `driver` link
+// points where tools expect it. It is not registered when the real driver is loaded.
+//
+// Configuration cycles come from the PCI core under its own spinlock, so the functions of a bus
+// are looked up under g_pci_lock rather than g_gpus_lock; the buses themselves are found in
+// g_pci_buses and counted under g_gpus_lock.
+#ifdef FAKE_PCI_SUPPORTED
+#define FAKE_PCI_CLASS 0x030200 // display controller, 3D
+#define FAKE_PCI_REVISION 0xa1
+#define FAKE_PCI_COMMAND_MASK (PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER | PCI_COMMAND_PARITY | \
+                               PCI_COMMAND_SERR | PCI_COMMAND_INTX_DISABLE)
+
+struct fake_pci_bus {
+    struct pci_sysdata sysdata;
+    struct pci_bus *bus;
+    struct resource busn;
+    struct list_head functions; // fake_gpu.pci_node, under g_pci_lock
+    unsigned int users;         // under g_gpus_lock
+};
+
+static DEFINE_XARRAY(g_pci_buses); // domain << 8 | bus -> struct fake_pci_bus
+static DEFINE_SPINLOCK(g_pci_lock);
+static bool g_pci_driver_registered = false;
+
+static struct fake_gpu *fake_pci_function(struct pci_bus *bus, unsigned int devfn) {
+    struct fake_pci_bus *fb = container_of(bus->sysdata, struct fake_pci_bus, sysdata);
+    struct fake_gpu *gpu;
+
+    list_for_each_entry(gpu, &fb->functions, pci_node) {
+        if (gpu->pci_devfn == devfn)
+            return gpu;
+    }
+    return NULL;
+}
+
+static u32 fake_pci_config_dword(const struct fake_gpu *gpu, int where) {
+    switch (where) {
+    case PCI_VENDOR_ID:
+        return FAKE_NVIDIA_PCI_VENDOR_ID | FAKE_NVIDIA_PCI_DEVICE_ID << 16;
+    case PCI_COMMAND:
+        return gpu->pci_command; // status: nothing to report
+    case PCI_CLASS_REVISION:
+        return FAKE_PCI_REVISION | FAKE_PCI_CLASS << 8;
+    case PCI_SUBSYSTEM_VENDOR_ID:
+        return FAKE_NVIDIA_PCI_VENDOR_ID | FAKE_NVIDIA_PCI_SUBSYSTEM_ID << 16;
+    case PCI_INTERRUPT_LINE:
+        return 1 << 8; // INTA
+    }
+    return 0; // single-function header type 0, BARs unimplemented
+}
+
+static int fake_pci_read(struct pci_bus *bus, unsigned int devfn, int where, int size, u32 *val) {
+    struct fake_gpu *gpu;
+    unsigned long flags;
+    u32 dword = 0;
+
+    spin_lock_irqsave(&g_pci_lock, flags);
+    gpu = fake_pci_function(bus, devfn);
+    if (gpu)
+        dword = fake_pci_config_dword(gpu, where & ~3);
+    spin_unlock_irqrestore(&g_pci_lock, flags);
+    if (!gpu) {
+        *val = ~0U;
+        return PCIBIOS_DEVICE_NOT_FOUND;
+    }
+    dword >>= 8 * (where & 3);
+    *val = size == 4 ? dword : dword & ((1U << (8 * size)) - 1);
+    return PCIBIOS_SUCCESSFUL;
+}
+
+// Only the command register is writable; BAR sizing and everything else read back unchanged.
+static int fake_pci_write(struct pci_bus *bus, unsigned int devfn, int where, int size, u32 val) {
+    struct fake_gpu *gpu;
+    unsigned long flags;
+
+    spin_lock_irqsave(&g_pci_lock, flags);
+    gpu = fake_pci_function(bus, devfn);
+    if (gpu && where < PCI_COMMAND + 2 && where + size > PCI_COMMAND) {
+        u32 mask = size == 4 ? ~0U : (1U << (8 * size)) - 1;
+        u32 dword = gpu->pci_command;
+        int shift = 8 * (where & 3);
+
+        dword = (dword & ~(mask << shift)) | (val & mask) << shift;
+        gpu->pci_command = dword & FAKE_PCI_COMMAND_MASK;
+    }
+    spin_unlock_irqrestore(&g_pci_lock, flags);
+    return gpu ? PCIBIOS_SUCCESSFUL : PCIBIOS_DEVICE_NOT_FOUND;
+}
+
+static struct pci_ops g_fake_pci_ops = {
+    .read  = fake_pci_read,
+    .write = fake_pci_write,
+};
+
+// The NUMA node of GPU `minor`: GPUs are spread over the online nodes in minor order.
+static int fake_pci_node(unsigned int minor) {
+    unsigned int count = max(gpu_count, minor + 1);
+    unsigned int k = div_u64((u64)minor * num_online_nodes(), count);
+    int node;
+
+    for_each_online_node(node) {
+        if (k-- == 0)
+            return node;
+    }
+    return NUMA_NO_NODE;
+}
+
+static struct fake_pci_bus *fake_pci_bus_get(unsigned int domain, unsigned int busnr, unsigned int minor) {
+    unsigned long key = (unsigned long)domain << 8 | busnr;
+    struct fake_pci_bus *fb = xa_load(&g_pci_buses, key);
+    LIST_HEAD(resources);
+    int ret;
+
+    if (fb) {
+        fb->users++;
+        return fb;
+    }
+    if (pci_find_bus(domain, busnr))
+        return ERR_PTR(-EEXIST);
+    fb = kzalloc(sizeof(*fb), GFP_KERNEL);
+    if (!fb)
+        return ERR_PTR(-ENOMEM);
+    fb->sysdata.domain = domain;
+#ifdef CONFIG_NUMA
+    fb->sysdata.node = fake_pci_node(minor);
+#endif
+    fb->busn = (struct resource){.name = "fake_nvidia", .start = busnr, .end = busnr, .flags = IORESOURCE_BUS};
+    INIT_LIST_HEAD(&fb->functions);
+    ret = xa_insert(&g_pci_buses, key, fb, GFP_KERNEL);
+    if (ret) {
+        kfree(fb);
+        return ERR_PTR(ret);
+    }
+    pci_add_resource(&resources, &fb->busn);
+    pci_lock_rescan_remove();
+    fb->bus = pci_create_root_bus(NULL, busnr, &g_fake_pci_ops, &fb->sysdata, &resources);
+    pci_unlock_rescan_remove();
+    if (!fb->bus) {
+        pci_free_resource_list(&resources);
+        xa_erase(&g_pci_buses, key);
+        kfree(fb);
+        return ERR_PTR(-ENODEV);
+    }
+    fb->users = 1;
+    return fb;
+}
+
+static void fake_pci_bus_put(struct fake_pci_bus *fb) {
+    if (--fb->users)
+        return;
+    pci_lock_rescan_remove();
+    pci_stop_root_bus(fb->bus);
+    pci_remove_root_bus(fb->bus);
+    pci_unlock_rescan_remove();
+    xa_erase(&g_pci_buses, (unsigned long)fb->sysdata.domain << 8 | fb->busn.start);
+    kfree(fb);
+}
+
+// Give a GPU being published its PCI function. Failures leave it without one. Called with
+// g_gpus_lock held.
+static void fake_pci_add(struct fake_gpu *gpu) {
+    unsigned int domain, busnr, device, function;
+    struct fake_pci_bus *fb;
+    struct pci_dev *pdev;
+    unsigned long flags;
+
+    if (!pci_bus || sscanf(gpu->bus_id, "%x:%x:%x.%x", &domain, &busnr, &device, &function) != 4)
+        return;
+    fb = fake_pci_bus_get(domain, busnr, gpu->minor);
+    if (IS_ERR(fb)) {
+        printk(KERN_WARNING "FAKE_NVIDIA: No PCI function for GPU %s: bus %04x:%02x %s (%ld).\n", gpu->bus_id,
+               domain, busnr, PTR_ERR(fb) == -EEXIST ? "belongs to the host" : "could not be created", PTR_ERR(fb));
+        return;
+    }
+    gpu->pci_devfn = PCI_DEVFN(device, function);
+    gpu->pci_command = 0;
+    spin_lock_irqsave(&g_pci_lock, flags);
+    list_add_tail(&gpu->pci_node, &fb->functions);
+    spin_unlock_irqrestore(&g_pci_lock, flags);
+    gpu->pci_bus = fb;
+
+    pci_lock_rescan_remove();
+    pdev = pci_scan_single_device(fb->bus, gpu->pci_devfn);
+    if (pdev)
+        pci_bus_add_device(pdev);
+    pci_unlock_rescan_remove();
+}
+
+// Called with g_gpus_lock held. The function is looked up rather than remembered: it may have
+// been removed, and rescanned, through sysfs in the meantime.
+static void fake_pci_remove(struct fake_gpu *gpu) {
+    struct fake_pci_bus *fb = gpu->pci_bus;
+    struct pci_dev *pdev;
+    unsigned long flags;
+
+    if (!fb)
+        return;
+    pdev = pci_get_slot(fb->bus, gpu->pci_devfn);
+    if (pdev) {
+        pci_stop_and_remove_bus_device_locked(pdev);
+        pci_dev_put(pdev);
+    }
+    spin_lock_irqsave(&g_pci_lock, flags);
+    list_del(&gpu->pci_node);
+    spin_unlock_irqrestore(&g_pci_lock, flags);
+    gpu->pci_bus = NULL;
+    fake_pci_bus_put(fb);
+}
+
+static int fake_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id) {
+    return pdev->bus->ops == &g_fake_pci_ops ? 0 : -ENODEV;
+}
+
+static void fake_pci_driver_remove(struct pci_dev *pdev) {
+}
+
+// No MODULE_DEVICE_TABLE: real NVIDIA GPUs must not load this module.
+static const struct pci_device_id g_fake_pci_ids[] = {
+    {PCI_DEVICE(FAKE_NVIDIA_PCI_VENDOR_ID, PCI_ANY_ID)},
+    {0},
+};
+
+static struct pci_driver g_fake_pci_driver = {
+    .name     = "nvidia",
+    .id_table = g_fake_pci_ids,
+    .probe    = fake_pci_probe,
+    .remove   = fake_pci_driver_remove,
+};
+
+static void fake_pci_register(void) {
+    int ret;
+
+    if (!pci_bus)
+        return;
+    ret = pci_register_driver(&g_fake_pci_driver);
+    if (ret)
+        printk(KERN_WARNING "FAKE_NVIDIA: PCI driver 'nvidia' not registered (%d); functions stay unbound.\n", ret);
+    g_pci_driver_registered = !ret;
+}
+
+// After the GPUs, and with them the root buses, are gone.
+static void fake_pci_unregister(void) {
+    if (g_pci_driver_registered)
+        pci_unregister_driver(&g_fake_pci_driver);
+    g_pci_driver_registered = false;
+}
+#else
+static void fake_pci_add(struct fake_gpu *gpu) {
+}
+
+static void fake_pci_remove(struct fake_gpu *gpu) {
+}
+
+static void fake_pci_register(void) {
+    if (pci_bus)
+        printk(KERN_WARNING "FAKE_NVIDIA: pci_bus needs an x86 kernel with PCI domains; ignored.\n");
+}
+
+static void fake_pci_unregister(void) {
+}
+#endif
+
+// --- Registry Updates ---
+// Empty the fields publish defaulted, so that a staged GPU gets the defaults of its next minor.
+static void fake_gpu_clear_defaults(struct fake_gpu *gpu) {
+    if (gpu->defaults & FAKE_GPU_DEFAULT_BUS_ID)
+        gpu->bus_id[0] = '\0';
+    if (gpu->defaults & FAKE_GPU_DEFAULT_UUID)
+        gpu->uuid[0] = '\0';
+    if (gpu->defaults & FAKE_GPU_DEFAULT_MODEL)
+        gpu->model[0] = '\0';
+    gpu->defaults = 0;
+}
+
+// Publish a GPU: pick the minor (the lowest free one when `minor` is negative), fill in the
+// defaults for empty fields, create its proc entry and device node and announce it on the event
+// channel. Called with g_gpus_lock held.
+static int fake_gpu_publish(struct fake_gpu *gpu, int minor) {
+    struct fake_gpu *pos;
+    int ret;
+
+    if (minor < 0)
+        minor = find_first_zero_bit(g_gpu_minors, FAKE_GPU_MAX);
+    if (minor >= FAKE_GPU_MAX || test_bit(minor, g_gpu_minors) || !fake_state_slot(minor))
+        return -ENOSPC;
+    gpu->bar1 = fake_bar1_create(minor);
+    if (!gpu->bar1)
+        return -ENOMEM;
+    gpu->minor = minor;
+    gpu->defaults = 0;
+    if (gpu->bus_id[0] == '\0') {
+        fake_gpu_default_bus_id(gpu->minor, gpu->bus_id, sizeof(gpu->bus_id));
+        gpu->defaults |= FAKE_GPU_DEFAULT_BUS_ID;
+    }
+    if (gpu->uuid[0] == '\0') {
+        snprintf(gpu->uuid, sizeof(gpu->uuid), "GPU-%u-FAKE-UUID", gpu->minor);
+        gpu->defaults |= FAKE_GPU_DEFAULT_UUID;
+    }
+    if (gpu->model[0] == '\0') {
+        strscpy(gpu->model, model, sizeof(gpu->model));
+        gpu->defaults |= FAKE_GPU_DEFAULT_MODEL;
+    }
+
+    // proc_mkdir refuses an existing name, which doubles as the duplicate bus ID check.
+    gpu->proc_dir = proc_mkdir(gpu->bus_id, g_proc_gpus_dir);
+    if (!gpu->proc_dir) {
+        ret = -EEXIST;
+        goto err_bar1;
+    }
+    if (!proc_create_data("information", 0444, gpu->proc_dir, &g_information_fops, gpu)) {
+        ret = -ENOMEM;
+        goto err_proc;
+    }
+    gpu->dev = NULL;
+    if (gpu->minor < NV_GPU_DEVICE_MINOR_LIMIT) {
+        gpu->dev = device_create(g_nvidia_class, NULL, MKDEV(NV_MAJOR_DEVICE_NUMBER, gpu->minor), NULL,
+                                 "nvidia%u", gpu->minor);
+        if (IS_ERR(gpu->dev)) {
+            ret = PTR_ERR(gpu->dev);
+            gpu->dev = NULL;
+            goto err_proc;
+        }
+    }
+
+    set_bit(gpu->minor, g_gpu_minors);
+    // Keep the list in minor order; load-time GPUs arrive in order and append in O(1).
+    list_for_each_entry_reverse(pos, &g_gpus, node) {
+        if (pos->minor < gpu->minor)
+            break;
+    }
+    list_add(&gpu->node, &pos->node);
+    fake_state_publish(gpu);
+    fake_pci_add(gpu);
+    fake_event_emit(FAKE_NVIDIA_EVENT_GPU_ADDED, gpu->minor, 0);
+    return 0;
+
+err_proc:
+    proc_remove(gpu->proc_dir);
+    gpu->proc_dir = NULL;
+err_bar1:
+    fake_bar1_put(gpu->bar1);
+    gpu->bar1 = NULL;
+    fake_gpu_clear_defaults(gpu);
+    return ret;
+}
+
+// Unpublish a GPU. proc_remove waits for readers inside the proc callbacks and cuts off open
+// files, so the entry may be freed afterwards; open device files and mappings only reference its
+// BAR1 region, which outlives it as long as they need. Called with g_gpus_lock held.
+static void fake_gpu_unpublish(struct fake_gpu *gpu) {
+    fake_pci_remove(gpu);
+    list_del(&gpu->node);
+    clear_bit(gpu->minor, g_gpu_minors);
+    if (gpu->dev)
+        device_unregister(gpu->dev);
+    gpu->dev = NULL;
+    proc_remove(gpu->proc_dir);
+    gpu->proc_dir = NULL;
+    fake_state_unpublish(gpu);
+    fake_bar1_put(gpu->bar1);
+    gpu->bar1 = NULL;
+    fake_event_emit(FAKE_NVIDIA_EVENT_GPU_REMOVED, gpu->minor, 0);
+    fake_gpu_clear_defaults(gpu);
+}
+
+// Create the load-time GPUs from gpu_count and bus_ids.
+static int fake_gpu_create_initial(void) {
+    char *list = NULL, *cursor = NULL;
+    unsigned int i;
+    int ret = 0;
+
+    if (bus_ids != NULL && bus_ids[0] != '\0') {
+        list = kstrdup(bus_ids, GFP_KERNEL);
+        if (list == NULL)
+            return -ENOMEM;
+        cursor = list;
+    }
+    mutex_lock(&g_gpus_lock);
+    for (i = 0; i < gpu_count; i++) {
+        struct fake_gpu *gpu = kzalloc(sizeof(*gpu), GFP_KERNEL);
+        char *token = cursor ? strsep(&cursor, ",") : NULL;
+
+        if (!gpu) {
+            ret = -ENOMEM;
+            break;
+        }
+        if (token && fake_gpu_parse_bus_id(token, gpu->bus_id, sizeof(gpu->bus_id))) {
+            printk(KERN_ERR "FAKE_NVIDIA: Invalid bus ID '%s' in bus_ids.\n", token);
+            ret = -EINVAL;
+        } else {
+            ret = fake_gpu_publish(gpu, i);
+            if (ret)
+                printk(KERN_ERR "FAKE_NVIDIA: Failed to publish GPU %u (%d, duplicate bus ID?).\n", i, ret);
+        }
+        if (ret) {
+            kfree(gpu);
+            break;
+        }
+    }
+    mutex_unlock(&g_gpus_lock);
+    kfree(list);
+    return ret;
+}
+
+static void fake_gpu_destroy_all(void) {
+    struct fake_gpu *gpu, *tmp;
+
+    mutex_lock(&g_gpus_lock);
+    list_for_each_entry_safe(gpu, tmp, &g_gpus, node) {
+        fake_gpu_unpublish(gpu);
+        kfree(gpu);
+    }
+    mutex_unlock(&g_gpus_lock);
+}
+
+// --- configfs: Runtime GPU Add/Remove ---
+// /sys/kernel/config/fake_nvidia/<name> is a GPU. A new directory is staged: set any of bus_id,
+// uuid and model (empty means the default for its minor), then write 1 to `enabled` to publish
+// it. Writing 0 to `enabled` or removing the directory unpublishes it. Attributes of a published
+// GPU are read-only; disable, change and re-enable to modify one.
+#if IS_ENABLED(CONFIG_CONFIGFS_FS)
+struct fake_gpu_item {
+    struct config_item item;
+    struct mutex lock; // serializes attribute writes against enable/disable
+    bool enabled;
+    struct fake_gpu gpu; // staged fields; linked into the registry while enabled
+};
+
+static inline struct fake_gpu_item *to_fake_gpu_item(struct config_item *item) {
+    return container_of(item, struct fake_gpu_item, item);
+}
+
+// Reads and writes of a text attribute of the staged GPU.
+static ssize_t fake_gpu_item_show_field(struct config_item *item, const char *field, char *page) {
+    return sprintf(page, "%s\n", field);
+}
+
+static ssize_t fake_gpu_item_store_field(struct config_item *item, char *field, size_t size,
+                                         const char *page, size_t count, bool bus_id) {
+    struct fake_gpu_item *gi = to_fake_gpu_item(item);
+    ssize_t ret = count;
+
+    mutex_lock(&gi->lock);
+    if (gi->enabled) {
+        ret = -EBUSY;
+    } else if (bus_id) {
+        if (count > 1 && fake_gpu_parse_bus_id(page, field, size))
+            ret = -EINVAL;
+        else if (count <= 1)
+            field[0] = '\0';
+    } else if (count >= size) {
+        ret = -EINVAL;
+    } else {
+        strscpy(field, page, size);
+        strim(field);
+    }
+    mutex_unlock(&gi->lock);
+    return ret;
+}
+
+static ssize_t fake_gpu_item_bus_id_show(struct config_item *item, char *page) {
+    return fake_gpu_item_show_field(item, to_fake_gpu_item(item)->gpu.bus_id, page);
+}
+
+static ssize_t fake_gpu_item_bus_id_store(struct config_item *item, const char *page, size_t count) {
+    struct fake_gpu *gpu = &to_fake_gpu_item(item)->gpu;
+
+    return fake_gpu_item_store_field(item, gpu->bus_id, sizeof(gpu->bus_id), page, count, true);
+}
+
+static ssize_t fake_gpu_item_uuid_show(struct config_item *item, char *page) {
+    return fake_gpu_item_show_field(item, to_fake_gpu_item(item)->gpu.uuid, page);
+}
+
+static ssize_t fake_gpu_item_uuid_store(struct config_item *item, const char *page, size_t count) {
+    struct fake_gpu *gpu = &to_fake_gpu_item(item)->gpu;
+
+    return fake_gpu_item_store_field(item, gpu->uuid, sizeof(gpu->uuid), page, count, false);
+}
+
+static ssize_t fake_gpu_item_model_show(struct config_item *item, char *page) {
+    return fake_gpu_item_show_field(item, to_fake_gpu_item(item)->gpu.model, page);
+}
+
+static ssize_t fake_gpu_item_model_store(struct config_item *item, const char *page, size_t count) {
+    struct fake_gpu *gpu = &to_fake_gpu_item(item)->gpu;
+
+    return fake_gpu_item_store_field(item, gpu->model, sizeof(gpu->model), page, count, false);
+}
+
+static ssize_t fake_gpu_item_minor_show(struct config_item *item, char *page) {
+    struct fake_gpu_item *gi = to_fake_gpu_item(item);
+
+    return gi->enabled ? sprintf(page, "%u\n", gi->gpu.minor) : sprintf(page, "\n");
+}
+
+static ssize_t fake_gpu_item_enabled_show(struct config_item *item, char *page) {
+    return sprintf(page, "%d\n", to_fake_gpu_item(item)->enabled);
+}
+
+static ssize_t fake_gpu_item_enabled_store(struct config_item *item, const char *page, size_t count) {
+    struct fake_gpu_item *gi = to_fake_gpu_item(item);
+    bool enable;
+    int ret = kstrtobool(page, &enable);
+
+    if (ret)
+        return ret;
+    mutex_lock(&gi->lock);
+    if (enable != gi->enabled) {
+        mutex_lock(&g_gpus_lock);
+        if (enable) {
+            ret = fake_gpu_publish(&gi->gpu, -1);
+        } else {
+            fake_gpu_unpublish(&gi->gpu);
+        }
+        mutex_unlock(&g_gpus_lock);
+        if (ret == 0)
+            gi->enabled = enable;
+    }
+    mutex_unlock(&gi->lock);
+    return ret ? ret : count;
+}
+
+CONFIGFS_ATTR(fake_gpu_item_, bus_id);
+CONFIGFS_ATTR(fake_gpu_item_, uuid);
+CONFIGFS_ATTR(fake_gpu_item_, model);
+CONFIGFS_ATTR_RO(fake_gpu_item_, minor);
+CONFIGFS_ATTR(fake_gpu_item_, enabled);
+
+static struct configfs_attribute *g_fake_gpu_item_attrs[] = {
+    &fake_gpu_item_attr_bus_id,
+    &fake_gpu_item_attr_uuid,
+    &fake_gpu_item_attr_model,
+    &fake_gpu_item_attr_minor,
+    &fake_gpu_item_attr_enabled,
+    NULL,
+};
+
+static void fake_gpu_item_release(struct config_item *item) {
+    struct fake_gpu_item *gi = to_fake_gpu_item(item);
+
+    if (gi->enabled) {
+        mutex_lock(&g_gpus_lock);
+        fake_gpu_unpublish(&gi->gpu);
+        mutex_unlock(&g_gpus_lock);
+    }
+    kfree(gi);
+}
+
+static struct configfs_item_operations g_fake_gpu_item_ops = {
+    .release = fake_gpu_item_release,
+};
+
+static const struct config_item_type g_fake_gpu_item_type = {
+    .ct_item_ops = &g_fake_gpu_item_ops,
+    .ct_attrs    = g_fake_gpu_item_attrs,
+    .ct_owner    = THIS_MODULE,
+};
+
+static struct config_item *fake_gpu_make_item(struct config_group *group, const char *name) {
+    struct fake_gpu_item *gi = kzalloc(sizeof(*gi), GFP_KERNEL);
+
+    if (!gi)
+        return ERR_PTR(-ENOMEM);
+    mutex_init(&gi->lock);
+    INIT_LIST_HEAD(&gi->gpu.node);
+    config_item_init_type_name(&gi->item, name, &g_fake_gpu_item_type);
+    return &gi->item;
+}
+
+static struct configfs_group_operations g_fake_gpu_group_ops = {
+    .make_item = fake_gpu_make_item,
+};
+
+static const struct config_item_type g_fake_gpu_group_type = {
+    .ct_group_ops = &g_fake_gpu_group_ops,
+    .ct_owner     = THIS_MODULE,
+};
+
+static struct configfs_subsystem g_fake_gpu_subsys = {
+    .su_group = {
+        .cg_item = {
+            .ci_namebuf = "fake_nvidia",
+            .ci_type    = &g_fake_gpu_group_type,
+        },
+    },
 };
+
+static int fake_gpu_configfs_register(void) {
+    config_group_init(&g_fake_gpu_subsys.su_group);
+    mutex_init(&g_fake_gpu_subsys.su_mutex);
+    return configfs_register_subsystem(&g_fake_gpu_subsys);
+}
+
+static void fake_gpu_configfs_unregister(void) {
+    configfs_unregister_subsystem(&g_fake_gpu_subsys);
+}
+#else
+static int fake_gpu_configfs_register(void) {
+    printk(KERN_INFO "FAKE_NVIDIA: configfs is not available; GPUs are fixed at load time.\n");
+    return 0;
+}
+
+static void fake_gpu_configfs_unregister(void) {
+}
 #endif
 
 static int __init fake_nvidia_init(void) {
-    struct proc_dir_entry *gpus_dir;
+    int ret;
+
+    printk(KERN_INFO "FAKE_NVIDIA: Loading Fake NVIDIA Driver Module (v19 - %u GPUs, driver %s)...\n",
+           gpu_count, driver_version);
+
+    if (gpu_count > FAKE_GPU_MAX) {
+        printk(KERN_ERR "FAKE_NVIDIA: gpu_count %u exceeds the maximum of %u.\n", gpu_count, FAKE_GPU_MAX);
+        return -EINVAL;
+    }
+    if (telemetry_hz > FAKE_TELEMETRY_MAX_HZ) {
+        printk(KERN_ERR "FAKE_NVIDIA: telemetry_hz %u exceeds the maximum of %u.\n", telemetry_hz,
+               FAKE_TELEMETRY_MAX_HZ);
+        return -EINVAL;
+    }
+    if (cgroup_filter && !IS_ENABLED(FAKE_CGROUP_FILTER_SUPPORTED))
+        printk(KERN_WARNING "FAKE_NVIDIA: cgroup_filter needs kernel 5.9 or later; all GPUs stay visible.\n");
 
-    printk(KERN_INFO "FAKE_NVIDIA: Loading Fake NVIDIA Driver Module (v6 - Correct GPU Path)...\n");
+    ret = fake_state_alloc();
+    if (ret)
+        return ret;
+    fake_stats_register();
+    fake_bar1_stats_register();
+    ret = fake_nvidia_chrdev_register();
+    if (ret)
+        goto err_state;
+    ret = misc_register(&g_events_misc);
+    if (ret) {
+        printk(KERN_ERR "FAKE_NVIDIA: Failed to create /dev/fake-nvidia-events (%d).\n", ret);
+        goto err_chrdev;
+    }
 
     // Create the /proc/driver/nvidia directory directly using the path.
     g_proc_nvidia_dir = proc_mkdir("driver/nvidia", NULL);
     if (!g_proc_nvidia_dir) {
         printk(KERN_ERR "FAKE_NVIDIA: Failed to create directory /proc/driver/nvidia.\n");
-        return -ENOMEM;
+        ret = -ENOMEM;
+        goto err_events;
     }
 
     // Create files and subdirectories under it.
     proc_create("version", 0444, g_proc_nvidia_dir, &g_version_fops);
-    gpus_dir = proc_mkdir("gpus", g_proc_nvidia_dir);
-    
-    if (gpus_dir) {
-        // *** This is the only modification ***
-        // According to the error log, the program needs '0000:00:00.0'.
-        proc_mkdir("0000:00:00.0", gpus_dir);
+    proc_create("fake_gpus", 0444, g_proc_nvidia_dir, &g_fake_gpus_fops);
+    g_proc_gpus_dir = proc_mkdir("gpus", g_proc_nvidia_dir);
+    if (!g_proc_gpus_dir) {
+        ret = -ENOMEM;
+        goto err_remove;
     }
+    ret = fake_proc_create_driver_files();
+    if (ret)
+        goto err_remove;
+    fake_pci_register();
+    ret = fake_gpu_create_initial();
+    if (ret)
+        goto err_gpus;
+    ret = fake_gpu_configfs_register();
+    if (ret) {
+        printk(KERN_ERR "FAKE_NVIDIA: Failed to register the configfs subsystem (%d).\n", ret);
+        goto err_gpus;
+    }
+    fake_telemetry_start();
 
-    printk(KERN_INFO "FAKE_NVIDIA: Module loaded and /proc/driver/nvidia structure created successfully.\n");
+    printk(KERN_INFO "FAKE_NVIDIA: Module loaded; /proc/driver/nvidia and /dev/nvidia* created successfully.\n");
     return 0;
+
+err_gpus:
+    fake_gpu_destroy_all();
+    fake_pci_unregister();
+err_remove:
+    proc_remove(g_proc_nvidia_dir);
+    g_proc_nvidia_dir = NULL;
+err_events:
+    misc_deregister(&g_events_misc);
+err_chrdev:
+    fake_nvidia_chrdev_unregister();
+err_state:
+    fake_stats_unregister();
+    fake_state_free();
+    return ret;
 }
 
 // Module exit function.
 static void __exit fake_nvidia_exit(void) {
-    printk(KERN_INFO "FAKE_NVIDIA: Unloading Fake NVIDIA Driver Module (v6)...\n");
-    
+    printk(KERN_INFO "FAKE_NVIDIA: Unloading Fake NVIDIA Driver Module (v19)...\n");
+
+    // configfs pins the module while GPU directories exist, so only load-time GPUs remain here.
+    fake_gpu_configfs_unregister();
+    fake_telemetry_stop();
+    fake_gpu_destroy_all();
+    fake_pci_unregister();
     if (g_proc_nvidia_dir) {
         // proc_remove is recursive, so it will clean up subdirectories and files.
         proc_remove(g_proc_nvidia_dir);
     }
-    
+    misc_deregister(&g_events_misc);
+    fake_nvidia_chrdev_unregister();
+    fake_stats_unregister();
+    fake_state_free();
+
     printk(KERN_INFO "FAKE_NVIDIA: Cleanup complete.\n");
 }
 
@@ -70,4 +2387,4 @@ module_exit(fake_nvidia_exit);
 
 MODULE_LICENSE("MIT");
 MODULE_AUTHOR("ssst0n3 with gemini-2.5-pro, patched for multi-kernel by ChatGPT");
-MODULE_DESCRIPTION("A fake driver with the correct GPU PCI path for nvidia-container-cli.");
\ No newline at end of file
+MODULE_DESCRIPTION("A fake driver with the correct GPU PCI path for nvidia-container-cli.");
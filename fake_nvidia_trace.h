@@ -0,0 +1,167 @@
+/**
+ * fake_nvidia_trace.h
+ *
+ * Tracepoints of fake_nvidia_driver, one per access to its /proc files and device nodes and one per
+ * BAR1 page fault, so that the cost of a container start can be attributed with perf or bpftrace:
+ *
+ *   perf stat -e 'fake_nvidia:*' -a -- docker run --runtime=nvidia --gpus=all busybox true
+ *   bpftrace -e 'tracepoint:fake_nvidia:fake_nvidia_proc_read { @[args->comm, str(args->name)] = count(); }'
+ *
+ * Every event records the calling process (tgid, comm) and the ID of its cgroup v2 cgroup, the
+ * same ID as bpftrace's `cgroup` and the inode number of the cgroup's directory.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fake_nvidia
+
+#if !defined(FAKE_NVIDIA_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define FAKE_NVIDIA_TRACE_H
+
+#include <linux/cgroup.h>
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+#include <linux/version.h>
+
+// Read once per event, and only while the event is enabled.
+#ifndef FAKE_NVIDIA_TRACE_HELPERS
+#define FAKE_NVIDIA_TRACE_HELPERS
+static inline u64 fake_nvidia_trace_cgroup(void) {
+#if defined(CONFIG_CGROUPS) && LINUX_VERSION_CODE >= KERNEL_VERSION(5,5,0)
+    u64 id;
+
+    rcu_read_lock();
+    id = cgroup_id(task_dfl_cgroup(current));
+    rcu_read_unlock();
+    return id;
+#else
+    return 0;
+#endif
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,10,0)
+#define fake_nvidia_assign_str(field, src) __assign_str(field)
+#else
+#define fake_nvidia_assign_str(field, src) __assign_str(field, src)
+#endif
+#endif
+
+#define FAKE_NVIDIA_TRACE_TASK_FIELDS      \
+    __field(pid_t, pid)                    \
+    __array(char, comm, TASK_COMM_LEN)     \
+    __field(u64, cgroup)
+
+#define FAKE_NVIDIA_TRACE_TASK_ASSIGN                          \
+    __entry->pid = task_tgid_nr(current);                      \
+    memcpy(__entry->comm, current->comm, TASK_COMM_LEN);       \
+    __entry->cgroup = fake_nvidia_trace_cgroup();
+
+// A read() of a file under /proc/driver/nvidia; `name` is the file's name.
+TRACE_EVENT(fake_nvidia_proc_read,
+    TP_PROTO(const char *name, size_t count, loff_t pos),
+    TP_ARGS(name, count, pos),
+    TP_STRUCT__entry(
+        FAKE_NVIDIA_TRACE_TASK_FIELDS
+        __string(name, name)
+        __field(size_t, count)
+        __field(loff_t, pos)
+    ),
+    TP_fast_assign(
+        FAKE_NVIDIA_TRACE_TASK_ASSIGN
+        fake_nvidia_assign_str(name, name);
+        __entry->count = count;
+        __entry->pos = pos;
+    ),
+    TP_printk("pid=%d comm=%s cgroup=%llu name=%s count=%zu pos=%lld", __entry->pid, __entry->comm,
+              __entry->cgroup, __get_str(name), __entry->count, __entry->pos)
+);
+
+// An open() of a device node of the module.
+TRACE_EVENT(fake_nvidia_dev_open,
+    TP_PROTO(dev_t dev, int ret),
+    TP_ARGS(dev, ret),
+    TP_STRUCT__entry(
+        FAKE_NVIDIA_TRACE_TASK_FIELDS
+        __field(dev_t, dev)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        FAKE_NVIDIA_TRACE_TASK_ASSIGN
+        __entry->dev = dev;
+        __entry->ret = ret;
+    ),
+    TP_printk("pid=%d comm=%s cgroup=%llu dev=%u:%u ret=%d", __entry->pid, __entry->comm, __entry->cgroup,
+              MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ret)
+);
+
+// An mmap() of /dev/nvidiactl or a GPU node.
+TRACE_EVENT(fake_nvidia_dev_mmap,
+    TP_PROTO(dev_t dev, unsigned long len, unsigned long pgoff, int ret),
+    TP_ARGS(dev, len, pgoff, ret),
+    TP_STRUCT__entry(
+        FAKE_NVIDIA_TRACE_TASK_FIELDS
+        __field(dev_t, dev)
+        __field(unsigned long, len)
+        __field(unsigned long, pgoff)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        FAKE_NVIDIA_TRACE_TASK_ASSIGN
+        __entry->dev = dev;
+        __entry->len = len;
+        __entry->pgoff = pgoff;
+        __entry->ret = ret;
+    ),
+    TP_printk("pid=%d comm=%s cgroup=%llu dev=%u:%u len=%lu pgoff=%lu ret=%d", __entry->pid, __entry->comm,
+              __entry->cgroup, MAJOR(__entry->dev), MINOR(__entry->dev), __entry->len, __entry->pgoff,
+              __entry->ret)
+);
+
+// An ioctl() on /dev/nvidiactl or a GPU node.
+TRACE_EVENT(fake_nvidia_dev_ioctl,
+    TP_PROTO(dev_t dev, unsigned int cmd, long ret),
+    TP_ARGS(dev, cmd, ret),
+    TP_STRUCT__entry(
+        FAKE_NVIDIA_TRACE_TASK_FIELDS
+        __field(dev_t, dev)
+        __field(unsigned int, cmd)
+        __field(long, ret)
+    ),
+    TP_fast_assign(
+        FAKE_NVIDIA_TRACE_TASK_ASSIGN
+        __entry->dev = dev;
+        __entry->cmd = cmd;
+        __entry->ret = ret;
+    ),
+    TP_printk("pid=%d comm=%s cgroup=%llu dev=%u:%u cmd=%#x ret=%ld", __entry->pid, __entry->comm,
+              __entry->cgroup, MAJOR(__entry->dev), MINOR(__entry->dev), __entry->cmd, __entry->ret)
+);
+
+// A page fault in the BAR1 region of GPU `minor`; `populated` when it allocated the page.
+TRACE_EVENT(fake_nvidia_bar1_fault,
+    TP_PROTO(unsigned int minor, unsigned long pgoff, bool write, bool populated),
+    TP_ARGS(minor, pgoff, write, populated),
+    TP_STRUCT__entry(
+        FAKE_NVIDIA_TRACE_TASK_FIELDS
+        __field(unsigned int, minor)
+        __field(unsigned long, pgoff)
+        __field(bool, write)
+        __field(bool, populated)
+    ),
+    TP_fast_assign(
+        FAKE_NVIDIA_TRACE_TASK_ASSIGN
+        __entry->minor = minor;
+        __entry->pgoff = pgoff;
+        __entry->write = write;
+        __entry->populated = populated;
+    ),
+    TP_printk("pid=%d comm=%s cgroup=%llu minor=%u pgoff=%lu write=%d populated=%d", __entry->pid,
+              __entry->comm, __entry->cgroup, __entry->minor, __entry->pgoff, __entry->write, __entry->populated)
+);
+
+#endif // FAKE_NVIDIA_TRACE_H
+
+// This part must be outside the include guard.
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fake_nvidia_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,178 @@
+/**
+ * fake_nvidia_uapi.h
+ *
+ * The interface between fake_nvidia_driver and its user-space clients, included by the kernel
+ * module (fake_nvidia_driver.c) and the NVML shim (fake_nvml.c). Only fixed-size types: the
+ * records are read by 32- and 64-bit processes alike.
+ */
+#ifndef FAKE_NVIDIA_UAPI_H
+#define FAKE_NVIDIA_UAPI_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+// --- PCI Identity ---
+// Every fake GPU is a Tesla T4 on the PCI bus: NVML's pciDeviceId and pciSubSystemId and, with the
+// module's virtual PCI bus, /sys/bus/pci/devices/<bus id>/{vendor,device,subsystem_*}.
+#define FAKE_NVIDIA_PCI_VENDOR_ID 0x10de
+#define FAKE_NVIDIA_PCI_DEVICE_ID 0x1eb8
+#define FAKE_NVIDIA_PCI_SUBSYSTEM_ID 0x12a2
+
+// --- Event Channel (/dev/fake-nvidia-events) ---
+// Every open for reading gets its own queue of the events raised after the open; read() returns
+// whole struct fake_nvidia_event records and blocks (or fails with EAGAIN under O_NONBLOCK) while
+// the queue is empty, and poll/epoll report POLLIN when it is not. Writes inject an event, one
+// text command per write:
+//
+//   xid <minor> <code>     Xid error <code> on GPU /dev/nvidia<minor>
+//   sbe <minor> [count]    single-bit ECC error(s)
+//   dbe <minor> [count]    double-bit ECC error(s)
+//
+// Adding and removing a GPU through configfs raises the hot-plug events.
+// With the module's cgroup_filter, a reader only gets the events of GPUs whose device node its
+// device cgroup allowed when it opened the channel.
+#define FAKE_NVIDIA_EVENTS_DEVICE "/dev/fake-nvidia-events"
+
+// The error types use the bit of the matching nvmlEventType* constant.
+#define FAKE_NVIDIA_EVENT_SBE_ECC     0x0000000000000001ULL
+#define FAKE_NVIDIA_EVENT_DBE_ECC     0x0000000000000002ULL
+#define FAKE_NVIDIA_EVENT_XID         0x0000000000000008ULL
+#define FAKE_NVIDIA_EVENT_GPU_ADDED   0x0000000100000000ULL
+#define FAKE_NVIDIA_EVENT_GPU_REMOVED 0x0000000200000000ULL
+// The reader's queue overflowed; `data` is the number of events it missed, `minor` is unused.
+#define FAKE_NVIDIA_EVENT_LOST        0x8000000000000000ULL
+
+struct fake_nvidia_event {
+    __u64 type;         // one FAKE_NVIDIA_EVENT_* bit
+    __u64 data;         // Xid code, ECC error count; 0 for hot-plug events
+    __u64 timestamp_ns; // CLOCK_REALTIME
+    __u32 minor;        // GPU minor number
+    __u32 reserved;
+};
+
+// --- State Page (mmap of /dev/nvidiactl) ---
+// The module keeps the state of every GPU in a shared area that clients map read-only: a header,
+// then one slot per GPU minor at header.slot_offset + minor * header.slot_size. A slot holds the
+// GPU's identity, its telemetry and the ledger of device memory charged by processes. Map the
+// header first, then header.size bytes. The module is the only writer: it makes `seq` odd while it
+// updates a slot and even again when done, so readers copy what they need and retry when `seq`
+// was odd or has changed. Changes go through the ioctls below.
+#define FAKE_NVIDIA_CONTROL_DEVICE "/dev/nvidiactl"
+#define FAKE_NVIDIA_STATE_MAGIC 0x53564e46 // "FNVS"
+#define FAKE_NVIDIA_STATE_VERSION 1
+#define FAKE_NVIDIA_STATE_PROCS 48
+
+// Slot flags.
+#define FAKE_NVIDIA_GPU_PRESENT 0x1
+// The telemetry was set through FAKE_NVIDIA_IOC_SET_TELEMETRY and the producer leaves it alone.
+#define FAKE_NVIDIA_GPU_TELEMETRY_SET 0x2
+
+// Telemetry of a GPU nobody has set any for: an idle Tesla T4. Its memory size follows the model
+// (fake_gpu_profiles.h).
+#define FAKE_NVIDIA_IDLE_POWER_MW 12000
+#define FAKE_NVIDIA_IDLE_POWER_LIMIT_MW 70000
+#define FAKE_NVIDIA_IDLE_TEMPERATURE_C 30
+
+struct fake_nvidia_state_header {
+    __u32 magic;
+    __u32 version;
+    __u32 size;        // bytes to map
+    __u32 slot_offset;
+    __u32 slot_size;
+    __u32 slot_count;  // GPU minors covered by the page
+    __u32 generation;  // incremented whenever a GPU is added or removed
+    __u32 telemetry_hz; // rate of the module's telemetry producer; 0 when it is off
+    char driver_version[32];
+};
+
+struct fake_nvidia_state_proc {
+    __u32 pid; // in the initial PID namespace, as the real driver reports it
+    __u32 reserved;
+    __u64 used_memory;
+};
+
+// Energy keeps accruing at power_mw after timestamp_ns: the energy consumed until a later time t
+// is energy_mj + power_mw * (t - timestamp_ns) / 1e9.
+struct fake_nvidia_state_telemetry {
+    __u64 energy_mj;
+    __u64 timestamp_ns; // CLOCK_MONOTONIC
+    __u32 gpu_util;     // percent
+    __u32 memory_util;  // percent
+    __u32 power_mw;
+    __u32 power_limit_mw;
+    __u32 temperature_c;
+    __u32 reserved;
+};
+
+// Bytes moved over the GPU's links since it was added, as NVML's PCIe and NVLink counters report
+// them: tx leaves the GPU, rx enters it. NVLink traffic is the sum over all of the GPU's links.
+struct fake_nvidia_state_links {
+    __u64 pcie_tx_bytes;
+    __u64 pcie_rx_bytes;
+    __u64 nvlink_tx_bytes;
+    __u64 nvlink_rx_bytes;
+};
+
+struct fake_nvidia_state_gpu {
+    __u32 seq;
+    __u32 flags;
+    __u32 minor;
+    __u32 process_count; // valid entries of procs[]
+    char bus_id[16];
+    char uuid[48];
+    char model[64];
+    __u64 memory_total;
+    __u64 memory_used;   // sum of procs[].used_memory
+    struct fake_nvidia_state_telemetry telemetry;
+    struct fake_nvidia_state_links links;
+    __u8 reserved[24];
+    struct fake_nvidia_state_proc procs[FAKE_NVIDIA_STATE_PROCS];
+};
+
+// --- Control ioctls (/dev/nvidiactl) ---
+#define FAKE_NVIDIA_IOC_MAGIC 'f'
+
+// Set the telemetry of a GPU; needs CAP_SYS_ADMIN. Energy is not set: it accrues from power. The
+// values stay until the next call: the telemetry producer skips the GPU from then on, unless the
+// call has FAKE_NVIDIA_TELEMETRY_PRODUCER in `flags`, which ignores the values and hands the GPU
+// back to the producer.
+#define FAKE_NVIDIA_TELEMETRY_PRODUCER 0x1
+
+struct fake_nvidia_set_telemetry {
+    __u32 minor;
+    __u32 gpu_util;
+    __u32 memory_util;
+    __u32 power_mw;
+    __u32 temperature_c;
+    __u32 flags;
+};
+#define FAKE_NVIDIA_IOC_SET_TELEMETRY _IOW(FAKE_NVIDIA_IOC_MAGIC, 1, struct fake_nvidia_set_telemetry)
+
+// Charge (bytes > 0) or release (bytes < 0) device memory of a GPU to the calling process. The
+// charges of an open file are released when it is closed, like the allocations of a process when
+// it exits. Fails with ENOMEM when the GPU's memory is exhausted, EBADF unless the file is open
+// for writing, and EPERM when the caller's device cgroup denies read-write access to
+// /dev/nvidia<minor> (CAP_SYS_ADMIN overrides).
+struct fake_nvidia_ledger {
+    __u32 minor;
+    __u32 reserved;
+    __s64 bytes;
+};
+#define FAKE_NVIDIA_IOC_LEDGER _IOW(FAKE_NVIDIA_IOC_MAGIC, 2, struct fake_nvidia_ledger)
+
+// Add traffic to the link counters of a GPU. Copy engines (the fake libcuda) report every
+// transfer here, so all processes see it in NVML. Permissions are those of FAKE_NVIDIA_IOC_LEDGER;
+// each direction takes at most FAKE_NVIDIA_LINK_TRAFFIC_MAX bytes per call (EINVAL beyond).
+#define FAKE_NVIDIA_LINK_PCIE 0
+#define FAKE_NVIDIA_LINK_NVLINK 1
+#define FAKE_NVIDIA_LINK_TRAFFIC_MAX (1ULL << 30)
+
+struct fake_nvidia_link_traffic {
+    __u32 minor;
+    __u32 link;     // FAKE_NVIDIA_LINK_*
+    __u64 tx_bytes;
+    __u64 rx_bytes;
+};
+#define FAKE_NVIDIA_IOC_LINK_TRAFFIC _IOW(FAKE_NVIDIA_IOC_MAGIC, 3, struct fake_nvidia_link_traffic)
+
+#endif // FAKE_NVIDIA_UAPI_H
@@ -6,13 +6,19 @@
  * into believing that NVIDIA GPUs are present on a system.
  *
  * Compilation:
- *   gcc -shared -fPIC -o libnvidia-ml.so.1 fake_nvml.c -ldl
+ *   gcc -shared -fPIC -pthread -o libnvidia-ml.so.1 fake_nvml.c fake_nvml_stats.c -ldl -lrt
  *
  * Usage (without logs):
  *   LD_PRELOAD=./libnvidia-ml.so.1 nvidia-container-cli info
  *
  * Usage (with logs):
  *   FAKE_NVML_LOG=1 LD_PRELOAD=./libnvidia-ml.so.1 nvidia-container-cli info
+ *
+ * Usage (redundant-call report printed to stderr at exit):
+ *   FAKE_NVML_REDUNDANT=1 LD_PRELOAD=./libnvidia-ml.so.1 nvidia-container-cli info
+ *
+ * Usage (per-symbol call statistics published to /dev/shm for fake-nvml-exporter):
+ *   FAKE_NVML_STATS=1 LD_PRELOAD=./libnvidia-ml.so.1 nvidia-container-cli info
  */
 #define _GNU_SOURCE
 #include <stdio.h>
@@ -21,94 +27,18 @@
 #include <time.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
-// --- NVML Type Definitions (from nvml.h) ---
-typedef enum nvmlReturn_enum {
-    NVML_SUCCESS = 0,
-    NVML_ERROR_UNINITIALIZED = 1,
-    NVML_ERROR_INVALID_ARGUMENT = 2,
-    NVML_ERROR_NOT_SUPPORTED = 3,
-    NVML_ERROR_NO_PERMISSION = 4,
-    NVML_ERROR_ALREADY_INITIALIZED = 5,
-    NVML_ERROR_NOT_FOUND = 6,
-    NVML_ERROR_INSUFFICIENT_SIZE = 7,
-    NVML_ERROR_INSUFFICIENT_POWER = 8,
-    NVML_ERROR_DRIVER_NOT_LOADED = 9,
-    NVML_ERROR_TIMEOUT = 10,
-    NVML_ERROR_FUNCTION_NOT_FOUND = 13,
-    NVML_ERROR_UNKNOWN = 999
-} nvmlReturn_t;
-
-typedef struct nvmlDevice_st* nvmlDevice_t;
-
-typedef enum nvmlBrandType_enum {
-    NVML_BRAND_UNKNOWN = 0,
-    NVML_BRAND_TESLA = 2
-} nvmlBrandType_t;
-
-typedef enum nvmlEnableState_enum {
-    NVML_FEATURE_DISABLED = 0,
-    NVML_FEATURE_ENABLED = 1
-} nvmlEnableState_t;
-
-#define NVML_DEVICE_NAME_BUFFER_SIZE 64
-#define NVML_DEVICE_UUID_BUFFER_SIZE 80
-#define NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE 80
-#define NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE 32
-
-typedef struct nvmlPciInfo_st {
-    char busId[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
-    unsigned int domain;
-    unsigned int bus;
-    unsigned int device;
-    unsigned int pciDeviceId;
-    unsigned int pciSubSystemId;
-} nvmlPciInfo_t;
-
-// --- NVML extended PCI info (consumed by nvmlDeviceGetPciInfoExt; from nvml.h) ---
-// Distinct from nvmlPciInfo_t: carries a version field and PCI base/sub class codes.
-typedef struct {
-    unsigned int version;
-    unsigned int domain;
-    unsigned int bus;
-    unsigned int device;
-    unsigned int pciDeviceId;
-    unsigned int pciSubSystemId;
-    unsigned int baseClass;
-    unsigned int subClass;
-    char busId[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
-} nvmlPciInfoExt_v1_t;
-
-typedef nvmlPciInfoExt_v1_t nvmlPciInfoExt_t;
-
-typedef struct nvmlMemory_st {
-    unsigned long long total;
-    unsigned long long free;
-    unsigned long long used;
-} nvmlMemory_t;
-
-// --- NVML UUID struct (consumed by nvmlDeviceGetHandleByUUIDV; from nvml.h) ---
-#define NVML_DEVICE_UUID_ASCII_LEN 41
-#define NVML_DEVICE_UUID_BINARY_LEN 16
-
-typedef enum {
-    NVML_UUID_TYPE_NONE = 0,
-    NVML_UUID_TYPE_ASCII = 1,
-    NVML_UUID_TYPE_BINARY = 2
-} nvmlUUIDType_t;
-
-typedef union {
-    char str[NVML_DEVICE_UUID_ASCII_LEN];
-    unsigned char bytes[NVML_DEVICE_UUID_BINARY_LEN];
-} nvmlUUIDValue_t;
-
-typedef struct {
-    unsigned int version;
-    unsigned int type;
-    nvmlUUIDValue_t value;
-} nvmlUUID_v1_t;
-
-typedef nvmlUUID_v1_t nvmlUUID_t;
+#include "fake_nvml.h"
+#include "fake_gpu_profiles.h"
+#include "fake_nvidia_uapi.h"
+#include "fake_nvml_stats.h"
 
 // --- Logging Utility ---
 #define LOG(func_name, msg, ...)                                         \
@@ -124,62 +54,697 @@ typedef nvmlUUID_v1_t nvmlUUID_t;
     } while (0)
 
 // --- Fake GPU State ---
+// Default number of fake GPUs; FAKE_NVML_GPU_COUNT overrides it for the default world (up to
+// FAKE_GPU_MAX, enough for large-host scaling tests).
 #define FAKE_GPU_COUNT 4
+#define FAKE_GPU_MAX 65535
 #define FAKE_GPU_NAME "NVIDIA Tesla T4"
 #define FAKE_DRIVER_VERSION "535.104.05"
+// NVML version: this prefix followed by the driver version.
+#define FAKE_NVML_VERSION_PREFIX "12."
 #define FAKE_CUDA_VERSION 12020
 
 typedef struct {
     int index;
+    unsigned int minor; // /dev/nvidia<minor>; equals the index unless the kernel module says otherwise
     char name[NVML_DEVICE_NAME_BUFFER_SIZE];
     char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
     nvmlPciInfo_t pci;
     nvmlDevice_t handle;
+    const struct fake_nvidia_state_gpu *state; // telemetry and ledger: a kernel slot or g_idle_state
+    const fakeGpuProfile_t *profile;            // the model named by `name`
+    unsigned long long memory_total;            // of the model; the module's slot has its own copy
+    // Last PCIe throughput sample of this process, under g_pcie_sample_lock.
+    unsigned long long pcie_sample_ns;
+    unsigned long long pcie_sample[2];
+    unsigned int pcie_rate[2];
+    int pcie_rate_valid;
 } fakeGpu_t;
 
-static fakeGpu_t g_fake_gpus[FAKE_GPU_COUNT];
-static int g_initialized = 0;
+// --- GPU State ---
+// Telemetry and the process ledger of a GPU are read from its slot of the kernel module's state
+// page (see fake_nvidia_uapi.h), so that every process on the host sees the same values. GPUs
+// without a slot (no module, FAKE_NVML_GPU_COUNT, embedded worlds) share g_idle_state.
+// Its memory_total is unused: each GPU's comes from its profile.
+static const struct fake_nvidia_state_gpu g_idle_state = {
+    .flags = FAKE_NVIDIA_GPU_PRESENT,
+    .telemetry = {
+        .power_mw = FAKE_NVIDIA_IDLE_POWER_MW,
+        .power_limit_mw = FAKE_NVIDIA_IDLE_POWER_LIMIT_MW,
+        .temperature_c = FAKE_NVIDIA_IDLE_TEMPERATURE_C,
+    },
+};
 
-// --- NVML API Implementations ---
+// Copy `len` bytes at `offset` of a state slot, retrying while the module updates the slot.
+static void fake_state_read(const struct fake_nvidia_state_gpu *slot, size_t offset, size_t len, void *dst) {
+    for (;;) {
+        unsigned int seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        memcpy(dst, (const char *)slot + offset, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+}
 
-nvmlReturn_t nvmlInit_v2(void) {
-    LOG(__func__, "enter");
-    // Idempotent: the real libnvidia-ml returns NVML_SUCCESS when called again
-    // without an intervening nvmlShutdown. libnvidia-sandboxutils.so (toolkit
-    // >= 1.19.0) calls nvmlInit twice in a row; returning ALREADY_INITIALIZED
-    // made it fail with ERROR_NVML_LIB_CALL. Re-initialization is a no-op here
-    // because the fake GPU state is static.
-    if (g_initialized) {
-        LOG(__func__, "exit, already initialized (idempotent SUCCESS)");
-        return NVML_SUCCESS;
+// Read one field of a GPU's state into *dst, which must have the field's size.
+#define FAKE_STATE_READ(gpu, field, dst)                                                          \
+    do {                                                                                          \
+        _Static_assert(sizeof(*(dst)) == sizeof(((struct fake_nvidia_state_gpu *)0)->field),     \
+                       "FAKE_STATE_READ size mismatch");                                          \
+        fake_state_read((gpu)->state, offsetof(struct fake_nvidia_state_gpu, field), sizeof(*(dst)), (dst)); \
+    } while (0)
+
+// --- Fake GPU Worlds ---
+// All mutable NVML state lives in a world: an isolated fake host with its own device list and
+// init state. LD_PRELOAD and installed-library users only ever see the default world. Embedders
+// linking libfake_nvml.a create further worlds with fake_nvml_world_create() and select one per
+// thread with fake_nvml_world_use(); until the first fake_nvml_world_use() the per-call lookup
+// is a single load of g_worlds_in_use, with no TLS access.
+// The device table of a world is built once, when the world gets its GPUs, and is never freed or
+// rewritten by nvmlShutdown: handles stay valid across init/shutdown cycles, as with the real
+// driver, and re-initialization costs nothing even with thousands of GPUs.
+// `initialized` is the init reference count, updated atomically so that threads may init and
+// shut down concurrently; the table is published before the first increment.
+// `users` counts the threads that have the world selected. A world destroyed while other threads
+// still have it selected is freed by the last one to select another world or to exit.
+struct fakeNvmlWorld {
+    unsigned int initialized;
+    unsigned int users;  // under g_world_lock
+    int destroyed;       // under g_world_lock
+    unsigned int gpu_count;
+    int custom_ids; // UUIDs or bus IDs taken from the kernel module, not derived from the index
+    fakeGpu_t *gpus;
+    char driver_version[NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE]; // empty: FAKE_DRIVER_VERSION
+};
+
+static fakeNvmlWorld_t g_default_world;
+static __thread fakeNvmlWorld_t *t_current_world;
+static int g_worlds_in_use;
+static pthread_mutex_t g_world_lock = PTHREAD_MUTEX_INITIALIZER;
+// Holds the thread's selected world (other than the default one), to release it at thread exit.
+static pthread_key_t g_world_key;
+static pthread_once_t g_world_key_once = PTHREAD_ONCE_INIT;
+
+static inline fakeNvmlWorld_t *fake_world(void) {
+    if (__builtin_expect(!__atomic_load_n(&g_worlds_in_use, __ATOMIC_RELAXED), 1)) return &g_default_world;
+    return t_current_world != NULL ? t_current_world : &g_default_world;
+}
+
+static inline int fake_world_initialized(void) {
+    return __atomic_load_n(&fake_world()->initialized, __ATOMIC_ACQUIRE) != 0;
+}
+
+static inline const char *fake_world_driver_version(const fakeNvmlWorld_t *w) {
+    return w->driver_version[0] != '\0' ? w->driver_version : FAKE_DRIVER_VERSION;
+}
+
+// GPU i sits at bus i+1 so that bus 0 stays free for the host bridge; past bus 255 the index
+// carries into the PCI domain. The UUID embeds the index, which the reverse lookups rely on.
+static void fake_gpu_init(fakeGpu_t *gpu, unsigned int i) {
+    gpu->index = i;
+    gpu->minor = i;
+    snprintf(gpu->name, NVML_DEVICE_NAME_BUFFER_SIZE, "%s", FAKE_GPU_NAME);
+    gpu->profile = fake_gpu_profile(gpu->name);
+    gpu->memory_total = fake_gpu_memory_bytes(gpu->profile, gpu->name);
+    snprintf(gpu->uuid, NVML_DEVICE_UUID_BUFFER_SIZE, "GPU-%u-FAKE-UUID", i);
+    gpu->pci.domain = (i + 1) >> 8;
+    gpu->pci.bus = (i + 1) & 0xff;
+    gpu->pci.device = 0;
+    snprintf(gpu->pci.busId, NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE, "%08X:%02X:00.0", gpu->pci.domain, gpu->pci.bus);
+    gpu->pci.pciDeviceId = FAKE_NVIDIA_PCI_DEVICE_ID << 16 | FAKE_NVIDIA_PCI_VENDOR_ID;
+    gpu->pci.pciSubSystemId = FAKE_NVIDIA_PCI_SUBSYSTEM_ID << 16 | FAKE_NVIDIA_PCI_VENDOR_ID;
+    gpu->state = &g_idle_state;
+}
+
+static int fake_world_add_gpus(fakeNvmlWorld_t *w, unsigned int gpu_count) {
+    fakeGpu_t *gpus = calloc(gpu_count ? gpu_count : 1, sizeof(fakeGpu_t));
+    if (gpus == NULL) return -1;
+    for (unsigned int i = 0; i < gpu_count; ++i) {
+        fake_gpu_init(&gpus[i], i);
+        gpus[i].handle = (nvmlDevice_t)&gpus[i];
+    }
+    w->gpu_count = gpu_count;
+    __atomic_store_n(&w->gpus, gpus, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Parse "DDDD:BB:DD.F" (any domain width, hex) into the NVML busId format.
+static int fake_parse_bus_id(const char *text, fakeGpu_t *gpu) {
+    char *end;
+    unsigned long domain = strtoul(text, &end, 16);
+    unsigned long bus = *end == ':' ? strtoul(end + 1, &end, 16) : ~0UL;
+    unsigned long dev = *end == ':' ? strtoul(end + 1, &end, 16) : ~0UL;
+    unsigned long func = *end == '.' ? strtoul(end + 1, &end, 16) : ~0UL;
+    if (domain > 0xffff || bus > 0xff || dev > 0x1f || func > 0x7 || *end != '\0') return -1;
+    gpu->pci.domain = (unsigned int)domain;
+    gpu->pci.bus = (unsigned int)bus;
+    gpu->pci.device = (unsigned int)dev;
+    snprintf(gpu->pci.busId, NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE, "%08lX:%02lX:%02lX.%lX", domain, bus, dev, func);
+    return 0;
+}
+
+// --- Kernel GPU Registry ---
+// When fake_nvidia_driver is loaded, the default world mirrors its GPUs (load-time parameters and
+// GPUs added through configfs), so that NVML and /proc/driver/nvidia describe the same GPUs. The
+// GPU list is read once, at first init, from the state page mapped from /dev/nvidiactl, whose
+// slots then also provide the telemetry; processes that only see /proc (no /dev/nvidiactl) read
+// the list from /proc/driver/nvidia/fake_gpus instead.
+#define FAKE_KMOD_GPU_LIST "/proc/driver/nvidia/fake_gpus"
+
+// Fill GPU `index` from the module's description of it; -1 if the bus ID does not parse.
+static int fake_gpu_init_kernel(fakeNvmlWorld_t *w, fakeGpu_t *gpu, unsigned int index, unsigned int minor,
+                                const char *bus_id, const char *uuid, const char *model) {
+    memset(gpu, 0, sizeof(*gpu));
+    fake_gpu_init(gpu, index);
+    fakeGpu_t probe = *gpu;
+    if (fake_parse_bus_id(bus_id, gpu) != 0) return -1;
+    gpu->minor = minor;
+    snprintf(gpu->name, NVML_DEVICE_NAME_BUFFER_SIZE, "%s", model);
+    gpu->profile = fake_gpu_profile(gpu->name);
+    gpu->memory_total = fake_gpu_memory_bytes(gpu->profile, gpu->name);
+    snprintf(gpu->uuid, NVML_DEVICE_UUID_BUFFER_SIZE, "%s", uuid);
+    // Identifiers that differ from the index-derived defaults disable the O(1) lookups.
+    if (strcmp(gpu->uuid, probe.uuid) != 0 || strcmp(gpu->pci.busId, probe.pci.busId) != 0) w->custom_ids = 1;
+    return 0;
+}
+
+static void fake_world_publish_gpus(fakeNvmlWorld_t *w, fakeGpu_t *gpus, unsigned int count) {
+    for (unsigned int i = 0; i < count; ++i) gpus[i].handle = (nvmlDevice_t)&gpus[i];
+    w->gpu_count = count;
+    __atomic_store_n(&w->gpus, gpus, __ATOMIC_RELEASE);
+}
+
+// Map the module's state page read-only. NULL when the module is not loaded or /dev/nvidiactl is
+// not available; the mapping is never removed, like the device tables that point into it.
+static const struct fake_nvidia_state_header *fake_state_map(void) {
+    int fd = open(FAKE_NVIDIA_CONTROL_DEVICE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    size_t size = 0;
+    const struct fake_nvidia_state_header *hdr = mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0);
+    if (hdr != MAP_FAILED) {
+        if (hdr->magic == FAKE_NVIDIA_STATE_MAGIC && hdr->version == FAKE_NVIDIA_STATE_VERSION &&
+            hdr->slot_size == sizeof(struct fake_nvidia_state_gpu)) {
+            size = hdr->size;
+        }
+        munmap((void *)hdr, sizeof(*hdr));
     }
-    for (int i = 0; i < FAKE_GPU_COUNT; ++i) {
-        g_fake_gpus[i].index = i;
-        snprintf(g_fake_gpus[i].name, NVML_DEVICE_NAME_BUFFER_SIZE, "%s", FAKE_GPU_NAME);
-        snprintf(g_fake_gpus[i].uuid, NVML_DEVICE_UUID_BUFFER_SIZE, "GPU-%d-FAKE-UUID", i);
-        snprintf(g_fake_gpus[i].pci.busId, NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE, "00000000:0%d:00.0", i + 1);
-        g_fake_gpus[i].pci.domain = 0;
-        g_fake_gpus[i].pci.bus = i + 1;
-        g_fake_gpus[i].pci.device = 0;
-        g_fake_gpus[i].pci.pciDeviceId = 0x1EB8;
-        g_fake_gpus[i].pci.pciSubSystemId = 0x12A210DE;
-        g_fake_gpus[i].handle = (nvmlDevice_t)&g_fake_gpus[i];
+    hdr = size ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    return hdr != MAP_FAILED ? hdr : NULL;
+}
+
+// Returns -1 on failure. Called under g_world_lock.
+static int fake_world_add_state_gpus(fakeNvmlWorld_t *w, const struct fake_nvidia_state_header *hdr) {
+    const struct fake_nvidia_state_gpu *slots =
+        (const struct fake_nvidia_state_gpu *)((const char *)hdr + hdr->slot_offset);
+    unsigned int capacity = 0, count = 0;
+    for (unsigned int minor = 0; minor < hdr->slot_count; ++minor) {
+        if (__atomic_load_n(&slots[minor].flags, __ATOMIC_RELAXED) & FAKE_NVIDIA_GPU_PRESENT) capacity++;
     }
-    g_initialized = 1;
-    LOG(__func__, "exit");
+    fakeGpu_t *gpus = calloc(capacity ? capacity : 1, sizeof(fakeGpu_t));
+    if (gpus == NULL) return -1;
+    // GPUs added between the two passes are left for the next process; removed ones are skipped.
+    struct fake_nvidia_state_gpu snap;
+    for (unsigned int minor = 0; minor < hdr->slot_count && count < capacity; ++minor) {
+        fake_state_read(&slots[minor], 0, sizeof(snap), &snap);
+        if (!(snap.flags & FAKE_NVIDIA_GPU_PRESENT)) continue;
+        snap.bus_id[sizeof(snap.bus_id) - 1] = snap.uuid[sizeof(snap.uuid) - 1] = snap.model[sizeof(snap.model) - 1] = '\0';
+        if (fake_gpu_init_kernel(w, &gpus[count], count, minor, snap.bus_id, snap.uuid, snap.model) != 0) continue;
+        gpus[count++].state = &slots[minor];
+    }
+    fake_world_publish_gpus(w, gpus, count);
+    return 0;
+}
+
+// Returns 1 when the module is not loaded, -1 on failure. Called under g_world_lock.
+static int fake_world_add_kernel_gpus(fakeNvmlWorld_t *w) {
+    const struct fake_nvidia_state_header *hdr = fake_state_map();
+    if (hdr != NULL) return fake_world_add_state_gpus(w, hdr);
+    FILE *f = fopen(FAKE_KMOD_GPU_LIST, "re");
+    if (f == NULL) return 1;
+    fakeGpu_t *gpus = NULL;
+    unsigned int count = 0, capacity = 0;
+    char line[256], bus_id[32], uuid[NVML_DEVICE_UUID_BUFFER_SIZE], model[NVML_DEVICE_NAME_BUFFER_SIZE];
+    unsigned int minor;
+    while (count < FAKE_GPU_MAX && fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%u %31s %79s %63[^\n]", &minor, bus_id, uuid, model) != 4) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            fakeGpu_t *grown = realloc(gpus, capacity * sizeof(fakeGpu_t));
+            if (grown == NULL) {
+                free(gpus);
+                fclose(f);
+                return -1;
+            }
+            gpus = grown;
+        }
+        if (fake_gpu_init_kernel(w, &gpus[count], count, minor, bus_id, uuid, model) == 0) count++;
+    }
+    fclose(f);
+    if (gpus == NULL && (gpus = calloc(1, sizeof(fakeGpu_t))) == NULL) return -1;
+    fake_world_publish_gpus(w, gpus, count);
+    return 0;
+}
+
+// --- Node Configuration ---
+// /etc/fake-nvidia.conf (FAKE_NVIDIA_CONFIG names another file) describes the fake node once for
+// all components: fake-nvidia-load turns it into the module's parameters whenever the module is
+// loaded, and the shim takes the driver version from it and, when the module is not loaded, the
+// GPUs. One "key = value" per line, '#' starts a comment, and the keys are the names of the module
+// parameters; the shim ignores the keys it has no use for.
+#define FAKE_NVIDIA_CONFIG_DEFAULT "/etc/fake-nvidia.conf"
+
+typedef struct {
+    long gpu_count; // -1 when unset
+    char *model;
+    char *bus_ids;  // comma-separated
+    char *driver_version;
+} fakeNodeConfig_t;
+
+static char *fake_config_trim(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) *--end = '\0';
+    if (end - s >= 2 && s[0] == '"' && end[-1] == '"') {
+        end[-1] = '\0';
+        s++;
+    }
+    return s;
+}
+
+static void fake_config_free(fakeNodeConfig_t *cfg) {
+    free(cfg->model);
+    free(cfg->bus_ids);
+    free(cfg->driver_version);
+}
+
+// Returns 1 when there is no configuration file; later lines override earlier ones.
+static int fake_config_load(fakeNodeConfig_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->gpu_count = -1;
+    const char *path = getenv("FAKE_NVIDIA_CONFIG");
+    FILE *f = fopen(path != NULL && path[0] != '\0' ? path : FAKE_NVIDIA_CONFIG_DEFAULT, "re");
+    if (f == NULL) return 1;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) >= 0) {
+        char *hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+        char *eq = strchr(line, '=');
+        if (eq == NULL) continue;
+        *eq = '\0';
+        const char *key = fake_config_trim(line);
+        const char *value = fake_config_trim(eq + 1);
+        char **field = strcmp(key, "model") == 0            ? &cfg->model
+                       : strcmp(key, "bus_ids") == 0        ? &cfg->bus_ids
+                       : strcmp(key, "driver_version") == 0 ? &cfg->driver_version
+                                                            : NULL;
+        if (field != NULL) {
+            free(*field);
+            *field = value[0] != '\0' ? strdup(value) : NULL;
+        } else if (strcmp(key, "gpu_count") == 0) {
+            char *end;
+            unsigned long count = strtoul(value, &end, 10);
+            if (*end == '\0' && value[0] != '\0') cfg->gpu_count = count > FAKE_GPU_MAX ? FAKE_GPU_MAX : (long)count;
+        }
+    }
+    free(line);
+    fclose(f);
+    LOG(__func__, "read %s", path != NULL && path[0] != '\0' ? path : FAKE_NVIDIA_CONFIG_DEFAULT);
+    return 0;
+}
+
+// The GPUs the module would create from the same configuration: bus_ids in index order, the
+// shim's default bus for the rest. Returns -1 on failure. Called under g_world_lock.
+static int fake_world_add_config_gpus(fakeNvmlWorld_t *w, const fakeNodeConfig_t *cfg) {
+    unsigned int count = cfg->gpu_count >= 0 ? (unsigned int)cfg->gpu_count : FAKE_GPU_COUNT;
+    if (cfg->model == NULL && cfg->bus_ids == NULL) return fake_world_add_gpus(w, count);
+    fakeGpu_t *gpus = calloc(count ? count : 1, sizeof(fakeGpu_t));
+    if (gpus == NULL) return -1;
+    const char *next = cfg->bus_ids;
+    for (unsigned int i = 0; i < count; ++i) {
+        fakeGpu_t def;
+        char bus_id[32];
+        fake_gpu_init(&def, i);
+        snprintf(bus_id, sizeof(bus_id), "%s", def.pci.busId);
+        if (next != NULL && *next != '\0') {
+            int len = (int)strcspn(next, ",");
+            snprintf(bus_id, sizeof(bus_id), "%.*s", len, next);
+            next += len + (next[len] == ',');
+        }
+        // The module refuses to load with such a bus ID; here the GPU keeps its defaults.
+        if (fake_gpu_init_kernel(w, &gpus[i], i, i, bus_id, def.uuid, cfg->model != NULL ? cfg->model : FAKE_GPU_NAME) != 0)
+            LOG(__func__, "invalid bus ID '%s' in the configuration", bus_id);
+    }
+    fake_world_publish_gpus(w, gpus, count);
+    return 0;
+}
+
+// GPUs of the default world: FAKE_NVML_GPU_COUNT, else the kernel module's, else the node
+// configuration's, else FAKE_GPU_COUNT.
+static int fake_default_world_add_gpus(fakeNvmlWorld_t *w) {
+    fakeNodeConfig_t cfg;
+    int no_config = fake_config_load(&cfg);
+    if (cfg.driver_version != NULL) snprintf(w->driver_version, sizeof(w->driver_version), "%s", cfg.driver_version);
+    const char *env = getenv("FAKE_NVML_GPU_COUNT");
+    int ret;
+    if (env != NULL && env[0] != '\0') {
+        unsigned long count = strtoul(env, NULL, 10);
+        ret = fake_world_add_gpus(w, count > FAKE_GPU_MAX ? FAKE_GPU_MAX : (unsigned int)count);
+    } else {
+        ret = fake_world_add_kernel_gpus(w);
+        if (ret > 0) ret = no_config ? fake_world_add_gpus(w, FAKE_GPU_COUNT) : fake_world_add_config_gpus(w, &cfg);
+    }
+    fake_config_free(&cfg);
+    return ret;
+}
+
+fakeNvmlWorld_t *fake_nvml_world_create(unsigned int gpu_count) {
+    fakeNvmlWorld_t *world = calloc(1, sizeof(*world));
+    if (world == NULL) return NULL;
+    if (gpu_count > FAKE_GPU_MAX || fake_world_add_gpus(world, gpu_count) != 0) {
+        free(world);
+        return NULL;
+    }
+    return world;
+}
+
+static void fake_world_free(fakeNvmlWorld_t *world) {
+    free(world->gpus);
+    free(world);
+}
+
+// A thread stops using `p`, which it had selected.
+static void fake_world_release(void *p) {
+    fakeNvmlWorld_t *world = p;
+    pthread_mutex_lock(&g_world_lock);
+    int unused = --world->users == 0 && world->destroyed;
+    pthread_mutex_unlock(&g_world_lock);
+    if (unused) fake_world_free(world);
+}
+
+static void fake_world_key_create(void) {
+    pthread_key_create(&g_world_key, fake_world_release);
+}
+
+void fake_nvml_world_destroy(fakeNvmlWorld_t *world) {
+    if (world == NULL || world == &g_default_world) return;
+    int selected = t_current_world == world;
+    if (selected) {
+        t_current_world = NULL;
+        pthread_setspecific(g_world_key, NULL);
+    }
+    pthread_mutex_lock(&g_world_lock);
+    if (selected) world->users--;
+    world->destroyed = 1;
+    int unused = world->users == 0;
+    pthread_mutex_unlock(&g_world_lock);
+    if (unused) fake_world_free(world);
+}
+
+fakeNvmlWorld_t *fake_nvml_world_use(fakeNvmlWorld_t *world) {
+    fakeNvmlWorld_t *previous = t_current_world;
+    if (world == &g_default_world) world = NULL;
+    __atomic_store_n(&g_worlds_in_use, 1, __ATOMIC_RELAXED);
+    if (world == previous) return previous;
+    pthread_once(&g_world_key_once, fake_world_key_create);
+    if (world != NULL) {
+        pthread_mutex_lock(&g_world_lock);
+        world->users++;
+        pthread_mutex_unlock(&g_world_lock);
+    }
+    t_current_world = world;
+    pthread_setspecific(g_world_key, world);
+    if (previous != NULL) fake_world_release(previous);
+    return previous;
+}
+
+// --- Shared-Memory Statistics ---
+// Enabled by FAKE_NVML_STATS=1: every exported function records its call count and latency into
+// the segment described in fake_nvml_stats.h, which fake-nvml-exporter serves to Prometheus.
+// When disabled the per-call cost is a single NULL check.
+static fakeNvmlStatsSegment_t *g_stats = NULL;
+static fakeNvmlStatsProc_t *g_stats_proc = NULL;
+
+__attribute__((constructor))
+static void stats_init(void) {
+    if (fake_nvml_stats_requested()) g_stats = fake_nvml_stats_attach(1, &g_stats_proc);
+}
+
+__attribute__((destructor))
+static void stats_fini(void) {
+    fakeNvmlStatsSegment_t *seg = g_stats;
+    g_stats = NULL;
+    fake_nvml_stats_detach(seg, g_stats_proc);
+}
+
+typedef struct {
+    fakeNvmlSymStats_t *st; // NULL when statistics are disabled
+    unsigned long long start;
+    int failed;             // set by STATS_RETURN
+} statsScope_t;
+
+static inline statsScope_t stats_scope_begin(fakeNvmlSymbol_t sym) {
+    statsScope_t scope = {0};
+    if (g_stats == NULL) return scope;
+    scope.st = &g_stats->syms[sym];
+    scope.start = fake_nvml_stats_now();
+    return scope;
+}
+
+static inline void stats_scope_end(statsScope_t *scope) {
+    if (scope->st == NULL) return;
+    fake_nvml_stats_record(scope->st, fake_nvml_stats_now() - scope->start, scope->failed);
+    if (g_stats_proc != NULL) __atomic_fetch_add(&g_stats_proc->calls, 1, __ATOMIC_RELAXED);
+}
+
+// Records the enclosing NVML function under the given symbol when it returns. Such a function
+// returns through STATS_RETURN, which counts every result other than NVML_SUCCESS as an error.
+#define STATS_CALL(name) \
+    statsScope_t stats_scope __attribute__((cleanup(stats_scope_end))) = stats_scope_begin(FAKE_NVML_SYM_##name)
+#define STATS_RETURN(result)                                   \
+    do {                                                       \
+        nvmlReturn_t stats_result = (result);                  \
+        stats_scope.failed = stats_result != NVML_SUCCESS;     \
+        return stats_result;                                   \
+    } while (0)
+
+// --- Redundant-Call Detector ---
+// Analysis mode enabled by FAKE_NVML_REDUNDANT=1. Calls whose results cannot change between
+// nvmlInit_v2 and nvmlShutdown (names, UUIDs, PCI info, counts, versions, ...) are marked with
+// TRACK_STATIC_CALL(). Every such call is keyed by (function, device, caller return address);
+// any call after the first for the same key within one init/shutdown window is redundant, and
+// its measured duration is counted as wasted time. A report sorted by wasted time is printed to
+// stderr at process exit. Return addresses are only symbolized (dladdr) when the report is
+// printed, so the per-call cost is a clock read and a hash-table update under a mutex.
+#define REDUNDANT_TABLE_SIZE 1024 // power of two, open addressing
+
+typedef struct {
+    const char *func;  // __func__ of the tracked NVML call (NULL: empty slot)
+    const void *device;
+    void *caller;
+    unsigned int epoch; // init/shutdown window in which the key was last seen
+    unsigned long long calls;
+    unsigned long long redundant;
+    unsigned long long wasted_ns;
+} redundantEntry_t;
+
+typedef struct {
+    const char *func; // NULL when the detector is disabled
+    const void *device;
+    void *caller;
+    struct timespec start;
+} redundantScope_t;
+
+static int g_redundant_enabled = -1; // -1: FAKE_NVML_REDUNDANT not read yet
+static unsigned int g_redundant_epoch = 0;
+static unsigned long long g_redundant_dropped = 0;
+static redundantEntry_t g_redundant_table[REDUNDANT_TABLE_SIZE];
+static pthread_mutex_t g_redundant_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int redundant_enabled(void) {
+    if (g_redundant_enabled < 0) {
+        const char *env = getenv("FAKE_NVML_REDUNDANT");
+        g_redundant_enabled = (env != NULL && env[0] != '\0' && strcmp(env, "0") != 0);
+    }
+    return g_redundant_enabled;
+}
+
+static redundantScope_t redundant_scope_begin(const char *func, const void *device, void *caller) {
+    redundantScope_t scope = {0};
+    if (!redundant_enabled()) return scope;
+    scope.func = func;
+    scope.device = device;
+    scope.caller = caller;
+    clock_gettime(CLOCK_MONOTONIC, &scope.start);
+    return scope;
+}
+
+static void redundant_scope_end(redundantScope_t *scope) {
+    if (scope->func == NULL || !fake_world_initialized()) return;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    unsigned long long ns = (unsigned long long)(end.tv_sec - scope->start.tv_sec) * 1000000000ULL +
+                            (unsigned long long)(end.tv_nsec - scope->start.tv_nsec);
+    size_t hash = ((size_t)scope->func * 31 + (size_t)scope->device * 17 + (size_t)scope->caller) >> 3;
+
+    pthread_mutex_lock(&g_redundant_lock);
+    for (size_t probe = 0; probe < REDUNDANT_TABLE_SIZE; ++probe) {
+        redundantEntry_t *e = &g_redundant_table[(hash + probe) & (REDUNDANT_TABLE_SIZE - 1)];
+        if (e->func == NULL) {
+            e->func = scope->func;
+            e->device = scope->device;
+            e->caller = scope->caller;
+            e->epoch = g_redundant_epoch;
+            e->calls = 1;
+            pthread_mutex_unlock(&g_redundant_lock);
+            return;
+        }
+        if (e->func == scope->func && e->device == scope->device && e->caller == scope->caller) {
+            e->calls++;
+            if (e->epoch == g_redundant_epoch) {
+                e->redundant++;
+                e->wasted_ns += ns;
+            }
+            e->epoch = g_redundant_epoch;
+            pthread_mutex_unlock(&g_redundant_lock);
+            return;
+        }
+    }
+    g_redundant_dropped++;
+    pthread_mutex_unlock(&g_redundant_lock);
+}
+
+// Declares a scope-bound tracker: the call is recorded when the enclosing NVML function returns,
+// whichever return statement it takes. Must be expanded directly inside the exported function so
+// that __builtin_return_address(0) is the consumer's call site.
+#define TRACK_STATIC_CALL(device)                                                      \
+    redundantScope_t redundant_scope __attribute__((cleanup(redundant_scope_end))) =   \
+        redundant_scope_begin(__func__, (const void *)(device), __builtin_return_address(0))
+
+static int redundant_entry_cmp(const void *a, const void *b) {
+    const redundantEntry_t *x = a, *y = b;
+    if (x->wasted_ns != y->wasted_ns) return x->wasted_ns < y->wasted_ns ? 1 : -1;
+    return x->redundant < y->redundant ? 1 : (x->redundant > y->redundant ? -1 : 0);
+}
+
+// Render a return address as "symbol+0xoff (module)", or "module+0xoff" when the caller is not
+// exported (feed the latter to `addr2line -e module 0xoff`).
+static void redundant_symbolize(void *addr, char *buf, size_t len) {
+    Dl_info info;
+    if (dladdr(addr, &info) == 0 || info.dli_fname == NULL) {
+        snprintf(buf, len, "%p", addr);
+    } else if (info.dli_sname != NULL) {
+        snprintf(buf, len, "%s+0x%lx (%s)", info.dli_sname,
+                 (unsigned long)((char *)addr - (char *)info.dli_saddr), info.dli_fname);
+    } else {
+        snprintf(buf, len, "%s+0x%lx", info.dli_fname,
+                 (unsigned long)((char *)addr - (char *)info.dli_fbase));
+    }
+}
+
+__attribute__((destructor))
+static void redundant_report(void) {
+    if (g_redundant_enabled <= 0) return;
+    static redundantEntry_t sorted[REDUNDANT_TABLE_SIZE];
+    size_t n = 0;
+    unsigned long long total_redundant = 0, total_wasted_ns = 0;
+
+    pthread_mutex_lock(&g_redundant_lock);
+    for (size_t i = 0; i < REDUNDANT_TABLE_SIZE; ++i) {
+        if (g_redundant_table[i].func != NULL && g_redundant_table[i].redundant > 0) {
+            sorted[n++] = g_redundant_table[i];
+            total_redundant += g_redundant_table[i].redundant;
+            total_wasted_ns += g_redundant_table[i].wasted_ns;
+        }
+    }
+    pthread_mutex_unlock(&g_redundant_lock);
+    qsort(sorted, n, sizeof(sorted[0]), redundant_entry_cmp);
+
+    fprintf(stderr, "[FAKE-GPU %d] redundant NVML calls: %llu at %zu call sites, est. %.3f ms wasted\n",
+            getpid(), total_redundant, n, total_wasted_ns / 1e6);
+    if (g_redundant_dropped > 0) {
+        fprintf(stderr, "[FAKE-GPU %d] (%llu calls not tracked: table full)\n", getpid(), g_redundant_dropped);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        char site[512];
+        redundant_symbolize(sorted[i].caller, site, sizeof(site));
+        fprintf(stderr, "  %-36s device=%-14p calls=%-8llu redundant=%-8llu wasted=%.3f us  at %s\n",
+                sorted[i].func, sorted[i].device, sorted[i].calls, sorted[i].redundant,
+                sorted[i].wasted_ns / 1e3, site);
+    }
+}
+
+// --- NVML API Implementations ---
+
+// Prototypes for every export listed in fake_nvml_functions.def, so that the compiler checks each
+// handler below against the parameter types recorded in the table. They also carry the default
+// visibility that keeps the handlers exported under -fvisibility=hidden.
+#define NVML_IMPL(name, ...) NVML_EXPORT nvmlReturn_t name NVML_PARAMS(__VA_ARGS__);
+#define NVML_STUB(name, ...)
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+NVML_EXPORT const char* nvmlErrorString(nvmlReturn_t result);
+
+// Shared by nvmlInit_v2 and nvmlInitWithFlags, so that each call is counted once, under its own
+// name.
+static nvmlReturn_t fake_init(const char *func) {
+    // Reference counted, like the real libnvidia-ml: every nvmlInit_v2 returns NVML_SUCCESS and
+    // the library stays initialized until the matching number of nvmlShutdown calls.
+    // libnvidia-sandboxutils.so (toolkit >= 1.19.0) calls nvmlInit twice in a row; returning
+    // ALREADY_INITIALIZED made it fail with ERROR_NVML_LIB_CALL.
+    fakeNvmlWorld_t *w = fake_world();
+    // The default world gets its GPUs on first init, so FAKE_NVML_GPU_COUNT and the kernel
+    // module's GPU list are read then.
+    if (__atomic_load_n(&w->gpus, __ATOMIC_ACQUIRE) == NULL) {
+        pthread_mutex_lock(&g_world_lock);
+        int failed = w->gpus == NULL && fake_default_world_add_gpus(w) != 0;
+        pthread_mutex_unlock(&g_world_lock);
+        if (failed) {
+            LOG(func, "exit, cannot allocate the fake GPUs");
+            return NVML_ERROR_MEMORY;
+        }
+    }
+    unsigned int refs = __atomic_add_fetch(&w->initialized, 1, __ATOMIC_ACQ_REL);
+    LOG(func, "exit, %u reference(s)", refs);
     return NVML_SUCCESS;
 }
 
+nvmlReturn_t nvmlInit_v2(void) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlInit_v2);
+    STATS_RETURN(fake_init(__func__));
+}
+
+nvmlReturn_t nvmlInitWithFlags(unsigned int flags) {
+    LOG(__func__, "enter, flags=0x%x", flags);
+    STATS_CALL(nvmlInitWithFlags);
+    // NVML_INIT_FLAG_NO_GPUS / NO_ATTACH only relax failure modes the fake never has.
+    STATS_RETURN(fake_init(__func__));
+}
+
 nvmlReturn_t nvmlShutdown(void) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    g_initialized = 0;
+    STATS_CALL(nvmlShutdown);
+    fakeNvmlWorld_t *w = fake_world();
+    unsigned int refs = __atomic_load_n(&w->initialized, __ATOMIC_RELAXED);
+    do {
+        if (refs == 0) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    } while (!__atomic_compare_exchange_n(&w->initialized, &refs, refs - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    // Static results may legitimately be re-queried after the next nvmlInit.
+    if (refs == 1) {
+        pthread_mutex_lock(&g_redundant_lock);
+        g_redundant_epoch++;
+        pthread_mutex_unlock(&g_redundant_lock);
+    }
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 const char* nvmlErrorString(nvmlReturn_t result) {
     LOG(__func__, "enter");
+    STATS_CALL(nvmlErrorString);
     LOG(__func__, "Translating error code: %d", (int)result);
     switch (result) {
         case NVML_SUCCESS: return "Success";
@@ -192,41 +757,66 @@ const char* nvmlErrorString(nvmlReturn_t result) {
         case NVML_ERROR_INSUFFICIENT_SIZE: return "Insufficient Size";
         case NVML_ERROR_DRIVER_NOT_LOADED: return "Driver Not Loaded";
         case NVML_ERROR_FUNCTION_NOT_FOUND: return "Function Not Found";
+        case NVML_ERROR_MEMORY: return "Insufficient Memory";
         default: return "Unknown Error";
     }
 }
 
 nvmlReturn_t nvmlSystemGetDriverVersion(char* version, unsigned int length) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    strncpy(version, FAKE_DRIVER_VERSION, length);
+    STATS_CALL(nvmlSystemGetDriverVersion);
+    TRACK_STATIC_CALL(NULL);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    strncpy(version, fake_world_driver_version(fake_world()), length);
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlSystemGetNVMLVersion(char* version, unsigned int length) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlSystemGetNVMLVersion);
+    TRACK_STATIC_CALL(NULL);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (version == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    const char *driver = fake_world_driver_version(fake_world());
+    size_t driver_len = strlen(driver);
+    if (length < sizeof(FAKE_NVML_VERSION_PREFIX) + driver_len) STATS_RETURN(NVML_ERROR_INSUFFICIENT_SIZE);
+    memcpy(version, FAKE_NVML_VERSION_PREFIX, sizeof(FAKE_NVML_VERSION_PREFIX) - 1);
+    memcpy(version + sizeof(FAKE_NVML_VERSION_PREFIX) - 1, driver, driver_len + 1);
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlSystemGetCudaDriverVersion(int* cudaDriverVersion) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
+    STATS_CALL(nvmlSystemGetCudaDriverVersion);
+    TRACK_STATIC_CALL(NULL);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
     *cudaDriverVersion = FAKE_CUDA_VERSION;
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetCount_v2(unsigned int* deviceCount) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    *deviceCount = FAKE_GPU_COUNT;
+    STATS_CALL(nvmlDeviceGetCount_v2);
+    TRACK_STATIC_CALL(NULL);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    *deviceCount = fake_world()->gpu_count;
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetHandleByIndex_v2(unsigned int index, nvmlDevice_t* device) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (index >= FAKE_GPU_COUNT) return NVML_ERROR_INVALID_ARGUMENT;
-    *device = g_fake_gpus[index].handle;
+    STATS_CALL(nvmlDeviceGetHandleByIndex_v2);
+    TRACK_STATIC_CALL((uintptr_t)index);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    fakeNvmlWorld_t *w = fake_world();
+    if (index >= w->gpu_count) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *device = w->gpus[index].handle;
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 // ******************** FIX: ADDED MISSING SYMBOLS (toolkit >= 1.19.0) ********************
@@ -240,10 +830,20 @@ nvmlReturn_t nvmlDeviceGetHandleByIndex_v2(unsigned int index, nvmlDevice_t* dev
 //     public headers but exported by the real driver; UUID given as a nvmlUUID_t struct whose
 //     value union holds an ASCII string or raw bytes (see nvmlUUID_t above).
 // Reverse-map an ASCII UUID string to its fake GPU handle (shared by the two APIs below).
+// Fake UUIDs embed the GPU index ("GPU-<i>-FAKE-UUID"), so the lookup is a parse and a single
+// comparison rather than a scan: consumers resolve every device by UUID, which would otherwise
+// be quadratic in the GPU count.
 static nvmlReturn_t fake_lookup_handle_by_uuid(const char *uuid, nvmlDevice_t *device) {
-    for (int i = 0; i < FAKE_GPU_COUNT; ++i) {
-        if (strcmp(uuid, g_fake_gpus[i].uuid) == 0) {
-            *device = g_fake_gpus[i].handle;
+    fakeNvmlWorld_t *w = fake_world();
+    int indexed = strncmp(uuid, "GPU-", 4) == 0 && uuid[4] >= '0' && uuid[4] <= '9';
+    unsigned long index = indexed ? strtoul(uuid + 4, NULL, 10) : ~0UL;
+    if (index < w->gpu_count && strcmp(uuid, w->gpus[index].uuid) == 0) {
+        *device = w->gpus[index].handle;
+        return NVML_SUCCESS;
+    }
+    for (unsigned int i = 0; w->custom_ids && i < w->gpu_count; ++i) {
+        if (strcmp(uuid, w->gpus[i].uuid) == 0) {
+            *device = w->gpus[i].handle;
             return NVML_SUCCESS;
         }
     }
@@ -252,17 +852,19 @@ static nvmlReturn_t fake_lookup_handle_by_uuid(const char *uuid, nvmlDevice_t *d
 
 nvmlReturn_t nvmlDeviceGetHandleByUUID(const char *uuid, nvmlDevice_t *device) {
     LOG(__func__, "enter, uuid=%s", uuid ? uuid : "(null)");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (uuid == NULL || device == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetHandleByUUID);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (uuid == NULL || device == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
     nvmlReturn_t result = fake_lookup_handle_by_uuid(uuid, device);
     LOG(__func__, "%s", result == NVML_SUCCESS ? "exit, matched" : "exit, UUID not found");
-    return result;
+    STATS_RETURN(result);
 }
 
 nvmlReturn_t nvmlDeviceGetHandleByUUIDV(const nvmlUUID_t *uuid, nvmlDevice_t *device) {
     LOG(__func__, "enter, uuid type=%u", uuid ? uuid->type : 0u);
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (uuid == NULL || device == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetHandleByUUIDV);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (uuid == NULL || device == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
     // The UUID value is a union: ASCII str[41] | binary bytes[16]. Our fake GPUs only carry
     // ASCII UUIDs ("GPU-<i>-FAKE-UUID"). Copy value.str into a NUL-terminated buffer so a
     // non-ASCII (binary) UUID is compared safely and simply cannot match.
@@ -271,35 +873,70 @@ nvmlReturn_t nvmlDeviceGetHandleByUUIDV(const nvmlUUID_t *uuid, nvmlDevice_t *de
     ascii[NVML_DEVICE_UUID_ASCII_LEN - 1] = '\0';
     nvmlReturn_t result = fake_lookup_handle_by_uuid(ascii, device);
     LOG(__func__, "%s", result == NVML_SUCCESS ? "exit, matched" : "exit, UUID not found");
-    return result;
+    STATS_RETURN(result);
 }
 // ******************************************************************************************
 
+// Bus IDs are accepted in both the 8-digit ("00000000:01:00.0") and 4-digit ("0000:01:00.0")
+// domain forms, in any case, as the real library does.
+nvmlReturn_t nvmlDeviceGetHandleByPciBusId_v2(const char *pciBusId, nvmlDevice_t *device) {
+    LOG(__func__, "enter, busId=%s", pciBusId ? pciBusId : "(null)");
+    STATS_CALL(nvmlDeviceGetHandleByPciBusId_v2);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (pciBusId == NULL || device == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    fakeGpu_t key;
+    if (fake_parse_bus_id(pciBusId, &key) != 0) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    // Inverse of the default bus numbering in fake_world_add_gpus(); bus IDs set through the
+    // kernel module fall back to a scan.
+    fakeNvmlWorld_t *w = fake_world();
+    unsigned long index = (((unsigned long)key.pci.domain << 8) | key.pci.bus) - 1;
+    if (index < w->gpu_count && strcmp(w->gpus[index].pci.busId, key.pci.busId) == 0) {
+        *device = w->gpus[index].handle;
+        LOG(__func__, "exit, matched");
+        STATS_RETURN(NVML_SUCCESS);
+    }
+    for (unsigned int i = 0; w->custom_ids && i < w->gpu_count; ++i) {
+        if (strcmp(w->gpus[i].pci.busId, key.pci.busId) == 0) {
+            *device = w->gpus[i].handle;
+            LOG(__func__, "exit, matched");
+            STATS_RETURN(NVML_SUCCESS);
+        }
+    }
+    LOG(__func__, "exit, bus ID not found");
+    STATS_RETURN(NVML_ERROR_NOT_FOUND);
+}
+
 nvmlReturn_t nvmlDeviceGetName(nvmlDevice_t device, char* name, unsigned int length) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
+    STATS_CALL(nvmlDeviceGetName);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
     fakeGpu_t* gpu = (fakeGpu_t*)device;
     strncpy(name, gpu->name, length);
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetUUID(nvmlDevice_t device, char* uuid, unsigned int length) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
+    STATS_CALL(nvmlDeviceGetUUID);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
     fakeGpu_t* gpu = (fakeGpu_t*)device;
     strncpy(uuid, gpu->uuid, length);
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetPciInfo(nvmlDevice_t device, nvmlPciInfo_t* pci) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
+    STATS_CALL(nvmlDeviceGetPciInfo);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
     fakeGpu_t* gpu = (fakeGpu_t*)device;
     memcpy(pci, &gpu->pci, sizeof(nvmlPciInfo_t));
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 // ******************** FIX: ADDED MISSING PCI SYMBOLS (toolkit >= 1.19.0) ********************
@@ -316,26 +953,32 @@ nvmlReturn_t nvmlDeviceGetPciInfo(nvmlDevice_t device, nvmlPciInfo_t* pci) {
 //     caller's version field.
 nvmlReturn_t nvmlDeviceGetPciInfo_v2(nvmlDevice_t device, nvmlPciInfo_t* pci) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
+    STATS_CALL(nvmlDeviceGetPciInfo_v2);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
     fakeGpu_t* gpu = (fakeGpu_t*)device;
     memcpy(pci, &gpu->pci, sizeof(nvmlPciInfo_t));
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetPciInfo_v3(nvmlDevice_t device, nvmlPciInfo_t* pci) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
+    STATS_CALL(nvmlDeviceGetPciInfo_v3);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
     fakeGpu_t* gpu = (fakeGpu_t*)device;
     memcpy(pci, &gpu->pci, sizeof(nvmlPciInfo_t));
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetPciInfoExt(nvmlDevice_t device, nvmlPciInfoExt_t* pci) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (pci == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetPciInfoExt);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (pci == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
     fakeGpu_t* gpu = (fakeGpu_t*)device;
     // Preserve the caller-set version field; fill the rest from the fake GPU.
     unsigned int version = pci->version;
@@ -348,78 +991,116 @@ nvmlReturn_t nvmlDeviceGetPciInfoExt(nvmlDevice_t device, nvmlPciInfoExt_t* pci)
     pci->pciSubSystemId = gpu->pci.pciSubSystemId;
     snprintf(pci->busId, NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE, "%s", gpu->pci.busId);
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 // ********************************************************************************************
 
 nvmlReturn_t nvmlDeviceGetCudaComputeCapability(nvmlDevice_t device, int *major, int *minor) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (major == NULL || minor == NULL) return NVML_ERROR_INVALID_ARGUMENT;
-
-    // Fake data for a Tesla T4 (Turing Architecture, CC 7.5)
-    *major = 7;
-    *minor = 5;
+    STATS_CALL(nvmlDeviceGetCudaComputeCapability);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || major == NULL || minor == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *major = ((fakeGpu_t *)device)->profile->cc_major;
+    *minor = ((fakeGpu_t *)device)->profile->cc_minor;
 
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetBrand(nvmlDevice_t device, nvmlBrandType_t *type) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    *type = NVML_BRAND_TESLA;
+    STATS_CALL(nvmlDeviceGetBrand);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || type == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *type = (nvmlBrandType_t)((fakeGpu_t *)device)->profile->brand;
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetMinorNumber(nvmlDevice_t device, unsigned int* minorNumber) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
+    STATS_CALL(nvmlDeviceGetMinorNumber);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
     fakeGpu_t* gpu = (fakeGpu_t*)device;
-    *minorNumber = gpu->index;
+    *minorNumber = gpu->minor;
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetIndex(nvmlDevice_t device, unsigned int* index) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetIndex);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || index == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *index = ((fakeGpu_t*)device)->index;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+_Static_assert(FAKE_GPU_ARCH_VOLTA == NVML_DEVICE_ARCH_VOLTA && FAKE_GPU_ARCH_TURING == NVML_DEVICE_ARCH_TURING &&
+                   FAKE_GPU_ARCH_AMPERE == NVML_DEVICE_ARCH_AMPERE && FAKE_GPU_ARCH_ADA == NVML_DEVICE_ARCH_ADA &&
+                   FAKE_GPU_ARCH_HOPPER == NVML_DEVICE_ARCH_HOPPER && FAKE_GPU_BRAND_TESLA == NVML_BRAND_TESLA &&
+                   FAKE_GPU_BRAND_NVIDIA == NVML_BRAND_NVIDIA,
+               "profile architectures and brands must match NVML's values");
+
+nvmlReturn_t nvmlDeviceGetArchitecture(nvmlDevice_t device, nvmlDeviceArchitecture_t* arch) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetArchitecture);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || arch == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *arch = (nvmlDeviceArchitecture_t)((fakeGpu_t *)device)->profile->architecture;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 // ******************** FIX: ADDED MISSING FUNCTION ********************
 nvmlReturn_t nvmlDeviceGetMaxMigDeviceCount(nvmlDevice_t device, unsigned int* count) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (count == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetMaxMigDeviceCount);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (count == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
 
     // Our fake Tesla T4 does not support MIG.
     *count = 0;
 
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 // *********************************************************************
 
 nvmlReturn_t nvmlDeviceGetMigCapability(nvmlDevice_t device, unsigned int* isMigCapable, unsigned int* isMigGpu) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (isMigCapable == NULL || isMigGpu == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetMigCapability);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (isMigCapable == NULL || isMigGpu == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
 
     // Tesla T4 does not support MIG.
     *isMigCapable = 0;
     *isMigGpu = 0;
 
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 nvmlReturn_t nvmlDeviceGetMigMode(nvmlDevice_t device, unsigned int *currentMode, unsigned int *pendingMode) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (currentMode == NULL || pendingMode == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetMigMode);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (currentMode == NULL || pendingMode == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
 
     // MIG is not enabled.
     *currentMode = NVML_FEATURE_DISABLED;
     *pendingMode = NVML_FEATURE_DISABLED;
 
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 
 // ******************** FIX: ADDED MISSING MIG SYMBOL (toolkit >= 1.19.0) ********************
@@ -437,11 +1118,12 @@ nvmlReturn_t nvmlDeviceGetMigMode(nvmlDevice_t device, unsigned int *currentMode
 nvmlReturn_t nvmlDeviceGetMigDeviceHandleByIndex(nvmlDevice_t device, unsigned int index,
                                                  nvmlDevice_t *migDevice) {
     LOG(__func__, "enter, index=%u", index);
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (migDevice == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetMigDeviceHandleByIndex);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (migDevice == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
     (void)device; // fake GPUs have no MIG devices; device validity is not checked further.
     LOG(__func__, "exit, no MIG devices (NOT_FOUND)");
-    return NVML_ERROR_NOT_FOUND;
+    STATS_RETURN(NVML_ERROR_NOT_FOUND);
 }
 
 // ******************** FIX: ADDED REMAINING MIG SYMBOLS (toolkit >= 1.19.0) ********************
@@ -458,29 +1140,43 @@ nvmlReturn_t nvmlDeviceGetMigDeviceHandleByIndex(nvmlDevice_t device, unsigned i
 //   nvmlReturn_t nvmlDeviceGetGpuInstanceId(nvmlDevice_t device, unsigned int *id);
 nvmlReturn_t nvmlDeviceGetDeviceHandleFromMigDeviceHandle(nvmlDevice_t migDevice, nvmlDevice_t *device) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (device == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetDeviceHandleFromMigDeviceHandle);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
     (void)migDevice; // no MIG device handles exist on fake GPUs.
     LOG(__func__, "exit, no MIG devices (NOT_FOUND)");
-    return NVML_ERROR_NOT_FOUND;
+    STATS_RETURN(NVML_ERROR_NOT_FOUND);
 }
 
 nvmlReturn_t nvmlDeviceGetGpuInstanceId(nvmlDevice_t device, unsigned int *id) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (id == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetGpuInstanceId);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (id == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
     (void)device; // fake GPUs have no GPU instances.
     LOG(__func__, "exit, no GPU instances (NOT_FOUND)");
-    return NVML_ERROR_NOT_FOUND;
+    STATS_RETURN(NVML_ERROR_NOT_FOUND);
 }
 
 nvmlReturn_t nvmlDeviceGetComputeInstanceId(nvmlDevice_t device, unsigned int *id) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (id == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetComputeInstanceId);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (id == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
     (void)device; // fake GPUs have no compute instances.
     LOG(__func__, "exit, no compute instances (NOT_FOUND)");
-    return NVML_ERROR_NOT_FOUND;
+    STATS_RETURN(NVML_ERROR_NOT_FOUND);
+}
+
+nvmlReturn_t nvmlDeviceIsMigDeviceHandle(nvmlDevice_t device, unsigned int *isMigDevice) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceIsMigDeviceHandle);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (isMigDevice == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    (void)device; // every handle the fake hands out is a full GPU.
+    *isMigDevice = 0;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
 }
 // ********************************************************************************************
 // ********************************************************************************************
@@ -488,20 +1184,505 @@ nvmlReturn_t nvmlDeviceGetComputeInstanceId(nvmlDevice_t device, unsigned int *i
 // ******************** ENHANCEMENT: ADDED COMMON FUNCTION FOR ROBUSTNESS ********************
 nvmlReturn_t nvmlDeviceGetMemoryInfo(nvmlDevice_t device, nvmlMemory_t *memory) {
     LOG(__func__, "enter");
-    if (!g_initialized) return NVML_ERROR_UNINITIALIZED;
-    if (memory == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    STATS_CALL(nvmlDeviceGetMemoryInfo);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || memory == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
 
-    // Fake data for a Tesla T4 (16 GB VRAM)
-    memory->total = 16ULL * 1024 * 1024 * 1024; // 16 GiB
-    memory->free = 15ULL * 1024 * 1024 * 1024;  // Fake 15 GiB free
-    memory->used = 1ULL * 1024 * 1024 * 1024;   // Fake 1 GiB used
+    // Total and used (the ledger's sum) must come from the same snapshot.
+    const fakeGpu_t *gpu = (const fakeGpu_t *)device;
+    unsigned long long total_used[2] = {gpu->memory_total, 0};
+    if (gpu->state != &g_idle_state)
+        fake_state_read(gpu->state, offsetof(struct fake_nvidia_state_gpu, memory_total), sizeof(total_used),
+                        total_used);
+    memory->total = total_used[0];
+    memory->used = total_used[1];
+    memory->free = total_used[0] - total_used[1];
 
     LOG(__func__, "exit");
-    return NVML_SUCCESS;
+    STATS_RETURN(NVML_SUCCESS);
 }
 // *****************************************************************************************
 
+// --- Telemetry and Processes ---
+// Served from the GPU's state slot; see GPU State.
+nvmlReturn_t nvmlDeviceGetUtilizationRates(nvmlDevice_t device, nvmlUtilization_t *utilization) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetUtilizationRates);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || utilization == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    struct fake_nvidia_state_telemetry t;
+    FAKE_STATE_READ((fakeGpu_t *)device, telemetry, &t);
+    utilization->gpu = t.gpu_util;
+    utilization->memory = t.memory_util;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetTemperature(nvmlDevice_t device, unsigned int sensorType, unsigned int *temp) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetTemperature);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || temp == NULL || sensorType != NVML_TEMPERATURE_GPU) {
+        STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    }
+    FAKE_STATE_READ((fakeGpu_t *)device, telemetry.temperature_c, temp);
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetPowerUsage(nvmlDevice_t device, unsigned int *power) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetPowerUsage);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || power == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    FAKE_STATE_READ((fakeGpu_t *)device, telemetry.power_mw, power);
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetPowerManagementLimit(nvmlDevice_t device, unsigned int *limit) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetPowerManagementLimit);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || limit == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    FAKE_STATE_READ((fakeGpu_t *)device, telemetry.power_limit_mw, limit);
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// The module accrues energy when it changes the power draw; the time since then is accrued here
+// at the current draw, so the counter advances smoothly between updates.
+nvmlReturn_t nvmlDeviceGetTotalEnergyConsumption(nvmlDevice_t device, unsigned long long *energy) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetTotalEnergyConsumption);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || energy == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    struct fake_nvidia_state_telemetry t;
+    FAKE_STATE_READ((fakeGpu_t *)device, telemetry, &t);
+    *energy = t.energy_mj;
+    if (t.timestamp_ns != 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        unsigned long long now_ns = (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+        if (now_ns > t.timestamp_ns) {
+            *energy += (unsigned long long)((unsigned __int128)(now_ns - t.timestamp_ns) * t.power_mw / 1000000000u);
+        }
+    }
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// Processes holding memory in the GPU's ledger, in the nvmlProcessInfo_v1_t (v1) or
+// nvmlProcessInfo_t (v2, v3) layout.
+static nvmlReturn_t fake_running_processes(nvmlDevice_t device, unsigned int *infoCount, void *infos, int v1) {
+    if (!fake_world_initialized()) return NVML_ERROR_UNINITIALIZED;
+    if (device == NULL || infoCount == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    struct fake_nvidia_state_gpu snap;
+    fake_state_read(((fakeGpu_t *)device)->state, 0, sizeof(snap), &snap);
+    unsigned int count = snap.process_count < FAKE_NVIDIA_STATE_PROCS ? snap.process_count : FAKE_NVIDIA_STATE_PROCS;
+    if (*infoCount < count) {
+        *infoCount = count;
+        return NVML_ERROR_INSUFFICIENT_SIZE;
+    }
+    if (count > 0 && infos == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    for (unsigned int i = 0; i < count; ++i) {
+        if (v1) {
+            ((nvmlProcessInfo_v1_t *)infos)[i] = (nvmlProcessInfo_v1_t){snap.procs[i].pid, snap.procs[i].used_memory};
+        } else {
+            ((nvmlProcessInfo_t *)infos)[i] = (nvmlProcessInfo_t){snap.procs[i].pid, snap.procs[i].used_memory,
+                                                                  0xFFFFFFFFu, 0xFFFFFFFFu};
+        }
+    }
+    *infoCount = count;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetComputeRunningProcesses(nvmlDevice_t device, unsigned int *infoCount, nvmlProcessInfo_v1_t *infos) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetComputeRunningProcesses);
+    nvmlReturn_t result = fake_running_processes(device, infoCount, infos, 1);
+    LOG(__func__, "exit");
+    STATS_RETURN(result);
+}
+
+nvmlReturn_t nvmlDeviceGetComputeRunningProcesses_v2(nvmlDevice_t device, unsigned int *infoCount, nvmlProcessInfo_t *infos) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetComputeRunningProcesses_v2);
+    nvmlReturn_t result = fake_running_processes(device, infoCount, infos, 0);
+    LOG(__func__, "exit");
+    STATS_RETURN(result);
+}
+
+nvmlReturn_t nvmlDeviceGetComputeRunningProcesses_v3(nvmlDevice_t device, unsigned int *infoCount, nvmlProcessInfo_t *infos) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetComputeRunningProcesses_v3);
+    nvmlReturn_t result = fake_running_processes(device, infoCount, infos, 0);
+    LOG(__func__, "exit");
+    STATS_RETURN(result);
+}
+
+// --- PCIe and NVLink ---
+// Link properties come from the GPU's model profile (fake_gpu_profiles.h). The traffic counters
+// come from its state slot, where the fake libcuda reports its copies.
+nvmlReturn_t nvmlDeviceGetMaxPcieLinkGeneration(nvmlDevice_t device, unsigned int *maxLinkGen) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetMaxPcieLinkGeneration);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || maxLinkGen == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *maxLinkGen = (unsigned int)((fakeGpu_t *)device)->profile->pcie_gen;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetGpuMaxPcieLinkGeneration(nvmlDevice_t device, unsigned int *maxLinkGenDevice) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetGpuMaxPcieLinkGeneration);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || maxLinkGenDevice == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *maxLinkGenDevice = (unsigned int)((fakeGpu_t *)device)->profile->pcie_gen;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// The link always trains at its maximum: the fake GPUs never idle down to a lower generation.
+nvmlReturn_t nvmlDeviceGetCurrPcieLinkGeneration(nvmlDevice_t device, unsigned int *currLinkGen) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetCurrPcieLinkGeneration);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || currLinkGen == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *currLinkGen = (unsigned int)((fakeGpu_t *)device)->profile->pcie_gen;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetMaxPcieLinkWidth(nvmlDevice_t device, unsigned int *maxLinkWidth) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetMaxPcieLinkWidth);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || maxLinkWidth == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *maxLinkWidth = (unsigned int)((fakeGpu_t *)device)->profile->pcie_width;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetCurrPcieLinkWidth(nvmlDevice_t device, unsigned int *currLinkWidth) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetCurrPcieLinkWidth);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || currLinkWidth == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *currLinkWidth = (unsigned int)((fakeGpu_t *)device)->profile->pcie_width;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// Transfer rate per lane in MT/s.
+nvmlReturn_t nvmlDeviceGetPcieSpeed(nvmlDevice_t device, unsigned int *pcieSpeed) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetPcieSpeed);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || pcieSpeed == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    int gen = ((fakeGpu_t *)device)->profile->pcie_gen;
+    *pcieSpeed = gen >= 3 ? 8000u << (gen - 3) : 2500u * (unsigned int)gen;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetPcieLinkMaxSpeed(nvmlDevice_t device, unsigned int *maxSpeed) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetPcieLinkMaxSpeed);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || maxSpeed == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    // NVML_PCIE_LINK_MAX_SPEED_<n>MBPS numbers the generations from 1.
+    *maxSpeed = (unsigned int)((fakeGpu_t *)device)->profile->pcie_gen;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// NVML reports PCIe throughput in KB/s over a 20 ms window. A call measures over the interval
+// since this process's previous sample of the GPU when that is 20 ms to 1 s old, repeats the last
+// result within 20 ms of it, and otherwise samples twice, 20 ms apart, blocking like the real
+// library does.
+#define FAKE_PCIE_SAMPLE_NS 20000000ULL
+#define FAKE_PCIE_SAMPLE_MAX_AGE_NS 1000000000ULL
+static pthread_mutex_t g_pcie_sample_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fake_pcie_read(const fakeGpu_t *gpu, unsigned long long bytes[2], unsigned long long *now) {
+    fake_state_read(gpu->state, offsetof(struct fake_nvidia_state_gpu, links.pcie_tx_bytes), 2 * sizeof(bytes[0]), bytes);
+    *now = fake_nvml_stats_now();
+}
+
+static unsigned int fake_pcie_throughput(fakeGpu_t *gpu, unsigned int counter) {
+    unsigned long long bytes[2], now;
+    fake_pcie_read(gpu, bytes, &now);
+    pthread_mutex_lock(&g_pcie_sample_lock);
+    unsigned long long age = gpu->pcie_sample_ns ? now - gpu->pcie_sample_ns : ~0ULL;
+    if (age < FAKE_PCIE_SAMPLE_NS && gpu->pcie_rate_valid) {
+        unsigned int rate = gpu->pcie_rate[counter];
+        pthread_mutex_unlock(&g_pcie_sample_lock);
+        return rate;
+    }
+    unsigned long long prev[2] = {gpu->pcie_sample[0], gpu->pcie_sample[1]}, prev_ns = gpu->pcie_sample_ns;
+    pthread_mutex_unlock(&g_pcie_sample_lock);
+    if (age < FAKE_PCIE_SAMPLE_NS || age > FAKE_PCIE_SAMPLE_MAX_AGE_NS) {
+        prev[0] = bytes[0];
+        prev[1] = bytes[1];
+        prev_ns = now;
+        struct timespec ts = {0, (long)FAKE_PCIE_SAMPLE_NS};
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+        fake_pcie_read(gpu, bytes, &now);
+    }
+    pthread_mutex_lock(&g_pcie_sample_lock);
+    for (int i = 0; i < 2; ++i) {
+        // bytes per ns * 1e9 / 1000 = KB/s
+        gpu->pcie_rate[i] = (unsigned int)((bytes[i] - prev[i]) * 1000000ULL / (now - prev_ns));
+        gpu->pcie_sample[i] = bytes[i];
+    }
+    gpu->pcie_sample_ns = now;
+    gpu->pcie_rate_valid = 1;
+    unsigned int rate = gpu->pcie_rate[counter];
+    pthread_mutex_unlock(&g_pcie_sample_lock);
+    return rate;
+}
+
+nvmlReturn_t nvmlDeviceGetPcieThroughput(nvmlDevice_t device, nvmlPcieUtilCounter_t counter, unsigned int *value) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetPcieThroughput);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || value == NULL || (unsigned int)counter > NVML_PCIE_UTIL_RX_BYTES) {
+        STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    }
+    fakeGpu_t *gpu = (fakeGpu_t *)device;
+    // Only GPUs with a state slot carry traffic; the others answer without the sampling delay.
+    *value = gpu->state == &g_idle_state ? 0 : fake_pcie_throughput(gpu, (unsigned int)counter);
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// Traffic through the NVSwitch fabric is spread evenly over a GPU's links, so each link counts
+// an equal share of the GPU's NVLink bytes.
+static nvmlReturn_t fake_nvlink_check(nvmlDevice_t device, unsigned int link) {
+    if (!fake_world_initialized()) return NVML_ERROR_UNINITIALIZED;
+    if (device == NULL) return NVML_ERROR_INVALID_ARGUMENT;
+    const fakeGpuProfile_t *p = ((fakeGpu_t *)device)->profile;
+    if (p->nvlinks == 0) return NVML_ERROR_NOT_SUPPORTED;
+    return link < (unsigned int)p->nvlinks ? NVML_SUCCESS : NVML_ERROR_INVALID_ARGUMENT;
+}
+
+nvmlReturn_t nvmlDeviceGetNvLinkState(nvmlDevice_t device, unsigned int link, nvmlEnableState_t *isActive) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetNvLinkState);
+    nvmlReturn_t result = fake_nvlink_check(device, link);
+    if (result != NVML_SUCCESS) STATS_RETURN(result);
+    if (isActive == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *isActive = NVML_FEATURE_ENABLED;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceGetNvLinkVersion(nvmlDevice_t device, unsigned int link, unsigned int *version) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetNvLinkVersion);
+    nvmlReturn_t result = fake_nvlink_check(device, link);
+    if (result != NVML_SUCCESS) STATS_RETURN(result);
+    if (version == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *version = (unsigned int)((fakeGpu_t *)device)->profile->nvlink_version;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// Byte counts, whatever counter set `counter` selects: the fake has no per-counter controls.
+nvmlReturn_t nvmlDeviceGetNvLinkUtilizationCounter(nvmlDevice_t device, unsigned int link, unsigned int counter,
+                                                   unsigned long long *rxcounter, unsigned long long *txcounter) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetNvLinkUtilizationCounter);
+    nvmlReturn_t result = fake_nvlink_check(device, link);
+    if (result != NVML_SUCCESS) STATS_RETURN(result);
+    if (counter > 1 || rxcounter == NULL || txcounter == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    const fakeGpu_t *gpu = (const fakeGpu_t *)device;
+    unsigned long long tx_rx[2];
+    fake_state_read(gpu->state, offsetof(struct fake_nvidia_state_gpu, links.nvlink_tx_bytes), sizeof(tx_rx), tx_rx);
+    *txcounter = tx_rx[0] / (unsigned int)gpu->profile->nvlinks;
+    *rxcounter = tx_rx[1] / (unsigned int)gpu->profile->nvlinks;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// --- NVML Events ---
+// An event set reads the kernel module's event channel (FAKE_NVIDIA_EVENTS_DEVICE, see
+// fake_nvidia_uapi.h), opened when the set is created, so it sees the Xid and ECC errors injected
+// on the host from then on, in any container the device node is passed into.
+// nvmlEventSetWait sleeps in poll() on the channel and returns the first record matching a
+// device and type registered on the set; records are read in batches, so a burst of events costs
+// one read() per FAKE_EVENT_BATCH. Without the module a set never fires and waits time out, as
+// on a healthy GPU. Hot-plug records have no NVML event type and are skipped.
+#define FAKE_EVENT_BATCH 64
+#define FAKE_EVENT_TYPES (nvmlEventTypeSingleBitEccError | nvmlEventTypeDoubleBitEccError | nvmlEventTypeXidCriticalError)
+
+_Static_assert(FAKE_NVIDIA_EVENT_SBE_ECC == nvmlEventTypeSingleBitEccError &&
+               FAKE_NVIDIA_EVENT_DBE_ECC == nvmlEventTypeDoubleBitEccError &&
+               FAKE_NVIDIA_EVENT_XID == nvmlEventTypeXidCriticalError,
+               "kernel event types must match the NVML event type bits");
+
+typedef struct {
+    const fakeGpu_t *gpu;
+    unsigned long long types;
+} fakeEventReg_t;
+
+struct nvmlEventSet_st {
+    int fd; // -1 when the kernel module is not loaded
+    pthread_mutex_t reg_lock; // guards regs; never held while sleeping
+    fakeEventReg_t *regs;
+    unsigned int reg_count;
+    pthread_mutex_t wait_lock; // guards the batch; serializes waiters
+    unsigned int head, tail;
+    struct fake_nvidia_event batch[FAKE_EVENT_BATCH];
+};
+
+static int fake_event_match(nvmlEventSet_t set, const struct fake_nvidia_event *ev, nvmlEventData_t *data) {
+    int matched = 0;
+    pthread_mutex_lock(&set->reg_lock);
+    for (unsigned int i = 0; i < set->reg_count && !matched; ++i) {
+        const fakeEventReg_t *reg = &set->regs[i];
+        if (reg->gpu->minor != ev->minor || (reg->types & ev->type) == 0) continue;
+        data->device = reg->gpu->handle;
+        data->eventType = ev->type;
+        data->eventData = ev->data;
+        data->gpuInstanceId = 0xFFFFFFFFu; // no MIG: the event belongs to the whole GPU
+        data->computeInstanceId = 0xFFFFFFFFu;
+        matched = 1;
+    }
+    pthread_mutex_unlock(&set->reg_lock);
+    return matched;
+}
+
+nvmlReturn_t nvmlDeviceGetSupportedEventTypes(nvmlDevice_t device, unsigned long long *eventTypes) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlDeviceGetSupportedEventTypes);
+    TRACK_STATIC_CALL(device);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || eventTypes == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    *eventTypes = FAKE_EVENT_TYPES;
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlEventSetCreate(nvmlEventSet_t *set) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlEventSetCreate);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (set == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    nvmlEventSet_t es = calloc(1, sizeof(*es));
+    if (es == NULL) STATS_RETURN(NVML_ERROR_MEMORY);
+    es->fd = open(FAKE_NVIDIA_EVENTS_DEVICE, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    pthread_mutex_init(&es->reg_lock, NULL);
+    pthread_mutex_init(&es->wait_lock, NULL);
+    *set = es;
+    LOG(__func__, "exit, %s", es->fd >= 0 ? "reading " FAKE_NVIDIA_EVENTS_DEVICE : "no event channel");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+nvmlReturn_t nvmlDeviceRegisterEvents(nvmlDevice_t device, unsigned long long eventTypes, nvmlEventSet_t set) {
+    LOG(__func__, "enter, eventTypes=0x%llx", eventTypes);
+    STATS_CALL(nvmlDeviceRegisterEvents);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (device == NULL || set == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    if (eventTypes & ~(unsigned long long)FAKE_EVENT_TYPES) STATS_RETURN(NVML_ERROR_NOT_SUPPORTED);
+    const fakeGpu_t *gpu = (const fakeGpu_t *)device;
+    nvmlReturn_t result = NVML_SUCCESS;
+    pthread_mutex_lock(&set->reg_lock);
+    unsigned int i = 0;
+    while (i < set->reg_count && set->regs[i].gpu != gpu) i++;
+    if (i == set->reg_count) {
+        fakeEventReg_t *grown = realloc(set->regs, (set->reg_count + 1) * sizeof(fakeEventReg_t));
+        if (grown == NULL) {
+            result = NVML_ERROR_MEMORY;
+        } else {
+            set->regs = grown;
+            set->regs[set->reg_count++] = (fakeEventReg_t){.gpu = gpu, .types = 0};
+        }
+    }
+    if (result == NVML_SUCCESS) set->regs[i].types |= eventTypes;
+    pthread_mutex_unlock(&set->reg_lock);
+    LOG(__func__, "exit");
+    STATS_RETURN(result);
+}
+
+nvmlReturn_t nvmlEventSetWait_v2(nvmlEventSet_t set, nvmlEventData_t *data, unsigned int timeoutms) {
+    LOG(__func__, "enter, timeoutms=%u", timeoutms);
+    STATS_CALL(nvmlEventSetWait_v2);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (set == NULL || data == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long deadline_ms = (unsigned long long)now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeoutms;
+    nvmlReturn_t result = NVML_ERROR_TIMEOUT;
+    pthread_mutex_lock(&set->wait_lock);
+    for (;;) {
+        while (set->head < set->tail) {
+            if (fake_event_match(set, &set->batch[set->head++], data)) {
+                result = NVML_SUCCESS;
+                goto out;
+            }
+        }
+        ssize_t n = set->fd >= 0 ? read(set->fd, set->batch, sizeof(set->batch)) : -1;
+        if (n > 0) {
+            set->head = 0;
+            set->tail = (unsigned int)(n / sizeof(set->batch[0]));
+            continue;
+        }
+        if (n < 0 && set->fd >= 0 && errno != EAGAIN && errno != EINTR) {
+            result = NVML_ERROR_UNKNOWN;
+            goto out;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        unsigned long long now_ms = (unsigned long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+        if (now_ms >= deadline_ms) goto out;
+        // poll() ignores a negative fd, which turns the wait into a plain sleep without the module.
+        struct pollfd pfd = {.fd = set->fd, .events = POLLIN};
+        poll(&pfd, 1, (int)(deadline_ms - now_ms));
+    }
+out:
+    pthread_mutex_unlock(&set->wait_lock);
+    LOG(__func__, "exit, %s", result == NVML_SUCCESS ? "event" : "no event");
+    STATS_RETURN(result);
+}
+
+nvmlReturn_t nvmlEventSetFree(nvmlEventSet_t set) {
+    LOG(__func__, "enter");
+    STATS_CALL(nvmlEventSetFree);
+    if (!fake_world_initialized()) STATS_RETURN(NVML_ERROR_UNINITIALIZED);
+    if (set == NULL) STATS_RETURN(NVML_ERROR_INVALID_ARGUMENT);
+    if (set->fd >= 0) close(set->fd);
+    pthread_mutex_destroy(&set->reg_lock);
+    pthread_mutex_destroy(&set->wait_lock);
+    free(set->regs);
+    free(set);
+    LOG(__func__, "exit");
+    STATS_RETURN(NVML_SUCCESS);
+}
+
+// --- Generated Stubs ---
+// Every NVML_STUB entry of fake_nvml_functions.def becomes an export that reports the feature as
+// unsupported. Consumers treat NVML_ERROR_NOT_SUPPORTED as a normal per-feature answer, whereas a
+// missing symbol fails their library load and sends them down slow fallback and retry paths.
+#define NVML_IMPL(name, ...)
+#define NVML_STUB(name, ...)                                                                    \
+    NVML_EXPORT nvmlReturn_t name NVML_PARAMS(__VA_ARGS__) {                                    \
+        LOG(__func__, "stub");                                                                  \
+        STATS_CALL(name);                                                                       \
+        nvmlReturn_t result = fake_world_initialized() ? NVML_ERROR_NOT_SUPPORTED               \
+                                                       : NVML_ERROR_UNINITIALIZED;              \
+        STATS_RETURN(result);                                                                   \
+    }
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+
 // --- Symbol Aliases (Keep these for compatibility) ---
 nvmlReturn_t nvmlInit(void) __attribute__((weak, alias("nvmlInit_v2")));
 nvmlReturn_t nvmlDeviceGetCount(unsigned int* deviceCount) __attribute__((weak, alias("nvmlDeviceGetCount_v2")));
-nvmlReturn_t nvmlDeviceGetHandleByIndex(unsigned int index, nvmlDevice_t* device) __attribute__((weak, alias("nvmlDeviceGetHandleByIndex_v2")));
\ No newline at end of file
+nvmlReturn_t nvmlDeviceGetHandleByIndex(unsigned int index, nvmlDevice_t* device) __attribute__((weak, alias("nvmlDeviceGetHandleByIndex_v2")));
+nvmlReturn_t nvmlSystemGetCudaDriverVersion_v2(int* cudaDriverVersion) __attribute__((weak, alias("nvmlSystemGetCudaDriverVersion")));
+nvmlReturn_t nvmlDeviceGetHandleByPciBusId(const char *pciBusId, nvmlDevice_t *device) __attribute__((weak, alias("nvmlDeviceGetHandleByPciBusId_v2")));
+nvmlReturn_t nvmlEventSetWait(nvmlEventSet_t set, nvmlEventData_t *data, unsigned int timeoutms) __attribute__((weak, alias("nvmlEventSetWait_v2")));
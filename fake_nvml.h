@@ -0,0 +1,217 @@
+/**
+ * fake_nvml.h
+ *
+ * The subset of the NVML types (from nvml.h) implemented by the fake library, shared by the
+ * shim (fake_nvml.c) and the profiling interposer (fake_nvml_prof.c), plus the opaque handle
+ * types named by the stub entries. The exported function surface itself is listed in
+ * fake_nvml_functions.def.
+ */
+#ifndef FAKE_NVML_H
+#define FAKE_NVML_H
+
+// --- NVML Type Definitions (from nvml.h) ---
+typedef enum nvmlReturn_enum {
+    NVML_SUCCESS = 0,
+    NVML_ERROR_UNINITIALIZED = 1,
+    NVML_ERROR_INVALID_ARGUMENT = 2,
+    NVML_ERROR_NOT_SUPPORTED = 3,
+    NVML_ERROR_NO_PERMISSION = 4,
+    NVML_ERROR_ALREADY_INITIALIZED = 5,
+    NVML_ERROR_NOT_FOUND = 6,
+    NVML_ERROR_INSUFFICIENT_SIZE = 7,
+    NVML_ERROR_INSUFFICIENT_POWER = 8,
+    NVML_ERROR_DRIVER_NOT_LOADED = 9,
+    NVML_ERROR_TIMEOUT = 10,
+    NVML_ERROR_FUNCTION_NOT_FOUND = 13,
+    NVML_ERROR_MEMORY = 20,
+    NVML_ERROR_UNKNOWN = 999
+} nvmlReturn_t;
+
+typedef struct nvmlDevice_st* nvmlDevice_t;
+typedef struct nvmlUnit_st* nvmlUnit_t;
+typedef struct nvmlEventSet_st* nvmlEventSet_t;
+typedef struct nvmlGpuInstance_st* nvmlGpuInstance_t;
+typedef struct nvmlComputeInstance_st* nvmlComputeInstance_t;
+typedef struct nvmlGpmSample_st* nvmlGpmSample_t;
+typedef unsigned int nvmlVgpuTypeId_t;
+typedef unsigned int nvmlVgpuInstance_t;
+typedef unsigned int nvmlDeviceArchitecture_t;
+
+#define NVML_DEVICE_ARCH_VOLTA 5
+#define NVML_DEVICE_ARCH_TURING 6
+#define NVML_DEVICE_ARCH_AMPERE 7
+#define NVML_DEVICE_ARCH_ADA 8
+#define NVML_DEVICE_ARCH_HOPPER 9
+
+typedef enum nvmlBrandType_enum {
+    NVML_BRAND_UNKNOWN = 0,
+    NVML_BRAND_TESLA = 2,
+    NVML_BRAND_NVIDIA = 14
+} nvmlBrandType_t;
+
+typedef enum nvmlEnableState_enum {
+    NVML_FEATURE_DISABLED = 0,
+    NVML_FEATURE_ENABLED = 1
+} nvmlEnableState_t;
+
+typedef enum nvmlPcieUtilCounter_enum {
+    NVML_PCIE_UTIL_TX_BYTES = 0,
+    NVML_PCIE_UTIL_RX_BYTES = 1,
+    NVML_PCIE_UTIL_COUNT
+} nvmlPcieUtilCounter_t;
+
+#define NVML_DEVICE_NAME_BUFFER_SIZE 64
+#define NVML_DEVICE_UUID_BUFFER_SIZE 80
+#define NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE 80
+#define NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE 32
+
+typedef struct nvmlPciInfo_st {
+    char busId[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
+    unsigned int domain;
+    unsigned int bus;
+    unsigned int device;
+    unsigned int pciDeviceId;
+    unsigned int pciSubSystemId;
+} nvmlPciInfo_t;
+
+// --- NVML extended PCI info (consumed by nvmlDeviceGetPciInfoExt; from nvml.h) ---
+// Distinct from nvmlPciInfo_t: carries a version field and PCI base/sub class codes.
+typedef struct {
+    unsigned int version;
+    unsigned int domain;
+    unsigned int bus;
+    unsigned int device;
+    unsigned int pciDeviceId;
+    unsigned int pciSubSystemId;
+    unsigned int baseClass;
+    unsigned int subClass;
+    char busId[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
+} nvmlPciInfoExt_v1_t;
+
+typedef nvmlPciInfoExt_v1_t nvmlPciInfoExt_t;
+
+typedef struct nvmlMemory_st {
+    unsigned long long total;
+    unsigned long long free;
+    unsigned long long used;
+} nvmlMemory_t;
+
+// --- NVML UUID struct (consumed by nvmlDeviceGetHandleByUUIDV; from nvml.h) ---
+#define NVML_DEVICE_UUID_ASCII_LEN 41
+#define NVML_DEVICE_UUID_BINARY_LEN 16
+
+typedef enum {
+    NVML_UUID_TYPE_NONE = 0,
+    NVML_UUID_TYPE_ASCII = 1,
+    NVML_UUID_TYPE_BINARY = 2
+} nvmlUUIDType_t;
+
+typedef union {
+    char str[NVML_DEVICE_UUID_ASCII_LEN];
+    unsigned char bytes[NVML_DEVICE_UUID_BINARY_LEN];
+} nvmlUUIDValue_t;
+
+typedef struct {
+    unsigned int version;
+    unsigned int type;
+    nvmlUUIDValue_t value;
+} nvmlUUID_v1_t;
+
+typedef nvmlUUID_v1_t nvmlUUID_t;
+
+// --- NVML telemetry and process types (from nvml.h) ---
+#define NVML_TEMPERATURE_GPU 0
+
+typedef struct nvmlUtilization_st {
+    unsigned int gpu;
+    unsigned int memory;
+} nvmlUtilization_t;
+
+typedef struct nvmlProcessInfo_v1_st {
+    unsigned int pid;
+    unsigned long long usedGpuMemory;
+} nvmlProcessInfo_v1_t;
+
+typedef struct nvmlProcessInfo_st {
+    unsigned int pid;
+    unsigned long long usedGpuMemory;
+    unsigned int gpuInstanceId;
+    unsigned int computeInstanceId;
+} nvmlProcessInfo_t;
+
+// --- NVML events (consumed by nvmlEventSetWait; from nvml.h) ---
+#define nvmlEventTypeSingleBitEccError 0x0000000000000001LL
+#define nvmlEventTypeDoubleBitEccError 0x0000000000000002LL
+#define nvmlEventTypeXidCriticalError  0x0000000000000008LL
+
+typedef struct nvmlEventData_st {
+    nvmlDevice_t device;
+    unsigned long long eventType;
+    unsigned long long eventData;
+    unsigned int gpuInstanceId;
+    unsigned int computeInstanceId;
+} nvmlEventData_t;
+
+// --- Symbol Visibility ---
+// The startup-optimized build compiles with -fvisibility=hidden; only declarations marked
+// NVML_EXPORT (the NVML API itself) stay in the dynamic symbol table.
+#define NVML_EXPORT __attribute__((visibility("default")))
+
+// --- Embedding API (libfake_nvml.a) ---
+// Test binaries that link the fake statically can run several isolated fake hosts ("worlds") in
+// one process. A world starts uninitialized, exactly like a freshly loaded library: call
+// nvmlInit_v2 after selecting it. fake_nvml_world_use() selects the world that NVML calls made by
+// the calling thread operate on (NULL selects the default world) and returns the previous one.
+// Device handles stay bound to the world that issued them. fake_nvml_world_destroy() deselects
+// the world for the calling thread; while other threads still have it selected it stays alive
+// until the last of them selects another world or exits. A destroyed world must not be selected
+// again, and its device handles must not be used by threads that do not have it selected.
+typedef struct fakeNvmlWorld fakeNvmlWorld_t;
+
+fakeNvmlWorld_t *fake_nvml_world_create(unsigned int gpu_count);
+void fake_nvml_world_destroy(fakeNvmlWorld_t *world);
+fakeNvmlWorld_t *fake_nvml_world_use(fakeNvmlWorld_t *world);
+
+// --- Function Table Helpers ---
+// Entries of fake_nvml_functions.def list a function's parameter *types* only. These helpers turn
+// such a type list into a parameter list "(T0 a0, T1 a1)", an argument list "(a0, a1)" or a
+// zero-valued argument list "((T0)0, (T1)0)". An empty type list means the function takes void.
+#define NVML_NARG(...) NVML_NARG_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define NVML_NARG_(_, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+#define NVML_CAT(a, b) NVML_CAT_(a, b)
+#define NVML_CAT_(a, b) a##b
+
+#define NVML_PARAMS(...) NVML_CAT(NVML_PARAMS_, NVML_NARG(__VA_ARGS__))(__VA_ARGS__)
+#define NVML_PARAMS_0() (void)
+#define NVML_PARAMS_1(T0) (T0 a0)
+#define NVML_PARAMS_2(T0, T1) (T0 a0, T1 a1)
+#define NVML_PARAMS_3(T0, T1, T2) (T0 a0, T1 a1, T2 a2)
+#define NVML_PARAMS_4(T0, T1, T2, T3) (T0 a0, T1 a1, T2 a2, T3 a3)
+#define NVML_PARAMS_5(T0, T1, T2, T3, T4) (T0 a0, T1 a1, T2 a2, T3 a3, T4 a4)
+#define NVML_PARAMS_6(T0, T1, T2, T3, T4, T5) (T0 a0, T1 a1, T2 a2, T3 a3, T4 a4, T5 a5)
+#define NVML_PARAMS_7(T0, T1, T2, T3, T4, T5, T6) (T0 a0, T1 a1, T2 a2, T3 a3, T4 a4, T5 a5, T6 a6)
+#define NVML_PARAMS_8(T0, T1, T2, T3, T4, T5, T6, T7) (T0 a0, T1 a1, T2 a2, T3 a3, T4 a4, T5 a5, T6 a6, T7 a7)
+
+#define NVML_ARGS(...) NVML_CAT(NVML_ARGS_, NVML_NARG(__VA_ARGS__))
+#define NVML_ARGS_0 ()
+#define NVML_ARGS_1 (a0)
+#define NVML_ARGS_2 (a0, a1)
+#define NVML_ARGS_3 (a0, a1, a2)
+#define NVML_ARGS_4 (a0, a1, a2, a3)
+#define NVML_ARGS_5 (a0, a1, a2, a3, a4)
+#define NVML_ARGS_6 (a0, a1, a2, a3, a4, a5)
+#define NVML_ARGS_7 (a0, a1, a2, a3, a4, a5, a6)
+#define NVML_ARGS_8 (a0, a1, a2, a3, a4, a5, a6, a7)
+
+#define NVML_ZEROS(...) NVML_CAT(NVML_ZEROS_, NVML_NARG(__VA_ARGS__))(__VA_ARGS__)
+#define NVML_ZEROS_0() ()
+#define NVML_ZEROS_1(T0) ((T0)0)
+#define NVML_ZEROS_2(T0, T1) ((T0)0, (T1)0)
+#define NVML_ZEROS_3(T0, T1, T2) ((T0)0, (T1)0, (T2)0)
+#define NVML_ZEROS_4(T0, T1, T2, T3) ((T0)0, (T1)0, (T2)0, (T3)0)
+#define NVML_ZEROS_5(T0, T1, T2, T3, T4) ((T0)0, (T1)0, (T2)0, (T3)0, (T4)0)
+#define NVML_ZEROS_6(T0, T1, T2, T3, T4, T5) ((T0)0, (T1)0, (T2)0, (T3)0, (T4)0, (T5)0)
+#define NVML_ZEROS_7(T0, T1, T2, T3, T4, T5, T6) ((T0)0, (T1)0, (T2)0, (T3)0, (T4)0, (T5)0, (T6)0)
+#define NVML_ZEROS_8(T0, T1, T2, T3, T4, T5, T6, T7) ((T0)0, (T1)0, (T2)0, (T3)0, (T4)0, (T5)0, (T6)0, (T7)0)
+
+#endif // FAKE_NVML_H
@@ -0,0 +1,335 @@
+/**
+ * fake_nvml_exporter.c
+ *
+ * A small companion daemon that serves the shared-memory statistics of the NVML shim and the
+ * profiling interposer (see fake_nvml_stats.h) in the Prometheus text exposition format:
+ * per-symbol call and error counters, latency histograms and the processes currently attached
+ * to the segment.
+ *
+ * Compilation:
+ *   gcc -O2 -o fake-nvml-exporter fake_nvml_exporter.c fake_nvml_stats.c -lrt
+ *
+ * Usage:
+ *   fake-nvml-exporter                          # http://127.0.0.1:9401/metrics
+ *   fake-nvml-exporter --listen 0.0.0.0:9401
+ *   fake-nvml-exporter --unix /run/fake-nvml-exporter.sock
+ *
+ * The segment name is taken from FAKE_NVML_STATS_SHM, as in the producers. Clients are served
+ * from one poll() loop on non-blocking sockets, so a slow client delays no other scrape: a client
+ * has 1 s to send its request and 10 s to take the response. Metrics are rendered into a static
+ * buffer shared by the responses in progress, so serving performs no heap allocation.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_nvml_stats.h"
+
+#define EXPORTER_DEFAULT_LISTEN "127.0.0.1:9401"
+#define EXPORTER_BODY_SIZE (4 << 20)
+#define EXPORTER_MAX_CLIENTS 64
+#define EXPORTER_REQUEST_TIMEOUT_MS 1000
+#define EXPORTER_RESPONSE_TIMEOUT_MS 10000
+// Pause in accepting clients after running out of descriptors or memory.
+#define EXPORTER_ACCEPT_BACKOFF_MS 100
+
+typedef struct {
+    int fd; // -1 when the slot is free
+    unsigned long long deadline_ms;
+    char request[4096];
+    size_t request_len;
+    // The response, once the request is read: the head, then g_body when `body` is set.
+    char head[192];
+    size_t head_len, sent;
+    int responding, body;
+} exporterClient_t;
+
+static char g_body[EXPORTER_BODY_SIZE];
+static size_t g_body_len;
+// Responses still sending g_body; it is rendered again only when there are none.
+static unsigned int g_body_readers;
+static exporterClient_t g_clients[EXPORTER_MAX_CLIENTS];
+// "le" label values for each histogram bucket, formatted once at startup.
+static char g_bucket_le[FAKE_NVML_STATS_BUCKETS][24];
+
+static void emit(const char *fmt, ...) {
+    if (g_body_len >= sizeof(g_body)) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(g_body + g_body_len, sizeof(g_body) - g_body_len, fmt, ap);
+    va_end(ap);
+    if (n > 0) g_body_len += (size_t)n;
+    if (g_body_len > sizeof(g_body)) g_body_len = sizeof(g_body);
+}
+
+static void render_metrics(fakeNvmlStatsSegment_t *seg) {
+    g_body_len = 0;
+    emit("# HELP fake_nvml_stats_up Whether the shim statistics segment is attached.\n"
+         "# TYPE fake_nvml_stats_up gauge\n"
+         "fake_nvml_stats_up %d\n", seg != NULL);
+    if (seg == NULL) return;
+
+    emit("# HELP fake_nvml_stats_segment_bytes Size of the shared statistics segment.\n"
+         "# TYPE fake_nvml_stats_segment_bytes gauge\n"
+         "fake_nvml_stats_segment_bytes %zu\n", sizeof(*seg));
+
+    emit("# HELP fake_nvml_calls_total NVML calls served, by symbol.\n"
+         "# TYPE fake_nvml_calls_total counter\n");
+    for (int i = 0; i < FAKE_NVML_SYM_COUNT; ++i) {
+        unsigned long long calls = __atomic_load_n(&seg->syms[i].calls, __ATOMIC_RELAXED);
+        if (calls) emit("fake_nvml_calls_total{symbol=\"%s\"} %llu\n", g_fake_nvml_symbol_names[i], calls);
+    }
+
+    emit("# HELP fake_nvml_call_errors_total NVML calls that did not return NVML_SUCCESS, by symbol.\n"
+         "# TYPE fake_nvml_call_errors_total counter\n");
+    for (int i = 0; i < FAKE_NVML_SYM_COUNT; ++i) {
+        if (!__atomic_load_n(&seg->syms[i].calls, __ATOMIC_RELAXED)) continue;
+        emit("fake_nvml_call_errors_total{symbol=\"%s\"} %llu\n", g_fake_nvml_symbol_names[i],
+             __atomic_load_n(&seg->syms[i].errors, __ATOMIC_RELAXED));
+    }
+
+    emit("# HELP fake_nvml_call_max_seconds Slowest NVML call observed, by symbol.\n"
+         "# TYPE fake_nvml_call_max_seconds gauge\n");
+    for (int i = 0; i < FAKE_NVML_SYM_COUNT; ++i) {
+        if (!__atomic_load_n(&seg->syms[i].calls, __ATOMIC_RELAXED)) continue;
+        emit("fake_nvml_call_max_seconds{symbol=\"%s\"} %.9f\n", g_fake_nvml_symbol_names[i],
+             __atomic_load_n(&seg->syms[i].max_ns, __ATOMIC_RELAXED) / 1e9);
+    }
+
+    emit("# HELP fake_nvml_call_duration_seconds NVML call latency, by symbol.\n"
+         "# TYPE fake_nvml_call_duration_seconds histogram\n");
+    for (int i = 0; i < FAKE_NVML_SYM_COUNT; ++i) {
+        const fakeNvmlSymStats_t *st = &seg->syms[i];
+        if (!__atomic_load_n(&st->calls, __ATOMIC_RELAXED)) continue;
+        // Buckets are read once; _count is their sum so the series stays self-consistent.
+        unsigned long long cumulative = 0;
+        for (int b = 0; b < FAKE_NVML_STATS_BUCKETS; ++b) {
+            cumulative += __atomic_load_n(&st->hist[b], __ATOMIC_RELAXED);
+            emit("fake_nvml_call_duration_seconds_bucket{symbol=\"%s\",le=\"%s\"} %llu\n",
+                 g_fake_nvml_symbol_names[i], g_bucket_le[b], cumulative);
+        }
+        emit("fake_nvml_call_duration_seconds_bucket{symbol=\"%s\",le=\"+Inf\"} %llu\n"
+             "fake_nvml_call_duration_seconds_sum{symbol=\"%s\"} %.9f\n"
+             "fake_nvml_call_duration_seconds_count{symbol=\"%s\"} %llu\n",
+             g_fake_nvml_symbol_names[i], cumulative,
+             g_fake_nvml_symbol_names[i], __atomic_load_n(&st->total_ns, __ATOMIC_RELAXED) / 1e9,
+             g_fake_nvml_symbol_names[i], cumulative);
+    }
+
+    // Slots of processes that died without detaching are skipped (and reclaimed by producers).
+    unsigned int active = 0;
+    emit("# HELP fake_nvml_process_calls_total NVML calls made by each attached process.\n"
+         "# TYPE fake_nvml_process_calls_total counter\n");
+    for (unsigned int i = 0; i < FAKE_NVML_STATS_MAX_PROCS; ++i) {
+        int pid = __atomic_load_n(&seg->procs[i].pid, __ATOMIC_ACQUIRE);
+        if (pid == 0 || (kill(pid, 0) != 0 && errno == ESRCH)) continue;
+        active++;
+        emit("fake_nvml_process_calls_total{pid=\"%d\"} %llu\n", pid,
+             __atomic_load_n(&seg->procs[i].calls, __ATOMIC_RELAXED));
+    }
+    emit("# HELP fake_nvml_active_processes Processes attached to the statistics segment.\n"
+         "# TYPE fake_nvml_active_processes gauge\n"
+         "fake_nvml_active_processes %u\n", active);
+}
+
+static unsigned long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000ULL + (unsigned long long)ts.tv_nsec / 1000000ULL;
+}
+
+static void client_close(exporterClient_t *c) {
+    if (c->body) g_body_readers--;
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void client_respond(exporterClient_t *c, fakeNvmlStatsSegment_t **seg) {
+    static const char not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    c->request[c->request_len] = '\0';
+    c->responding = 1;
+    c->sent = 0;
+    c->deadline_ms = now_ms() + EXPORTER_RESPONSE_TIMEOUT_MS;
+    if (strncmp(c->request, "GET /metrics ", 13) != 0 && strncmp(c->request, "GET /metrics?", 13) != 0) {
+        memcpy(c->head, not_found, sizeof(not_found) - 1);
+        c->head_len = sizeof(not_found) - 1;
+        return;
+    }
+    // Scrapes that arrive while earlier responses are still being sent get the same body.
+    if (g_body_readers == 0) {
+        // The segment may be created after the exporter starts; retry until it appears.
+        if (*seg == NULL) *seg = fake_nvml_stats_attach(0, NULL);
+        render_metrics(*seg);
+    }
+    g_body_readers++;
+    c->body = 1;
+    c->head_len = (size_t)snprintf(c->head, sizeof(c->head),
+                                   "HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                   "Content-Length: %zu\r\nConnection: close\r\n\r\n", g_body_len);
+}
+
+// Read what the client has sent; the request is complete at the end of its headers. Returns -1
+// when the client is gone.
+static int client_read(exporterClient_t *c, fakeNvmlStatsSegment_t **seg) {
+    for (;;) {
+        ssize_t n = read(c->fd, c->request + c->request_len, sizeof(c->request) - 1 - c->request_len);
+        if (n < 0) return errno == EAGAIN || errno == EINTR ? 0 : -1;
+        if (n > 0) {
+            c->request_len += (size_t)n;
+            c->request[c->request_len] = '\0';
+        }
+        if (n == 0 || c->request_len == sizeof(c->request) - 1 || strstr(c->request, "\r\n\r\n") != NULL) {
+            client_respond(c, seg);
+            return 0;
+        }
+    }
+}
+
+// Send what the socket takes. Returns -1 when the client is done or gone.
+static int client_write(exporterClient_t *c) {
+    size_t total = c->head_len + (c->body ? g_body_len : 0);
+    while (c->sent < total) {
+        const char *buf = c->sent < c->head_len ? c->head + c->sent : g_body + (c->sent - c->head_len);
+        size_t len = c->sent < c->head_len ? c->head_len - c->sent : total - c->sent;
+        ssize_t n = write(c->fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return 0;
+        if (n <= 0) return -1;
+        c->sent += (size_t)n;
+    }
+    return -1;
+}
+
+static int listen_tcp(const char *spec) {
+    char host[64];
+    const char *colon = strrchr(spec, ':');
+    if (colon == NULL || (size_t)(colon - spec) >= sizeof(host)) return -1;
+    memcpy(host, spec, (size_t)(colon - spec));
+    host[colon - spec] = '\0';
+
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons((unsigned short)atoi(colon + 1))};
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) return -1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) return -1;
+    return fd;
+}
+
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) return -1;
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    const char *listen_spec = EXPORTER_DEFAULT_LISTEN;
+    const char *unix_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listen_spec = argv[++i];
+        } else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            unix_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--listen ADDR:PORT | --unix PATH]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (int b = 0; b < FAKE_NVML_STATS_BUCKETS; ++b) {
+        snprintf(g_bucket_le[b], sizeof(g_bucket_le[b]), "%.9g", (double)(2ULL << b) / 1e9);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = unix_path ? listen_unix(unix_path) : listen_tcp(listen_spec);
+    if (server < 0) {
+        fprintf(stderr, "fake-nvml-exporter: cannot listen on %s: %s\n",
+                unix_path ? unix_path : listen_spec, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "fake-nvml-exporter: serving /metrics on %s\n", unix_path ? unix_path : listen_spec);
+
+    fakeNvmlStatsSegment_t *seg = fake_nvml_stats_attach(0, NULL);
+    struct pollfd fds[1 + EXPORTER_MAX_CLIENTS];
+    exporterClient_t *polled[1 + EXPORTER_MAX_CLIENTS];
+    for (unsigned int i = 0; i < EXPORTER_MAX_CLIENTS; ++i) g_clients[i].fd = -1;
+    unsigned long long accept_resume_ms = 0;
+    for (;;) {
+        // The listening socket is left out while every slot is busy; the backlog holds new clients.
+        nfds_t nfds = 0;
+        int free_slots = 0;
+        unsigned long long now = now_ms(), wake = 0;
+        for (unsigned int i = 0; i < EXPORTER_MAX_CLIENTS; ++i) {
+            exporterClient_t *c = &g_clients[i];
+            if (c->fd < 0) {
+                free_slots++;
+                continue;
+            }
+            if (wake == 0 || c->deadline_ms < wake) wake = c->deadline_ms;
+            polled[nfds] = c;
+            fds[nfds++] = (struct pollfd){.fd = c->fd, .events = c->responding ? POLLOUT : POLLIN};
+        }
+        int listening = free_slots > 0 && accept_resume_ms <= now;
+        if (listening) {
+            fds[nfds++] = (struct pollfd){.fd = server, .events = POLLIN};
+        } else if (free_slots > 0 && (wake == 0 || accept_resume_ms < wake)) {
+            wake = accept_resume_ms;
+        }
+        int timeout = wake == 0 ? -1 : wake <= now ? 0 : (int)(wake - now);
+        if (poll(fds, nfds, timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("fake-nvml-exporter: poll");
+            return 1;
+        }
+
+        now = now_ms();
+        for (nfds_t i = 0; i < nfds; ++i) {
+            if (fds[i].fd == server) continue;
+            exporterClient_t *c = polled[i];
+            int done = 0;
+            if (fds[i].revents != 0) {
+                done = c->responding ? client_write(c) : client_read(c, &seg);
+                // A request read in full is answered at once, without waiting for the next poll.
+                if (done == 0 && c->responding && fds[i].events == POLLIN) done = client_write(c);
+            }
+            if (done != 0 || (c->fd >= 0 && c->deadline_ms <= now)) client_close(c);
+        }
+
+        if (!listening || !(fds[nfds - 1].revents & POLLIN)) continue;
+        for (unsigned int i = 0; i < EXPORTER_MAX_CLIENTS; ++i) {
+            exporterClient_t *c = &g_clients[i];
+            if (c->fd >= 0) continue;
+            int client = accept4(server, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            // Errors are transient: pending network errors of the new connection (EPROTO,
+            // ENETDOWN, ...) are retried on the next poll, and running out of descriptors or
+            // memory pauses accepting for a while.
+            if (client < 0) {
+                if (errno == EAGAIN || errno == EINTR || errno == ECONNABORTED) break;
+                int err = errno;
+                fprintf(stderr, "fake-nvml-exporter: accept: %s\n", strerror(err));
+                if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM) {
+                    accept_resume_ms = now + EXPORTER_ACCEPT_BACKOFF_MS;
+                }
+                break;
+            }
+            *c = (exporterClient_t){.fd = client, .deadline_ms = now + EXPORTER_REQUEST_TIMEOUT_MS};
+        }
+    }
+}
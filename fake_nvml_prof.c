@@ -0,0 +1,163 @@
+/**
+ * fake_nvml_prof.c
+ *
+ * A profiling interposer for the NVIDIA Management Library (NVML). Every NVML symbol listed in
+ * fake_nvml_functions.def is exported and forwarded, unchanged, to the next definition found by
+ * dlsym(RTLD_NEXT, ...) -- the real libnvidia-ml.so.1 on a GPU host, or libfake_nvml.so when
+ * testing locally. Each call is timed; call counts, error counts and a log2 latency histogram
+ * per symbol are printed when the process exits. Results are never modified.
+ *
+ * Compilation:
+ *   gcc -shared -fPIC -pthread -o libfake_nvml_prof.so fake_nvml_prof.c fake_nvml_stats.c -ldl -lrt
+ *
+ * Usage (interposing over the fake shim):
+ *   LD_PRELOAD="./libfake_nvml_prof.so ./libfake_nvml.so" nvidia-container-cli info
+ *
+ * Usage (interposing over the real driver library):
+ *   LD_PRELOAD=./libfake_nvml_prof.so nvidia-smi
+ *
+ * Consumers that dlopen() libnvidia-ml.so.1 and look symbols up through that handle (go-nvml,
+ * libnvidia-sandboxutils) bypass LD_PRELOAD interposition. For those, install the interposer in
+ * place of libnvidia-ml.so.1 and point FAKE_NVML_PROF_LIB at the library to forward to:
+ *   FAKE_NVML_PROF_LIB=/usr/lib/x86_64-linux-gnu/libnvidia-ml.so.535.104.05 nvidia-ctk ...
+ *
+ * The report goes to stderr, or is appended to the file named by FAKE_NVML_PROF_OUT; a process
+ * that made no NVML call prints none. With FAKE_NVML_STATS=1 the same counters are also
+ * published for fake-nvml-exporter.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <stdint.h>
+
+#include "fake_nvml.h"
+#include "fake_nvml_stats.h"
+
+// --- Per-Symbol Statistics ---
+// Always kept in-process for the exit report; also published to the shared-memory segment read by
+// fake-nvml-exporter when FAKE_NVML_STATS=1. When both this interposer and libfake_nvml.so publish,
+// point one of them at a different segment with FAKE_NVML_STATS_SHM to avoid double counting.
+static fakeNvmlSymStats_t g_prof_stats[FAKE_NVML_SYM_COUNT];
+static fakeNvmlStatsSegment_t *g_prof_shared = NULL;
+static fakeNvmlStatsProc_t *g_prof_shared_proc = NULL;
+static void *g_prof_target = RTLD_NEXT;
+
+static inline void prof_record(fakeNvmlSymbol_t sym, unsigned long long ns, int failed) {
+    fake_nvml_stats_record(&g_prof_stats[sym], ns, failed);
+    if (g_prof_shared != NULL) {
+        fake_nvml_stats_record(&g_prof_shared->syms[sym], ns, failed);
+        if (g_prof_shared_proc != NULL) __atomic_fetch_add(&g_prof_shared_proc->calls, 1, __ATOMIC_RELAXED);
+    }
+}
+
+__attribute__((constructor))
+static void prof_init(void) {
+    if (fake_nvml_stats_requested()) g_prof_shared = fake_nvml_stats_attach(1, &g_prof_shared_proc);
+    const char *lib = getenv("FAKE_NVML_PROF_LIB");
+    if (lib == NULL || lib[0] == '\0') return;
+    g_prof_target = dlopen(lib, RTLD_NOW | RTLD_LOCAL);
+    if (g_prof_target == NULL) {
+        fprintf(stderr, "[FAKE-GPU-PROF %d] cannot load FAKE_NVML_PROF_LIB: %s\n", getpid(), dlerror());
+        g_prof_target = RTLD_NEXT;
+    }
+}
+
+// Resolve the forwarding target once per symbol. A racing first call may resolve twice; both
+// threads store the same pointer.
+static void *prof_resolve(void **slot, const char *name) {
+    void *fn = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (fn == NULL) {
+        fn = dlsym(g_prof_target, name);
+        __atomic_store_n(slot, fn, __ATOMIC_RELEASE);
+    }
+    return fn;
+}
+
+// --- Forwarders ---
+// A symbol absent from the target library returns NVML_ERROR_FUNCTION_NOT_FOUND, the same code
+// the real library uses for entry points the driver does not provide.
+#define NVML_IMPL(name, ...)                                                                  \
+    nvmlReturn_t name NVML_PARAMS(__VA_ARGS__) {                                              \
+        static void *real;                                                                    \
+        nvmlReturn_t(*fn) NVML_PARAMS(__VA_ARGS__) = prof_resolve(&real, #name);              \
+        if (fn == NULL) return NVML_ERROR_FUNCTION_NOT_FOUND;                                 \
+        unsigned long long start = fake_nvml_stats_now();                                     \
+        nvmlReturn_t ret = fn NVML_ARGS(__VA_ARGS__);                                         \
+        unsigned long long elapsed = fake_nvml_stats_now() - start;                           \
+        prof_record(FAKE_NVML_SYM_##name, elapsed, ret != NVML_SUCCESS);                      \
+        return ret;                                                                           \
+    }
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+
+const char* nvmlErrorString(nvmlReturn_t result) {
+    static void *real;
+    const char *(*fn)(nvmlReturn_t) = prof_resolve(&real, "nvmlErrorString");
+    if (fn == NULL) return "Function Not Found";
+    unsigned long long start = fake_nvml_stats_now();
+    const char *ret = fn(result);
+    prof_record(FAKE_NVML_SYM_nvmlErrorString, fake_nvml_stats_now() - start, 0);
+    return ret;
+}
+
+// --- Exit Report ---
+// Latency percentile estimated from the histogram: the upper bound of the bucket holding it,
+// capped at the observed maximum.
+static unsigned long long prof_percentile(const fakeNvmlSymStats_t *st, double q) {
+    unsigned long long rank = (unsigned long long)(q * (double)st->calls);
+    unsigned long long seen = 0;
+    for (unsigned int b = 0; b < FAKE_NVML_STATS_BUCKETS; ++b) {
+        seen += st->hist[b];
+        if (seen > rank) return (2ULL << b) < st->max_ns ? (2ULL << b) : st->max_ns;
+    }
+    return st->max_ns;
+}
+
+static void prof_print(void) {
+    FILE *out = stderr;
+    const char *path = getenv("FAKE_NVML_PROF_OUT");
+    if (path != NULL && path[0] != '\0') {
+        out = fopen(path, "a");
+        if (out == NULL) out = stderr;
+    }
+
+    fprintf(out, "[FAKE-GPU-PROF %d] NVML call profile\n", getpid());
+    fprintf(out, "  %-44s %10s %8s %10s %10s %10s %10s\n",
+            "symbol", "calls", "errors", "mean_ns", "p50_ns", "p99_ns", "max_ns");
+    for (int i = 0; i < FAKE_NVML_SYM_COUNT; ++i) {
+        fakeNvmlSymStats_t st;
+        memcpy(&st, &g_prof_stats[i], sizeof(st));
+        if (st.calls == 0) continue;
+        fprintf(out, "  %-44s %10llu %8llu %10llu %10llu %10llu %10llu\n",
+                g_fake_nvml_symbol_names[i], st.calls, st.errors, st.total_ns / st.calls,
+                prof_percentile(&st, 0.50), prof_percentile(&st, 0.99), st.max_ns);
+    }
+    for (int i = 0; i < FAKE_NVML_SYM_COUNT; ++i) {
+        const fakeNvmlSymStats_t *st = &g_prof_stats[i];
+        if (st->calls == 0) continue;
+        fprintf(out, "  %s histogram (ns bucket lower bound: calls):", g_fake_nvml_symbol_names[i]);
+        for (unsigned int b = 0; b < FAKE_NVML_STATS_BUCKETS; ++b) {
+            if (st->hist[b]) fprintf(out, " %llu:%llu", b ? 1ULL << b : 0ULL, st->hist[b]);
+        }
+        fputc('\n', out);
+    }
+    if (out != stderr) fclose(out);
+}
+
+// Nothing is printed for a process that made no NVML call.
+__attribute__((destructor))
+static void prof_report(void) {
+    int called = 0;
+    for (int i = 0; i < FAKE_NVML_SYM_COUNT && !called; ++i) called = g_prof_stats[i].calls != 0;
+    if (called) prof_print();
+
+    fakeNvmlStatsSegment_t *seg = g_prof_shared;
+    g_prof_shared = NULL;
+    fake_nvml_stats_detach(seg, g_prof_shared_proc);
+}
@@ -0,0 +1,107 @@
+/**
+ * fake_nvml_stats.c
+ *
+ * Attach/detach logic for the shared-memory statistics segment described in fake_nvml_stats.h.
+ * Linked into the shim, the profiling interposer and the metrics exporter.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_nvml_stats.h"
+
+const char *const g_fake_nvml_symbol_names[FAKE_NVML_SYM_COUNT] = {
+#define NVML_IMPL(name, ...) [FAKE_NVML_SYM_##name] = #name,
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+    [FAKE_NVML_SYM_nvmlErrorString] = "nvmlErrorString",
+};
+
+int fake_nvml_stats_requested(void) {
+    const char *env = getenv("FAKE_NVML_STATS");
+    return env != NULL && env[0] != '\0' && strcmp(env, "0") != 0;
+}
+
+static const char *stats_shm_name(void) {
+    const char *name = getenv("FAKE_NVML_STATS_SHM");
+    return (name != NULL && name[0] == '/') ? name : FAKE_NVML_STATS_DEFAULT_SHM;
+}
+
+// Claim a free process slot, or one left behind by a process that exited without detaching.
+static fakeNvmlStatsProc_t *stats_claim_slot(fakeNvmlStatsSegment_t *seg) {
+    int self = getpid();
+    for (int pass = 0; pass < 2; ++pass) {
+        for (unsigned int i = 0; i < FAKE_NVML_STATS_MAX_PROCS; ++i) {
+            fakeNvmlStatsProc_t *p = &seg->procs[i];
+            int expected = __atomic_load_n(&p->pid, __ATOMIC_RELAXED);
+            if (pass == 0 ? expected != 0 : (expected == 0 || kill(expected, 0) == 0 || errno != ESRCH)) {
+                continue;
+            }
+            if (__atomic_compare_exchange_n(&p->pid, &expected, self, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                p->attach_ns = (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+                __atomic_store_n(&p->calls, 0, __ATOMIC_RELAXED);
+                return p;
+            }
+        }
+    }
+    return NULL;
+}
+
+fakeNvmlStatsSegment_t *fake_nvml_stats_attach(int writable, fakeNvmlStatsProc_t **slot) {
+    const char *name = stats_shm_name();
+    int fd = shm_open(name, writable ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+    if (fd < 0) return NULL;
+    if (writable) {
+        // shm_open honours the umask; the segment is meant to be shared between users.
+        fchmod(fd, 0666);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (st.st_size != 0 && st.st_size != (off_t)sizeof(fakeNvmlStatsSegment_t)) ||
+        (st.st_size == 0 && (!writable || ftruncate(fd, sizeof(fakeNvmlStatsSegment_t)) != 0))) {
+        close(fd);
+        return NULL;
+    }
+    fakeNvmlStatsSegment_t *seg = mmap(NULL, sizeof(*seg), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                                       MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) return NULL;
+
+    // ftruncate zero-fills and every creator writes the same header, so concurrent creation is
+    // benign; the magic is published last.
+    if (writable && __atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == 0) {
+        seg->version = FAKE_NVML_STATS_VERSION;
+        seg->symbol_count = FAKE_NVML_SYM_COUNT;
+        seg->bucket_count = FAKE_NVML_STATS_BUCKETS;
+        seg->max_procs = FAKE_NVML_STATS_MAX_PROCS;
+        __atomic_store_n(&seg->magic, FAKE_NVML_STATS_MAGIC, __ATOMIC_RELEASE);
+    }
+    if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != FAKE_NVML_STATS_MAGIC ||
+        seg->version != FAKE_NVML_STATS_VERSION || seg->symbol_count != FAKE_NVML_SYM_COUNT ||
+        seg->bucket_count != FAKE_NVML_STATS_BUCKETS || seg->max_procs != FAKE_NVML_STATS_MAX_PROCS) {
+        munmap(seg, sizeof(*seg));
+        return NULL;
+    }
+
+    if (slot != NULL) *slot = writable ? stats_claim_slot(seg) : NULL;
+    return seg;
+}
+
+void fake_nvml_stats_detach(fakeNvmlStatsSegment_t *seg, fakeNvmlStatsProc_t *slot) {
+    if (seg == NULL) return;
+    if (slot != NULL) __atomic_store_n(&slot->pid, 0, __ATOMIC_RELEASE);
+    munmap(seg, sizeof(*seg));
+}
@@ -0,0 +1,93 @@
+/**
+ * fake_nvml_stats.h
+ *
+ * Layout of the shared-memory statistics segment written by the NVML shim (fake_nvml.c) and the
+ * profiling interposer (fake_nvml_prof.c) when FAKE_NVML_STATS=1, and read by the metrics
+ * exporter (fake_nvml_exporter.c). The segment lives at /dev/shm/<FAKE_NVML_STATS_SHM> (default
+ * "fake-nvml-stats") and is shared by every process in the same IPC/mount namespace.
+ *
+ * All counters are updated with relaxed atomics; readers see a consistent-enough snapshot for
+ * rate and histogram computations, not a transactionally consistent one.
+ */
+#ifndef FAKE_NVML_STATS_H
+#define FAKE_NVML_STATS_H
+
+#include <time.h>
+
+#include "fake_nvml.h"
+
+#define FAKE_NVML_STATS_DEFAULT_SHM "/fake-nvml-stats"
+#define FAKE_NVML_STATS_MAGIC 0x5354534C4D564E46ULL // "FNVMLSTS"
+#define FAKE_NVML_STATS_VERSION 1
+// Bucket b counts calls that took [2^b, 2^(b+1)) ns; bucket 0 also holds 0 ns calls.
+#define FAKE_NVML_STATS_BUCKETS 40
+#define FAKE_NVML_STATS_MAX_PROCS 1024
+
+// One index per exported NVML symbol, in fake_nvml_functions.def order.
+typedef enum {
+#define NVML_IMPL(name, ...) FAKE_NVML_SYM_##name,
+#define NVML_STUB NVML_IMPL
+#include "fake_nvml_functions.def"
+#undef NVML_STUB
+#undef NVML_IMPL
+    FAKE_NVML_SYM_nvmlErrorString,
+    FAKE_NVML_SYM_COUNT
+} fakeNvmlSymbol_t;
+
+extern const char *const g_fake_nvml_symbol_names[FAKE_NVML_SYM_COUNT];
+
+typedef struct {
+    unsigned long long calls;
+    unsigned long long errors; // calls known to have returned anything but NVML_SUCCESS
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long hist[FAKE_NVML_STATS_BUCKETS];
+} fakeNvmlSymStats_t;
+
+typedef struct {
+    int pid;                 // 0: free slot
+    unsigned int reserved;
+    unsigned long long attach_ns; // CLOCK_REALTIME at attach
+    unsigned long long calls;
+} fakeNvmlStatsProc_t;
+
+typedef struct {
+    unsigned long long magic; // written last by the creator; readers ignore the segment until set
+    unsigned int version;
+    unsigned int symbol_count;
+    unsigned int bucket_count;
+    unsigned int max_procs;
+    fakeNvmlSymStats_t syms[FAKE_NVML_SYM_COUNT];
+    fakeNvmlStatsProc_t procs[FAKE_NVML_STATS_MAX_PROCS];
+} fakeNvmlStatsSegment_t;
+
+// Map the segment named by FAKE_NVML_STATS_SHM (or the default). When `writable` is set the
+// segment is created if missing and a process slot is claimed for the caller; the returned
+// `*slot` is then released by fake_nvml_stats_detach(). Returns NULL if the segment does not
+// exist (read-only) or has an incompatible layout.
+fakeNvmlStatsSegment_t *fake_nvml_stats_attach(int writable, fakeNvmlStatsProc_t **slot);
+void fake_nvml_stats_detach(fakeNvmlStatsSegment_t *seg, fakeNvmlStatsProc_t *slot);
+
+// Returns 1 when FAKE_NVML_STATS asks for the segment to be written.
+int fake_nvml_stats_requested(void);
+
+static inline unsigned long long fake_nvml_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static inline void fake_nvml_stats_record(fakeNvmlSymStats_t *st, unsigned long long ns, int failed) {
+    unsigned int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= FAKE_NVML_STATS_BUCKETS) bucket = FAKE_NVML_STATS_BUCKETS - 1;
+    __atomic_fetch_add(&st->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->hist[bucket], 1, __ATOMIC_RELAXED);
+    if (failed) __atomic_fetch_add(&st->errors, 1, __ATOMIC_RELAXED);
+    unsigned long long max = __atomic_load_n(&st->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&st->max_ns, &max, ns, 1,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+#endif // FAKE_NVML_STATS_H